@@ -62,6 +62,8 @@ const int PWM_RESOLUTION = 14; // 14-bit resolutie
 #include <WiFiClientSecure.h>
 #include <TJpg_Decoder.h>
 #include <TFT_eSPI.h>
+#include <EmilyProtocol.h>  // Firmware/libraries/EmilyProtocol
+#include <EmilyReliable.h>
 
 // --- WIFI AP INCLUDES ---
 #include <WebServer.h>
@@ -114,6 +116,13 @@ const uint16_t EMILYBRAIN_UDP_PORT = 12345;
 const uint16_t CAMCANVAS_LISTEN_PORT = 12347; 
 WiFiUDP udp;
 
+// --- Binary Protocol ---
+uint8_t tx_frame[EMILY_PROTO_MAX_FRAME];
+uint16_t tx_seq = 0;
+bool reply_json = false;   // Last command came in as JSON (debug tools): answer in JSON too
+emily_proto::Outbox<4> outbox;          // Results awaiting the brain's ACK
+emily_proto::DuplicateFilter seen_frames; // Commands already executed
+
 // --- WiFi AP Objects ---
 WebServer server(80);
 DNSServer dnsServer;
@@ -124,8 +133,14 @@ const char* CAM_SYSTEM_PROMPT_JSON = "You are the dedicated vision system for th
 
 // --- Function Prototypes ---
 void handleCommand(char* commandJson);
+void handleFrame(const emily_proto::Frame& frame);
+bool acceptFrame(const emily_proto::Frame& frame);
+void serviceOutbox();
 void analyzeImage(IPAddress remoteIp, uint16_t remotePort, const char* prompt, bool use_flash);
 void sendUdpResponse(const IPAddress& remoteIp, uint16_t remotePort, const String& message);
+void sendVisionResult(const IPAddress& remoteIp, uint16_t remotePort, bool ok, const char* text);
+void sendPictureTaken(const IPAddress& remoteIp, uint16_t remotePort, bool ok, const char* text);
+void sendImageComplete(const IPAddress& remoteIp, uint16_t remotePort);
 void takeAndSavePhoto(IPAddress remoteIp, uint16_t remotePort);
 void generateAndDisplayImage(const char* prompt, const char* model, IPAddress remoteIp, uint16_t remotePort);
 void performQrScanLoop();
@@ -189,6 +204,7 @@ void setup() {
     // --- Step 6: Start UDP (only if WiFi connected) ---
     if (WiFi.status() == WL_CONNECTED) {
         udp.begin(CAMCANVAS_LISTEN_PORT);
+        tx_seq = (uint16_t)esp_random(); // The brain still remembers sequence numbers from before a reboot
         Serial.printf("UDP Server online on port %d\n", CAMCANVAS_LISTEN_PORT);
         Serial.println("Waiting for Brain PING...");
         
@@ -257,6 +273,15 @@ void loop() {
         if (len > 0) {
             packetBuffer[len] = 0;
         }
+
+        // Binary frames from the brain; JSON commands still work for debugging
+        emily_proto::Frame frame;
+        if (emily_proto::decode((const uint8_t*)packetBuffer, len, frame)) {
+            if (!acceptFrame(frame)) continue; // ACK or repeated command
+            reply_json = false;
+            handleFrame(frame);
+            continue;
+        }
         
         if (strcmp(packetBuffer, "PING") == 0) {
             if (conn_state == WAITING_FOR_BRAIN) {
@@ -267,12 +292,16 @@ void loop() {
         }
 
         Serial.printf("\nCommand received from %s\n", udp.remoteIP().toString().c_str());
+        reply_json = true;
         handleCommand(packetBuffer); 
     }
     
     // 2. Heartbeat
     sendHeartbeat(); 
 
+    // Retransmit results the brain hasn't acknowledged yet
+    serviceOutbox();
+
     // 3. LED Effects
     updateLedEffect(); 
 }
@@ -358,22 +387,151 @@ void handleCommand(char* commandJson) {
   }
 }
 
+// --- Delivery layer (see EmilyReliable.h) ---
+// Acks the brain's commands right away, before a long job (vision, image
+// generation) keeps the loop busy, and drops repeats of commands that were
+// already executed. Returns false if there's nothing left to handle.
+bool acceptFrame(const emily_proto::Frame& frame) {
+  uint32_t sender = (uint32_t)udp.remoteIP();
+
+  if (frame.type == emily_proto::MSG_ACK) {
+    emily_proto::Ack ack;
+    if (emily_proto::read(frame, ack)) outbox.acknowledge(sender, ack.seq);
+    return false;
+  }
+  if (!emily_proto::wantsAck(frame)) return true;
+
+  emily_proto::Ack ack;
+  ack.seq = frame.seq;
+  size_t len = emily_proto::encode(tx_frame, sizeof(tx_frame), ++tx_seq, ack);
+  udp.beginPacket(udp.remoteIP(), udp.remotePort());
+  udp.write(tx_frame, len);
+  udp.endPacket();
+
+  if (seen_frames.seen(sender, frame.seq)) {
+    Serial.printf("Duplicate command 0x%02X (seq %u) ignored.\n", frame.type, frame.seq);
+    return false;
+  }
+  return true;
+}
+
+void serviceOutbox() {
+  outbox.service(millis(),
+    [](uint32_t addr, uint16_t port, const uint8_t* data, size_t len) {
+      udp.beginPacket(IPAddress(addr), port);
+      udp.write(data, len);
+      udp.endPacket();
+    },
+    [](uint32_t addr, uint16_t port, uint8_t type, uint16_t seq) {
+      Serial.printf("No ACK from brain for result 0x%02X (seq %u), giving up.\n", type, seq);
+    });
+}
+
+// Binary counterpart of handleCommand()
+void handleFrame(const emily_proto::Frame& frame) {
+  emily_proto::Text text;
+  char prompt[512];
+
+  switch (frame.type) {
+    case emily_proto::MSG_PING:
+      if (conn_state == WAITING_FOR_BRAIN) {
+        Serial.println("PING received from Brain. Connected.");
+        conn_state = CONNECTED_TO_BRAIN;
+      }
+      break;
+
+    case emily_proto::MSG_TAKE_PICTURE: {
+      emily_proto::TakePicture cmd;
+      if (!emily_proto::read(frame, cmd)) break;
+      Serial.println("Action: take_picture");
+      takeAndSavePhoto(udp.remoteIP(), udp.remotePort());
+      break;
+    }
+
+    case emily_proto::MSG_ANALYZE_VISION: {
+      emily_proto::AnalyzeVision cmd;
+      if (!emily_proto::read(frame, cmd, &text)) break;
+      text.copyTo(prompt, sizeof(prompt));
+      Serial.printf("Action: analyze_vision. Prompt: %s\n", prompt);
+      analyzeImage(udp.remoteIP(), udp.remotePort(), prompt, cmd.use_flash == 1);
+      break;
+    }
+
+    case emily_proto::MSG_GENERATE_IMAGE: {
+      emily_proto::GenerateImage cmd;
+      if (!emily_proto::read(frame, cmd, &text) || text.len == 0) break;
+      char model[sizeof(cmd.model) + 1];
+      memcpy(model, cmd.model, sizeof(cmd.model));
+      model[sizeof(cmd.model)] = 0;
+      text.copyTo(prompt, sizeof(prompt));
+      Serial.printf("Action: generate_image. Model: %s\n", model);
+      generateAndDisplayImage(prompt, model[0] ? model : "venice-sd35", udp.remoteIP(), udp.remotePort());
+      break;
+    }
+
+    case emily_proto::MSG_MOVE_HEAD: {
+      emily_proto::MoveHead cmd;
+      if (!emily_proto::read(frame, cmd)) break;
+      int tilt_target = constrain((int)cmd.tilt, TILT_MIN_ANGLE, TILT_MAX_ANGLE); // Safety Clamp
+      Serial.printf("Action: move_head. Target Pan: %d, Tilt: %d\n", cmd.pan, tilt_target);
+      slowPan(cmd.pan, 15);
+      slowTilt(tilt_target, 15);
+      break;
+    }
+
+    case emily_proto::MSG_NOD_HEAD: {
+      emily_proto::NodHead cmd;
+      if (!emily_proto::read(frame, cmd)) break;
+      int angle = constrain((int)cmd.angle, TILT_MIN_ANGLE, TILT_MAX_ANGLE);
+      Serial.printf("Action: nod_head. Angle: %d\n", angle);
+      slowNod(angle, 25);
+      break;
+    }
+
+    case emily_proto::MSG_SET_LED: {
+      emily_proto::SetLed cmd;
+      if (!emily_proto::read(frame, cmd)) break;
+      led_r = cmd.r;
+      led_g = cmd.g;
+      led_b = cmd.b;
+      led_effect = (cmd.effect == emily_proto::LED_PULSE) ? "pulse" :
+                   (cmd.effect == emily_proto::LED_BLINK) ? "blink" : "none";
+      led_speed = cmd.speed_ms > 0 ? cmd.speed_ms : 1000;
+
+      led_last_update = millis();
+      led_override = false;
+
+      if (led_r > 0 || led_g > 0 || led_b > 0 || led_effect != "none") {
+          led_effect_end_time = millis() + 5000;
+          Serial.printf("LED set: %s (5s timeout)\n", led_effect.c_str());
+      } else {
+          led_effect_end_time = 0;
+          Serial.println("LED set: OFF (permanent)");
+      }
+      break;
+    }
+
+    default:
+      Serial.printf("Unknown message type: 0x%02X\n", frame.type);
+      break;
+  }
+}
+
 void sendHeartbeat() {
   if (conn_state != CONNECTED_TO_BRAIN) {
     return; 
   }
   
   if (millis() - lastHeartbeatTime > 1500) {
-    JsonDocument heartbeat_doc;
-    heartbeat_doc["id"] = "camcanvas_v1"; 
-    heartbeat_doc["state"] = "Ready"; 
-    heartbeat_doc["tilt_angle"] = current_tilt_angle;
-    heartbeat_doc["pan_angle"] = current_pan_angle;
-    String heartbeat_string;
-    serializeJson(heartbeat_doc, heartbeat_string);
-    
+    emily_proto::Heartbeat heartbeat;
+    heartbeat.node = emily_proto::NODE_CAMCANVAS;
+    heartbeat.state = 0; // Ready
+    heartbeat.pan = current_pan_angle;
+    heartbeat.tilt = current_tilt_angle;
+    size_t len = emily_proto::encode(tx_frame, sizeof(tx_frame), ++tx_seq, heartbeat);
+
     udp.beginPacket(EMILYBRAIN_IP, EMILYBRAIN_UDP_PORT);
-    udp.print(heartbeat_string);
+    udp.write(tx_frame, len);
     udp.endPacket();
     
     lastHeartbeatTime = millis();
@@ -402,7 +560,7 @@ void analyzeImage(IPAddress remoteIp, uint16_t remotePort, const char* prompt, b
   
   if (!fb) {
     Serial.println("!!! Capture Failed!");
-    sendUdpResponse(remoteIp, remotePort, "{\"status\":\"error\", \"message\":\"Camera capture failed\"}");
+    sendVisionResult(remoteIp, remotePort, false, "Camera capture failed");
     return;
   }
 
@@ -414,7 +572,7 @@ void analyzeImage(IPAddress remoteIp, uint16_t remotePort, const char* prompt, b
 
   if (!jpeg_converted) {
     Serial.println("!!! JPEG Conversion Failed.");
-    sendUdpResponse(remoteIp, remotePort, "{\"status\":\"error\", \"message\":\"Software JPEG conversion failed\"}");
+    sendVisionResult(remoteIp, remotePort, false, "Software JPEG conversion failed");
     return;
   }
 
@@ -435,7 +593,7 @@ void analyzeImage(IPAddress remoteIp, uint16_t remotePort, const char* prompt, b
   
   if(base64Image.length() == 0){
     Serial.println("!!! Base64 Failed.");
-    sendUdpResponse(remoteIp, remotePort, "{\"status\":\"error\", \"message\":\"Base64 encoding failed\"}");
+    sendVisionResult(remoteIp, remotePort, false, "Base64 encoding failed");
     tft.fillScreen(TFT_BLACK);
     return;
   }
@@ -472,23 +630,15 @@ void analyzeImage(IPAddress remoteIp, uint16_t remotePort, const char* prompt, b
       
       JsonDocument doc; 
       deserializeJson(doc, response_payload);
-      const char* description = doc["choices"][0]["message"]["content"];
-      
-      JsonDocument udp_response_doc;
-      udp_response_doc["status"] = "success";
-      udp_response_doc["result_type"] = "vision";
-      udp_response_doc["description"] = description;
-      
-      String clean_response_string;
-      serializeJson(udp_response_doc, clean_response_string);
-      sendUdpResponse(remoteIp, remotePort, clean_response_string);
+      const char* description = doc["choices"][0]["message"]["content"] | "";
+      sendVisionResult(remoteIp, remotePort, true, description);
     } else {
       Serial.printf("HTTP Error: %d\n", httpResponseCode);
-      sendUdpResponse(remoteIp, remotePort, "{\"status\":\"error\", \"message\":\"Vision API call failed\"}");
+      sendVisionResult(remoteIp, remotePort, false, "Vision API call failed");
     }
     http.end();
   } else {
-      sendUdpResponse(remoteIp, remotePort, "{\"status\":\"error\", \"message\":\"HTTP client begin failed\"}");
+      sendVisionResult(remoteIp, remotePort, false, "HTTP client begin failed");
   }
 
   tft.fillScreen(TFT_BLACK);
@@ -500,7 +650,7 @@ void takeAndSavePhoto(IPAddress remoteIp, uint16_t remotePort) {
   Serial.println("Taking Photo for SD...");
   camera_fb_t * fb = esp_camera_fb_get();
   if (!fb) {
-    sendUdpResponse(remoteIp, remotePort, "{\"status\":\"error\", \"message\":\"Camera capture failed\"}");
+    sendPictureTaken(remoteIp, remotePort, false, "Camera capture failed");
     return;
   }
   
@@ -510,7 +660,7 @@ void takeAndSavePhoto(IPAddress remoteIp, uint16_t remotePort) {
   esp_camera_fb_return(fb); 
 
   if (!jpeg_converted) {
-    sendUdpResponse(remoteIp, remotePort, "{\"status\":\"error\", \"message\":\"Software JPEG conversion failed\"}");
+    sendPictureTaken(remoteIp, remotePort, false, "Software JPEG conversion failed");
     return; 
   }
 
@@ -526,27 +676,17 @@ void takeAndSavePhoto(IPAddress remoteIp, uint16_t remotePort) {
   // Save
   String path = "/photo_" + String(millis()) + ".jpg";
   File file = SD_MMC.open(path.c_str(), FILE_WRITE);
-  
-  JsonDocument udp_response_doc;
-  udp_response_doc["id"] = "vision_cortex_v2_S3";
-  udp_response_doc["result_type"] = "picture_taken";
 
   if (file) {
     file.write(out_buf, out_len); 
     file.close();
     Serial.printf("Saved: %s\n", path.c_str());
-    udp_response_doc["status"] = "success";
-    udp_response_doc["path"] = path;
+    sendPictureTaken(remoteIp, remotePort, true, path.c_str());
   } else {
     Serial.println("!!! SD Write Failed.");
-    udp_response_doc["status"] = "error";
-    udp_response_doc["message"] = "Failed to save photo to SD card.";
+    sendPictureTaken(remoteIp, remotePort, false, "Failed to save photo to SD card.");
   }
 
-  String response_string;
-  serializeJson(udp_response_doc, response_string);
-  sendUdpResponse(remoteIp, remotePort, response_string);
-
   delay(3000); 
   
   tft.fillScreen(TFT_BLACK);
@@ -708,13 +848,7 @@ void generateAndDisplayImage(const char* prompt, const char* model, IPAddress re
   }
 
   // Confirmation
-  JsonDocument confirmation_doc;
-  confirmation_doc["id"] = "camcanvas_v1";
-  confirmation_doc["result_type"] = "image_complete";
-  
-  String confirmation_string;
-  serializeJson(confirmation_doc, confirmation_string);
-  sendUdpResponse(remoteIp, remotePort, confirmation_string);
+  sendImageComplete(remoteIp, remotePort);
   
   delay(8000); // Show image for 8 seconds
   
@@ -824,6 +958,68 @@ void sendUdpResponse(const IPAddress& remoteIp, uint16_t remotePort, const Strin
   Serial.printf("Response sent: %s\n", message.c_str());
 }
 
+// --- Results back to the brain ---
+// Binary frames normally; the old JSON messages when the command was JSON.
+// Binary results are acknowledged by the brain and retransmitted until then.
+template <typename T>
+void sendFrame(const IPAddress& remoteIp, uint16_t remotePort, const T& body, const char* text = nullptr) {
+  size_t len = emily_proto::encode(tx_frame, sizeof(tx_frame), ++tx_seq, body, text);
+  if (!outbox.track(tx_frame, len, (uint32_t)remoteIp, remotePort, millis())) {
+    Serial.println("Outbox full, result sent without retransmit.");
+  }
+  udp.beginPacket(remoteIp, remotePort);
+  udp.write(tx_frame, len);
+  udp.endPacket();
+}
+
+void sendVisionResult(const IPAddress& remoteIp, uint16_t remotePort, bool ok, const char* text) {
+  Serial.printf("Vision result (%s): %s\n", ok ? "success" : "error", text);
+  if (reply_json) {
+    JsonDocument doc;
+    doc["status"] = ok ? "success" : "error";
+    if (ok) {
+      doc["result_type"] = "vision";
+      doc["description"] = text;
+    } else {
+      doc["message"] = text;
+    }
+    String response_string;
+    serializeJson(doc, response_string);
+    sendUdpResponse(remoteIp, remotePort, response_string);
+    return;
+  }
+  emily_proto::VisionResult result;
+  result.status = ok ? emily_proto::STATUS_OK : emily_proto::STATUS_ERROR;
+  sendFrame(remoteIp, remotePort, result, text);
+}
+
+void sendPictureTaken(const IPAddress& remoteIp, uint16_t remotePort, bool ok, const char* text) {
+  if (reply_json) {
+    JsonDocument doc;
+    doc["id"] = "vision_cortex_v2_S3";
+    doc["result_type"] = "picture_taken";
+    doc["status"] = ok ? "success" : "error";
+    doc[ok ? "path" : "message"] = text;
+    String response_string;
+    serializeJson(doc, response_string);
+    sendUdpResponse(remoteIp, remotePort, response_string);
+    return;
+  }
+  emily_proto::PictureTaken result;
+  result.status = ok ? emily_proto::STATUS_OK : emily_proto::STATUS_ERROR;
+  sendFrame(remoteIp, remotePort, result, text);
+}
+
+void sendImageComplete(const IPAddress& remoteIp, uint16_t remotePort) {
+  if (reply_json) {
+    sendUdpResponse(remoteIp, remotePort, "{\"id\":\"camcanvas_v1\",\"result_type\":\"image_complete\"}");
+    return;
+  }
+  emily_proto::ImageComplete result;
+  result.status = emily_proto::STATUS_OK;
+  sendFrame(remoteIp, remotePort, result);
+}
+
 // --- WIFI HELPER FUNCTIONS ---
 
 void setupWiFi() {
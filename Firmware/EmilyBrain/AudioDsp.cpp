@@ -0,0 +1,41 @@
+#include "AudioDsp.h"
+
+// Generic version: one sample per step.
+static uint32_t sumAbsScalar(const int16_t* samples, size_t count) {
+    uint32_t sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        int32_t s = samples[i];
+        sum += (uint32_t)(s < 0 ? -s : s);
+    }
+    return sum;
+}
+
+// Word version: loads two samples per 32-bit read and runs four words per
+// iteration, which keeps the Xtensa pipeline busy (ABS is a single
+// instruction there) instead of stalling on 16-bit loads.
+static uint32_t sumAbsWords(const int16_t* samples, size_t count) {
+    const uint32_t* words = (const uint32_t*)samples;
+    size_t word_count = count / 2;
+    uint32_t sum0 = 0, sum1 = 0;
+    size_t i = 0;
+    for (; i + 4 <= word_count; i += 4) {
+        uint32_t w0 = words[i], w1 = words[i + 1], w2 = words[i + 2], w3 = words[i + 3];
+        sum0 += abs((int16_t)w0) + abs((int16_t)(w0 >> 16));
+        sum1 += abs((int16_t)w1) + abs((int16_t)(w1 >> 16));
+        sum0 += abs((int16_t)w2) + abs((int16_t)(w2 >> 16));
+        sum1 += abs((int16_t)w3) + abs((int16_t)(w3 >> 16));
+    }
+    for (; i < word_count; i++) {
+        sum0 += abs((int16_t)words[i]) + abs((int16_t)(words[i] >> 16));
+    }
+    if (count & 1) sum1 += abs(samples[count - 1]);
+    return sum0 + sum1;
+}
+
+uint32_t frameEnergy(const int16_t* samples, size_t count) {
+    if (count == 0) return 0;
+    // 32768 * 65536 still fits the 32-bit accumulators
+    bool aligned = ((uintptr_t)samples & 3) == 0;
+    uint32_t sum = aligned ? sumAbsWords(samples, count) : sumAbsScalar(samples, count);
+    return sum / count;
+}
@@ -0,0 +1,12 @@
+#ifndef AUDIODSP_H
+#define AUDIODSP_H
+
+#include <Arduino.h>
+
+// --- Small DSP kernels shared by the audio engine ---
+
+// Mean absolute amplitude of a mono int16 frame (the VAD energy measure).
+// Returns 0 for an empty frame. 'count' may be up to 65536 samples.
+uint32_t frameEnergy(const int16_t* samples, size_t count);
+
+#endif // AUDIODSP_H
@@ -0,0 +1,678 @@
+#include "AudioEngine.h"
+#include "EmilyBrain.h" // Pins and VAD parameters
+#include "AudioDsp.h"
+
+bool AudioEngine::begin() {
+    if (!installDuplexI2s()) return false;
+    sound_cache.begin(SOUND_CACHE_BYTES, SOUND_CACHE_MAX_ENTRY);
+    if (!pre_roll.begin(VAD_PREROLL_MS * AUDIO_MIC_RATE / 1000 * 2)) {
+        Serial.println("AudioEngine WARNING: No memory for VAD pre-roll.");
+    }
+
+    cmd_queue = xQueueCreate(AUDIO_CMD_QUEUE_LEN, sizeof(Command));
+    evt_queue = xQueueCreate(AUDIO_EVT_QUEUE_LEN, sizeof(AudioEvent));
+    if (cmd_queue == nullptr || evt_queue == nullptr) {
+        Serial.println("AudioEngine ERROR: Could not create queues.");
+        return false;
+    }
+    BaseType_t result = xTaskCreatePinnedToCore(taskEntry, "audio_engine", AUDIO_TASK_STACK, this,
+                                                AUDIO_TASK_PRIORITY, &task, AUDIO_TASK_CORE);
+    if (result != pdPASS) {
+        Serial.println("AudioEngine ERROR: Could not start task.");
+        return false;
+    }
+    Serial.println("AudioEngine started.");
+    return true;
+}
+
+// --- Public API (called from loop()) ---
+uint32_t AudioEngine::submit(Command& cmd) {
+    cmd.job_id = next_job_id++;
+    if (xQueueSend(cmd_queue, &cmd, pdMS_TO_TICKS(100)) != pdTRUE) {
+        Serial.println("AudioEngine ERROR: Command queue full.");
+        return 0;
+    }
+    return cmd.job_id;
+}
+
+uint32_t AudioEngine::playFile(const char* path, float gain, bool notify) {
+    Command cmd = {};
+    cmd.type = CommandType::PLAY_FILE;
+    strlcpy(cmd.path, path, sizeof(cmd.path));
+    cmd.gain = (int32_t)(constrain(gain, 0.0f, 1.0f) * AUDIO_GAIN_UNITY);
+    cmd.notify = notify;
+    return submit(cmd);
+}
+
+uint32_t AudioEngine::playStream(RingBuffer* ring, int sample_rate, size_t prebuffer_bytes) {
+    Command cmd = {};
+    cmd.type = CommandType::PLAY_STREAM;
+    cmd.ring = ring;
+    cmd.sample_rate = sample_rate;
+    cmd.prebuffer_bytes = prebuffer_bytes;
+    cmd.gain = AUDIO_GAIN_UNITY;
+    cmd.notify = true;
+    stream_ended = false; // Before the job can see it
+    return submit(cmd);
+}
+
+uint32_t AudioEngine::record(const char* path, RingBuffer* capture) {
+    Command cmd = {};
+    cmd.type = CommandType::RECORD;
+    strlcpy(cmd.path, path, sizeof(cmd.path));
+    cmd.ring = capture;
+    capture_overflow = false;
+    return submit(cmd);
+}
+
+void AudioEngine::prewarm(const char* list_path) {
+    Command cmd = {};
+    cmd.type = CommandType::PREWARM;
+    strlcpy(cmd.path, list_path, sizeof(cmd.path));
+    submit(cmd);
+}
+
+// Stops all voices and any recording, and drops anything still queued.
+void AudioEngine::stop() {
+    xQueueReset(cmd_queue);
+    Command cmd = {};
+    cmd.type = CommandType::STOP;
+    xQueueSend(cmd_queue, &cmd, 0);
+}
+
+bool AudioEngine::pollEvent(AudioEvent& evt) {
+    return xQueueReceive(evt_queue, &evt, 0) == pdTRUE;
+}
+
+// --- Engine task ---
+void AudioEngine::taskEntry(void* arg) {
+    static_cast<AudioEngine*>(arg)->run();
+}
+
+// Takes new commands between mix passes. While nothing plays the task
+// sleeps on the queue; while voices play, i2s_write() paces the loop.
+void AudioEngine::run() {
+    Command cmd;
+    while (true) {
+        bool busy = anyVoiceActive() || record_pending;
+        TickType_t wait = busy ? 0 : portMAX_DELAY;
+        while (xQueueReceive(cmd_queue, &cmd, wait) == pdTRUE) {
+            handleCommand(cmd);
+            wait = 0;
+        }
+
+        if (record_pending) {
+            // Give short effects (e.g. a confirm sound) a moment to finish
+            if (anyVoiceActive() && millis() - record_requested_at > AUDIO_RECORD_WAIT_MS) {
+                stopAllVoices();
+            }
+            if (!anyVoiceActive()) {
+                record_pending = false;
+                runRecord(pending_record);
+                continue;
+            }
+        }
+
+        if (anyVoiceActive()) {
+            mixBlock();
+        } else if (record_pending) {
+            vTaskDelay(pdMS_TO_TICKS(5));
+        }
+    }
+}
+
+void AudioEngine::handleCommand(const Command& cmd) {
+    switch (cmd.type) {
+        case CommandType::PLAY_FILE:
+            if (!startFileVoice(cmd) && cmd.notify) {
+                postEvent(AudioEventType::PLAYBACK_DONE, cmd.job_id);
+            }
+            break;
+        case CommandType::PLAY_STREAM:
+            startStreamVoice(cmd);
+            break;
+        case CommandType::RECORD:
+            if (record_pending) postEvent(AudioEventType::RECORDING_DONE, pending_record.job_id, 0);
+            pending_record = cmd;
+            record_pending = true;
+            record_requested_at = millis();
+            break;
+        case CommandType::PREWARM:
+            runPrewarm(cmd);
+            break;
+        case CommandType::STOP:
+            stopAllVoices();
+            if (record_pending) {
+                record_pending = false;
+                postEvent(AudioEventType::RECORDING_DONE, pending_record.job_id, 0);
+            }
+            break;
+    }
+}
+
+void AudioEngine::postEvent(AudioEventType type, uint32_t job_id, uint32_t value) {
+    AudioEvent evt = { type, job_id, value };
+    if (xQueueSend(evt_queue, &evt, pdMS_TO_TICKS(100)) != pdTRUE) {
+        Serial.println("AudioEngine WARNING: Event queue full, event dropped.");
+    }
+}
+
+// Checked between buffers by the blocking jobs (recording, prewarm).
+bool AudioEngine::stopRequested() {
+    Command cmd;
+    if (xQueuePeek(cmd_queue, &cmd, 0) == pdTRUE && cmd.type == CommandType::STOP) {
+        xQueueReceive(cmd_queue, &cmd, 0);
+        return true;
+    }
+    return false;
+}
+
+// --- I2S Helpers ---
+// One full-duplex driver (speaker TX + mic RX on shared BCK/WS) stays
+// installed at AUDIO_I2S_RATE for the lifetime of the engine. Files and
+// streams at other rates are converted in software, so switching between
+// speaking and listening costs no driver reinstall.
+bool AudioEngine::installDuplexI2s() {
+    i2s_config_t i2s_config = {
+        .mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_TX | I2S_MODE_RX),
+        .sample_rate = AUDIO_I2S_RATE,
+        .bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT,
+        .channel_format = I2S_CHANNEL_FMT_ONLY_LEFT,  // Mono speaker and mic
+        .communication_format = I2S_COMM_FORMAT_STAND_I2S,
+        .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
+        .dma_buf_count = 8,
+        .dma_buf_len = 256,
+        .use_apll = true,           // Use APLL for stable clock
+        .tx_desc_auto_clear = true  // Silence whenever nothing is being played
+    };
+    i2s_pin_config_t pin_config = {
+        .bck_io_num = PIN_I2S_BCK,
+        .ws_io_num = PIN_I2S_WS,
+        .data_out_num = PIN_I2S_DATA_OUT,
+        .data_in_num = PIN_I2S_DATA_IN
+    };
+
+    esp_err_t install_result = i2s_driver_install(I2S_NUM_0, &i2s_config, 0, NULL);
+    if (install_result != ESP_OK) {
+        Serial.printf("Error installing I2S driver: %d\n", install_result);
+        return false;
+    }
+    esp_err_t pin_result = i2s_set_pin(I2S_NUM_0, &pin_config);
+    if (pin_result != ESP_OK) {
+        Serial.printf("Error setting I2S pins: %d\n", pin_result);
+        i2s_driver_uninstall(I2S_NUM_0);
+        return false;
+    }
+    i2s_zero_dma_buffer(I2S_NUM_0);
+    Serial.printf("AudioEngine: Full-duplex I2S running at %d Hz.\n", AUDIO_I2S_RATE);
+    return true;
+}
+
+// Reads stale microphone samples that piled up while nobody was listening.
+void AudioEngine::drainInput() {
+    uint8_t scratch[512];
+    size_t bytes_read = 0;
+    for (int i = 0; i < 32; i++) {
+        if (i2s_read(I2S_NUM_0, scratch, sizeof(scratch), &bytes_read, 0) != ESP_OK || bytes_read == 0) break;
+    }
+}
+
+// --- Mixer: voices ---
+// A free voice, or the oldest file voice if all are busy (a stream is
+// never stolen: that is Emily talking).
+AudioEngine::Voice* AudioEngine::allocateVoice() {
+    Voice* victim = nullptr;
+    for (Voice& voice : voices) {
+        if (voice.source == VoiceSource::NONE) return &voice;
+        if (voice.source != VoiceSource::STREAM && (victim == nullptr || voice.job_id < victim->job_id)) {
+            victim = &voice;
+        }
+    }
+    if (victim != nullptr) {
+        Serial.printf("AudioEngine: All voices busy, stopping job %u.\n", victim->job_id);
+        finishVoice(*victim);
+    }
+    return victim;
+}
+
+bool AudioEngine::startFileVoice(const Command& cmd) {
+    CachedSound* cached = sound_cache.find(cmd.path);
+    WavReader wav; // One handle for header and samples
+    if (cached == nullptr) {
+        if (!wav.open(cmd.path)) return false;
+        if (wav.format().sampleRate < 8000) {
+            Serial.printf("Error: %s is below 8kHz. Cannot play.\n", cmd.path);
+            wav.close();
+            return false;
+        }
+    }
+
+    Voice* voice = allocateVoice();
+    if (voice == nullptr) {
+        Serial.println("AudioEngine: No voice free for playback.");
+        wav.close();
+        return false;
+    }
+    voice->job_id = cmd.job_id;
+    voice->gain = cmd.gain;
+    voice->notify = cmd.notify;
+    voice->ended = false;
+    voice->end_event = AudioEventType::PLAYBACK_DONE;
+    voice->source_bytes = 0;
+    voice->pending_count = 0;
+
+    if (cached != nullptr) {
+        // PSRAM hit: no header parse, no SD traffic
+        Serial.printf("Playing cached sound: %s\n", cmd.path);
+        sound_cache.pin(cached);
+        voice->source = VoiceSource::CACHED;
+        voice->sound = cached;
+        voice->pos = 0;
+        voice->resampler.begin(cached->sample_rate, AUDIO_I2S_RATE);
+        return true;
+    }
+
+    Serial.printf("Playing audio file: %s\n", cmd.path);
+    voice->source = VoiceSource::FILE;
+    voice->wav = wav;
+    voice->resampler.begin(wav.format().sampleRate, AUDIO_I2S_RATE);
+
+    // Sound effects are copied into the cache (already converted to mono
+    // 16-bit) while they play the first time
+    voice->sound = nullptr;
+    if (strncmp(cmd.path, SOUND_CACHE_PREFIX, strlen(SOUND_CACHE_PREFIX)) == 0) {
+        voice->sound = sound_cache.insert(cmd.path, wav.frameCount(), wav.format().sampleRate);
+        if (voice->sound != nullptr) sound_cache.pin(voice->sound);
+    }
+    return true;
+}
+
+void AudioEngine::startStreamVoice(const Command& cmd) {
+    Voice* voice = allocateVoice();
+    if (voice == nullptr) {
+        Serial.println("AudioEngine: No voice free for the stream.");
+        postEvent(AudioEventType::PLAYBACK_DONE, cmd.job_id);
+        return;
+    }
+    voice->source = VoiceSource::STREAM;
+    voice->job_id = cmd.job_id;
+    voice->gain = cmd.gain;
+    voice->notify = true;
+    voice->ended = false;
+    voice->end_event = AudioEventType::PLAYBACK_DONE;
+    voice->source_bytes = 0;
+    voice->pending_count = 0;
+    voice->ring = cmd.ring;
+    voice->prebuffer_bytes = cmd.prebuffer_bytes;
+    voice->started = false;
+    voice->last_level = 0;
+    voice->waiting_since = millis();
+    voice->resampler.begin(cmd.sample_rate, AUDIO_I2S_RATE);
+}
+
+// Decodes one AUDIO_VOICE_CHUNK from the voice's source into 'pending'.
+void AudioEngine::refillVoice(Voice& voice) {
+    int16_t chunk[AUDIO_VOICE_CHUNK];
+    size_t count = 0;
+
+    switch (voice.source) {
+        case VoiceSource::CACHED: {
+            count = voice.sound->sample_count - voice.pos;
+            if (count > AUDIO_VOICE_CHUNK) count = AUDIO_VOICE_CHUNK;
+            memcpy(chunk, voice.sound->samples + voice.pos, count * sizeof(int16_t));
+            voice.pos += count;
+            if (count == 0) voice.ended = true;
+            break;
+        }
+        case VoiceSource::FILE: {
+            count = voice.wav.read(chunk, AUDIO_VOICE_CHUNK);
+            CachedSound* fill = voice.sound;
+            if (fill != nullptr && count > 0) {
+                size_t room = fill->sample_count * 2 - voice.source_bytes;
+                memcpy((uint8_t*)fill->samples + voice.source_bytes, chunk, count * 2 < room ? count * 2 : room);
+            }
+            if (count == 0) voice.ended = true;
+            break;
+        }
+        case VoiceSource::STREAM: {
+            RingBuffer* ring = voice.ring;
+            if (!voice.started) {
+                // --- Wait for the jitter buffer ---
+                size_t level = ring->available();
+                if (level >= voice.prebuffer_bytes || stream_ended) {
+                    voice.started = true;
+                    voice.waiting_since = 0;
+                } else {
+                    if (level != voice.last_level) {
+                        voice.last_level = level;
+                        voice.waiting_since = millis();
+                    } else if (millis() - voice.waiting_since > 30000) {
+                        Serial.println("AudioEngine ERROR: Timeout while buffering stream.");
+                        voice.ended = true;
+                    }
+                    return;
+                }
+            }
+            size_t n = ring->available() & ~(size_t)1; // Whole samples only
+            if (n > sizeof(chunk)) n = sizeof(chunk);
+            if (n > 0) {
+                ring->read((uint8_t*)chunk, n);
+                count = n / 2;
+                voice.waiting_since = 0;
+            } else if (stream_ended) {
+                voice.ended = true; // Everything played
+            } else if (voice.waiting_since == 0) {
+                voice.waiting_since = millis();
+            } else if (millis() - voice.waiting_since > TTS_UNDERRUN_GRACE_MS) {
+                // Underrun: the speaker is starving while the producer is still busy
+                voice.end_event = AudioEventType::STREAM_UNDERRUN;
+                voice.ended = true;
+            }
+            break;
+        }
+        case VoiceSource::NONE:
+            return;
+    }
+
+    voice.source_bytes += count * 2;
+    if (count > 0) {
+        voice.pending_count += voice.resampler.process(chunk, count, voice.pending + voice.pending_count);
+    }
+}
+
+void AudioEngine::finishVoice(Voice& voice) {
+    if (voice.source == VoiceSource::NONE) return;
+    if (voice.source == VoiceSource::CACHED) {
+        sound_cache.unpin(voice.sound);
+    } else if (voice.source == VoiceSource::FILE) {
+        voice.wav.close();
+        if (voice.sound != nullptr) {
+            sound_cache.unpin(voice.sound);
+            if (voice.source_bytes >= voice.sound->sample_count * 2) {
+                voice.sound->ready = true;
+            } else {
+                sound_cache.remove(voice.sound); // Interrupted: don't keep a partial copy
+            }
+        }
+    } else if (voice.source == VoiceSource::STREAM) {
+        Serial.printf("AudioEngine: %u bytes played from stream.\n", voice.source_bytes);
+    }
+    if (voice.notify) postEvent(voice.end_event, voice.job_id, voice.source_bytes);
+    voice.source = VoiceSource::NONE;
+    voice.sound = nullptr;
+    voice.ring = nullptr;
+    voice.pending_count = 0;
+}
+
+void AudioEngine::stopAllVoices() {
+    for (Voice& voice : voices) finishVoice(voice);
+}
+
+bool AudioEngine::anyVoiceActive() const {
+    for (const Voice& voice : voices) {
+        if (voice.source != VoiceSource::NONE) return true;
+    }
+    return false;
+}
+
+// --- Mixer: one output block ---
+// Sums every voice with its Q15 gain in 32 bits and saturates to 16 bits.
+// Voices that can't fill the whole block (buffering, underrun) just add
+// silence for the rest of it.
+void AudioEngine::mixBlock() {
+    memset(mix_acc, 0, sizeof(mix_acc));
+
+    for (Voice& voice : voices) {
+        if (voice.source == VoiceSource::NONE) continue;
+        while (voice.pending_count < AUDIO_MIX_BLOCK && !voice.ended) {
+            size_t before = voice.pending_count;
+            refillVoice(voice);
+            if (voice.pending_count == before && !voice.ended) break; // Nothing available right now
+        }
+
+        size_t n = voice.pending_count < AUDIO_MIX_BLOCK ? voice.pending_count : AUDIO_MIX_BLOCK;
+        int32_t gain = voice.gain;
+        for (size_t i = 0; i < n; i++) {
+            mix_acc[i] += ((int32_t)voice.pending[i] * gain) >> 15;
+        }
+        voice.pending_count -= n;
+        memmove(voice.pending, voice.pending + n, voice.pending_count * sizeof(int16_t));
+
+        if (voice.ended && voice.pending_count == 0) finishVoice(voice);
+    }
+
+    for (size_t i = 0; i < AUDIO_MIX_BLOCK; i++) {
+        int32_t v = mix_acc[i];
+        mix_out[i] = (int16_t)(v > 32767 ? 32767 : (v < -32768 ? -32768 : v));
+    }
+    size_t written = 0;
+    i2s_write(I2S_NUM_0, mix_out, sizeof(mix_out), &written, portMAX_DELAY);
+}
+
+// --- PSRAM sound cache ---
+// Reads a whole WAV into the cache. Returns false if it can't be cached.
+bool AudioEngine::loadIntoCache(const char* path) {
+    if (sound_cache.find(path) != nullptr) return true;
+
+    WavReader wav;
+    if (!wav.open(path)) return false;
+    if (wav.format().sampleRate < 8000) {
+        wav.close();
+        return false;
+    }
+    CachedSound* entry = sound_cache.insert(path, wav.frameCount(), wav.format().sampleRate);
+    if (entry == nullptr) {
+        wav.close();
+        return false;
+    }
+    size_t got = wav.read(entry->samples, entry->sample_count);
+    wav.close();
+    if (got < entry->sample_count) {
+        sound_cache.remove(entry);
+        return false;
+    }
+    entry->ready = true;
+    return true;
+}
+
+// --- Job: fill the sound cache from a list on SD ---
+void AudioEngine::runPrewarm(const Command& cmd) {
+    File list = SD.open(cmd.path, FILE_READ);
+    if (!list) {
+        Serial.printf("SoundCache: No prewarm list at %s.\n", cmd.path);
+        return;
+    }
+    unsigned long started = millis();
+    int loaded = 0;
+    while (list.available()) {
+        if (uxQueueMessagesWaiting(cmd_queue) > 0) {
+            Serial.println("SoundCache: Prewarm interrupted by a new job.");
+            break;
+        }
+        String path = list.readStringUntil('\n');
+        path.trim();
+        if (path.length() == 0 || path.startsWith("#")) continue;
+        if (loadIntoCache(path.c_str())) {
+            loaded++;
+        } else {
+            Serial.printf("SoundCache: Could not prewarm %s.\n", path.c_str());
+        }
+    }
+    list.close();
+    Serial.printf("SoundCache: %d sounds prewarmed (%u bytes) in %lu ms.\n",
+                  loaded, sound_cache.usedBytes(), millis() - started);
+}
+
+// Reads one block from the mic and converts it to AUDIO_MIC_RATE.
+// 'bytes_out' receives the size of the converted block in 'out'.
+esp_err_t AudioEngine::readMic(uint8_t* raw, size_t raw_size, uint8_t* out, size_t* bytes_out) {
+    size_t raw_read = 0;
+    *bytes_out = 0;
+    esp_err_t result = i2s_read(I2S_NUM_0, raw, raw_size, &raw_read, pdMS_TO_TICKS(100));
+    if (result == ESP_OK && raw_read >= 2) {
+        *bytes_out = input_resampler.process((const int16_t*)raw, raw_read / 2, (int16_t*)out) * sizeof(int16_t);
+    }
+    return result;
+}
+
+// Appends captured speech to the WAV file and the optional live-upload ring.
+size_t AudioEngine::storeRecording(File& file, RingBuffer* capture, const uint8_t* data, size_t len) {
+    file.write(data, len);
+    if (capture != nullptr && capture->write(data, len) != len) {
+        capture_overflow = true; // Live copy is incomplete now; SD copy is not
+    }
+    return len;
+}
+
+// Keeps the last VAD_PREROLL_MS of quiet audio, dropping the oldest bytes.
+void AudioEngine::keepPreRoll(const uint8_t* data, size_t len) {
+    if (!pre_roll.isAllocated()) return;
+    if (len > pre_roll.capacity()) {
+        data += len - pre_roll.capacity();
+        len = pre_roll.capacity();
+    }
+    size_t space = pre_roll.space();
+    if (space < len) pre_roll.consume(len - space);
+    pre_roll.write(data, len);
+}
+
+// --- Job: record with VAD to a WAV file ---
+void AudioEngine::runRecord(const Command& cmd) {
+    Serial.println("Starting VAD Recording to WAV...");
+
+    // --- Step 1: Microphone runs at the I2S rate; STT gets AUDIO_MIC_RATE ---
+    drainInput();
+    input_resampler.begin(AUDIO_I2S_RATE, AUDIO_MIC_RATE);
+
+    // --- Step 2: VAD Logic and Recording ---
+    File file = SD.open(cmd.path, FILE_WRITE);
+    if (!file) {
+        postEvent(AudioEventType::RECORDING_DONE, cmd.job_id, 0);
+        return;
+    }
+
+    byte wav_header[44];
+    createWavHeader(wav_header, 0); // Write dummy header first
+    file.write(wav_header, 44);
+
+    // One VAD frame per read (VAD_FRAME_MS at the I2S rate, 16-bit aligned)
+    const int raw_buffer_size = AUDIO_I2S_RATE / 1000 * VAD_FRAME_MS * 2;
+    int16_t raw_buffer[raw_buffer_size / 2];
+    int16_t record_buffer[raw_buffer_size / 2];
+    size_t bytes_read;
+    size_t total_data_size = 0;
+    long recording_started_at = millis(); // Max recording timer
+    long last_frame_at = millis();
+
+    vad.begin(VAD_FRAME_MS);
+    pre_roll.clear();
+    Serial.println("VAD: Listening...");
+
+    // --- Main VAD Loop ---
+    while (true) {
+        if (stopRequested()) {
+            Serial.println("VAD: Recording stopped externally.");
+            break;
+        }
+
+        // Check max recording duration
+        if (millis() - recording_started_at > MAX_RECORDING_MS) {
+            Serial.println("VAD: Max recording duration reached.");
+            break;
+        }
+
+        esp_err_t read_result = readMic((uint8_t*)raw_buffer, raw_buffer_size, (uint8_t*)record_buffer, &bytes_read);
+
+        if (read_result == ESP_OK && bytes_read > 0) {
+            last_frame_at = millis();
+            Vad::Result result = vad.process(frameEnergy(record_buffer, bytes_read / 2));
+
+            if (result == Vad::Result::SILENCE) {
+                keepPreRoll((const uint8_t*)record_buffer, bytes_read);
+                continue;
+            }
+            if (result == Vad::Result::SPEECH_START) {
+                Serial.printf("VAD: Speech started (floor %u, threshold %u), recording...\n",
+                              vad.noiseFloor(), vad.startThreshold());
+                postEvent(AudioEventType::SPEECH_STARTED, cmd.job_id);
+                // Prepend the audio from just before the threshold crossing
+                uint8_t chunk[512];
+                size_t n;
+                while ((n = pre_roll.read(chunk, sizeof(chunk))) > 0) {
+                    total_data_size += storeRecording(file, cmd.ring, chunk, n);
+                }
+            }
+            total_data_size += storeRecording(file, cmd.ring, (const uint8_t*)record_buffer, bytes_read);
+            if (result == Vad::Result::SPEECH_END) {
+                Serial.println("VAD: Silence detected, stopping recording.");
+                break; // End recording loop
+            }
+        } else if (read_result == ESP_ERR_TIMEOUT) {
+            // No frames arriving: treat a stall during speech as its end
+            if (vad.inSpeech() && millis() - last_frame_at > VAD_HANGOVER_MS) {
+                Serial.println("VAD: Silence detected (via timeout), stopping recording.");
+                break;
+            }
+        } else {
+            Serial.printf("VAD Error during recording read: %d\n", read_result);
+            break; // Exit loop on read error
+        }
+    } // End of main VAD loop
+
+    // --- Step 3: Update header and clean up ---
+    if (total_data_size > 0) {
+        createWavHeader(wav_header, total_data_size);
+        file.seek(0);
+        file.write(wav_header, 44);
+        Serial.printf("VAD: Recording complete. %u bytes written.\n", total_data_size);
+    } else {
+        Serial.println("VAD: Recording complete, but no audio data captured.");
+    }
+    file.close();
+    postEvent(AudioEventType::RECORDING_DONE, cmd.job_id, total_data_size);
+}
+
+// --- WAV Header Function (Helper for recording) ---
+void AudioEngine::createWavHeader(byte* header, size_t total_data_size, int sampleRate) {
+    const int bitsPerSample = 16;
+    const int channels = 1;
+
+    long total_file_size = total_data_size + 36;
+    long byteRate = sampleRate * channels * bitsPerSample / 8;
+    int blockAlign = channels * bitsPerSample / 8;
+
+    memcpy(&header[0], "RIFF", 4);                                  // ChunkID
+    header[4] = (byte)(total_file_size & 0xFF);                     // ChunkSize
+    header[5] = (byte)((total_file_size >> 8) & 0xFF);
+    header[6] = (byte)((total_file_size >> 16) & 0xFF);
+    header[7] = (byte)((total_file_size >> 24) & 0xFF);
+    memcpy(&header[8], "WAVE", 4);                                  // Format
+    memcpy(&header[12], "fmt ", 4);                                 // Subchunk1ID
+    header[16] = 16;                                                // Subchunk1Size (16 for PCM)
+    header[17] = 0;
+    header[18] = 0;
+    header[19] = 0;
+    header[20] = 1;                                                 // AudioFormat (1 for PCM)
+    header[21] = 0;
+    header[22] = channels;                                          // NumChannels
+    header[23] = 0;
+    header[24] = (byte)(sampleRate & 0xFF);                         // SampleRate
+    header[25] = (byte)((sampleRate >> 8) & 0xFF);
+    header[26] = (byte)((sampleRate >> 16) & 0xFF);
+    header[27] = 0;
+    header[28] = (byte)(byteRate & 0xFF);                           // ByteRate
+    header[29] = (byte)((byteRate >> 8) & 0xFF);
+    header[30] = (byte)((byteRate >> 16) & 0xFF);
+    header[31] = (byte)((byteRate >> 24) & 0xFF);
+    header[32] = blockAlign;                                        // BlockAlign
+    header[33] = 0;
+    header[34] = bitsPerSample;                                     // BitsPerSample
+    header[35] = 0;
+    memcpy(&header[36], "data", 4);                                 // Subchunk2ID
+    header[40] = (byte)(total_data_size & 0xFF);                    // Subchunk2Size
+    header[41] = (byte)((total_data_size >> 8) & 0xFF);
+    header[42] = (byte)((total_data_size >> 16) & 0xFF);
+    header[43] = (byte)((total_data_size >> 24) & 0xFF);
+
+
+}
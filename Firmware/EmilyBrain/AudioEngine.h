@@ -0,0 +1,173 @@
+#ifndef AUDIOENGINE_H
+#define AUDIOENGINE_H
+
+#include <Arduino.h>
+#include "SD.h"
+#include "FS.h"
+#include "driver/i2s.h"
+#include <atomic>
+#include "RingBuffer.h"
+#include "Resampler.h"
+#include "Vad.h"
+#include "SoundCache.h"
+#include "WavReader.h"
+
+// --- Audio Engine Task Parameters ---
+#define AUDIO_TASK_CORE         0
+#define AUDIO_TASK_PRIORITY     5
+#define AUDIO_TASK_STACK        8192
+#define AUDIO_CMD_QUEUE_LEN     4
+#define AUDIO_EVT_QUEUE_LEN     16
+
+// --- Mixer ---
+#define AUDIO_MAX_VOICES        4       // Sounds that can play at the same time
+#define AUDIO_MIX_BLOCK         256     // Output samples per mix pass (~10ms at 24kHz)
+#define AUDIO_VOICE_CHUNK       128     // Source samples decoded per voice refill
+#define AUDIO_GAIN_UNITY        32768   // Q15 gain of 1.0
+#define AUDIO_RECORD_WAIT_MS    1500    // Let short effects finish before the mic opens
+
+// --- I2S Rates ---
+#define AUDIO_I2S_RATE          24000   // Fixed duplex rate (native rate of TTS and most sounds)
+#define AUDIO_MIC_RATE          16000   // Rate of recordings sent to STT
+
+// --- Sound Effect Cache (PSRAM) ---
+#define SOUND_CACHE_BYTES       (2 * 1024 * 1024)   // Total budget
+#define SOUND_CACHE_MAX_ENTRY   (512 * 1024)        // Longer files always stream from SD
+#define SOUND_CACHE_PREFIX      "/sounds/"          // Only these paths are cached
+#define SOUND_PREWARM_LIST      "/sounds/prewarm.txt" // One path per line, loaded at boot
+
+// --- VAD Framing ---
+#define VAD_FRAME_MS            20      // Energy is measured per frame of this length
+
+enum class AudioEventType {
+    PLAYBACK_DONE,      // File or stream finished (or failed)
+    STREAM_UNDERRUN,    // Stream ran dry; the ring is handed back to the producer
+    SPEECH_STARTED,     // VAD detected speech during a recording
+    RECORDING_DONE      // value = bytes of audio captured (0 = no speech)
+};
+
+struct AudioEvent {
+    AudioEventType type;
+    uint32_t job_id;    // Job that produced the event
+    uint32_t value;
+};
+
+// --- Audio Engine ---
+// Owns the I2S peripheral and runs playback and recording in its own
+// FreeRTOS task, so loop() (UDP, web server, timeouts, wake button) keeps
+// running while Emily speaks or listens. Every play/record call starts a
+// job and returns its id; completion is reported through pollEvent().
+//
+// Playback goes through a mixer: up to AUDIO_MAX_VOICES files (from SD or
+// the PSRAM cache) and one PCM stream play at once, each with its own gain,
+// summed with saturation into the single I2S output. Recording is exclusive:
+// it waits up to AUDIO_RECORD_WAIT_MS for running sounds, then stops them.
+class AudioEngine {
+public:
+    bool begin();
+
+    // 'gain' is 0.0 .. 1.0 of full scale. Fire-and-forget sounds pass
+    // notify = false so nobody has to drain their PLAYBACK_DONE events.
+    uint32_t playFile(const char* path, float gain = 1.0f, bool notify = true);
+    // Plays mono 16-bit PCM from 'ring' once prebuffer_bytes are queued.
+    // The caller keeps filling the ring and calls endStream() when done.
+    uint32_t playStream(RingBuffer* ring, int sample_rate, size_t prebuffer_bytes);
+    void endStream() { stream_ended = true; }
+    // Records with VAD to a WAV file on SD. After speech starts, captured
+    // audio is also copied into 'capture' (optional) for live upload.
+    uint32_t record(const char* path, RingBuffer* capture);
+    // Loads every sound listed in 'list_path' into the sound cache.
+    void prewarm(const char* list_path);
+    // Stops every voice and any recording, and drops queued jobs.
+    void stop();
+
+    bool pollEvent(AudioEvent& evt);
+    bool captureOverflowed() const { return capture_overflow; }
+
+    static void createWavHeader(byte* header, size_t total_data_size, int sampleRate = 16000);
+
+private:
+    enum class CommandType { PLAY_FILE, PLAY_STREAM, RECORD, PREWARM, STOP };
+    struct Command {
+        CommandType type;
+        uint32_t job_id;
+        char path[64];
+        RingBuffer* ring;
+        int sample_rate;
+        size_t prebuffer_bytes;
+        int32_t gain;           // Q15
+        bool notify;            // Post PLAYBACK_DONE when finished
+    };
+
+    enum class VoiceSource { NONE, CACHED, FILE, STREAM };
+    struct Voice {
+        VoiceSource source = VoiceSource::NONE;
+        uint32_t job_id = 0;
+        int32_t gain = AUDIO_GAIN_UNITY;
+        bool notify = true;
+        Resampler resampler;
+        bool ended = false;                 // Source exhausted; drain 'pending' then finish
+        AudioEventType end_event = AudioEventType::PLAYBACK_DONE;
+        size_t source_bytes = 0;            // Bytes taken from the source so far
+
+        CachedSound* sound = nullptr;       // CACHED: sound played; FILE: entry being filled
+        size_t pos = 0;                     // CACHED: next sample
+        WavReader wav;                      // FILE
+        RingBuffer* ring = nullptr;         // STREAM
+        size_t prebuffer_bytes = 0;
+        bool started = false;               // STREAM: jitter buffer reached
+        size_t last_level = 0;
+        unsigned long waiting_since = 0;    // STREAM: buffering / underrun timer
+
+        int16_t pending[AUDIO_MIX_BLOCK + AUDIO_VOICE_CHUNK * 3 + 2]; // Resampled, not yet mixed
+        size_t pending_count = 0;
+    };
+
+    static void taskEntry(void* arg);
+    void run();
+    uint32_t submit(Command& cmd);
+    void postEvent(AudioEventType type, uint32_t job_id, uint32_t value = 0);
+    bool stopRequested();
+
+    // --- Mixer ---
+    void handleCommand(const Command& cmd);
+    Voice* allocateVoice();
+    bool startFileVoice(const Command& cmd);
+    void startStreamVoice(const Command& cmd);
+    void refillVoice(Voice& voice);
+    void finishVoice(Voice& voice);
+    void stopAllVoices();
+    bool anyVoiceActive() const;
+    void mixBlock();
+
+    void runRecord(const Command& cmd);
+    void runPrewarm(const Command& cmd);
+    bool loadIntoCache(const char* path);
+
+    bool installDuplexI2s();
+    void drainInput();
+    esp_err_t readMic(uint8_t* raw, size_t raw_size, uint8_t* out, size_t* bytes_out);
+    size_t storeRecording(File& file, RingBuffer* capture, const uint8_t* data, size_t len);
+    void keepPreRoll(const uint8_t* data, size_t len);
+
+    Voice voices[AUDIO_MAX_VOICES];
+    int32_t mix_acc[AUDIO_MIX_BLOCK];
+    int16_t mix_out[AUDIO_MIX_BLOCK];
+    Command pending_record;
+    bool record_pending = false;
+    unsigned long record_requested_at = 0;
+
+    Resampler input_resampler;
+    SoundCache sound_cache;                 // Audio task only
+    Vad vad;
+    RingBuffer pre_roll;                    // Last VAD_PREROLL_MS before speech starts
+
+    QueueHandle_t cmd_queue = nullptr;
+    QueueHandle_t evt_queue = nullptr;
+    TaskHandle_t task = nullptr;
+    uint32_t next_job_id = 1;
+    std::atomic<bool> stream_ended{false};
+    std::atomic<bool> capture_overflow{false};
+};
+
+#endif // AUDIOENGINE_H
@@ -0,0 +1,241 @@
+#include "ChatStream.h"
+
+// Tool calls whose text is spoken, and the arguments holding it.
+static const char* const SPEECH_TOOLS[] = { "announce_message", "start_conversation" };
+static const char* const SPEECH_KEYS[] = { "announcement", "question" };
+
+// --- SseReader ---
+void SseReader::reset() {
+    line = "";
+    event = "";
+    has_data = false;
+    line_overflow = false;
+}
+
+// --- JsonStringWatcher ---
+void JsonStringWatcher::begin(const char* const* watch_keys, size_t count) {
+    keys = watch_keys;
+    key_count = count;
+    depth = 0;
+    in_string = false;
+    escape = false;
+    unicode_digits = 0;
+    high_surrogate = 0;
+    role = Role::OTHER;
+    expect_key = false;
+    key_matched = false;
+    value_next = false;
+    done = false;
+    key = "";
+    captured = "";
+}
+
+bool JsonStringWatcher::feed(const char* data, size_t len) {
+    for (size_t i = 0; i < len && !done; i++) feedChar(data[i]);
+    return done;
+}
+
+void JsonStringWatcher::feedChar(char c) {
+    if (in_string) {
+        if (unicode_digits > 0) {
+            unicode_value <<= 4;
+            if (c >= '0' && c <= '9') unicode_value |= c - '0';
+            else if (c >= 'a' && c <= 'f') unicode_value |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') unicode_value |= c - 'A' + 10;
+            if (--unicode_digits == 0) emit(unicode_value);
+            return;
+        }
+        if (escape) {
+            escape = false;
+            switch (c) {
+                case 'n': emit('\n'); break;
+                case 't': emit('\t'); break;
+                case 'r': emit('\r'); break;
+                case 'b': emit('\b'); break;
+                case 'f': emit('\f'); break;
+                case 'u': unicode_digits = 4; unicode_value = 0; break;
+                default:  emit((uint8_t)c); break; // \" \\ \/
+            }
+            return;
+        }
+        if (c == '\\') { escape = true; return; }
+        if (c == '"') { endString(); return; }
+        if (role == Role::VALUE || (role == Role::KEY && key.length() < 32)) {
+            (role == Role::VALUE ? captured : key) += c; // Raw UTF-8 passes through
+        }
+        return;
+    }
+
+    switch (c) {
+        case '{':
+        case '[':
+            depth++;
+            expect_key = (c == '{' && depth == 1);
+            value_next = false;
+            break;
+        case '}':
+        case ']':
+            depth--;
+            break;
+        case ',':
+            if (depth == 1) expect_key = true;
+            value_next = false;
+            break;
+        case ':':
+            if (depth == 1) value_next = key_matched;
+            break;
+        case '"':
+            in_string = true;
+            high_surrogate = 0;
+            if (depth == 1 && expect_key) {
+                role = Role::KEY;
+                key = "";
+                key_matched = false;
+                expect_key = false;
+            } else if (depth == 1 && value_next) {
+                role = Role::VALUE;
+                captured = "";
+            } else {
+                role = Role::OTHER;
+            }
+            value_next = false;
+            break;
+        case ' ': case '\t': case '\r': case '\n':
+            break;
+        default:
+            if (depth == 1) value_next = false; // Number, bool or null: not ours
+            break;
+    }
+}
+
+void JsonStringWatcher::endString() {
+    in_string = false;
+    if (role == Role::KEY) {
+        for (size_t i = 0; i < key_count; i++) {
+            if (key == keys[i]) { key_matched = true; break; }
+        }
+    } else if (role == Role::VALUE) {
+        done = true;
+    }
+    role = Role::OTHER;
+}
+
+// Appends a decoded character as UTF-8 (\uXXXX escapes, surrogate pairs).
+void JsonStringWatcher::emit(uint32_t cp) {
+    if (cp >= 0xD800 && cp <= 0xDBFF) { high_surrogate = cp; return; }
+    if (cp >= 0xDC00 && cp <= 0xDFFF) {
+        if (high_surrogate == 0) return; // Lone low surrogate: drop it
+        cp = 0x10000 + ((high_surrogate - 0xD800) << 10) + (cp - 0xDC00);
+    }
+    high_surrogate = 0;
+    if (role == Role::OTHER) return;
+
+    String& out = (role == Role::VALUE) ? captured : key;
+    if (cp < 0x80) {
+        out += (char)cp;
+    } else if (cp < 0x800) {
+        out += (char)(0xC0 | (cp >> 6));
+        out += (char)(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += (char)(0xE0 | (cp >> 12));
+        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    } else {
+        out += (char)(0xF0 | (cp >> 18));
+        out += (char)(0x80 | ((cp >> 12) & 0x3F));
+        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    }
+}
+
+// --- ChatStream ---
+ChatStream::ChatStream() {
+    // Only the parts of each event we reassemble
+    filter["choices"][0]["delta"]["content"] = true;
+    filter["choices"][0]["delta"]["tool_calls"] = true;
+    filter["choices"][0]["finish_reason"] = true;
+}
+
+void ChatStream::feed(const char* data, size_t len) {
+    sse.feed(data, len, [this](const String& payload) { handleEvent(payload); });
+}
+
+void ChatStream::handleEvent(const String& payload) {
+    if (payload == "[DONE]") {
+        stream_done = true;
+        return;
+    }
+    event_doc.clear();
+    DeserializationError error = deserializeJson(event_doc, payload, DeserializationOption::Filter(filter));
+    if (error) {
+        Serial.printf("ChatStream: Skipping unparsable event (%s).\n", error.c_str());
+        return;
+    }
+
+    JsonObjectConst choice = event_doc["choices"][0];
+    const char* text = choice["delta"]["content"];
+    if (text != nullptr) content += text;
+    const char* reason = choice["finish_reason"];
+    if (reason != nullptr) finish_reason = reason;
+
+    for (JsonObjectConst delta : choice["delta"]["tool_calls"].as<JsonArrayConst>()) {
+        size_t index = delta["index"] | 0;
+        if (index >= CHAT_STREAM_MAX_TOOL_CALLS) continue;
+        ToolCall& call = calls[index];
+        if (index >= call_count) call_count = index + 1;
+
+        const char* id = delta["id"];
+        if (id != nullptr) call.id = id;
+        const char* name = delta["function"]["name"];
+        if (name != nullptr) {
+            call.name += name;
+            if (speech_call < 0) watchSpeechOf(index);
+        }
+        const char* fragment = delta["function"]["arguments"];
+        if (fragment != nullptr) {
+            call.arguments += fragment;
+            if ((int)index == speech_call) speech_watcher.feed(fragment, strlen(fragment));
+        }
+    }
+}
+
+// Starts watching call 'index' if it speaks; catches up on the arguments
+// that arrived before its name was complete.
+void ChatStream::watchSpeechOf(size_t index) {
+    for (const char* tool : SPEECH_TOOLS) {
+        if (calls[index].name == tool) {
+            speech_call = (int)index;
+            speech_watcher.begin(SPEECH_KEYS, sizeof(SPEECH_KEYS) / sizeof(SPEECH_KEYS[0]));
+            speech_watcher.feed(calls[index].arguments.c_str(), calls[index].arguments.length());
+            return;
+        }
+    }
+}
+
+bool ChatStream::takeEarlySpeech(String& text) {
+    if (speech_taken || speech_call < 0 || !speech_watcher.complete()) return false;
+    speech_taken = true;
+    text = speech_watcher.value();
+    return text.length() > 0;
+}
+
+void ChatStream::toDocument(JsonDocument& doc) const {
+    doc.clear();
+    JsonObject choice = doc["choices"].add<JsonObject>();
+    JsonObject message = choice["message"].to<JsonObject>();
+    message["role"] = "assistant";
+    if (content.length() > 0) message["content"] = content;
+    if (call_count > 0) {
+        JsonArray tool_calls = message["tool_calls"].to<JsonArray>();
+        for (size_t i = 0; i < call_count; i++) {
+            const ToolCall& call = calls[i];
+            if (call.name.isEmpty()) continue; // A gap in the indices
+            JsonObject out = tool_calls.add<JsonObject>();
+            out["id"] = call.id;
+            out["type"] = "function";
+            out["function"]["name"] = call.name;
+            out["function"]["arguments"] = call.arguments;
+        }
+    }
+    if (finish_reason.length() > 0) choice["finish_reason"] = finish_reason;
+}
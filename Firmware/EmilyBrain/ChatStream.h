@@ -0,0 +1,130 @@
+#ifndef CHATSTREAM_H
+#define CHATSTREAM_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#define CHAT_STREAM_MAX_TOOL_CALLS  8       // Tool calls reassembled per response (as TURN_MAX_TOOL_CALLS)
+#define SSE_LINE_MAX_BYTES          8192    // Longer lines are dropped (one delta is ~200 bytes)
+
+// --- Server-sent events framing ---
+// Splits an SSE byte stream into the payloads of its events. 'data:' lines
+// of one event are joined with '\n' (per the spec); comments, other fields
+// and over-long lines are skipped.
+class SseReader {
+public:
+    // Calls on_event(payload) for every event completed by 'data'.
+    template <typename Fn>
+    void feed(const char* data, size_t len, Fn on_event) {
+        for (size_t i = 0; i < len; i++) {
+            char c = data[i];
+            if (c != '\n') {
+                if (line.length() < SSE_LINE_MAX_BYTES) line += c;
+                else line_overflow = true;
+                continue;
+            }
+            if (line.endsWith("\r")) line.remove(line.length() - 1);
+            if (line.isEmpty()) {
+                // Blank line: the event is complete
+                if (has_data) on_event(event);
+                event = "";
+                has_data = false;
+            } else if (!line_overflow && line.startsWith("data:")) {
+                if (has_data) event += '\n';
+                event += line.c_str() + ((line.length() > 5 && line[5] == ' ') ? 6 : 5);
+                has_data = true;
+            }
+            line = "";
+            line_overflow = false;
+        }
+    }
+    void reset();
+
+private:
+    String line;
+    String event;
+    bool has_data = false;
+    bool line_overflow = false;
+};
+
+// --- Incremental JSON string extractor ---
+// Watches a JSON object that arrives in pieces (a tool call's 'arguments')
+// and decodes the string value of the first top-level key from 'keys' as
+// soon as its closing quote arrives, long before the object is complete.
+class JsonStringWatcher {
+public:
+    // 'keys' must stay valid while watching.
+    void begin(const char* const* keys, size_t key_count);
+    // True once the value is complete; value() holds it from then on.
+    bool feed(const char* data, size_t len);
+    bool complete() const { return done; }
+    const String& value() const { return captured; }
+
+private:
+    enum class Role : uint8_t { OTHER, KEY, VALUE };
+    void feedChar(char c);
+    void emit(uint32_t codepoint);
+    void endString();
+
+    const char* const* keys = nullptr;
+    size_t key_count = 0;
+    int depth = 0;
+    bool in_string = false;
+    bool escape = false;
+    uint8_t unicode_digits = 0;     // Hex digits of a \uXXXX still to come
+    uint32_t unicode_value = 0;
+    uint32_t high_surrogate = 0;
+    Role role = Role::OTHER;
+    bool expect_key = false;        // Next string at depth 1 is a key
+    bool key_matched = false;       // The last key is one we watch
+    bool value_next = false;        // ':' after a watched key seen
+    bool done = false;
+    String key;
+    String captured;
+};
+
+// --- Streamed chat completion ---
+// Feeds a chat completion response sent with "stream": true and reassembles
+// the choices[0].delta.tool_calls[] fragments. The announcement or question
+// of the first announce_message / start_conversation call is available
+// through takeEarlySpeech() as soon as it is complete. toDocument() then
+// builds the same JSON a non-streamed response has, so the planner can't
+// tell the difference.
+class ChatStream {
+public:
+    ChatStream();
+
+    void feed(const char* data, size_t len);
+    bool done() const { return stream_done; }
+
+    // One-shot: true (with the text) the first time the speech is complete.
+    bool takeEarlySpeech(String& text);
+
+    // choices[0].message.{content, tool_calls[]} and finish_reason.
+    void toDocument(JsonDocument& doc) const;
+
+private:
+    struct ToolCall {
+        String id;
+        String name;
+        String arguments;
+    };
+
+    void handleEvent(const String& payload);
+    void watchSpeechOf(size_t index);
+
+    SseReader sse;
+    JsonDocument filter;
+    JsonDocument event_doc;
+    ToolCall calls[CHAT_STREAM_MAX_TOOL_CALLS];
+    size_t call_count = 0;
+    String content;
+    String finish_reason;
+    bool stream_done = false;
+
+    int speech_call = -1;           // Tool call watched for early speech
+    JsonStringWatcher speech_watcher;
+    bool speech_taken = false;
+};
+
+#endif // CHATSTREAM_H
@@ -0,0 +1,107 @@
+#include "DisplayRegion.h"
+#include "esp_heap_caps.h"
+
+// --- DisplayRegion ---
+bool DisplayRegion::begin(TFT_eSPI& tft, int16_t rx, int16_t ry, int16_t rw, int16_t rh, uint16_t bg) {
+    end();
+    x = rx;
+    y = ry;
+    w = rw;
+    h = rh;
+    background = bg;
+
+    sprite = new TFT_eSprite(&tft);
+    sprite->setAttribute(PSRAM_ENABLE, true);
+    sprite->setColorDepth(16);
+    if (sprite->createSprite(w, h) == nullptr) {
+        Serial.printf("DisplayRegion ERROR: Could not allocate %dx%d sprite.\n", w, h);
+        delete sprite;
+        sprite = nullptr;
+        return false;
+    }
+    clear();
+    dirty = true;
+    return true;
+}
+
+void DisplayRegion::end() {
+    if (sprite != nullptr) {
+        sprite->deleteSprite();
+        delete sprite;
+        sprite = nullptr;
+    }
+    dirty = false;
+}
+
+TFT_eSprite& DisplayRegion::clear() {
+    sprite->fillSprite(background);
+    return *sprite;
+}
+
+// --- RegionRenderer ---
+bool RegionRenderer::begin(TFT_eSPI& display, int16_t max_width) {
+    end();
+    tft = &display;
+    bounce_pixels = (size_t)max_width * DISPLAY_DMA_STRIPE_ROWS;
+    for (int i = 0; i < 2; i++) {
+        bounce[i] = (uint16_t*)heap_caps_malloc(bounce_pixels * sizeof(uint16_t), MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    }
+    if (bounce[0] == nullptr || bounce[1] == nullptr) {
+        Serial.println("RegionRenderer: No DMA buffers, pushing without DMA.");
+        return false;
+    }
+    dma_ready = tft->initDMA();
+    if (!dma_ready) Serial.println("RegionRenderer: DMA not available, pushing without DMA.");
+    return dma_ready;
+}
+
+void RegionRenderer::end() {
+    if (dma_ready) tft->deInitDMA();
+    dma_ready = false;
+    for (int i = 0; i < 2; i++) {
+        if (bounce[i] != nullptr) heap_caps_free(bounce[i]);
+        bounce[i] = nullptr;
+    }
+    bounce_pixels = 0;
+}
+
+size_t RegionRenderer::flush(DisplayRegion* regions, size_t count) {
+    if (tft == nullptr) return 0;
+    size_t pixels = 0;
+    bool writing = false;
+    for (size_t i = 0; i < count; i++) {
+        DisplayRegion& region = regions[i];
+        if (!region.dirty || !region.ready()) continue;
+        if (!writing) {
+            tft->startWrite(); // One transaction for all regions of this frame
+            writing = true;
+        }
+        if (dma_ready && (size_t)region.w * DISPLAY_DMA_STRIPE_ROWS <= bounce_pixels) {
+            pushDma(region);
+        } else {
+            region.sprite->pushSprite(region.x, region.y);
+        }
+        region.dirty = false;
+        pixels += (size_t)region.w * region.h;
+    }
+    if (writing) {
+        if (dma_ready) tft->dmaWait(); // CS must stay low until the last stripe is out
+        tft->endWrite();
+    }
+    return pixels;
+}
+
+void RegionRenderer::pushDma(DisplayRegion& region) {
+    uint16_t* pixels = (uint16_t*)region.sprite->getPointer();
+    bool swap = tft->getSwapBytes();
+    tft->setSwapBytes(false); // Sprites already hold the panel's byte order
+    for (int16_t row = 0; row < region.h; row += DISPLAY_DMA_STRIPE_ROWS) {
+        int16_t rows = (region.h - row < DISPLAY_DMA_STRIPE_ROWS) ? region.h - row : DISPLAY_DMA_STRIPE_ROWS;
+        // pushImageDMA() copies into the buffer before waiting for the
+        // transfer in flight, so alternate between the two.
+        tft->pushImageDMA(region.x, region.y + row, region.w, rows,
+                          pixels + (size_t)row * region.w, bounce[next_bounce]);
+        next_bounce ^= 1;
+    }
+    tft->setSwapBytes(swap);
+}
@@ -0,0 +1,68 @@
+#ifndef DISPLAYREGION_H
+#define DISPLAYREGION_H
+
+#include <Arduino.h>
+#include <TFT_eSPI.h>
+
+#define DISPLAY_DMA_STRIPE_ROWS 10      // Rows per DMA transfer (two bounce buffers of width x rows)
+
+// --- Screen region with its own back buffer ---
+// A 16-bit sprite (PSRAM) covering one rectangle of the status screen.
+// Draw into canvas() at region-local coordinates, then markDirty();
+// RegionRenderer::flush() sends it to the panel in one piece, so the
+// screen never shows a half-cleared area.
+class DisplayRegion {
+public:
+    ~DisplayRegion() { end(); }
+
+    // Allocates the sprite and fills it with 'background'. Must run before
+    // RegionRenderer::begin(): TFT_eSprite stops using PSRAM once DMA is on.
+    bool begin(TFT_eSPI& tft, int16_t x, int16_t y, int16_t w, int16_t h, uint16_t background);
+    void end();
+
+    bool ready() const { return sprite != nullptr; }
+    TFT_eSprite& canvas() { return *sprite; }
+    // Fills the sprite with the background and returns it.
+    TFT_eSprite& clear();
+
+    void markDirty() { dirty = true; }
+    bool isDirty() const { return dirty; }
+
+    int16_t x = 0, y = 0, w = 0, h = 0;
+
+private:
+    friend class RegionRenderer;
+
+    TFT_eSprite* sprite = nullptr;
+    uint16_t background = TFT_BLACK;
+    bool dirty = false;
+};
+
+// --- Dirty-region flusher ---
+// Pushes the regions that changed since the last flush and nothing else.
+// Uses DMA when the driver supports it: each region goes out in stripes
+// through two small internal-RAM bounce buffers (DMA can't read PSRAM),
+// copying the next stripe while the previous one is on the wire.
+class RegionRenderer {
+public:
+    ~RegionRenderer() { end(); }
+
+    // Allocates the bounce buffers for regions up to 'max_width' pixels
+    // wide and enables DMA. Without DMA, flush() falls back to pushSprite().
+    bool begin(TFT_eSPI& tft, int16_t max_width);
+    void end();
+
+    // Returns the number of pixels sent.
+    size_t flush(DisplayRegion* regions, size_t count);
+
+private:
+    void pushDma(DisplayRegion& region);
+
+    TFT_eSPI* tft = nullptr;
+    uint16_t* bounce[2] = { nullptr, nullptr };
+    size_t bounce_pixels = 0;
+    uint8_t next_bounce = 0;
+    bool dma_ready = false;
+};
+
+#endif // DISPLAYREGION_H
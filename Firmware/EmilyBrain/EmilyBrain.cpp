@@ -1,2883 +1,3791 @@
-#include "EmilyBrain.h"
-#include <ArduinoJson.h>
-
-// --- Descriptions for Self-Awareness Report (v5.0) ---
-const char* DESC_CORE =
-    "I am a robot entity. My core logic runs on a unified processor named 'EmilyBrain'. "
-    "This provides me with the basic abilities to hear, speak, and be activated by a physical button.\n";
-
-// DESC_OS removed (Component no longer exists as separate entity)
-
-// --- CAMCANVAS DESCRIPTION ---
-const char* DESC_CAMCANVAS =
-    "- A 'CamCanvas' (CC) unit: A module equipped with a high-resolution camera (for vision), "
-    "a visual display (for generating images), and a pan/tilt mechanism for head movement.\n";
-
-// --- INPUTPAD DESCRIPTION ---
-const char* DESC_INPUTPAD =
-    "- An 'InputPad' (IP): A separate, wireless handheld device with a screen and 3 buttons (A, B, C) "
-    "used for specific game inputs or choices, like rolling dice or answering quizzes.\n";
-
-// Constructor. Called when the 'emily' object is instantiated.
-EmilyBrain::EmilyBrain() : status_led(1, PIN_NEOPIXEL, NEO_GRB + NEO_KHZ800), display() {
-    // The constructor body can remain empty
-}
-
-void EmilyBrain::setup() {
-    Serial.begin(115200);
-    while (!Serial);
-    Serial.println("EmilyBrain Dual-Bus Startup... (Final Boot Sequence)");
-    pinMode(PIN_WAKE_BUTTON, INPUT_PULLUP);
-    Serial.println("Wake button pin configured.");
-
-    // --- Step 1: Initialize Non-Conflicting Hardware ---
-    status_led.begin();
-    status_led.setPixelColor(0, 0, 10, 0); // Green
-    status_led.show();
-
-    Serial.println("Initializing SD Card on FSPI...");
-    spiSD = new SPIClass(FSPI);
-    spiSD->begin(PIN_SD_SCLK, PIN_SD_MISO, PIN_SD_MOSI);
-    if (!SD.begin(PIN_SD_CS, *spiSD)) {
-        Serial.println("!!! SD Card Mount FAILED!");
-        // We cannot proceed without SD card
-        while(true) { delay(1000); } 
-    }
-    Serial.println("SD Card OK.");
-    
-    // Load configurations (essential for tools, system prompts, etc.)
-    loadConfigurations();
-
-    // --- Step 2: Wi-Fi & Display Setup Wizard ---
-    // This function handles ALL Wi-Fi AND Display initialization.
-    setupWiFi(); 
-
-    // --- Step 3: Start Remaining Services ---
-    // UDP and PTMS server are started inside setupWiFi() 
-    // at the correct moment (either in AP mode or STA mode).
-    
-    Serial.println("Setup complete. Starting main loop.");
-    last_display_text = "System Ready.";
-    prev_display_text = "";
-    // renderDisplay() is already called within setupWiFi()
-
-    // (If WiFi is NOT connected, the display shows AP instructions)
-    last_display_text = "System Ready."; // Update default text
-    prev_display_text = "";
-}   
-    
-const char* EmilyBrain::stateToString(EmilyState state) {
-    switch (state) {
-        case EmilyState::IDLE:                    return "Idle";
-        case EmilyState::AWAITING_SPEECH:         return "Waiting for Speech";
-        case EmilyState::RECORDING_SPEECH:        return "Recording...";
-        case EmilyState::PROCESSING_STT:          return "Transcribing...";
-        case EmilyState::PROCESSING_AI:           return "Thinking...";
-        case EmilyState::GENERATING_SPEECH:       return "Preparing Speech...";
-        case EmilyState::SPEAKING:                return "Speaking...";
-        
-        // Renamed from "Acting (OS)" to generic Hardware Action
-        case EmilyState::EXECUTING_PHYSICAL_TOOL: return "Hardware Action..."; 
-        
-        // Simplified texts (removed CamCanvas references for cleaner UI)
-        case EmilyState::SEEING:                  return "Analyzing Vision...";
-        case EmilyState::VISUALIZING:             return "Generating Image...";
-        
-        case EmilyState::PLAYING_SOUND:           return "Playing Sound...";
-        
-        case EmilyState::AWAITING_INPUT:          return "Awaiting Input...";
-        case EmilyState::PROCESSING_GAMEDATA:     return "Finding Data...";
-        default:                                  return "Unknown";
-    }
-}
-
-void EmilyBrain::setState(EmilyState newState) {
-    if (newState == currentState) {
-        return; // No change needed
-    }
-
-    currentState = newState;
-    const char* stateName = stateToString(currentState);
-    // Serial.printf("STATE CHANGE -> %s\n", stateName); // Optional: Uncomment for debug
-
-    // Update LED color based on the new state
-    uint32_t color = status_led.Color(10, 5, 0); // Default Orange for unknown
-
-    switch (currentState) {
-        case EmilyState::IDLE:
-            color = status_led.Color(0, 10, 0); // Green
-            break;
-        case EmilyState::AWAITING_SPEECH:
-        case EmilyState::RECORDING_SPEECH:
-            color = status_led.Color(15, 0, 0); // Red
-            break;
-        case EmilyState::PROCESSING_STT:
-        case EmilyState::PROCESSING_AI:
-            color = status_led.Color(0, 0, 15); // Blue
-            break;
-        case EmilyState::GENERATING_SPEECH:
-        case EmilyState::SPEAKING:
-            color = status_led.Color(0, 15, 15); // Cyan
-            break;
-        case EmilyState::EXECUTING_PHYSICAL_TOOL:
-        case EmilyState::SEEING:
-        case EmilyState::VISUALIZING:
-            color = status_led.Color(15, 0, 15); // Magenta
-            break;
-        // InputPad uses Magenta/Purple as well for now, or define new color
-        case EmilyState::AWAITING_INPUT:
-        case EmilyState::PROCESSING_GAMEDATA:
-             color = status_led.Color(15, 0, 15); // Magenta
-             break;
-    }
-    status_led.setPixelColor(0, color);
-    status_led.show();
-    renderDisplay();
-}
-
-// Function to set up web server
-void EmilyBrain::setupWebServer() {
-    // Set 'normal' PTMS-handlers
-    ptms_server.on("/upload", HTTP_POST, [this](){ this->handleFileUpload(); });
-    ptms_server.on("/delete-history", HTTP_GET, [this](){ this->handleHistoryDelete(); });
-    ptms_server.on("/download", HTTP_GET, [this](){ this->handleFileDownload(); });
-
-    // ---WEB REMOTE ---
-    ptms_server.on("/remote", HTTP_GET, [this](){ this->handleRemotePage(); });
-    ptms_server.on("/send", HTTP_POST, [this](){ this->handleRemoteInput(); }); // Use POST for form data
-    
-    // Use GET for simple click-actions
-    ptms_server.on("/force-idle", HTTP_GET, [this](){ this->handleForceIdle(); });
-    ptms_server.on("/center-head", HTTP_GET, [this](){ this->handleCenterHead(); });
-    ptms_server.on("/force-reboot", HTTP_GET, [this](){ this->handleForceReboot(); });
-    
-    // Add a simple 'not found' or 'root' handler for 'normal' mode
-    ptms_server.on("/", HTTP_GET, [this](){
-        ptms_server.send(200, "text/plain", "EmilyBrain PTMS Server is online.");
-    });
-    ptms_server.onNotFound([this](){
-         ptms_server.send(404, "text/plain", "Not Found.");
-    });
-    
-    ptms_server.begin(); // 
-}
-
-void EmilyBrain::handleFileUpload() {
-    if (!ptms_server.hasArg("file") || !ptms_server.hasArg("plain")) {
-        ptms_server.send(400, "text/plain", "400: BAD REQUEST");
-        return;
-    }
-
-    String filename = ptms_server.arg("file");
-    String content = ptms_server.arg("plain");
-    Serial.printf("File upload request received for: %s\n", filename.c_str());
-
-    // Pah shall begin with '/' for the SD-card
-    if (!filename.startsWith("/")) {
-        filename = "/" + filename;
-    }
-
-    File file = SD.open(filename, FILE_WRITE);
-    if (file) {
-        file.print(content);
-        file.close();
-        Serial.println("File successfully saved to SD card.");
-        ptms_server.send(200, "text/plain", "SUCCESS: File saved.");
-        
-        // IMPORTANT: Reload the configurations after a succesful upload
-        loadConfigurations(); 
-    } else {
-        Serial.println("ERROR: Could not open file on SD card for writing.");
-        ptms_server.send(500, "text/plain", "500: SERVER ERROR - Could not save file.");
-    }
-}
-/**
-    * @brief Handler for downloading a file from the SD card.
-    */
-void EmilyBrain::handleFileDownload() {
-    // Get filename from URL-parameter (bv. /download?file=/system_prompt.txt)
-    if (!ptms_server.hasArg("file")) {
-        ptms_server.send(400, "text/plain", "400: BAD REQUEST - 'file' parameter is missing.");
-        return;
-    }
-
-    String path = ptms_server.arg("file");
-    Serial.printf("File download request received for: %s\n", path.c_str());
-
-    if (!path.startsWith("/")) {
-        path = "/" + path;
-    }
-
-    if (SD.exists(path)) {
-        File file = SD.open(path, FILE_READ);
-        String contentType = "text/plain"; // Standard content type
-        if (path.endsWith(".json") || path.endsWith(".jsonl")) {
-            contentType = "application/json";
-        }
-        
-        // Stream the file directly to the client. This is very memory efficient.
-        ptms_server.streamFile(file, contentType);
-        file.close();
-        Serial.println("File successfully streamed to client.");
-    } else {
-        Serial.println("ERROR: Requested file does not exist.");
-        ptms_server.send(404, "text/plain", "404: NOT FOUND - File does not exist.");
-    }
-}
-/**
-* @brief Handler for deleting the chat history file.
-*/
-void EmilyBrain::handleHistoryDelete() {
-    Serial.println("Received request to delete chat history...");
-    if (SD.remove("/chat_history.jsonl")) {
-        Serial.println("File /chat_history.jsonl deleted successfully.");
-        ptms_server.send(200, "text/plain", "SUCCESS: Chat history has been deleted.");
-    } else {
-        Serial.println("ERROR: Failed to delete chat history file.");
-        ptms_server.send(500, "text/plain", "ERROR: Failed to delete file. It might not exist.");
-    }
-}
-
-bool EmilyBrain::checkWakeButton() {
-    bool button_pressed_event = false; // Vlag om een nieuwe druk te signaleren
-    int reading = digitalRead(PIN_WAKE_BUTTON);
-
-    // Als de fysieke staat is veranderd, reset de debounce timer
-    if (reading != last_button_state) {
-        last_debounce_time = millis();
-    }
-
-    // Als de staat stabiel is voor langer dan de delay
-    if ((millis() - last_debounce_time) > DEBOUNCE_DELAY_MS) {
-        // En als deze stabiele staat anders is dan de vorige stabiele staat
-        if (reading != debounced_state) {
-            debounced_state = reading;
-            // Als de nieuwe stabiele staat LOW is (knop ingedrukt)
-            if (debounced_state == LOW) {
-                Serial.println("Wake Button Ingedrukt!"); // Debug output
-                button_pressed_event = true; // Signaleer de nieuwe druk
-            }
-        }
-    }
-
-    // Onthoud de fysieke staat voor de volgende keer
-    last_button_state = reading;
-
-    return button_pressed_event; // Geef terug of er een schone druk was
-}
-
-void EmilyBrain::processAiProxyRequest(const char* current_prompt_content, JsonObject device_status) {
-    // Note: State is already set to PROCESSING_AI by _start_ai_cycle
-
-    Serial.println("Starting AI Proxy Request (StaticJsonDocument in PSRAM)...");
-
-    // --- Step 1: Allocate PSRAM Buffer ---
-    Serial.printf("DEBUG: Allocating %u byte buffer in PSRAM...\n", JSON_DOC_CAPACITY);
-    byte* json_psram_buffer = (byte*)heap_caps_malloc(JSON_DOC_CAPACITY, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-
-    if (json_psram_buffer == nullptr) {
-        Serial.println("FATAL: Failed to allocate PSRAM buffer!");
-        setState(EmilyState::IDLE);
-        return;
-    }
-    Serial.println("DEBUG: PSRAM buffer allocated.");
-
-
-    // --- Step 2: Construct StaticJsonDocument in the buffer ---
-    // Use placement new to construct the object AT the buffer address
-    StaticJsonDocument<JSON_DOC_CAPACITY>* doc_ptr = new (json_psram_buffer) StaticJsonDocument<JSON_DOC_CAPACITY>();
-    Serial.println("DEBUG: StaticJsonDocument constructed in buffer.");
-
-
-    // --- Step 3: Build the payload INTO the document ---  
-    // Serial.println("DEBUG: Calling buildAiPayload...");
-    // Serial.println("DEBUG: Calling buildAiPayload (SD test version)...");
-    // Pass the actual document object (*doc_ptr) by reference
-    buildAiPayload(*doc_ptr, current_prompt_content, device_status);
-    // Serial.println("DEBUG: buildAiPayload finished.");
-
-    // Check if buildAiPayload caused an overflow
-    if (doc_ptr->overflowed()) {
-        Serial.println("ERROR: JSON Document overflowed during build!");
-        // --- Cleanup on error ---
-        doc_ptr->~StaticJsonDocument(); // Explicitly call destructor
-        heap_caps_free(json_psram_buffer); // Free the buffer
-        // --- End Cleanup ---
-        setState(EmilyState::IDLE);
-        return;
-    }
-
-
-
-    // --- Step 4: Allocate buffer for string and serialize ---
-    Serial.println("DEBUG: Measuring final JSON...");
-    size_t len = measureJson(*doc_ptr); // Use *doc_ptr
-    Serial.printf("Calculated payload string size: %u bytes\n", len);
-    char *payload_buffer = (char *) malloc(len + 1); // Allocate from default heap (should be smaller)
-    if (!payload_buffer) {
-        Serial.println("FATAL: Malloc failed for payload STRING buffer!");
-         // --- Cleanup on error ---
-        doc_ptr->~StaticJsonDocument(); // Explicitly call destructor
-        heap_caps_free(json_psram_buffer); // Free the buffer
-        // --- End Cleanup ---
-        setState(EmilyState::IDLE);
-        return;
-    }
-    Serial.println("DEBUG: String buffer allocated. Serializing JSON...");
-    serializeJson(*doc_ptr, payload_buffer, len + 1); // Use *doc_ptr
-    Serial.println("DEBUG: JSON Serialized to string buffer.");
-
-
-    // Step 5: Make the HTTPS POST request
-    String response_body = ""; // To store the result
-    WiFiClientSecure client;
-    HTTPClient http;
-    client.setInsecure(); // Allow connection without checking certificate (easier for ESP32)
-
-    Serial.println("Connecting to Venice API...");
-    if (http.begin(client, VENICE_API_URL)) {
-        http.addHeader("Authorization", "Bearer " + String(VENICE_API_KEY));
-        http.addHeader("Content-Type", "application/json");
-        http.setTimeout(90000); // Increased timeout (90 seconds) for AI
-
-        Serial.println("Sending POST request...");
-        int httpResponseCode = http.POST((uint8_t*)payload_buffer, len);
-
-        // --- Free the buffer ASAP ---
-        free(payload_buffer);
-        payload_buffer = nullptr; // Good practice
-
-        if (httpResponseCode == HTTP_CODE_OK) {
-            response_body = http.getString();
-            Serial.println("API response OK.");
-            // --- Optional Debug: Print raw response ---
-            // Serial.println("\n--- RAW API RESPONSE ---");
-            // Serial.println(response_body);
-            // Serial.println("------------------------\n");
-        } else {
-            Serial.printf("[HTTP] POST failed, error: %d\n", httpResponseCode);
-            response_body = http.getString(); // Get error message from server
-            Serial.println("Error payload: " + response_body);
-            // Create a JSON error message for the planner
-            response_body = "{\"error\":\"API call failed\", \"code\": " + String(httpResponseCode) + "}";
-        }
-        http.end();
-    } else {
-         Serial.println("Failed to connect to API URL!");
-         if (payload_buffer) free(payload_buffer); // Ensure buffer is freed on connection error
-         response_body = "{\"error\":\"Connection failed\"}";
-    }
-
-
-    // --- Step 6: CRUCIAL Cleanup ---
-    Serial.println("DEBUG: Cleaning up JSON document and buffers...");
-    // free(payload_buffer); // Free the string buffer from default heap
-    if (doc_ptr != nullptr) {
-        doc_ptr->~StaticJsonDocument<JSON_DOC_CAPACITY>(); // Explicitly call destructor for placement new object
-    }
-    if (json_psram_buffer != nullptr) {
-        heap_caps_free(json_psram_buffer); // Free the main PSRAM buffer
-    }
-    Serial.println("DEBUG: Cleanup complete.");
-    // --- End Cleanup ---
-
-
-
-    // --- Step 7: Parse response and call Planner (Identical to before) ---
-    Serial.println("Parsing API response...");
-
-
-    DynamicJsonDocument response_doc(4096); // Adjust size based on expected response complexity
-    DeserializationError error = deserializeJson(response_doc, response_body);
-
-    if (error) {
-        Serial.printf("Failed to parse API response JSON: %s\n", error.c_str());
-        // Handle error - maybe try again or inform user via TTS?
-        // For now, just go back to IDLE
-        setState(EmilyState::IDLE);
-    } else {
-        // Extract the tool calls array (handle potential errors/missing keys)
-        JsonArray tool_calls;
-        if (response_doc.containsKey("choices") &&
-            response_doc["choices"][0].containsKey("message") &&
-            response_doc["choices"][0]["message"].containsKey("tool_calls")) {
-            tool_calls = response_doc["choices"][0]["message"]["tool_calls"].as<JsonArray>();
-        }
-
-        // Check if tool_calls is valid before calling the planner
-        if (!tool_calls.isNull() && tool_calls.size() > 0) {
-            Serial.println("Tool calls received, calling planner...");
-            // We pass the original user prompt (as string?) and the tool_calls array
-            // NOTE: PB passed the user_prompt JSON object. We might need to adjust _handle_ai_response
-            // For now, let's pass nullptr for the user_prompt part.
-             _handle_ai_response(nullptr, tool_calls); // Call the planner!
-        } else {
-             Serial.println("API response received, but no tool calls found or format is unexpected.");
-             // Handle situation where AI didn't return a tool call
-             // Maybe call planner with a message like "AI did not provide an action"?
-             setState(EmilyState::IDLE); // Go back to IDLE for now
-        }
-    }
-    // State transition happens inside _handle_ai_response or if an error occurred.
-    // setState(EmilyState::IDLE); // for testing
-}
-
-// --- Helper Function to Add Task ---
-void EmilyBrain::addTask(const String& type, JsonVariantConst args_variant) {
-    Task new_task;
-    new_task.type = type;
-    new_task.args = args_variant; // Copy the arguments
-    task_queue.push_back(new_task);
-    Serial.printf("Task added: %s\n", type.c_str()); // Optional confirmation
-}
-
-// --- The Planner ---
-void EmilyBrain::_handle_ai_response(const char* user_prompt_json_str, JsonArray tool_calls) {
-    Serial.println("Planner (_handle_ai_response) called!");
-
-    if (tool_calls.isNull() || tool_calls.size() == 0) {
-        Serial.println("Planner Warning: Received empty or null tool_calls array.");
-        _start_ai_cycle("My cognitive core returned no specific action. What should I do?"); // Ask again
-        return;
-    }
-
-    // --- Log the AI response ---
-    StaticJsonDocument<1024> log_doc; 
-    log_doc["role"] = "assistant";
-    JsonArray log_tool_calls = log_doc.createNestedArray("tool_calls");
-    for(JsonObject tc : tool_calls) {
-        log_tool_calls.add(tc);
-    }
-    logInteractionToSd(log_doc.as<JsonObject>()); 
-
-    // --- Process the FIRST tool call ---
-    JsonObject tool_call = tool_calls[0].as<JsonObject>();
-    if (tool_call.isNull()) {
-         Serial.println("Planner Error: First tool call is invalid JSON.");
-         setState(EmilyState::IDLE); 
-         return;
-    }
-
-    active_tool_call_id = tool_call["id"] | ""; 
-    JsonObject function_call = tool_call["function"].as<JsonObject>();
-    active_tool_call_name = function_call["name"] | "unknown_tool"; 
-
-    Serial.printf("Planner: Processing tool '%s' (ID: %s)\n", active_tool_call_name.c_str(), active_tool_call_id.c_str());
-
-    // --- Parse ALLE Argumenten EENMALIG ---
-    StaticJsonDocument<1024> all_args_doc; 
-    DeserializationError error = deserializeJson(all_args_doc, function_call["arguments"].as<const char*>());
-
-    if (error) {
-        Serial.printf("Planner Error: Failed to parse arguments for tool '%s': %s\n", active_tool_call_name.c_str(), error.c_str());
-        logInteractionToSd_Error("tool", active_tool_call_id, active_tool_call_name, "ERROR: Invalid arguments received: " + String(error.c_str()));
-        setState(EmilyState::IDLE);
-        return;
-    }
-    JsonObject all_args = all_args_doc.as<JsonObject>(); 
-    
-    // --- Clear previous queue ---
-    task_queue.clear();
-
-    // --- REVISED Planning Logic met Argument Filtering ---
-    bool main_task_planned = false;
-    
-    // === Stap 0: Plan OPTIONELE SFEERVERLICHTING ===
-    if (all_args.containsKey("led_effect")) {
-        StaticJsonDocument<256> led_args_doc;
-        led_args_doc["command"] = "set_status_led"; 
-        led_args_doc["effect"] = all_args["led_effect"];
-        led_args_doc["r"] = all_args["led_r"] | 0; 
-        led_args_doc["g"] = all_args["led_g"] | 0;
-        led_args_doc["b"] = all_args["led_b"] | 0;
-        led_args_doc["speed"] = all_args["led_speed"] | 1000; 
-        
-        addTask("CAMCANVAS_SET_LED", led_args_doc); 
-    }
-
-    // === Step 1: Plan OPTIONAL Background Image FIRST ===
-    // JSON Key changed from 'begeleidende_afbeelding_prompt' to 'visual_prompt'
-    if (all_args.containsKey("visual_prompt")) {
-        StaticJsonDocument<1024> image_args_doc;
-        image_args_doc["prompt"] = all_args["visual_prompt"];
-        image_args_doc["image_model"] = all_args["image_model"] | "venice-sd35"; 
-        addTask("CANVAS_IMAGE_ASYNC", image_args_doc); 
-        Serial.println("Planner: Added ASYNC image task first.");
-    }
-    
-    // === Step 2: Plan the MAIN Action ===
-
-    // 1. Emotion: update_emotional_state
-    if (!main_task_planned && active_tool_call_name == "update_emotional_state") {
-        addTask("PB_EMOTION", all_args_doc); 
-        if (all_args.containsKey("sound_effect")) {
-            StaticJsonDocument<128> sound_args_doc;
-            sound_args_doc["sound_effect"] = all_args["sound_effect"];
-            addTask("CB_SOUND_EMOTION", sound_args_doc); 
-        }
-        main_task_planned = true;
-    }
-    // 2. Vision: analyze_visual_environment
-    else if (!main_task_planned && active_tool_call_name == "analyze_visual_environment") {
-        // (Old 'hoek' logic removed as requested)
-        StaticJsonDocument<512> analyze_args_doc;
-        analyze_args_doc["question"] = all_args["question"] | "Describe what you see.";
-        analyze_args_doc["use_flash"] = all_args["use_flash"] | false;
-        addTask("CAM_ANALYZE", analyze_args_doc); 
-        main_task_planned = true;
-    }
-
-    // 3. Speech: announce_message OR start_conversation
-    
-    else if (!main_task_planned && (active_tool_call_name == "announce_message" || active_tool_call_name == "start_conversation")) {
-        StaticJsonDocument<1024> speak_args_doc; 
-        
-        // Map English keys to Internal keys
-        if (all_args.containsKey("announcement")) speak_args_doc["announcement"] = all_args["announcement"];
-        else if (all_args.containsKey("question")) speak_args_doc["question"] = all_args["question"];
-        
-        addTask("CB_SPEAK", speak_args_doc);
-        main_task_planned = true;
-    }
-
-    // 4. Movement: move_head
-    
-    else if (!main_task_planned && active_tool_call_name == "move_head") {
-        StaticJsonDocument<128> head_args_doc;
-        head_args_doc["pan"] = all_args["pan"] | 90; 
-        head_args_doc["tilt"] = all_args["tilt"] | 90; 
-        addTask("CAMCANVAS_MOVE_HEAD", head_args_doc);
-        main_task_planned = true;
-    }
-
-    // 5. Image: generate_image
-    
-    else if (!main_task_planned && active_tool_call_name == "generate_image") {
-        StaticJsonDocument<1024> gen_img_args_doc;
-        gen_img_args_doc["prompt"] = all_args["prompt"];
-        gen_img_args_doc["image_model"] = all_args["image_model"];
-        addTask("CANVAS_IMAGE_SYNC", gen_img_args_doc);
-        
-        if (all_args.containsKey("sound_effect")) {
-            StaticJsonDocument<128> sound_args;
-            sound_args["sound_path"] = all_args["sound_effect"];
-            addTask("CB_SOUND", sound_args); 
-        }
-        main_task_planned = true;
-    }
-    // 6. Sound: play_sound_effect
-    else if (!main_task_planned && active_tool_call_name == "play_sound_effect") {
-        StaticJsonDocument<128> sound_args_doc;
-        sound_args_doc["sound_path"] = all_args["sound_path"];
-        addTask("CB_SOUND", sound_args_doc);
-        main_task_planned = true;
-    }
-    // 7. Nod: nod_head
-    else if (!main_task_planned && active_tool_call_name == "nod_head") {
-        StaticJsonDocument<128> knod_args_doc;
-        knod_args_doc["angle"] = all_args["angle"];
-        addTask("CAM_NOD", knod_args_doc);
-        main_task_planned = true;
-    }
-    // 8. Photo: take_photo
-    else if (!main_task_planned && active_tool_call_name == "take_photo") {
-        StaticJsonDocument<1> photo_args_doc; 
-        addTask("CAM_TAKE_PICTURE", photo_args_doc);
-        main_task_planned = true;
-    }
-
-    // 9. InputPad: activate_inputpad
-    
-    else if (!main_task_planned && active_tool_call_name == "activate_inputpad") {
-        StaticJsonDocument<256> input_args_doc;
-        input_args_doc["mode"] = all_args["mode"];
-        input_args_doc["max_value"] = all_args["max_value"]; // English key
-        addTask("INPUTPAD_SET_MODE", input_args_doc);
-        main_task_planned = true;
-    }
-
-    // 10. CMS Data: retrieve_local_data
-    
-    else if (!main_task_planned && active_tool_call_name == "retrieve_local_data") {
-        StaticJsonDocument<256> data_args_doc;
-        data_args_doc["key"] = all_args["key"]; // English key
-        addTask("EB_GET_LOCAL_DATA", data_args_doc);
-        main_task_planned = true;
-    }
-
-    // === Step 3: Handle Unknown Tool or Start Execution ===
-
-    if (task_queue.empty()) {
-        Serial.printf("Planner Error: Unknown tool '%s' requested by AI.\n", active_tool_call_name.c_str());
-        logInteractionToSd_Error("tool", active_tool_call_id, active_tool_call_name, "ERROR: Tool does not exist.");
-        String error_message = "My cognitive core requested a tool '" + active_tool_call_name + "' which I do not have.";
-        _start_ai_cycle(error_message.c_str()); 
-        return; 
-    }
-
-    Serial.printf("Planner: Added %d task(s) to the queue. Starting execution...\n", task_queue.size());
-    _continue_task(); 
-}
- 
-
-void EmilyBrain::playWavFromSd(const char* filename) {
-    Serial.printf("Attempting to play audio file: %s\n", filename);
-
-
-    // --- Step 1: Parse Header ---
-    WavHeader header = parseWavHeader(filename);
-    if (header.sampleRate == 0 || header.bitsPerSample == 0 || header.channels == 0) {
-        Serial.println("Error: Invalid WAV header data. Cannot play.");
-        return; // Stop if header is invalid
-    }
-    // Basic validation (add more checks if needed)
-    if (header.channels != 1) {
-         Serial.println("Error: Only MONO (1 channel) WAV files are supported for playback.");
-         return;
-    }
-    if (header.bitsPerSample != 16) {
-         Serial.println("Error: Only 16-bit WAV files are supported for playback.");
-         return;
-    }
-
-  // --- Step 2: Open the file AGAIN for playback ---
-    File audioFile = SD.open(filename, FILE_READ);
-    if (!audioFile) {
-        Serial.printf("Error: Could not re-open file %s for playback\n", filename);
-        return;
-    }
-
-    // --- Add Memory Check before I2S initialization ---
-    // Serial.println(">>> DEBUG: playWavFromSd - Checking memory before I2S install...");
-    // Serial.printf(">>> DEBUG: Free Heap: %u, Free PSRAM: %u\n", ESP.getFreeHeap(), ESP.getFreePsram());
-    // --- End Memory Check ---
-
-  // --- Step 3: Configureer I2S Dynamisch ---
-    i2s_config_t i2s_config = {
-        .mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_TX),
-        // Use values from the header!
-        .sample_rate = header.sampleRate,
-        .bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT, // Assuming 16-bit based on check above
-        .channel_format = I2S_CHANNEL_FMT_ONLY_LEFT,  // Assuming Mono based on check above
-        .communication_format = I2S_COMM_FORMAT_STAND_I2S,
-        .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
-        .dma_buf_count = 8,
-        .dma_buf_len = 256, // Keep smaller buffer for now
-        .use_apll = true,   // Keep APLL enabled
-        .tx_desc_auto_clear = true
-    };
-
-  i2s_pin_config_t pin_config = {
-      .bck_io_num = PIN_I2S_BCK,
-      .ws_io_num = PIN_I2S_WS,
-      .data_out_num = PIN_I2S_DATA_OUT,
-      .data_in_num = I2S_PIN_NO_CHANGE // We ontvangen geen data
-  };
-
-  // --- Step 4: Install and start the driver -
-  
-    // --- Force Uninstall/Reinstall ---
-    Serial.println(">>> DEBUG: Force uninstalling I2S driver before playback...");
-    i2s_driver_uninstall(I2S_NUM_0);
-    delay(20);
-    Serial.println(">>> DEBUG: Installing I2S driver for playback...");
-
-    esp_err_t install_result = i2s_driver_install(I2S_NUM_0, &i2s_config, 0, NULL);
-     if (install_result != ESP_OK) {
-        Serial.printf("Error installing I2S driver: %d\n", install_result);
-        audioFile.close();
-        return;
-    }
-    esp_err_t pin_result = i2s_set_pin(I2S_NUM_0, &pin_config);
-     if (pin_result != ESP_OK) {
-        Serial.printf("Error setting I2S pins: %d\n", pin_result);
-        audioFile.close();
-        i2s_driver_uninstall(I2S_NUM_0);
-        return;
-    }
-    i2s_zero_dma_buffer(I2S_NUM_0);
-    delay(50); // Small delay after setup
-
-    // --- Step 5: Play the file ---
-    audioFile.seek(44); // Skip header NOW that I2S is configured
-
-    const size_t bufferSize = 2048; // Keep buffer size reasonable
-    uint8_t buffer[bufferSize];
-    size_t bytes_written = 0;
-    size_t total_bytes_read = 0; // Track total bytes read
-
-    Serial.println("Starting playback...");
-    while (audioFile.available()) {
-        int bytesRead = audioFile.read(buffer, bufferSize);
-        if (bytesRead <= 0) break;
-        total_bytes_read += bytesRead; // Add to total
-
-        // Write data to I2S
-        esp_err_t write_result = i2s_write(I2S_NUM_0, buffer, bytesRead, &bytes_written, portMAX_DELAY);
-        if (write_result != ESP_OK) {
-            Serial.printf("Error writing to I2S: %d\n", write_result);
-            break; // Stop playback on error
-        }
-        if (bytes_written != bytesRead) {
-             Serial.printf("Warning: I2S write underrun? Read %d, wrote %d\n", bytesRead, bytes_written);
-             // Continue playback? May cause glitches.
-        }
-    }
-     Serial.printf("Playback loop finished. Total bytes read from file: %u\n", total_bytes_read);
-
-    // --- Stap 6: Ruim netjes op ---
-    audioFile.close();
-    i2s_zero_dma_buffer(I2S_NUM_0); // Flush buffer with silence
-    delay(100); // Give buffer time to play silence
-    i2s_driver_uninstall(I2S_NUM_0);
-    
-    Serial.println("Playback finished. I2S driver uninstalled.");
-}
-
-// --- WAV Header Function (Helper for recording) ---
-void EmilyBrain::createWavHeader(byte* header, size_t total_data_size) {
-    const int sampleRate = 16000;
-    const int bitsPerSample = 16;
-    const int channels = 1;
-
-    long total_file_size = total_data_size + 36;
-    long byteRate = sampleRate * channels * bitsPerSample / 8;
-    int blockAlign = channels * bitsPerSample / 8;
-
-    memcpy(&header[0], "RIFF", 4);                                  // ChunkID
-    header[4] = (byte)(total_file_size & 0xFF);                     // ChunkSize
-    header[5] = (byte)((total_file_size >> 8) & 0xFF);
-    header[6] = (byte)((total_file_size >> 16) & 0xFF);
-    header[7] = (byte)((total_file_size >> 24) & 0xFF);
-    memcpy(&header[8], "WAVE", 4);                                  // Format
-    memcpy(&header[12], "fmt ", 4);                                 // Subchunk1ID
-    header[16] = 16;                                                // Subchunk1Size (16 for PCM)
-    header[17] = 0;
-    header[18] = 0;
-    header[19] = 0;
-    header[20] = 1;                                                 // AudioFormat (1 for PCM)
-    header[21] = 0;
-    header[22] = channels;                                          // NumChannels
-    header[23] = 0;
-    header[24] = (byte)(sampleRate & 0xFF);                         // SampleRate
-    header[25] = (byte)((sampleRate >> 8) & 0xFF);
-    header[26] = 0;
-    header[27] = 0;
-    header[28] = (byte)(byteRate & 0xFF);                           // ByteRate
-    header[29] = (byte)((byteRate >> 8) & 0xFF);
-    header[30] = (byte)((byteRate >> 16) & 0xFF);
-    header[31] = (byte)((byteRate >> 24) & 0xFF);
-    header[32] = blockAlign;                                        // BlockAlign
-    header[33] = 0;
-    header[34] = bitsPerSample;                                     // BitsPerSample
-    header[35] = 0;
-    memcpy(&header[36], "data", 4);                                 // Subchunk2ID
-    header[40] = (byte)(total_data_size & 0xFF);                    // Subchunk2Size
-    header[41] = (byte)((total_data_size >> 8) & 0xFF);
-    header[42] = (byte)((total_data_size >> 16) & 0xFF);
-    header[43] = (byte)((total_data_size >> 24) & 0xFF);
-
-
-}
-
-WavHeader EmilyBrain::parseWavHeader(const char* path) {
-    WavHeader header;
-    File file = SD.open(path);
-    if (!file) {
-        Serial.printf("parseWavHeader ERROR: Could not open file %s\n", path);
-        return header; // Return default (empty) header
-    }
-
-    if (file.size() < 44) {
-        Serial.printf("parseWavHeader ERROR: File %s is too small to be a valid WAV file.\n", path);
-        file.close();
-        return header; // Return default header
-    }
-
-    byte buffer[44];
-    file.read(buffer, 44);
-    file.close(); // Close file after reading header
-
-    // Bytes 22-23: Channels
-    header.channels = (buffer[23] << 8) | buffer[22];
-    // Bytes 24-27: Sample Rate
-    header.sampleRate = (buffer[27] << 24) | (buffer[26] << 16) | (buffer[25] << 8) | buffer[24];
-    // Bytes 34-35: Bits per Sample
-    header.bitsPerSample = (buffer[35] << 8) | buffer[34];
-
-    Serial.println("--- Parsed WAV Header ---");
-    Serial.printf("  Sample Rate: %d Hz\n", header.sampleRate);
-    Serial.printf("  Bits/Sample: %d\n", header.bitsPerSample);
-    Serial.printf("  Channels:    %d\n", header.channels);
-    Serial.println("-------------------------");
-
-    return header;
-}
-
-bool EmilyBrain::recordAudioToWav(const char* filename) {
-    Serial.println("Starting VAD Recording to WAV...");
-
-    // --- Step 1: Configure and install I2S driver for RX (Microphone) ---
-    i2s_config_t i2s_config = {
-        .mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_RX), // Set to RX mode
-        .sample_rate = 16000,                               // Standard for STT
-        .bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT,
-        .channel_format = I2S_CHANNEL_FMT_ONLY_LEFT,      // Mono mic
-        .communication_format = I2S_COMM_FORMAT_STAND_I2S,
-        .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
-        .dma_buf_count = 8,
-        .dma_buf_len = 256,
-        .use_apll = true // Use APLL for stable clock
-    };
-    i2s_pin_config_t pin_config = {
-        .bck_io_num = PIN_I2S_BCK,       // Pin 17
-        .ws_io_num = PIN_I2S_WS,        // Pin 18
-        .data_out_num = I2S_PIN_NO_CHANGE, // Not sending data
-        .data_in_num = PIN_I2S_DATA_IN   // *** CORRECT: Pin 19 (Mic SD) ***
-    };
-
-    // Uninstall previous driver (might be TX from speaker) before installing RX
-    i2s_driver_uninstall(I2S_NUM_0);
-    esp_err_t install_result = i2s_driver_install(I2S_NUM_0, &i2s_config, 0, NULL);
-    if (install_result != ESP_OK) { /* handle error */ return false; }
-    esp_err_t pin_result = i2s_set_pin(I2S_NUM_0, &pin_config);
-    if (pin_result != ESP_OK) { /* handle error */ i2s_driver_uninstall(I2S_NUM_0); return false; }
-    i2s_zero_dma_buffer(I2S_NUM_0); // Clear any old data
-    delay(50);
-
-    // --- Step 2: VAD Logic and Recording ---
-    File file = SD.open(filename, FILE_WRITE);
-    if (!file) { /* handle error */ i2s_driver_uninstall(I2S_NUM_0); return false; }
-
-    byte wav_header[44];
-    createWavHeader(wav_header, 0); // Write dummy header first
-    file.write(wav_header, 44);
-
-    const int record_buffer_size = 1024;
-    byte record_buffer[record_buffer_size];
-    size_t bytes_read;
-    long silence_started_at = 0;
-    bool speech_started = false; // Flag to indicate if speech has begun
-    size_t total_data_size = 0;
-    long recording_started_at = 0;
-    int quiet_buffers_in_a_row = 0; // For initial silence calibration
-
-    // --- Initial Silence Calibration (Wait for quiet before listening) ---
-    Serial.println("VAD: Waiting for initial silence...");
-    setState(EmilyState::AWAITING_SPEECH); // Update state
-    while (quiet_buffers_in_a_row < 10) { // ~0.5s of quiet
-        // Use a short timeout to prevent blocking forever if mic is noisy
-        esp_err_t read_result = i2s_read(I2S_NUM_0, record_buffer, record_buffer_size, &bytes_read, (100 / portTICK_PERIOD_MS));
-        if (read_result == ESP_OK && bytes_read > 0) {
-            long long total_amplitude = 0;
-            for (int i = 0; i < bytes_read; i += 2) {
-                total_amplitude += abs((int16_t)(record_buffer[i] | (record_buffer[i+1] << 8)));
-            }
-            int average_amplitude = (bytes_read > 0) ? (total_amplitude / (bytes_read / 2)) : 0;
-
-            if (average_amplitude < SILENCE_THRESHOLD) {
-                quiet_buffers_in_a_row++;
-            } else {
-                quiet_buffers_in_a_row = 0;
-            }
-        } else if (read_result == ESP_ERR_TIMEOUT) {
-             // Continue if timeout, maybe mic disconnected?
-             Serial.print("."); // Indicate waiting
-        } else {
-            Serial.printf("VAD Error during initial silence read: %d\n", read_result);
-             break; // Exit calibration on read error
-        }
-    }
-     if (quiet_buffers_in_a_row < 10) { // If calibration failed
-        Serial.println("VAD Error: Could not detect initial silence.");
-        file.close();
-        i2s_driver_uninstall(I2S_NUM_0);
-        return false;
-     }
-    Serial.println("VAD: Silence confirmed. Listening...");
-
-    // --- Main VAD Loop ---
-    recording_started_at = millis(); // Start max recording timer now
-    while (true) {
-        // Check for external stop command (e.g., interrupt button)
-        // We need a global flag for this, let's call it 'force_stop_listening_flag'
-        // if (force_stop_listening_flag) {
-        //     Serial.println("VAD: Recording stopped externally.");
-        //     force_stop_listening_flag = false; // Reset flag
-        //     break;
-        // }
-
-        // Check max recording duration
-        if (millis() - recording_started_at > MAX_RECORDING_MS) {
-            Serial.println("VAD: Max recording duration reached.");
-            break;
-        }
-
-        esp_err_t read_result = i2s_read(I2S_NUM_0, record_buffer, record_buffer_size, &bytes_read, (100 / portTICK_PERIOD_MS)); // Short timeout
-
-        if (read_result == ESP_OK && bytes_read > 0) {
-            long long total_amplitude = 0;
-            for (int i = 0; i < bytes_read; i += 2) {
-                total_amplitude += abs((int16_t)(record_buffer[i] | (record_buffer[i+1] << 8)));
-            }
-             int average_amplitude = (bytes_read > 0) ? (total_amplitude / (bytes_read / 2)) : 0;
-
-            // Start recording?
-            if (!speech_started && average_amplitude > SPEECH_START_THRESHOLD) {
-                speech_started = true;
-                setState(EmilyState::RECORDING_SPEECH); // Update state
-                Serial.println("VAD: Speech started, recording...");
-            }
-
-            // Record if speech detected
-            if (speech_started) {
-                file.write(record_buffer, bytes_read);
-                total_data_size += bytes_read;
-                Serial.print("+"); // Optional progress indicator
-
-                // Check for end of speech (silence)
-                if (average_amplitude < SILENCE_THRESHOLD) {
-                    if (silence_started_at == 0) { silence_started_at = millis(); }
-                    if (millis() - silence_started_at > SILENCE_DURATION_MS) {
-                        Serial.println("VAD: Silence detected, stopping recording.");
-                        break; // End recording loop
-                    }
-                } else {
-                    silence_started_at = 0; // Reset silence timer if sound detected
-                }
-            }
-        } else if (read_result == ESP_ERR_TIMEOUT) {
-            // Timeout reading - check if silence duration met while recording
-             if (speech_started && silence_started_at > 0 && (millis() - silence_started_at > SILENCE_DURATION_MS)) {
-                Serial.println("VAD: Silence detected (via timeout), stopping recording.");
-                break;
-             }
-             // Otherwise, just continue waiting if timeout occurred before speech started
-        } else {
-             Serial.printf("VAD Error during recording read: %d\n", read_result);
-             break; // Exit loop on read error
-        }
-    } // End of main VAD loop
-
-    // --- Step 3: Update header and clean up ---
-    if (total_data_size > 0) {
-        createWavHeader(wav_header, total_data_size);
-        file.seek(0);
-        file.write(wav_header, 44);
-        Serial.printf("VAD: Recording complete. %u bytes written.\n", total_data_size);
-    } else {
-        Serial.println("VAD: Recording complete, but no audio data captured.");
-        speech_started = false; // Ensure we return false if nothing was recorded
-    }
-    file.close();
-    i2s_driver_uninstall(I2S_NUM_0); // Uninstall RX driver
-    // --- NEW: Explicitly Detach Pins ---
-    
-    i2s_set_pin(I2S_NUM_0, NULL); // Detach pins from I2S peripheral
-    // --- END NEW ---
-    Serial.println(">>> DEBUG: Delaying after I2S RX cleanup (300ms)...");
-    delay(300); // Keep delay for now to be safe
-    return speech_started; // Return true only if speech was actually detected and recorded
-}
-
-// --- Need logInteractionToSd implementation (from CognitiveCore.ino) ---
-void EmilyBrain::logInteractionToSd(JsonObject log_data) {
-    File history_file = SD.open("/chat_history.jsonl", FILE_APPEND);
-    if (history_file) {
-        serializeJson(log_data, history_file);
-        history_file.println();
-        history_file.close();
-        // Serial.println("Interaction logged to SD."); // Optional debug
-    } else {
-        Serial.println("ERROR: Could not open chat_history.jsonl for logging.");
-    }
-}
-// --- Need a similar function for logging tool errors ---
-void EmilyBrain::logInteractionToSd_Error(const char* role, String tool_call_id, String tool_name, String content) {
-     StaticJsonDocument<512> log_doc;
-     log_doc["role"] = role;
-     log_doc["tool_call_id"] = tool_call_id;
-     log_doc["name"] = tool_name;
-     log_doc["content"] = content;
-     logInteractionToSd(log_doc.as<JsonObject>());
-}
-
-void EmilyBrain::transcribeAudioFromSd(const char* filename) {
-    File audioFile = SD.open(filename, FILE_READ);
-    if (!audioFile) {
-        processSttResponseAndTriggerAi("{\"error\":\"Could not read audio file.\"}");
-        return;
-    }
-    size_t file_size = audioFile.size();
-    if (file_size <= 44) {
-        audioFile.close();
-        processSttResponseAndTriggerAi("{\"error\":\"Audio file empty or invalid.\"}");
-        return;
-    }
-
-    Serial.printf("Starting STT streaming upload of %s (%d bytes)...\n", filename, file_size);
-    setState(EmilyState::PROCESSING_STT);
-
-    String boundary = "----EmilyBoundary" + String(random(0xFFFFF), HEX);
-    String host = "api.venice.ai";
-    String url = "/api/v1/audio/transcriptions";
-
-    // --- Build request parts ---
-    String prefix = "--" + boundary + "\r\n";
-    prefix += "Content-Disposition: form-data; name=\"model\"\r\n\r\nopenai/whisper-large-v3\r\n";
-    prefix += "--" + boundary + "\r\n";
-    prefix += "Content-Disposition: form-data; name=\"language\"\r\n\r\nen\r\n";
-    prefix += "--" + boundary + "\r\n";
-    prefix += "Content-Disposition: form-data; name=\"file\"; filename=\"stt_input.wav\"\r\n";
-    prefix += "Content-Type: audio/wav\r\n\r\n";
-    String suffix = "\r\n--" + boundary + "--\r\n";
-    size_t content_length = prefix.length() + file_size + suffix.length();
-
-    // --- Open network connection ---
-    WiFiClientSecure client;
-    client.setInsecure();
-    Serial.printf("Connecting to %s...\n", host.c_str());
-    if (!client.connect(host.c_str(), 443)) {
-        audioFile.close();
-        processSttResponseAndTriggerAi("{\"error\":\"Connection failed\"}");
-        return;
-    }
-    Serial.println("Connected to Venice STT.");
-
-    // --- Send HTTP Headers ---
-    client.println("POST " + url + " HTTP/1.1");
-    client.println("Host: " + host);
-    String authHeader = "Bearer " + String(VENICE_API_KEY);
-    client.println("Authorization: " + authHeader);
-    client.println("Content-Type: multipart/form-data; boundary=" + boundary);
-    client.println("Content-Length: " + String(content_length));
-    client.println("Connection: close");
-    client.println();
-
-    // --- Stream Body ---
-    client.print(prefix);
-    Serial.println("Streaming audio data...");
-    uint8_t buffer[1024];
-    size_t total_bytes_sent = 0;
-    while (audioFile.available()) {
-        size_t bytes_read = audioFile.read(buffer, sizeof(buffer));
-        size_t bytes_sent = client.write(buffer, bytes_read);
-        if (bytes_sent != bytes_read) {
-            Serial.println("!!! ERROR sending audio chunk!");
-            break;
-        }
-        total_bytes_sent += bytes_sent;
-    }
-    audioFile.close();
-    client.print(suffix);
-    Serial.printf("Streaming upload complete (%u bytes sent).\n", total_bytes_sent);
-
-    // --- Read Response ---
-    String response_full = "";
-    unsigned long timeout = millis();
-    while (client.connected() && millis() - timeout < 30000) {
-        if (client.available()) {
-            response_full += client.readString();
-            timeout = millis();
-        }
-        delay(10);
-    }
-    if (!client.connected() && response_full.length() == 0) {
-        Serial.println("!!! ERROR: Connection closed before response.");
-        processSttResponseAndTriggerAi("{\"error\":\"No response from server\"}");
-        client.stop();
-        return;
-    }
-    client.stop();
-
-    // --- Extract Body and Send Result ---
-    int body_start_index = response_full.indexOf("\r\n\r\n");
-    String response_body = "{\"error\":\"Invalid server response\"}";
-    if (body_start_index != -1) {
-        response_body = response_full.substring(body_start_index + 4);
-        response_body.trim();
-    }
-    processSttResponseAndTriggerAi(response_body);
-}
-
-
-
-// --- processSttResponseAndTriggerAi function (from CognitiveCore) ---
-void EmilyBrain::processSttResponseAndTriggerAi(const String& raw_api_payload) {
-    // ... (Implementation remains the same as in CognitiveCore, BUT sends result to AI cycle) ...
-
-    // --- ADJUSTMENT NEEDED (former sendSerialResult functie)---
-    // Instead of sending over SerialPB, if the result_type is "stt_transcript",
-    // we need to parse the transcript and call _start_ai_cycle with it.
-    // If it's an error, we might still call _start_ai_cycle with the error message.
-
-    Serial.println("processSttResponseAndTriggerAi (STT): Parsing transcript...");
-
-    StaticJsonDocument<512> data_doc; // Adjust size
-    DeserializationError error = deserializeJson(data_doc, raw_api_payload);
-    String transcript = "";
-    String error_msg = "";
-
-    if (!error && data_doc.containsKey("text")) {
-        transcript = data_doc["text"].as<String>();
-        Serial.printf("Transcript received: '%s'\n", transcript.c_str());
-    } else if (!error && data_doc.containsKey("error")) {
-        error_msg = data_doc["error"].as<String>();
-        Serial.printf("STT API Error received: '%s'\n", error_msg.c_str());
-    } else {
-        error_msg = "Failed to parse STT response or unknown format.";
-        Serial.println(error_msg);
-    }
-    
-    // --- Trigger AI Cycle with Result ---
-   if (!transcript.isEmpty()) {
-    // Combine the reason and the transcript into ONE string
-    
-    String trigger_string = "The user just said: " + transcript;
-    _start_ai_cycle(trigger_string.c_str()); // Pass ONE argument using .c_str()
-    } else {
-        // Combine the reason and the error into ONE string
-        // --- Optioneel: Log de STT error ook? ---
-        StaticJsonDocument<256> error_log_doc;
-        error_log_doc["role"] = "system"; // Of "internal"?
-        error_log_doc["content"] = "STT Error: " + error_msg;
-        logInteractionToSd(error_log_doc.as<JsonObject>());
-        // --- Einde optioneel ---
-        String trigger_string = "I tried listening but received no clear transcript. Error: " + error_msg;
-        _start_ai_cycle(trigger_string.c_str()); // Pass ONE argument using .c_str()
-    }
-    // Serial.println(">>> DEBUG: Returned from _start_ai_cycle (after STT).");
-    
-    // Note: State change happens inside _start_ai_cycle
-}
-
-void EmilyBrain::listenAndTranscribe() {
-    Serial.println("Starting listen_and_transcribe process...");
-    // State is already AWAITING_SPEECH or set by recordAudioToWav
-
-    const char* filename = "/stt_input.wav";
-
-    // Step 1: Record audio using VAD
-    bool recording_success = recordAudioToWav(filename);
-
-    // Step 2: If recording successful (speech detected), transcribe it
-    if (recording_success) {
-        transcribeAudioFromSd(filename); // This function will set state and call AI cycle
-    } else {
-        // No speech detected or recording failed
-        Serial.println("No speech detected or recording failed. Returning to IDLE.");
-        processSttResponseAndTriggerAi("{\"error\":\"No speech detected\"}"); // Inform AI cycle
-        // setState(EmilyState::IDLE); // processSttResponseAndTriggerAi now triggers AI cycle which sets state
-    }
-}
-
-// --- The Executor ---
-void EmilyBrain::_continue_task() {
-    
-    if (task_queue.empty()) {
-        Serial.println("Executor: Task queue empty. Mission complete.");
-        // Log SUCCESS result back to AI history
-        if (!active_tool_call_id.isEmpty()) {
-            logInteractionToSd_Error("tool", active_tool_call_id, active_tool_call_name, "SUCCESS: Action completed.");
-             active_tool_call_id = ""; // Clear after logging
-             active_tool_call_name = "";
-        }
-        setState(EmilyState::IDLE); // Return to idle
-        return;
-    }
-
-    Task& next_task = task_queue.front(); // Get reference to next task
-    Serial.printf("Executor: Starting task type '%s'\n", next_task.type.c_str());
-    // Print args for debugging
-    Serial.print("Executor: Args: ");
-    serializeJson(next_task.args, Serial);
-    Serial.println();
-
-    // --- Task Execution Logic ---
-    bool task_completed_immediately = false; // Flag for quick tasks
-
-    if (next_task.type == "PB_EMOTION") {
-        // Directly update internal emotional state
-        arousal = next_task.args["new_arousal"] | arousal; // Keep current if missing
-        valence = next_task.args["new_valence"] | valence; // Keep current if missing
-        Serial.printf("Executor: Emotion updated - Arousal=%.2f, Valence=%.2f\n", arousal, valence);
-
-        // Clear context if arousal drops below threshold (homeostasis)
-        if (arousal <= AROUSAL_THRESHOLD) {
-             if (current_arousal_context != nullptr) {
-                Serial.println("Executor: Homeostasis reached, clearing context.");
-                current_arousal_context = nullptr;
-             }
-        }
-        task_completed_immediately = true; // This task is instant
-    }
-    else if (next_task.type == "CB_SOUND" || next_task.type == "CB_SOUND_EMOTION") {
-        // Play a sound effect using state
-        Serial.println("Executor: Setting state to PLAYING_SOUND.");
-        setState(EmilyState::PLAYING_SOUND);
-    }
-
-    // --- CAMCANVAS_MOVE_HEAD (Vervangt oude OS_MOVE en Head moves) ---
-    else if (next_task.type == "CAMCANVAS_MOVE_HEAD") {
-        int pan_angle = next_task.args["pan"] | 90;
-        int tilt_angle = next_task.args["tilt"] | 90;
-
-        StaticJsonDocument<128> cmd_doc;
-        cmd_doc["command"] = "move_head"; 
-        cmd_doc["pan"] = pan_angle;
-        cmd_doc["tilt"] = tilt_angle;
-        String command_string;
-        serializeJson(cmd_doc, command_string);
-
-        Serial.printf("Executor: Sending CamCanvas command: %s\n", command_string.c_str());
-        udp.beginPacket(CAMCANVAS_IP_ADDRESS, CAMCANVAS_UDP_PORT);
-        udp.print(command_string);
-        udp.endPacket();
-
-        task_completed_immediately = true; // "Fire-and-forget"
-        Serial.println("Executor: move_head command sent to CamCanvas.");
-    }
-
-    // --- CB_SPEAK Task (Aangepast naar Engels) ---
-    else if (next_task.type == "CB_SPEAK") {
-        const char* text_to_speak = nullptr; 
-
-        // Check English keys
-        if (next_task.args.containsKey("announcement")) {
-            text_to_speak = next_task.args["announcement"];
-        } else if (next_task.args.containsKey("question")) {
-            text_to_speak = next_task.args["question"];
-        }
-        
-
-        if (text_to_speak != nullptr && strlen(text_to_speak) > 0) {
-             Serial.printf("Executor: Starting TTS for: '%s'\n", text_to_speak);
-            last_display_text = text_to_speak;
-             
-             // Check against English tool name
-             if (active_tool_call_name == "start_conversation") {
-                 next_state_after_audio = EmilyState::AWAITING_SPEECH; 
-                 Serial.println("Executor: Will transition to AWAITING_SPEECH after speaking.");
-             } else { 
-                 next_state_after_audio = EmilyState::IDLE;
-                 Serial.println("Executor: Will transition to IDLE after speaking.");
-             }
-
-             // Start the TTS process (will set state internally)
-             processTtsRequest(text_to_speak); 
-
-             // Set timer for TTS timeout monitoring
-             tts_task_start_time = millis();
-
-             // Task is NOT completed immediately, TTS takes time.
-        } else {
-             Serial.println("Executor Error: No text found for CB_SPEAK task.");
-             task_completed_immediately = true; // Skip this malformed task
-        }
-    }
-
-    // --- CAM_ANALYZE Task ---
-    else if (next_task.type == "CAM_ANALYZE") {
-        String question = next_task.args["question"] | "Describe what you see.";
-        bool use_flash_bool = next_task.args["use_flash"].as<bool>(); 
-        int use_flash_int = use_flash_bool ? 1 : 0;
-
-        StaticJsonDocument<256> cmd_doc; 
-        cmd_doc["command"] = "analyze_vision";
-        cmd_doc["prompt"] = question;
-        cmd_doc["use_flash"] = use_flash_int;
-        String command_string;
-        serializeJson(cmd_doc, command_string);
-
-        Serial.printf("Executor: Sending CAM command: %s\n", command_string.c_str());
-        udp.beginPacket(CAMCANVAS_IP_ADDRESS, CAMCANVAS_UDP_PORT);
-        udp.print(command_string);
-        udp.endPacket();
-
-        camcanvas_task_start_time = millis(); // Start timer
-        setState(EmilyState::SEEING); // Set waiting state
-    }
-
-    // --- CAM_NOD Task ---
-    else if (next_task.type == "CAM_NOD") {
-        int angle = next_task.args["angle"] | 90; 
-
-        StaticJsonDocument<128> cmd_doc;
-        cmd_doc["command"] = "nod_head"; 
-        cmd_doc["angle"] = angle;
-        String command_string;
-        serializeJson(cmd_doc, command_string);
-
-        Serial.printf("Executor: Sending CAMCANVAS command (Nod): %s\n", command_string.c_str());
-        udp.beginPacket(CAMCANVAS_IP_ADDRESS, CAMCANVAS_UDP_PORT); 
-        udp.print(command_string);
-        udp.endPacket();
-
-        task_completed_immediately = true; 
-        Serial.println("Executor: Nod command sent to CAMCANVAS.");
-    }
-
-    else if (next_task.type == "CAM_TAKE_PICTURE") {
-        StaticJsonDocument<64> cmd_doc;
-        cmd_doc["command"] = "take_picture"; 
-        String command_string;
-        serializeJson(cmd_doc, command_string);
-
-        Serial.println("Executor: Sending CAMCANVAS command: take_picture");
-        udp.beginPacket(CAMCANVAS_IP_ADDRESS, CAMCANVAS_UDP_PORT);
-        udp.print(command_string);
-        udp.endPacket();
-
-        task_completed_immediately = true; 
-    }
-
-    // --- CAMCANVAS_SET_LED Taak ---
-    else if (next_task.type == "CAMCANVAS_SET_LED") {
-        String command_string;
-        serializeJson(next_task.args, command_string); 
-
-        Serial.printf("Executor: Sending CamCanvas LED command: %s\n", command_string.c_str());
-        udp.beginPacket(CAMCANVAS_IP_ADDRESS, CAMCANVAS_UDP_PORT);
-        udp.print(command_string);
-        udp.endPacket();
-
-        task_completed_immediately = true; 
-    }
-     // --- CANVAS_IMAGE_SYNC Task (Blocking) ---
-    else if (next_task.type == "CANVAS_IMAGE_SYNC") {
-        String prompt = next_task.args["prompt"] | "a robot";
-        String model = next_task.args["image_model"] | "venice-sd35"; 
-
-        StaticJsonDocument<512> cmd_doc; 
-        cmd_doc["command"] = "generate_image";
-        cmd_doc["prompt"] = prompt;
-        cmd_doc["model"] = model;
-        String command_string;
-        serializeJson(cmd_doc, command_string);
-
-        Serial.printf("Executor: Sending CAMCANVAS command (SYNC): %s\n", command_string.c_str());
-        udp.beginPacket(CAMCANVAS_IP_ADDRESS, CAMCANVAS_UDP_PORT);
-        udp.print(command_string);
-        udp.endPacket();
-
-        camcanvas_task_start_time = millis(); 
-        setState(EmilyState::VISUALIZING); 
-    }
-
-     // --- CANVAS_IMAGE_ASYNC Task (Non-blocking) ---
-    else if (next_task.type == "CANVAS_IMAGE_ASYNC") {
-        String prompt = next_task.args["prompt"] | "a robot";
-        String model = next_task.args["image_model"] | "venice-sd35";
-
-        StaticJsonDocument<512> cmd_doc;
-        cmd_doc["command"] = "generate_image";
-        cmd_doc["prompt"] = prompt;
-        cmd_doc["model"] = model;
-        String command_string;
-        serializeJson(cmd_doc, command_string);
-
-        Serial.printf("Executor: Sending CAMCANVAS command (ASYNC): %s\n", command_string.c_str());
-        udp.beginPacket(CAMCANVAS_IP_ADDRESS, CAMCANVAS_UDP_PORT);
-        udp.print(command_string);
-        udp.endPacket();
-
-        task_completed_immediately = true; // ASYNC: Don't wait
-        Serial.println("Executor: Async image command sent.");
-    }
-    
-    // --- INPUTPAD Tools (Aangepast naar Engels) ---
-    else if (next_task.type == "INPUTPAD_SET_MODE") {
-        StaticJsonDocument<256> cmd_doc;
-        cmd_doc["command"] = "set_mode";
-        cmd_doc["mode"] = next_task.args["mode"];
-        
-        // Changed to max_value
-        if (next_task.args.containsKey("max_value")) {
-             cmd_doc["max"] = next_task.args["max_value"];
-        }
-        
-        String command_string;
-        serializeJson(cmd_doc, command_string);
-
-        Serial.printf("Executor: Sending INPUTPAD command: %s\n", command_string.c_str());
-        udp.beginPacket(INPUTPAD_IP_ADDRESS, INPUTPAD_UDP_PORT);
-        udp.print(command_string);
-        udp.endPacket();
-
-        input_task_start_time = millis(); 
-        setState(EmilyState::AWAITING_INPUT); 
-    }
-    
-    // --- EB_GET_LOCAL_DATA ---
-    else if (next_task.type == "EB_GET_LOCAL_DATA") {
-        Serial.println("Executor: Setting state to PROCESS_GAMEDATA");
-        setState(EmilyState::PROCESSING_GAMEDATA);
-    }
-    
-    else {
-        Serial.printf("Executor Error: Unknown task type '%s'\n", next_task.type.c_str());
-        task_completed_immediately = true;
-    }
-
-    // --- Task Completion & Next Step ---
-    if (task_completed_immediately) {
-        physical_task_start_time = 0; 
-        task_queue.pop_front(); 
-        _continue_task();       
-    }
-}
-
-
-String EmilyBrain::getDataFromJson(const char* key) {
-    if (strcmp(key, "ERROR_KEY") == 0) {
-        return "ERROR"; // Invalid key passed
-    }
-    
-    File file = SD.open("/adventure.json");
-    if (!file) { 
-        Serial.println("ERROR: Could not open /adventure.json");
-        return "ERROR"; 
-    }
-
-    // Filter to only read the specific key we need (saves memory)
-    DynamicJsonDocument filter(JSON_OBJECT_SIZE(1));
-    filter[key] = true; 
-
-    DynamicJsonDocument doc(1024);
-    DeserializationError error = deserializeJson(doc, file, DeserializationOption::Filter(filter));
-    file.close();
-
-    if (error) { 
-        Serial.print("ERROR: JSON Deserialization failed: ");
-        Serial.println(error.c_str());
-        return "ERROR"; 
-    }
-
-    if (!doc.containsKey(key)) { 
-        Serial.printf("ERROR: getDataFromJson - Key '%s' not found in json.\n", key);
-        return "ERROR";
-    }
-
-    JsonObject field_info = doc[key]; 
-    String output_string;
-    serializeJson(field_info, output_string);
-    
-    return output_string;
-}
-
-
-// --- Helper Function for Significant Events ---
-void EmilyBrain::addSignificantEvent(const String& event_desc) {
-    // Check if deque is full
-    if (significant_events.size() >= MAX_SIGNIFICANT_EVENTS) {
-        significant_events.pop_front(); // Remove oldest event
-    }
-    // Add new event
-    significant_events.push_back(event_desc);
-    Serial.println("DEBUG: Added significant event: " + event_desc);
-}
-
-bool EmilyBrain::downloadTtsToSd(const char* textToSpeak, const char* filename) {
-    // This function remains almost IDENTICAL to the CognitiveCore version
-    
-    setState(EmilyState::GENERATING_SPEECH);
-    Serial.printf("TTS Download: Requesting audio for '%s' to %s\n", textToSpeak, filename);
-    WiFiClientSecure https_client;
-    HTTPClient http;
-    https_client.setInsecure();
-
-    if (http.begin(https_client, "https://api.venice.ai/api/v1/audio/speech")) {
-        // ... (add headers: Authorization, Content-Type) ...
-        String authHeader = "Bearer " + String(VENICE_API_KEY); // Use define
-        http.addHeader("Authorization", authHeader);
-        http.addHeader("Content-Type", "application/json");
-
-        StaticJsonDocument<256> payload_doc; // Small doc is enough for TTS payload
-        payload_doc["model"] = "tts-kokoro";
-        payload_doc["input"] = textToSpeak;
-        payload_doc["voice"] = "af_nova";
-        payload_doc["response_format"] = "wav";
-        String payload_string;
-        serializeJson(payload_doc, payload_string);
-
-        int httpCode = http.POST(payload_string);
-
-        if (httpCode == HTTP_CODE_OK) {
-            File file = SD.open(filename, FILE_WRITE);
-            if (file) {
-                int bytesWritten = http.writeToStream(&file); // Get bytes written
-                file.close();
-                if (bytesWritten > 0) {
-                     Serial.printf("TTS Download: Success (%d bytes written).\n", bytesWritten);
-                     http.end(); // End connection here on success
-                     return true;
-                } else {
-                     Serial.println("TTS Download ERROR: Failed to write to SD file.");
-                     // SD might be full or corrupted
-                }
-            } else {
-                Serial.println("TTS Download ERROR: Could not open SD file for writing.");
-            }
-        } else {
-            Serial.printf("TTS Download ERROR: API Error Code %d\n", httpCode);
-            String errorPayload = http.getString();
-            Serial.println("Error Payload: " + errorPayload);
-        }
-        http.end(); // End connection here on failure too
-    } else {
-        Serial.println("TTS Download ERROR: Failed to connect to API.");
-    }
-    return false; // Return false if any error occurred
-}
-
-void EmilyBrain::processTtsRequest(const char* text) {
-    Serial.println("Processing TTS request...");
-    
-    // Give ESP32 breathing room - let heap recover from previous TLS connections
-    delay(500);
-    Serial.printf(">>> TTS: Free Heap: %u, Free PSRAM: %u\n", 
-                  ESP.getFreeHeap(), ESP.getFreePsram());
-
-    const char* filename = "/tts_output.wav";
-    tts_task_start_time = millis();
-
-    bool download_success = downloadTtsToSd(text, filename);
-
-    // Retry once on failure after longer delay
-    if (!download_success) {
-        Serial.println("TTS first attempt failed, retrying...");
-        delay(1500);
-        Serial.printf(">>> TTS retry: Free Heap: %u, Free PSRAM: %u\n", 
-                      ESP.getFreeHeap(), ESP.getFreePsram());
-        download_success = downloadTtsToSd(text, filename);
-    }
-
-    if (download_success) {
-        setState(EmilyState::SPEAKING);
-    } else {
-        Serial.println("TTS Request FAILED after retry.");
-        if (!active_tool_call_id.isEmpty()) {
-             logInteractionToSd_Error("tool", active_tool_call_id, 
-                                       active_tool_call_name, 
-                                       "ERROR: Failed to generate speech audio.");
-        }
-        setState(EmilyState::IDLE);
-        tts_task_start_time = 0;
-    }
-    Serial.println(">>> DEBUG: Exiting processTtsRequest.");
-}
-
-String EmilyBrain::buildSelfAwarenessReport(JsonObject device_status) {
-    String report = "--- SELF-AWARENESS REPORT ---\n";
-    report += "This section describes my physical body and its capabilities.\n\n";
-    report += DESC_CORE; // Core description
-    report += "\nMy physical body has the following additional components currently online:\n";
-
-    
-    if (device_status["camcanvas_online"]) {
-        report += DESC_CAMCANVAS;
-    }
-    if (device_status["inputpad_online"]) {
-        report += DESC_INPUTPAD;
-    }
-    return report;
-}
-
-// --- SIMPLIFIED Forward Reading Version ---
-void EmilyBrain::addChatHistoryToMessages(JsonArray messages, int max_history_items) {
-    File history_file = SD.open("/chat_history.jsonl");
-    if (!history_file || !history_file.size()) {
-        Serial.println("Chat history not found or is empty.");
-        if (history_file) history_file.close();
-        return;
-    }
-
-    Serial.printf("Reading chat history (forward, max %d items)...\n", max_history_items);
-
-    // Use a deque to store lines temporarily to easily limit the count
-    std::deque<String> history_lines;
-
-    // Read file line by line, forward
-    while (history_file.available()) {
-        String line = history_file.readStringUntil('\n');
-        line.trim(); // Remove potential \r or extra whitespace
-        if (line.length() > 0) {
-            history_lines.push_back(line);
-            // If deque exceeds max size, remove the oldest item (at the front)
-            if (history_lines.size() > max_history_items) {
-                history_lines.pop_front();
-            }
-        }
-    }
-    history_file.close();
-
-    Serial.printf("DEBUG: Found %d relevant lines in history file.\n", history_lines.size());
-
-    int added_count = 0;
-    // Iterate through the collected lines (now in correct chronological order)
-    for (const String& line : history_lines) {
-        // Serial.println("DEBUG: Attempting to parse history line:"); // Optional
-        // Serial.println(line);                                     // Optional
-
-        StaticJsonDocument<4096> history_item_doc; // Keep buffer reasonably large
-        DeserializationError error = deserializeJson(history_item_doc, line);
-
-        if (error == DeserializationError::Ok) {
-            // Serial.println("DEBUG: Parse SUCCESSFUL."); // Optional
-            messages.add(history_item_doc.as<JsonObject>());
-            added_count++;
-        } else {
-            Serial.print("!!! ERROR parsing history line: ");
-            Serial.println(error.c_str());
-        }
-    }
-    Serial.printf("%d history items added to payload.\n", added_count);
-}
-
-// --- Function to build the payload IN the provided document ---
-void EmilyBrain::buildAiPayload(StaticJsonDocument<JSON_DOC_CAPACITY>& api_payload_doc, // Pass by reference
-                                const char* current_prompt_content,
-                                JsonObject device_status) {
-
-    Serial.println("DEBUG: Entering buildAiPayload (StaticJsonDocument version)...");
-
-    // --- Step A: Read, Filter, and Clean Tools ---
-    Serial.println("DEBUG: Adding tools...");
-    File tools_file = SD.open("/tools_config.json");
-    if (tools_file) {
-        // Serial.println("DEBUG: SD.open() SUCCESSFUL."); // <-- Added check
-        StaticJsonDocument<16384> all_tools_doc; // Temp doc for tools
-        DeserializationError error = deserializeJson(all_tools_doc, tools_file);
-        tools_file.close();
-        
-        if (!error) {
-            JsonArray filtered_tools = api_payload_doc.createNestedArray("tools");
-            for (JsonObject tool : all_tools_doc.as<JsonArray>()) {
-                bool is_tool_available = true;
-                JsonObject function_obj = tool["function"];
-                JsonArray required = function_obj["required_devices"];
-
-                if (required) { // Check if required array exists
-                    for (JsonVariant device_var : required) { // Iterate using JsonVariant
-                        const char* device = device_var.as<const char*>();
-                         if (!device) continue; // Skip if conversion fails
-
-                        if (strcmp(device, "OS") == 0 && !device_status["os_online"]) {
-                            is_tool_available = false; break;
-                        }
-                        if (strcmp(device, "CAMCANVAS") == 0 && !device_status["camcanvas_online"]) {
-                            is_tool_available = false; break;
-                        }
-                        if (strcmp(device, "INPUTPAD") == 0 && !device_status["inputpad_online"]) {
-                            is_tool_available = false; break;
-                        }
-                    }
-                }
-
-                if (is_tool_available) {
-                    // Copy the tool, excluding 'required_devices'
-                    JsonObject new_tool = filtered_tools.createNestedObject();
-                    new_tool["type"] = tool["type"];
-                    JsonObject new_function = new_tool.createNestedObject("function");
-                    for (JsonPair kvp : function_obj) {
-                        if (strcmp(kvp.key().c_str(), "required_devices") != 0) {
-                            new_function[kvp.key()] = kvp.value();
-                        }
-                    }
-                }
-            }
-            Serial.printf("DEBUG: Tools added (%d).\n", filtered_tools.size());
-            if (api_payload_doc.overflowed()) { Serial.println("FATAL: Overflow after tools!"); return; } // Exit if overflowed
-        } else { Serial.printf("DEBUG: Error parsing tools: %s\n", error.c_str()); }
-    } else { Serial.println("DEBUG: Error opening tools file!"); }
-
-
-
-    // --- Step B: Build the 'messages' List ---
-    Serial.println("DEBUG: Adding model and messages array...");
-    api_payload_doc["model"] = "llama-3.3-70b";
-    JsonArray messages = api_payload_doc.createNestedArray("messages");
-    if (api_payload_doc.overflowed()) { Serial.println("FATAL: Overflow after model/array!"); return; }
-
-    // 1. System Prompt
-    Serial.println("DEBUG: Building/Adding system prompt...");
-    String self_awareness_report = buildSelfAwarenessReport(device_status);
-    String final_system_prompt = self_awareness_report + "\n\n" + system_prompt_content;
-    JsonObject system_msg = messages.createNestedObject();
-    system_msg["role"] = "system";
-    system_msg["content"] = final_system_prompt;
-    Serial.printf("DEBUG: System prompt added. size: %d bytes\n", measureJson(api_payload_doc));
-    if (api_payload_doc.overflowed()) { Serial.println("FATAL: Overflow after system prompt!"); return; }
-
-    // 2. Chat History
-    Serial.println("DEBUG: Adding chat history...");
-    addChatHistoryToMessages(messages, 120);
-    Serial.printf("DEBUG: History added. Size: %d bytes\n", measureJson(api_payload_doc));
-    if (api_payload_doc.overflowed()) { Serial.println("FATAL: Overflow after history!"); return; }
-
-    // 3. User Message
-    Serial.println("DEBUG: Adding user message...");
-    JsonObject user_msg = messages.createNestedObject();
-    user_msg["role"] = "user";
-    user_msg["content"] = current_prompt_content;
-    Serial.printf("DEBUG: User message added. FINAL measured size: %d bytes\n", measureJson(api_payload_doc));
-    if (api_payload_doc.overflowed()) { Serial.println("FATAL: Overflow after user message!"); return; }
-
-    Serial.println("DEBUG: Exiting buildAiPayload...");
-    // No return value needed
-    // return;
-}
-
-void EmilyBrain::decayArousal() {
-    unsigned long current_time = millis();
-    // Only decay if arousal is positive and enough time has passed
-    if (arousal > 0.0 && (current_time - last_decay_time) >= 1000) { // Check every second
-        double decay_amount = AROUSAL_DECAY_RATE;
-        arousal -= decay_amount;
-        if (arousal < 0.0) {
-            arousal = 0.0; // Don't go below zero
-        }
-        // Serial.printf("Arousal decayed to: %.2f\n", arousal); // Optional debug
-        last_decay_time = current_time;
-    }
-}
-
-void EmilyBrain::loadConfigurations() {
-    Serial.println("Loading configurations from SD card...");
-
-    File prompt_file = SD.open("/system_prompt.txt");
-    if (prompt_file) {
-        // Lees de volledige inhoud van het bestand in de String-variabele
-        system_prompt_content = prompt_file.readString();
-        prompt_file.close();
-        
-        if (system_prompt_content.length() > 0) {
-            Serial.println("System prompt successfully loaded.");
-        } else {
-            Serial.println("WARNING: system_prompt.txt is empty.");
-        }
-    } else {
-        Serial.println("ERROR: Could not open system_prompt.txt!");
-        // We kunnen hier een standaard-prompt laden als terugval
-        system_prompt_content = "You are a helpful assistant.";
-    }
-}
-
-void EmilyBrain::sendPings() {
-    unsigned long current_time = millis();
-    if (current_time - last_ping_time >= PING_INTERVAL_MS) {
-        if (wifi_status == WiFiStatus::CONNECTED) { // Only send if connected
-            const char* ping_msg = "PING";
-            
-            // Removed OS Ping
-            
-            udp.beginPacket(CAMCANVAS_IP_ADDRESS, CAMCANVAS_UDP_PORT);
-            udp.print(ping_msg);
-            udp.endPacket();
-
-            udp.beginPacket(INPUTPAD_IP_ADDRESS, INPUTPAD_UDP_PORT);
-            udp.print(ping_msg);
-            udp.endPacket();
-
-            // Serial.println("Pings sent."); // Optional debug
-        }
-        last_ping_time = current_time;
-    }
-}
-
-void EmilyBrain::handleUdpPackets() {
-    if (wifi_status != WiFiStatus::CONNECTED) {
-        return; // Don't process if not connected
-    }
-
-    int packetSize = udp.parsePacket();
-    if (packetSize) {
-        
-        // --- STEP 1: READ THE PACKET (ONCE!) ---
-        // Use a buffer large enough for the LARGEST expected packet (e.g. vision data)
-        char packetBuffer[1536]; // 1.5K buffer
-        int len = udp.read(packetBuffer, 1536);
-        if (len > 0) {
-            packetBuffer[len] = 0; // Null-terminate
-        } else {
-            udp.flush(); // Empty buffer
-            return; // Empty packet
-        }
-
-        String sender_ip_str = udp.remoteIP().toString();
-        unsigned long current_time = millis();
-
-        // --- Identify Sender & Update Status ---
-
-        // (OS Block Removed)
-
-        // --- Handle CAMCANVAS Packets ---
-        if (sender_ip_str == CAMCANVAS_IP_ADDRESS) {
-            last_camcanvas_contact = current_time;
-            if (!camcanvas_connected) { Serial.println("CamCanvas Connected."); camcanvas_connected = true; }
-
-            // --- STATE-BASED PROCESSING ---
-            // What do we expect right now?
-
-            // 1. Expecting VISION response?
-            if (currentState == EmilyState::SEEING) {
-                // Serial.println(">>> DEBUG: (State=SEEING) Looking for 'vision'...");
-                StaticJsonDocument<1024> vision_doc;
-                DeserializationError error = deserializeJson(vision_doc, packetBuffer);
-                if (!error && vision_doc.containsKey("result_type") && strcmp(vision_doc["result_type"], "vision") == 0) {
-                    Serial.println(">>> DEBUG: 'vision' result FOUND and processing.");
-                    last_vision_response.set(vision_doc);
-                } 
-            }
-            
-            // 2. Expecting IMAGE COMPLETE response?
-            else if (currentState == EmilyState::VISUALIZING) {
-                // Serial.println(">>> DEBUG: (State=VISUALIZING) Looking for 'image_complete'...");
-                StaticJsonDocument<256> confirmation_doc;
-                DeserializationError error = deserializeJson(confirmation_doc, packetBuffer);
-                if (!error && confirmation_doc.containsKey("result_type") && strcmp(confirmation_doc["result_type"], "image_complete") == 0) {
-                    Serial.println(">>> DEBUG: 'image_complete' FOUND and processing.");
-                    last_camcanvas_confirmation.set(confirmation_doc);
-                } 
-            }
-
-            // 3. General Updates (Heartbeats, Photos, etc.)
-            else {
-                StaticJsonDocument<512> other_doc; 
-                DeserializationError error = deserializeJson(other_doc, packetBuffer);
-                
-                // Check for Photo Confirmation
-                if (!error && other_doc.containsKey("result_type") && strcmp(other_doc["result_type"], "picture_taken") == 0) {
-                    const char* status = other_doc["status"] | "error";
-                    if (strcmp(status, "success") == 0) { addSignificantEvent("CAM: Photo saved."); }
-                    else { addSignificantEvent("CAM: ERROR saving photo."); }
-                }
-                // Check for Heartbeat (Tilt/Pan info)
-                else if (!error && other_doc.containsKey("id") && other_doc.containsKey("state")) {
-                    current_cam_tilt = other_doc["tilt_angle"] | 90.0f; 
-                    current_cam_pan = other_doc["pan_angle"] | 90.0f;
-                }
-            }
-        } // --- END CAMCANVAS BLOCK ---    
-        
-        
-
-        // --- Handle INPUTPAD Packets ---
-        else if (sender_ip_str == INPUTPAD_IP_ADDRESS) {
-            last_inputpad_contact = current_time;
-            if (!inputpad_connected) { 
-                Serial.println("InputPad Connected."); 
-                inputpad_connected = true; 
-            }
-
-        StaticJsonDocument<128> input_doc;
-        DeserializationError err = deserializeJson(input_doc, packetBuffer);
-        
-        if (!err) {
-            const char* event_type = input_doc["event"] | "unknown";
-            
-            if (strcmp(event_type, "input_received") == 0) {
-                Serial.println("Received INPUT_RECEIVED from InputPad.");
-                last_inputpad_response.clear();
-                last_inputpad_response["event"] = input_doc["event"];
-                last_inputpad_response["value"] = input_doc["value"];
-                Serial.printf(">>> Stored InputPad value: %s\n", 
-                            last_inputpad_response["value"].as<const char*>());
-            }
-        }
-    }
-        
-        // --- Clear the UDP buffer ---
-        udp.flush();
-    }
-}
-
-void EmilyBrain::checkTimeouts() {
-    unsigned long current_time = millis();
-
-    // (OS Check Removed)
-
-    // --- CAMCANVAS CHECK ---
-    if (camcanvas_connected && (current_time - last_camcanvas_contact > CONNECTION_TIMEOUT_MS) &&
-        currentState != EmilyState::SEEING &&           
-        currentState != EmilyState::VISUALIZING)      
-    {
-        Serial.println("CamCanvas Disconnected (Timeout).");
-        camcanvas_connected = false;
-    }
-    // --- INPUTPAD CHECK ---
-    if (inputpad_connected && (current_time - last_inputpad_contact > CONNECTION_TIMEOUT_MS) &&
-        currentState != EmilyState::AWAITING_INPUT)   
-    {
-        Serial.println("InputPad Disconnected (Timeout).");
-        inputpad_connected = false;
-    }
-}
-
-void EmilyBrain::renderDisplay() {
-    bool force_redraw = false;
-    static bool layout_drawn = false;
-    
-    // --- Static Layout ---
-    if (!layout_drawn) {
-        display.fillScreen(TFT_BLACK);
-        // --- Title Bar (1x) ---
-        display.fillRect(0, 0, display.width(), 30, TFT_DARKCYAN);
-        display.setTextColor(TFT_WHITE, TFT_DARKCYAN);
-        display.drawString("Emily", 5, 5, 4);
-
-        // --- Static Labels (1x) ---
-        int y_lineA = 45;
-        int y_lineV = 60;
-        int y_line1 = 75;
-        int y_line2 = 90;
-        int x_col1_lbl = 10;
-        
-        display.setTextColor(TFT_WHITE, TFT_BLACK);
-        
-        display.drawString("A:", x_col1_lbl, y_lineA + 2, 1); // Arousal Label
-        display.drawString("V:", x_col1_lbl, y_lineV + 2, 1); // Valence Label
-        display.drawString("State:", x_col1_lbl, y_line1 + 2, 1); // Translated
-        display.drawString("CC:", x_col1_lbl, y_line2 + 2, 1);
-
-        layout_drawn = true;
-    }
-
-    // --- Connectivity Dots (Simple Update Logic) ---
-    // WiFi
-    if (wifi_status != prev_wifi_status || force_redraw) {
-        int wifiX = display.width() - 25; int wifiY = 15; int radius = 6;
-        uint16_t wifiColor = TFT_RED;
-        if (wifi_status == WiFiStatus::CONNECTING) { /* Blink logic placeholder */ }
-        else if (wifi_status == WiFiStatus::CONNECTED) { wifiColor = TFT_BLUE; }
-        display.fillCircle(wifiX, wifiY, radius, wifiColor);
-        prev_wifi_status = wifi_status;
-    }
-    
-    // CAMCANVAS Dot
-    if (camcanvas_connected != prev_camcanvas_connected || force_redraw) {
-        int ccDotX = display.width() - 50; int cY = 15; int radius = 6;
-        uint16_t ccDotColor = camcanvas_connected ? TFT_GREEN : TFT_RED;
-        display.fillCircle(ccDotX, cY, radius, ccDotColor);
-        prev_camcanvas_connected = camcanvas_connected; 
-    }
-    // InputPad (IP) Status Dot
-    if (inputpad_connected != prev_inputpad_connected || force_redraw) {
-        int ipDotX = display.width() - 75; 
-        int ipY = 15; int radius = 6;
-        uint16_t ipDotColor = inputpad_connected ? TFT_GREEN : TFT_RED;
-        display.fillCircle(ipDotX, ipY, radius, ipDotColor);
-        prev_inputpad_connected = inputpad_connected;
-    }
-
-    // --- Arousal Bar ---
-    if (arousal != prev_arousal || force_redraw) {
-        int barY = 40; 
-        int barX = 30;
-        int barHeight = 10;
-        int barWidth = display.width() - barX - 10;
-        int filledWidth = (int)(arousal * barWidth);
-
-        display.fillRect(barX, barY, barWidth, barHeight, TFT_DARKGREY);
-        if (filledWidth > 0) {
-             display.fillRect(barX, barY, filledWidth, barHeight, TFT_RED);
-        }
-        prev_arousal = arousal;
-    }
-
-    // --- Valence Bar ---
-    if (valence != prev_valence || force_redraw) {
-        int barY = 55; 
-        int barX = 30;
-        int barHeight = 10;
-        int barWidth = display.width() - barX - 10;
-        
-        // Map valence [-1.0, 1.0] to [0, barWidth]
-        int zeroPoint = barWidth / 2;
-        int valPixel = (int)(((valence + 1.0) / 2.0) * barWidth);
-        
-        display.fillRect(barX, barY, barWidth, barHeight, TFT_DARKGREY);
-        uint16_t valenceColor = (valence >= 0) ? TFT_GREEN : TFT_ORANGE;
-        
-        if (valPixel > zeroPoint) {
-             display.fillRect(barX + zeroPoint, barY, valPixel - zeroPoint, barHeight, valenceColor);
-        } else if (valPixel < zeroPoint) {
-             display.fillRect(barX + valPixel, barY, zeroPoint - valPixel, barHeight, valenceColor);
-        }
-        prev_valence = valence;
-    }
-
-    // --- Dynamic Text Lines ---
-    char text_buffer[50]; 
-    int y_line1 = 75;
-    int y_line2 = 90;
-    int y_line3 = 105;
-    int x_col1_val = 50;  
-    int x_col2_lbl = 160; 
-    int x_col2_val = 200; 
-
-    // --- Line 1: Emily State ---
-    const char* stateStr = stateToString(currentState);
-    // Removed Mode string logic
-    
-    if (prev_line1_L != stateStr) {
-        display.fillRect(x_col1_val, y_line1, display.width() - x_col1_val, 10, TFT_BLACK); 
-        display.setTextColor(TFT_YELLOW, TFT_BLACK);
-        display.drawString(stateStr, x_col1_val, y_line1 + 2, 1);
-        
-        prev_line1_L = stateStr;
-    }
-
-    // --- Line 2: CC Status & Pan ---
-    String cc_text = camcanvas_connected ? "Online" : "Offline";
-    sprintf(text_buffer, "%.0f deg", current_cam_pan);
-    String pan_text = camcanvas_connected ? text_buffer : "N/A";
-    
-    if (prev_line2_L != cc_text || prev_line2_R != pan_text) {
-        display.fillRect(x_col1_val, y_line2, display.width() - x_col1_val, 10, TFT_BLACK);
-        display.setTextColor(camcanvas_connected ? TFT_GREEN : TFT_RED, TFT_BLACK);
-        display.drawString(cc_text, x_col1_val, y_line2 + 2, 1);
-        
-        display.setTextColor(TFT_WHITE, TFT_BLACK);
-        display.drawString("Pan:", x_col2_lbl, y_line2 + 2, 1); 
-        display.setTextColor(camcanvas_connected ? TFT_SKYBLUE : TFT_RED, TFT_BLACK);
-        display.drawString(pan_text, x_col2_val, y_line2 + 2, 1);
-
-        prev_line2_L = cc_text;
-        prev_line2_R = pan_text;
-    }
-
-    // --- Line 3: Tilt ---
-    sprintf(text_buffer, "%.0f deg", current_cam_tilt);
-    String tilt_text = camcanvas_connected ? text_buffer : "N/A";
-
-    if (prev_line3_R != tilt_text) {
-        // Only clearing the right side to avoid flickering the left side if it was used
-        // But since Line 3 left is empty, we can clear it or just draw over.
-        // Let's clear the area for Tilt Label + Value
-        display.fillRect(x_col2_lbl, y_line3, display.width() - x_col2_lbl, 10, TFT_BLACK); 
-        
-        display.setTextColor(TFT_WHITE, TFT_BLACK);
-        display.drawString("Tilt:", x_col2_lbl, y_line3 + 2, 1); 
-        display.setTextColor(camcanvas_connected ? TFT_SKYBLUE : TFT_RED, TFT_BLACK);
-        display.drawString(tilt_text, x_col2_val, y_line3 + 2, 1); 
-        
-        prev_line3_R = tilt_text;
-    }
-    
-    // --- Chat / Info Window ---
-    int chat_start_y = 125; 
-    int chat_line_height = 10; 
-
-    if (last_display_text != prev_display_text || force_redraw) {
-        // Clear the chat area
-        display.fillRect(0, chat_start_y, display.width(), display.height() - chat_start_y, TFT_BLACK);
-
-        // Set text properties
-        display.setTextColor(TFT_WHITE, TFT_BLACK);
-        display.setTextSize(1); 
-        display.setCursor(5, chat_start_y + 2); 
-
-        // Enable text wrapping
-        display.setTextWrap(true);
-
-        // Print the text 
-        display.print(last_display_text);
-
-        prev_display_text = last_display_text; 
-    }
-}
-
-// --- State Handlers ---
-void EmilyBrain::handleIdleState() {
-    // This function is only called when currentState == IDLE.
-    
-    // --- CHECK 1: HIGH AROUSAL (Active Context) ---
-    // If arousal is high, we MUST react or continue reacting.
-    if (arousal > AROUSAL_THRESHOLD) {
-        
-        if (current_arousal_context != nullptr) {
-            // Option A: CONTINUATION. Previous action didn't resolve arousal.
-            Serial.println("Idle Handling: Continuing previous arousal context.");
-            _start_ai_cycle("CONTINUATION: Previous action did not resolve high arousal.");
-        
-        } else {
-            // Option B: High arousal but NO context (e.g. web trigger).
-            // Investigate cause.
-            Serial.println("Idle Handling: Arousal is high with NO context. Investigating.");
-            _start_ai_cycle("INTERNAL_TRIGGER: Arousal is high without context, investigating cause.");
-        }
-        return; // Exit function, AI cycle started.
-    }
-
-    // --- CHECK 2: LOW AROUSAL (Scan for NEW Triggers) ---
-    // If arousal is low, reset context and look for new stimuli.
-    if (arousal <= AROUSAL_THRESHOLD) {
-        if (current_arousal_context != nullptr) {
-             Serial.println("Idle Handling: Arousal low, clearing context.");
-             current_arousal_context = nullptr;
-        }
-
-        const char* new_trigger_reason = nullptr;
-        double new_arousal = 0.0;
-        double new_valence = 0.0;
-        bool trigger_found = false; 
-
-        // --- PRIORITY 1: WAKE BUTTON (Physical Interrupt) ---
-        if (checkWakeButton()) { 
-            Serial.println("Idle Handling: Wake Button pressed!");
-            new_trigger_reason = "USER_ACTION: Wake button pressed.";
-            new_arousal = 0.8; 
-            new_valence = 0.2; 
-            trigger_found = true;
-        }
-
-        // --- FUTURE PRIORITIES (Placeholders) ---
-        // 2. Agenda / Timer check
-        // 3. Vision-based presence detection or human presence detection
-
-        // --- DECISION: TRIGGER FOUND? ---
-        if (trigger_found) {
-            // Update internal state
-            arousal = new_arousal;
-            valence = new_valence;
-            last_decay_time = millis(); // Reset decay timer
-            current_arousal_context = new_trigger_reason; // Store new context
-
-            // Start AI Cycle (if online)
-            if (wifi_status == WiFiStatus::CONNECTED) {
-                 _start_ai_cycle(current_arousal_context);
-            } else {
-                 Serial.println("Trigger detected, but WiFi is offline. Cannot start AI cycle.");
-            }
-        }
-    }
-    // If we reach here: Either arousal was high (handled in Check 1), 
-    // or arousal was low but no NEW trigger was found. Do nothing.
-}
-
-// ---  _start_ai_cycle ---
-void EmilyBrain::_start_ai_cycle(const char* trigger_reason) {
-    
-    Serial.printf("AI Cycle Triggered! Reason: %s\n", trigger_reason);
-
-    // --- Log the trigger context as a 'user' message ---
-    StaticJsonDocument<1536> log_doc; 
-    log_doc["role"] = "user";
-    
-    // Construct the full "INTERNAL_REPORT:" string here
-    String report_content = "INTERNAL_REPORT:\n";
-    report_content += "- Triggering Event: " + String(trigger_reason) + "\n";
-    report_content += "- My Current Emotional State: arousal=" + String(arousal, 2) + ", valence=" + String(valence, 2) + "\n";
-    
-    log_doc["content"] = report_content;
-    logInteractionToSd(log_doc.as<JsonObject>()); // Log it!
-    
-    // --- Set State ---
-    setState(EmilyState::PROCESSING_AI);
-
-    // --- 1. Collect Context Data (JSON) ---
-    StaticJsonDocument<1024> context_doc; 
-
-    context_doc["trigger"] = trigger_reason;
-    
-    JsonObject emotion = context_doc.createNestedObject("emotion");
-    emotion["arousal"] = arousal;
-    emotion["valence"] = valence;
-
-    JsonObject device_status = context_doc.createNestedObject("device_status");
-    // Removed os_online
-    device_status["camcanvas_online"] = camcanvas_connected;
-    device_status["inputpad_online"] = inputpad_connected;
-
-    // --- 2. Build Full Prompt String (Text) ---
-    String ai_prompt = "INTERNAL_REPORT:\n";
-    ai_prompt += "- Triggering Event: " + String(trigger_reason) + "\n";
-    ai_prompt += "- My Current Emotional State: arousal=" + String(arousal, 2) + ", valence=" + String(valence, 2) + "\n";
-    
-    // --- World Summary (Cleaned Up) ---
-    ai_prompt += "- Peripherals: ";
-    ai_prompt += "CamCanvas=" + String(camcanvas_connected ? "Online" : "Offline") + ", ";
-    ai_prompt += "InputPad=" + String(inputpad_connected ? "Online" : "Offline") + ".\n";
-
-    // Only Pan/Tilt remains (Head Position)
-    ai_prompt += "- Head Position: Pan=" + String(current_cam_pan, 0) + " deg, ";
-    ai_prompt += "Tilt=" + String(current_cam_tilt, 0) + " deg.\n";
-    
-    // --- Significant Events ---
-    if (!significant_events.empty()) {
-        ai_prompt += "- Recent Events: ";
-        for (const String& evt : significant_events) {
-            ai_prompt += "[" + evt + "] ";
-        }
-        ai_prompt += "\n";
-    }
-    
-    // --- End Prompt Build ---
-    Serial.println("--- Context for AI (Prompt String) ---");
-    Serial.println(ai_prompt);
-    Serial.println("------------------------------------");
-    
-    // --- AI Call ---
-    Serial.println("Calling processAiProxyRequest...");
-    processAiProxyRequest(ai_prompt.c_str(), context_doc["device_status"].as<JsonObject>());
-}
-
-void EmilyBrain::handleAwaitingSpeechState() { 
-    // We are actively waiting for sound > SPEECH_START_THRESHOLD.
-    // The actual VAD logic is currently *blocking* inside recordAudioToWav.
-    // If recordAudioToWav were non-blocking, this handler would read I2S.
-    // For now, this handler doesn't do much besides indicate the state.
-    // We might add a timeout here later.
-    // Serial.print("A"); // Optional debug indicator
- }
-void EmilyBrain::handleRecordingSpeechState() { 
-    // We are actively recording audio (sound > SILENCE_THRESHOLD).
-    // The actual recording logic is *blocking* inside recordAudioToWav.
-    // If recording were non-blocking, this handler would write to SD.
-    // For now, this handler doesn't do much.
-    // Serial.print("R"); // Optional debug indicator
- }
-void EmilyBrain::handleProcessingSttState() { 
-    // We are waiting for the transcribeAudioFromSd function (Whisper API call)
-    // to complete. That function is currently *blocking*.
-    // If transcription were asynchronous, this handler would check for completion.
-    // We *could* add a timeout check here for the API call.
-    // Serial.print("T"); // Optional debug indicator 
-}
-
-void EmilyBrain::handleProcessGamedataState() {
-    Serial.println("Handler: Entering PROCESS_GAMEDATA state.");
-
-    // 1. Get the task (we know it's at the front)
-    if (task_queue.empty() || task_queue.front().type != "EB_GET_LOCAL_DATA") {
-        Serial.println("Handler ERROR: PROCESS_GAMEDATA state entered, but task queue is invalid!");
-        setState(EmilyState::IDLE); 
-        return;
-    }
-    
-    Task& current_task = task_queue.front();
-
-    // 2. Get the data key
-    // --- KEY CORRECTION ---
-    const char* key = current_task.args["key"] | "ERROR_KEY"; // Changed from 'sleutel' to 'key'
-    // --- END CORRECTION ---
-
-    Serial.printf("Handler: Reading local CMS data for key: %s...\n", key);
-    
-    // Call helper function (assuming getDataFromJson exists and works)
-    String field_data_str = getDataFromJson(key); 
-
-    // 3. Process the result
-    if (field_data_str == "ERROR") {
-        // Log error
-        logInteractionToSd_Error("tool", active_tool_call_id, active_tool_call_name, "ERROR: Failed to read local data.");
-        String error_trigger = "GAME_DATA_ERROR: Failed to read local game data for key " + String(key);
-        
-        // 4. Remove task
-        task_queue.pop_front();
-        
-        // 5. Start NEXT AI cycle with error context
-        _start_ai_cycle(error_trigger.c_str());
-    
-    } else {
-        // Log success
-        logInteractionToSd_Error("tool", active_tool_call_id, active_tool_call_name, "SUCCESS: Data retrieved.");
-        
-        // Construct natural language trigger for AI
-        String success_trigger = "GAME_DATA: Retrieved info for key '" + String(key) + "': " + field_data_str;
-
-        // 4. Remove task
-        task_queue.pop_front();
-        
-        // 5. Start NEXT AI cycle with data context
-        _start_ai_cycle(success_trigger.c_str());
-    }
-}
-
-void EmilyBrain::handleProcessingAiState() {
-    // This function simulates waiting for the AI response non-blockingly.
-
-    unsigned long current_time = millis();
-
-    // Check if 2 seconds have passed since the simulation started
-    if (current_time - ai_simulation_start_time >= 2000) {
-        Serial.println("Simulating AI response: applying homeostasis...");
-
-        // Apply simulated homeostasis
-        arousal = 0.0;
-        valence = 0.5; // Simulate positive outcome
-        // current_arousal_context = nullptr; // Clear context now that it's resolved
-
-        // Transition back to IDLE
-        setState(EmilyState::IDLE);
-        Serial.println("Homeostasis applied (simulation). Back to Idle.");
-    }
-    // While waiting, the main loop() continues to run, checking buttons and network.
-}
-void EmilyBrain::handleGeneratingSpeechState() {
-    // This state is currently very short because downloadTtsToSd is blocking.
-    // If we make download asynchronous later, this handler will check completion.
-    // For now, it might not even be called if download is fast.
-    // We *could* add a timeout check here.
-    if (tts_task_start_time != 0 && (millis() - tts_task_start_time > TTS_GENERATION_TIMEOUT_MS)) {
-        Serial.println("!!! TIMEOUT during TTS Generation/Download!");
-         if (!active_tool_call_id.isEmpty()) {
-             logInteractionToSd_Error("tool", active_tool_call_id, active_tool_call_name, "ERROR: Timeout generating speech audio.");
-         }
-         setState(EmilyState::IDLE); // Go back to IDLE on failure
-         tts_task_start_time = 0; // Reset timer
-    }
-}
-
-void EmilyBrain::handleSpeakingState() {
-    // This state is entered AFTER TTS audio is successfully downloaded.
-    // Play the audio file NOW.
-    Serial.println("Handler: Entering SPEAKING state. Starting playback...");
-    playWavFromSd("/tts_output.wav"); // Play the standard output file
-
-    Serial.println("Handler: Playback finished.");
-    tts_task_start_time = 0; // Reset timer after successful playback
-
-    // --- Task Completion ---
-    // Remove the CB_SPEAK task from the queue
-    if (!task_queue.empty() && task_queue.front().type == "CB_SPEAK") {
-        task_queue.pop_front();
-    } else {
-        Serial.println("Handler Warning: SPEAKING finished, but queue was empty or front task wasn't CB_SPEAK?");
-    }
-
-    // --- Transition to Next State ---
-    // Use the state we decided on in the executor
-    Serial.printf("Handler: Transitioning to next state: %s\n", stateToString(next_state_after_audio));
-    EmilyState intendedNextState = next_state_after_audio; // Remember the plan
-    _continue_task(); // Process next task (might set state to IDLE if queue becomes empty)
-
-    // If the plan was to listen, AND _continue_task didn't start another waiting task
-    // (i.e., state is now IDLE because queue is empty), set state correctly and start listening.
-     if (intendedNextState == EmilyState::AWAITING_SPEECH && currentState == EmilyState::IDLE) {
-         Serial.println("Handler: Overriding IDLE, setting AWAITING_SPEECH and starting listening.");
-         setState(EmilyState::AWAITING_SPEECH);
-         listenAndTranscribe();
-     }
-}
-
-void EmilyBrain::handleExecutingPhysicalToolState() { 
-    // Not used anymore (OS removed). 
-    // If we somehow end up here, return to IDLE immediately.
-    setState(EmilyState::IDLE);
-}
-
-
-void EmilyBrain::handleSeeingState() {
-    // Check 1: Have we received the vision result?
-    if (!last_vision_response.isNull()) {
-        Serial.println("Handler: Vision result received.");
-        // Process the result - For now, just log it and trigger AI cycle
-        String description = last_vision_response["description"] | "Vision error.";
-        last_display_text = description;
-        Serial.printf("Vision Result: %s\n", description.c_str());
-
-        // Log result back to AI
-         if (!active_tool_call_id.isEmpty()) {
-             logInteractionToSd_Error("tool", active_tool_call_id, active_tool_call_name, description);
-             // Don't clear active_tool_call IDs here, AI cycle needs them
-         }
-
-        // Clear the postbus
-        last_vision_response.clear();
-        camcanvas_task_start_time = 0; // Reset timer
-
-        // Remove the CAM_ANALYZE task from queue (it should be the front one)
-        if (!task_queue.empty() && task_queue.front().type == "CAM_ANALYZE") {
-            task_queue.pop_front();
-        } else { /* Log warning */ }
-
-        // Start next AI cycle with the description
-        _start_ai_cycle(("My visual analysis returned: " + description).c_str());
-        return; // AI cycle started, exit handler
-    }
-
-    // Check 2: Timeout
-    if (camcanvas_task_start_time != 0 && (millis() - camcanvas_task_start_time > CAM_TASK_TIMEOUT_MS)) {
-        Serial.println("!!! Handler TIMEOUT: Waiting for CAM vision result!");
-        // Log error, clear postbus, reset timer, remove task, trigger AI cycle with error
-        if (!active_tool_call_id.isEmpty()) { logInteractionToSd_Error("tool", active_tool_call_id, active_tool_call_name, "ERROR: Timeout waiting for vision analysis."); }
-        last_vision_response.clear();
-        camcanvas_task_start_time = 0;
-        if (!task_queue.empty() && task_queue.front().type == "CAM_ANALYZE") { task_queue.pop_front(); }
-        _start_ai_cycle("I requested visual analysis but received no response in time.");
-        return; // AI cycle started, exit handler
-    }
-    // Still waiting...
-}
-
-void EmilyBrain::handleVisualizingState() {
-     // Check 1: Have we received the image complete confirmation?
-    if (!last_camcanvas_confirmation.isNull()) {
-        Serial.println("Handler: Image generation complete confirmation received.");
-        // Confirmation received, the task is done.
-
-        // Clear postbus, reset timer
-        last_camcanvas_confirmation.clear();
-        camcanvas_task_start_time = 0;
-
-        // Remove the CANVAS_IMAGE_SYNC task from queue
-         if (!task_queue.empty() && task_queue.front().type == "CANVAS_IMAGE_SYNC") {
-            task_queue.pop_front();
-        } else { /* Log warning */ }
-
-        // Continue to the next task
-        _continue_task();
-        return; // Next task started (or went IDLE), exit handler
-    }
-
-    // Check 2: Timeout
-    if (camcanvas_task_start_time != 0 && (millis() - camcanvas_task_start_time > CANVAS_TASK_TIMEOUT_MS)) {
-        Serial.println("!!! Handler TIMEOUT: Waiting for CANVAS image completion!");
-        // Log error, clear postbus, reset timer, remove task, trigger AI cycle with error? Or just continue?
-        // Let's log error and continue the task queue for now.
-         if (!active_tool_call_id.isEmpty()) { logInteractionToSd_Error("tool", active_tool_call_id, active_tool_call_name, "ERROR: Timeout waiting for image generation."); }
-        last_camcanvas_confirmation.clear();
-        camcanvas_task_start_time = 0;
-        if (!task_queue.empty() && task_queue.front().type == "CANVAS_IMAGE_SYNC") { task_queue.pop_front(); }
-        _continue_task(); // Try to continue with the next task
-        return; // Exit handler
-    }
-    // Still waiting...
-}
-
-void EmilyBrain::handlePlayingSoundState() {
-    // Serial.println("Handler: Entering PLAYING_SOUND state."); // Optional Debug
-
-    // Check if the task queue is valid and the front task is a sound task
-    if (!task_queue.empty() &&
-        (task_queue.front().type == "CB_SOUND" || task_queue.front().type == "CB_SOUND_EMOTION"))
-    {
-        Task& sound_task = task_queue.front(); 
-        const char* path = nullptr;
-
-        // --- ARGUMENT EXTRACTION ---
-        // 1. Check 'sound_path' (Standard for play_sound_effect tool)
-        if (sound_task.args.containsKey("sound_path")) {
-            path = sound_task.args["sound_path"];
-        }
-        // 2. Check 'sound_effect' (Standard for update_emotional_state tool)
-        else if (sound_task.args.containsKey("sound_effect")) {
-            path = sound_task.args["sound_effect"];
-        }
-        
-        // --- EXECUTION ---
-        if (path != nullptr) {
-            Serial.printf("Handler: Playing sound '%s'...\n", path);
-            delay(100); // Safety delay for SD/Audio stability
-            playWavFromSd(path); // This function plays the file (blocking)
-            Serial.println("Handler: Sound finished.");
-        } else {
-            Serial.println("Handler Warning: PLAYING_SOUND state entered but no valid path found.");
-        }
-
-        // --- COMPLETION ---
-        task_queue.pop_front(); // Remove the finished task
-        _continue_task();       // Move to next task immediately
-        return;                 // Exit, state has changed
-
-    } else {
-        // Error recovery
-        Serial.println("Handler Error: Entered PLAYING_SOUND state unexpectedly or queue empty.");
-        setState(EmilyState::IDLE); 
-    }
-}
-
-void EmilyBrain::handleAwaitingInputState() {
-    // Check 1: Did we receive input?
-    if (!last_inputpad_response.isNull()) {
-        Serial.println("Handler: InputPad result received.");
-        String value = last_inputpad_response["value"] | "ERROR";
-        
-        // Log the result back to the AI history
-        if (!active_tool_call_id.isEmpty()) {
-             logInteractionToSd_Error("tool", active_tool_call_id, active_tool_call_name, value);
-        }
-
-        last_inputpad_response.clear(); // Clear the mailbox
-        input_task_start_time = 0;      // Reset timer
-
-        // Remove the INPUTPAD_SET_MODE task from the queue
-        if (!task_queue.empty()) task_queue.pop_front();
-
-        // Start the AI cycle with the received value
-        _start_ai_cycle(("USER_INPUT: Received '" + value + "' from InputPad.").c_str());
-        return; // AI cycle started
-    }
-
-    // Check 2: Timeout
-    if (input_task_start_time != 0 && (millis() - input_task_start_time > INPUT_TASK_TIMEOUT_MS)) {
-        Serial.println("!!! Handler TIMEOUT: Waiting for InputPad!");
-        if (!active_tool_call_id.isEmpty()) { 
-            logInteractionToSd_Error("tool", active_tool_call_id, active_tool_call_name, "ERROR: Timeout waiting for user input."); 
-        }
-        
-        last_inputpad_response.clear();
-        input_task_start_time = 0;
-        if (!task_queue.empty()) task_queue.pop_front();
-
-        _start_ai_cycle("I requested user input via the InputPad, but received no response in time.");
-        return;
-    }
-}
-
-
-void EmilyBrain::loop() {
-    // Serial.printf(">>> DEBUG: Top of loop. Current State = %s\n", stateToString(currentState)); // Optional Debug
-
-    // --- If NO WiFi, run AP Server ---
-    if (WiFi.status() != WL_CONNECTED) {
-        ptms_server.handleClient();     // Handle AP web page
-        dnsServer.processNextRequest(); // Handle Captive Portal
-        delay(10);                      // Give AP tasks breathing room
-        return;                         // Stop the rest of the loop
-    }
-    
-    // --- Handle Web Server ---
-    ptms_server.handleClient(); // Check for incoming web requests FIRST
-
-    // --- Check for INTERRUPT first ---
-    if (currentState != EmilyState::IDLE && checkWakeButton()) {
-        Serial.println("INTERRUPT received via button press!");
-        // Force back to IDLE
-        arousal = 0.0;
-        valence = 0.0;
-        current_arousal_context = nullptr;
-        task_queue.clear();
-        setState(EmilyState::IDLE);
-        
-        delay(100); // Small delay to prevent immediate re-trigger
-        return; // Skip the rest of this loop cycle
-    }
-
-    // --- Update Emotional State ---
-    // decayArousal(); // Let arousal decrease over time (Currently disabled)
-
-    // --- Handle Network ---
-    sendPings();         // Send periodic pings
-    handleUdpPackets();  // Check for incoming data
-    checkTimeouts();     // Check if modules have gone offline
-
-    // --- State Machine Dispatcher ---
-    switch (currentState) {
-        case EmilyState::IDLE:
-            handleIdleState();
-            break;
-        case EmilyState::AWAITING_SPEECH:
-            handleAwaitingSpeechState();
-            break;
-        case EmilyState::RECORDING_SPEECH:
-            handleRecordingSpeechState();
-            break;
-        case EmilyState::PROCESSING_STT:
-            handleProcessingSttState();
-            break;
-        case EmilyState::PROCESSING_AI:
-            handleProcessingAiState();
-            break;
-        case EmilyState::GENERATING_SPEECH:
-            handleGeneratingSpeechState();
-            break;
-        case EmilyState::SPEAKING:
-            handleSpeakingState();
-            break;
-        case EmilyState::EXECUTING_PHYSICAL_TOOL:
-            handleExecutingPhysicalToolState();
-            break;
-        case EmilyState::SEEING:
-            handleSeeingState();
-            break;
-        case EmilyState::VISUALIZING:
-            handleVisualizingState();
-            break;
-        case EmilyState::PLAYING_SOUND:
-            handlePlayingSoundState();
-            break;
-        case EmilyState::AWAITING_INPUT:
-            handleAwaitingInputState();
-            break;
-        case EmilyState::PROCESSING_GAMEDATA: 
-            handleProcessGamedataState();
-            break;
-    }
-
-    // --- Update Display ---
-    renderDisplay();
-
-    delay(30);
-}
-
-
-// --- setupWiFi() ---
-// Determines mode (STA/AP) and initializes display.
-void EmilyBrain::setupWiFi() {
-    preferences.begin("emily-wifi", false);
-    String stored_ssid = preferences.getString("ssid", "");
-    String stored_pass = preferences.getString("pass", "");
-    preferences.end();
-
-    // --- TRY CONNECTING FIRST ---
-    if (stored_ssid.length() > 0) {
-        Serial.println("Stored credentials found. Attempting to connect...");
-        
-        // --- DISPLAY INIT (for STA mode) ---
-        display.init();
-        display.setRotation(1);
-        display.fillScreen(TFT_BLACK);
-        display.setCursor(10, 10);
-        display.setTextSize(2);
-        display.println("Connecting...");
-        // --- END DISPLAY INIT ---
-
-        if (connectToWiFi(stored_ssid, stored_pass)) {
-            Serial.println("Connection successful with stored credentials.");
-            display.fillScreen(TFT_BLACK);
-            display.setCursor(10, 10);
-            display.println("Connected!");
-            display.setTextSize(1);
-            display.println(WiFi.localIP().toString());
-            delay(1000);
-            
-            // --- STATE FIX ---
-            wifi_status = WiFiStatus::CONNECTED; 
-            // --- END FIX ---
-            
-            // Start normal services
-            udp.begin(UDP_LISTEN_PORT);
-            setupWebServer(); // Calls ptms_server.begin()
-            Serial.println("PTMS server started.");
-            return; // Success!
-        }
-        Serial.println("Connection failed with stored credentials.");
-        display.fillScreen(TFT_RED);
-        display.setCursor(10, 10);
-        display.println("Config Error.");
-        delay(1000);
-    } else {
-        Serial.println("No stored credentials found.");
-    }
-    
-    // --- FAILED OR NO CREDS: START AP MODE ---
-    startAPMode();
-}
-
-bool EmilyBrain::connectToWiFi(String ssid, String pass) {
-    WiFi.mode(WIFI_STA);
-    
-    // --- STATIC IP CONFIG ---
-    IPAddress staticIP(192, 168, 68, 201);
-    IPAddress gateway(192, 168, 68, 1);
-    IPAddress subnet(255, 255, 255, 0);
-    IPAddress primaryDNS(8, 8, 8, 8);
-    
-    if (!WiFi.config(staticIP, gateway, subnet, primaryDNS)) {
-        Serial.println("Static IP configuration failed!");
-    }
-    // --- End Static IP ---
-
-    WiFi.begin(ssid.c_str(), pass.c_str());
-    Serial.print("Connecting to " + ssid);
-
-    unsigned long startTijd = millis();
-    while (WiFi.status() != WL_CONNECTED && millis() - startTijd < 15000) {
-        delay(500); Serial.print(".");
-    }
-    return (WiFi.status() == WL_CONNECTED);
-}
-
-void EmilyBrain::startAPMode() {
-    Serial.println("Starting AP Mode ('Emily_Setup')...");
-    
-    // --- STEP 1: START WI-FI AP FIRST ---
-    WiFi.softAP("Emily_Setup", "12345678");
-    IPAddress AP_IP(192, 168, 4, 1);
-    dnsServer.start(53, "*", AP_IP);
-    Serial.println("WiFi AP Mode active.");
-    delay(500); 
-
-    // --- STEP 2: INITIALIZE DISPLAY ---
-    Serial.println("Initializing display for AP instructions...");
-    display.init();
-    display.setRotation(1);
-    display.fillScreen(TFT_BLACK);
-    
-    // Show AP instructions
-    display.setCursor(10, 10);
-    display.setTextSize(2);
-    display.println("SETUP MODE");
-    display.setTextSize(1);
-    display.println("\nConnect phone to WiFi:");
-    display.setTextColor(TFT_CYAN, TFT_BLACK);
-    display.println("Emily_Setup");
-    display.setTextColor(TFT_WHITE, TFT_BLACK);
-    display.println("\nPassword: 12345678");
-    display.println("\nGo to 192.168.4.1 in browser.");
-
-    // Reconfigure server for AP mode
-    ptms_server.onNotFound([this](){ this->handleRoot(); });
-    ptms_server.on("/", HTTP_GET, [this](){ this->handleRoot(); });
-    ptms_server.on("/save", HTTP_POST, [this](){ this->handleSave(); });
-    ptms_server.begin(); 
-    Serial.println("AP Web Server started at 192.168.4.1");
-}
-
-void EmilyBrain::handleRoot() {
-    // HTML for setup page
-    String html = R"(
-        <!DOCTYPE HTML><html><head><title>Emily WiFi Setup</title><meta name='viewport' content='width=device-width, initial-scale=1'></head>
-        <body style='font-family: sans-serif; background: #222; color: #EEE; text-align: center;'>
-        <h2 style='color: #0AF;'>Emily WiFi Setup</h2>
-        <p>Choose your network:</p>
-        <form action='/save' method='POST' style='display: grid; max-width: 300px; margin: auto; gap: 10px;'>
-            <input type='text' name='ssid' placeholder='Network Name (SSID)' style='padding: 10px; border-radius: 5px; border: none;'>
-            <input type='password' name='pass' placeholder='Password' style='padding: 10px; border-radius: 5px; border: none;'>
-            <input type='submit' value='Save & Reboot' style='padding: 10px; background: #0AF; color: white; border: none; border-radius: 5px; font-weight: bold;'>
-        </form>
-        </body></html>
-    )";
-    ptms_server.send(200, "text/html", html);
-}
-
-void EmilyBrain::handleSave() {
-    Serial.println("New credentials received!");
-    String ssid = ptms_server.arg("ssid");
-    String pass = ptms_server.arg("pass");
-
-    if (ssid.length() > 0 && pass.length() > 0) {
-        preferences.begin("emily-wifi", false);
-        preferences.putString("ssid", ssid);
-        preferences.putString("pass", pass);
-        preferences.end();
-
-        Serial.println("Credentials saved to flash. Rebooting...");
-        String html = "<html><body style='font-family: sans-serif; background: #222; color: #EEE; text-align: center;'><h2>Success!</h2><p>Credentials saved. Emily is rebooting and connecting to '" + ssid + "'.</p><p>Reconnect your phone to normal WiFi.</p></body></html>";
-        ptms_server.send(200, "text/html", html);
-        
-        delay(2000);
-        ESP.restart();
-    } else {
-        ptms_server.send(400, "text/plain", "SSID or password missing.");
-    }
-}
-
-// --- Serve Remote Control Page ---
-void EmilyBrain::handleRemotePage() {
-    String html = R"(
-        <!DOCTYPE HTML><html><head><title>Emily Remote</title>
-        <meta name='viewport' content='width=device-width, initial-scale=1'>
-        <style>
-            body { font-family: sans-serif; background: #222; color: #EEE; display: flex; flex-direction: column; height: 90vh; }
-            h2 { color: #0AF; text-align: center; }
-            form { display: flex; width: 100%; padding: 10px; box-sizing: border-box; }
-            input[type='text'] { flex-grow: 1; padding: 15px; border-radius: 5px; border: none; font-size: 1.1em; background: #444; color: #EEE; }
-            input[type='submit'] { padding: 15px; background: #0AF; color: white; border: none; border-radius: 5px; font-weight: bold; margin-left: 10px; }
-            
-            /* Button styles */
-            .button_bar { display: flex; justify-content: space-around; padding: 10px; }
-            .button { padding: 10px 15px; text-decoration: none; background: #555; color: #FFF; border-radius: 5px; font-size: 0.9em; }
-            .button.red { background: #900; }
-        </style>
-        </head>
-        <body>
-            <h2>Emily Web Remote</h2>
-            
-            <form action='/send' method='POST'>
-                <input type='text' name='user_text' placeholder='Type message...' autofocus>
-                <input type='submit' value='Send'>
-            </form>
-
-            <div class='button_bar'>
-                <a href='/force-idle' class='button red'>STOP (IDLE)</a>
-                <a href='/center-head' class='button'>Center Head</a>
-                <a href='/delete-history' class='button'>Clear History</a>
-                <a href='/force-reboot' class='button'>Reboot EB</a>
-            </div>
-            
-        </body></html>
-    )";
-    ptms_server.send(200, "text/html", html);
-}
-
-// --- Process Remote Input ---
-void EmilyBrain::handleRemoteInput() {
-    Serial.println(">>> Web Remote: Input received via POST...");
-
-    // Check IDLE state
-    if (currentState != EmilyState::IDLE) {
-        ptms_server.send(429, "text/plain", "Emily is busy. Try again shortly.");
-        return; 
-    }
-
-    if (ptms_server.hasArg("user_text")) {
-        String text = ptms_server.arg("user_text");
-        Serial.printf(">>> Web Remote: Text = %s\n", text.c_str());
-
-        if (text.length() > 0) {
-            // --- TRIGGER ---
-            String trigger_string = "USER_INPUT (Web): " + text;
-            _start_ai_cycle(trigger_string.c_str());
-            // --- END TRIGGER ---
-            
-            ptms_server.sendHeader("Location", "/remote");
-            ptms_server.send(302, "text/plain", "Input received, processing...");
-        } else {
-            ptms_server.sendHeader("Location", "/remote");
-            ptms_server.send(302, "text/plain", "Empty message, try again.");
-        }
-    } else {
-        ptms_server.send(400, "text/plain", "Error: 'user_text' field missing.");
-    }
-}
-
-// --- FORCE IDLE Handler ---
-void EmilyBrain::handleForceIdle() {
-    Serial.println(">>> Web Remote: FORCE IDLE received.");
-    
-    // Interrupt logic
-    arousal = 0.0;
-    valence = 0.0;
-    current_arousal_context = nullptr;
-    task_queue.clear(); 
-    
-    setState(EmilyState::IDLE);
-    ptms_server.sendHeader("Location", "/remote");
-    ptms_server.send(302, "text/plain", "Forced to IDLE.");
-}
-
-// --- CENTER HEAD Handler ---
-void EmilyBrain::handleCenterHead() {
-    Serial.println(">>> Web Remote: CENTER HEAD received.");
-    
-    // Build command
-    StaticJsonDocument<128> cmd_doc;
-    cmd_doc["command"] = "move_head";
-    cmd_doc["pan"] = 90;
-    cmd_doc["tilt"] = 90;
-    String command_string;
-    serializeJson(cmd_doc, command_string);
-
-    // Send direct
-    udp.beginPacket(CAMCANVAS_IP_ADDRESS, CAMCANVAS_UDP_PORT);
-    udp.print(command_string);
-    udp.endPacket();
-
-    ptms_server.sendHeader("Location", "/remote");
-    ptms_server.send(302, "text/plain", "Center command sent.");
-}
-
-// --- REBOOT Handler ---
-void EmilyBrain::handleForceReboot() {
-    Serial.println(">>> Web Remote: FORCE REBOOT received. Rebooting...");
-    
-    String html = "<html><body style='font-family: sans-serif; background: #222; color: #EEE; text-align: center;'><h2>EmilyBrain Rebooting...</h2><p>Page reloads in 5 seconds.</p><script>setTimeout(() => { window.location.href = '/remote'; }, 5000);</script></body></html>";
-    ptms_server.send(200, "text/html", html);
-    
-    delay(1000); 
-    ESP.restart(); 
-}
+#include "EmilyBrain.h"
+#include <ArduinoJson.h>
+
+// --- Descriptions for Self-Awareness Report (v5.0) ---
+const char* DESC_CORE =
+    "I am a robot entity. My core logic runs on a unified processor named 'EmilyBrain'. "
+    "This provides me with the basic abilities to hear, speak, and be activated by a physical button.\n";
+
+// DESC_OS removed (Component no longer exists as separate entity)
+
+// --- CAMCANVAS DESCRIPTION ---
+const char* DESC_CAMCANVAS =
+    "- A 'CamCanvas' (CC) unit: A module equipped with a high-resolution camera (for vision), "
+    "a visual display (for generating images), and a pan/tilt mechanism for head movement.\n";
+
+// --- INPUTPAD DESCRIPTION ---
+const char* DESC_INPUTPAD =
+    "- An 'InputPad' (IP): A separate, wireless handheld device with a screen and 3 buttons (A, B, C) "
+    "used for specific game inputs or choices, like rolling dice or answering quizzes.\n";
+
+// Constructor. Called when the 'emily' object is instantiated.
+EmilyBrain::EmilyBrain() : status_led(1, PIN_NEOPIXEL, NEO_GRB + NEO_KHZ800), display(), venice(VENICE_API_HOST, VENICE_API_KEY),
+                           net_worker(VENICE_API_HOST, VENICE_API_KEY) {
+    // The constructor body can remain empty
+}
+
+void EmilyBrain::setup() {
+    Serial.begin(115200);
+    while (!Serial);
+    Serial.println("EmilyBrain Dual-Bus Startup... (Final Boot Sequence)");
+    pinMode(PIN_WAKE_BUTTON, INPUT_PULLUP);
+    Serial.println("Wake button pin configured.");
+
+    // --- Step 1: Initialize Non-Conflicting Hardware ---
+    status_led.begin();
+    status_led.setPixelColor(0, 0, 10, 0); // Green
+    status_led.show();
+
+    Serial.println("Initializing SD Card on FSPI...");
+    spiSD = new SPIClass(FSPI);
+    spiSD->begin(PIN_SD_SCLK, PIN_SD_MISO, PIN_SD_MOSI);
+    if (!SD.begin(PIN_SD_CS, *spiSD)) {
+        Serial.println("!!! SD Card Mount FAILED!");
+        // We cannot proceed without SD card
+        while(true) { delay(1000); } 
+    }
+    Serial.println("SD Card OK.");
+
+    // Playback and recording run in their own task from here on
+    if (audio.begin()) {
+        audio.prewarm(SOUND_PREWARM_LIST); // Frequent effects into PSRAM
+    }
+
+    // LLM requests run on the network worker; it reads the configs under this lock
+    config_mutex = xSemaphoreCreateRecursiveMutex();
+    net_worker.begin();
+    
+    // Load configurations (essential for tools, system prompts, etc.)
+    loadConfigurations();
+
+    // Verify (or rebuild) the chat history offset index once at boot
+    ensureHistoryIndex();
+    loadHistorySummary();
+
+    // Map the adventure nodes to their byte ranges for retrieve_local_data
+    buildAdventureIndex();
+
+    // --- Step 2: Wi-Fi & Display Setup Wizard ---
+    // This function handles ALL Wi-Fi AND Display initialization.
+    setupWiFi(); 
+
+    // --- Step 3: Start Remaining Services ---
+    // UDP and PTMS server are started inside setupWiFi() 
+    // at the correct moment (either in AP mode or STA mode).
+    
+    Serial.println("Setup complete. Starting main loop.");
+    // (If WiFi is NOT connected, the display shows AP instructions)
+    setDisplayText("System Ready."); // Update default text
+}   
+    
+const char* EmilyBrain::stateToString(EmilyState state) {
+    switch (state) {
+        case EmilyState::IDLE:                    return "Idle";
+        case EmilyState::AWAITING_SPEECH:         return "Waiting for Speech";
+        case EmilyState::RECORDING_SPEECH:        return "Recording...";
+        case EmilyState::PROCESSING_STT:          return "Transcribing...";
+        case EmilyState::PROCESSING_AI:           return "Thinking...";
+        case EmilyState::GENERATING_SPEECH:       return "Preparing Speech...";
+        case EmilyState::SPEAKING:                return "Speaking...";
+        
+        // Renamed from "Acting (OS)" to generic Hardware Action
+        case EmilyState::EXECUTING_PHYSICAL_TOOL: return "Hardware Action..."; 
+        
+        // Simplified texts (removed CamCanvas references for cleaner UI)
+        case EmilyState::SEEING:                  return "Analyzing Vision...";
+        case EmilyState::VISUALIZING:             return "Generating Image...";
+        
+        
+        case EmilyState::AWAITING_INPUT:          return "Awaiting Input...";
+        case EmilyState::PROCESSING_GAMEDATA:     return "Finding Data...";
+        default:                                  return "Unknown";
+    }
+}
+
+void EmilyBrain::setState(EmilyState newState) {
+    if (newState == currentState) {
+        return; // No change needed
+    }
+
+    currentState = newState;
+    if (currentState == EmilyState::IDLE) idle_since = millis();
+    const char* stateName = stateToString(currentState);
+    // Serial.printf("STATE CHANGE -> %s\n", stateName); // Optional: Uncomment for debug
+
+    // Update LED color based on the new state
+    uint32_t color = status_led.Color(10, 5, 0); // Default Orange for unknown
+
+    switch (currentState) {
+        case EmilyState::IDLE:
+            color = status_led.Color(0, 10, 0); // Green
+            break;
+        case EmilyState::AWAITING_SPEECH:
+        case EmilyState::RECORDING_SPEECH:
+            color = status_led.Color(15, 0, 0); // Red
+            break;
+        case EmilyState::PROCESSING_STT:
+        case EmilyState::PROCESSING_AI:
+            color = status_led.Color(0, 0, 15); // Blue
+            break;
+        case EmilyState::GENERATING_SPEECH:
+        case EmilyState::SPEAKING:
+            color = status_led.Color(0, 15, 15); // Cyan
+            break;
+        case EmilyState::EXECUTING_PHYSICAL_TOOL:
+        case EmilyState::SEEING:
+        case EmilyState::VISUALIZING:
+            color = status_led.Color(15, 0, 15); // Magenta
+            break;
+        // InputPad uses Magenta/Purple as well for now, or define new color
+        case EmilyState::AWAITING_INPUT:
+        case EmilyState::PROCESSING_GAMEDATA:
+             color = status_led.Color(15, 0, 15); // Magenta
+             break;
+    }
+    status_led.setPixelColor(0, color);
+    status_led.show();
+    renderDisplay(true); // Show the new state before a blocking step starts
+}
+
+// Function to set up web server
+void EmilyBrain::setupWebServer() {
+    // Set 'normal' PTMS-handlers
+    ptms_server.on("/upload", HTTP_POST, [this](){ this->handleFileUpload(); });
+    ptms_server.on("/delete-history", HTTP_GET, [this](){ this->handleHistoryDelete(); });
+    ptms_server.on("/download", HTTP_GET, [this](){ this->handleFileDownload(); });
+
+    // ---WEB REMOTE ---
+    ptms_server.on("/remote", HTTP_GET, [this](){ this->handleRemotePage(); });
+    ptms_server.on("/send", HTTP_POST, [this](){ this->handleRemoteInput(); }); // Use POST for form data
+    
+    // Use GET for simple click-actions
+    ptms_server.on("/force-idle", HTTP_GET, [this](){ this->handleForceIdle(); });
+    ptms_server.on("/center-head", HTTP_GET, [this](){ this->handleCenterHead(); });
+    ptms_server.on("/force-reboot", HTTP_GET, [this](){ this->handleForceReboot(); });
+    
+    // Add a simple 'not found' or 'root' handler for 'normal' mode
+    ptms_server.on("/", HTTP_GET, [this](){
+        ptms_server.send(200, "text/plain", "EmilyBrain PTMS Server is online.");
+    });
+    ptms_server.onNotFound([this](){
+         ptms_server.send(404, "text/plain", "Not Found.");
+    });
+    
+    ptms_server.begin(); // 
+}
+
+void EmilyBrain::handleFileUpload() {
+    if (!ptms_server.hasArg("file") || !ptms_server.hasArg("plain")) {
+        ptms_server.send(400, "text/plain", "400: BAD REQUEST");
+        return;
+    }
+
+    String filename = ptms_server.arg("file");
+    String content = ptms_server.arg("plain");
+    Serial.printf("File upload request received for: %s\n", filename.c_str());
+
+    // Pah shall begin with '/' for the SD-card
+    if (!filename.startsWith("/")) {
+        filename = "/" + filename;
+    }
+
+    ConfigLock lock(config_mutex); // The worker may be streaming from these files
+    File file = SD.open(filename, FILE_WRITE);
+    if (file) {
+        file.print(content);
+        file.close();
+        Serial.println("File successfully saved to SD card.");
+        ptms_server.send(200, "text/plain", "SUCCESS: File saved.");
+
+        // A restored save slot replaces the history: its offset index is stale now
+        if (filename == CHAT_HISTORY_PATH) {
+            invalidateHistoryIndex();
+            resetHistorySummary();
+        }
+        // New adventure: re-map its nodes so lookups stay one seek each
+        if (filename == ADVENTURE_PATH) {
+            buildAdventureIndex();
+        }
+        
+        // IMPORTANT: Reload the configurations after a succesful upload
+        loadConfigurations(); 
+    } else {
+        Serial.println("ERROR: Could not open file on SD card for writing.");
+        ptms_server.send(500, "text/plain", "500: SERVER ERROR - Could not save file.");
+    }
+}
+/**
+    * @brief Handler for downloading a file from the SD card.
+    */
+void EmilyBrain::handleFileDownload() {
+    // Get filename from URL-parameter (bv. /download?file=/system_prompt.txt)
+    if (!ptms_server.hasArg("file")) {
+        ptms_server.send(400, "text/plain", "400: BAD REQUEST - 'file' parameter is missing.");
+        return;
+    }
+
+    String path = ptms_server.arg("file");
+    Serial.printf("File download request received for: %s\n", path.c_str());
+
+    if (!path.startsWith("/")) {
+        path = "/" + path;
+    }
+
+    if (SD.exists(path)) {
+        File file = SD.open(path, FILE_READ);
+        String contentType = "text/plain"; // Standard content type
+        if (path.endsWith(".json") || path.endsWith(".jsonl")) {
+            contentType = "application/json";
+        }
+        
+        // Stream the file directly to the client. This is very memory efficient.
+        ptms_server.streamFile(file, contentType);
+        file.close();
+        Serial.println("File successfully streamed to client.");
+    } else {
+        Serial.println("ERROR: Requested file does not exist.");
+        ptms_server.send(404, "text/plain", "404: NOT FOUND - File does not exist.");
+    }
+}
+/**
+* @brief Handler for deleting the chat history file.
+*/
+void EmilyBrain::handleHistoryDelete() {
+    Serial.println("Received request to delete chat history...");
+    ConfigLock lock(config_mutex);
+    invalidateHistoryIndex();
+    resetHistorySummary();
+    if (SD.remove(CHAT_HISTORY_PATH)) {
+        Serial.println("File /chat_history.jsonl deleted successfully.");
+        ptms_server.send(200, "text/plain", "SUCCESS: Chat history has been deleted.");
+    } else {
+        Serial.println("ERROR: Failed to delete chat history file.");
+        ptms_server.send(500, "text/plain", "ERROR: Failed to delete file. It might not exist.");
+    }
+}
+
+bool EmilyBrain::checkWakeButton() {
+    bool button_pressed_event = false; // Vlag om een nieuwe druk te signaleren
+    int reading = digitalRead(PIN_WAKE_BUTTON);
+
+    // Als de fysieke staat is veranderd, reset de debounce timer
+    if (reading != last_button_state) {
+        last_debounce_time = millis();
+    }
+
+    // Als de staat stabiel is voor langer dan de delay
+    if ((millis() - last_debounce_time) > DEBOUNCE_DELAY_MS) {
+        // En als deze stabiele staat anders is dan de vorige stabiele staat
+        if (reading != debounced_state) {
+            debounced_state = reading;
+            // Als de nieuwe stabiele staat LOW is (knop ingedrukt)
+            if (debounced_state == LOW) {
+                Serial.println("Wake Button Ingedrukt!"); // Debug output
+                button_pressed_event = true; // Signaleer de nieuwe druk
+            }
+        }
+    }
+
+    // Onthoud de fysieke staat voor de volgende keer
+    last_button_state = reading;
+
+    return button_pressed_event; // Geef terug of er een schone druk was
+}
+
+void EmilyBrain::processAiProxyRequest(const char* current_prompt_content, JsonObject device_status) {
+    // Note: State is already set to PROCESSING_AI by _start_ai_cycle
+
+    Serial.println("Starting AI Proxy Request (network worker)...");
+
+    // --- Step 1: Prepare the payload plan ---
+    // Tools, self-awareness report and the selected history lines are resolved
+    // ONCE, so the measuring pass and the sending pass produce identical bytes.
+    std::shared_ptr<AiPayloadPlan> plan = std::make_shared<AiPayloadPlan>();
+    prepareAiPayload(*plan, current_prompt_content, device_status);
+    Serial.printf("Payload plan ready (history lines: %u)\n", plan->history_offsets.size());
+    Serial.printf(">>> AI: Free Heap: %u, Free PSRAM: %u\n", ESP.getFreeHeap(), ESP.getFreePsram());
+
+    // --- Step 2: Hand the HTTPS round trip to the worker task ---
+    // The body is streamed from the worker; the config lock keeps the
+    // sources stable while each pass runs.
+    ChatRequest* request = new ChatRequest();
+    request->path = VENICE_CHAT_PATH;
+    request->timeout_ms = 90000; // Increased timeout (90 seconds) for AI
+    request->stream = VENICE_CHAT_STREAM;
+    request->write_body = [this, plan](Print& out) {
+        ConfigLock lock(config_mutex);
+        writeAiPayload(out, *plan);
+    };
+
+    ai_request_id = 0;
+    pollNetworkResults(); // Stores a finished summary, drops results of abandoned cycles
+    ai_request_id = net_worker.submit(request);
+    if (ai_request_id == 0) {
+        Serial.println("[AI] Could not queue the request.");
+        setState(EmilyState::IDLE);
+    }
+    // handleProcessingAiState() picks up the result.
+}
+
+// --- Step 3: Parse response and call Planner (back on the main task) ---
+void EmilyBrain::handleAiResult(ChatResult& result) {
+    if (result.partial) {
+        // Streamed answer: the speech is complete, the rest is still coming
+#if VENICE_EARLY_SPEECH
+        prefetchSpeech(result.early_speech);
+#endif
+        return;
+    }
+    if (!result.ok) {
+        Serial.printf("[HTTP] AI request failed: %s\n", result.error.c_str());
+        // Handle error - maybe try again or inform user via TTS?
+        // For now, just go back to IDLE
+        dropEarlySpeech();
+        setState(EmilyState::IDLE);
+        return;
+    }
+    Serial.println("API response OK.");
+
+    // Extract the tool calls array (handle potential errors/missing keys)
+    JsonArray tool_calls = result.doc["choices"][0]["message"]["tool_calls"].as<JsonArray>();
+
+    // Check if tool_calls is valid before calling the planner
+    if (!tool_calls.isNull() && tool_calls.size() > 0) {
+        Serial.println("Tool calls received, calling planner...");
+        // NOTE: PB passed the user_prompt JSON object. We might need to adjust _handle_ai_response
+        // For now, let's pass nullptr for the user_prompt part.
+        _handle_ai_response(nullptr, tool_calls); // Call the planner!
+    } else {
+        Serial.println("API response received, but no tool calls found or format is unexpected.");
+        // Handle situation where AI didn't return a tool call
+        dropEarlySpeech();
+        setState(EmilyState::IDLE); // Go back to IDLE for now
+    }
+    // State transition happens inside _handle_ai_response or if an error occurred.
+}
+
+// --- Helper Function to Add Task ---
+// Returns the task's handle for Task::after (0 if the queue was full).
+uint8_t EmilyBrain::addTask(uint8_t tool, Task task) {
+    task.tool = tool;
+    task.status = TaskStatus::PENDING;
+    uint8_t handle = task_queue.push_back(task);
+    if (handle) {
+        Serial.printf("Task added: %s (%s lane)\n", taskTypeName(task.type), taskLaneName(taskLane(task.type))); // Optional confirmation
+    }
+    return handle;
+}
+
+// --- The Planner ---
+// Expands every tool call of the response into tasks, all in one queue.
+// Each call gets its own 'tool' result in the history (logged together
+// once the queue has drained, see finishTurn()), and whatever needs an
+// answer is batched into a single follow-up AI cycle.
+void EmilyBrain::_handle_ai_response(const char* user_prompt_json_str, JsonArray tool_calls) {
+    Serial.println("Planner (_handle_ai_response) called!");
+
+    if (tool_calls.isNull() || tool_calls.size() == 0) {
+        Serial.println("Planner Warning: Received empty or null tool_calls array.");
+        _start_ai_cycle("My cognitive core returned no specific action. What should I do?"); // Ask again
+        return;
+    }
+
+    // --- Clear previous queue ---
+    // Normally already empty; leftover results are logged before the new turn.
+    abandonTurn("ERROR: Superseded by a newer response.");
+
+    // --- Log the AI response ---
+    StaticJsonDocument<1024> log_doc; 
+    log_doc["role"] = "assistant";
+    JsonArray log_tool_calls = log_doc.createNestedArray("tool_calls");
+    for(JsonObject tc : tool_calls) {
+        log_tool_calls.add(tc);
+    }
+    logInteractionToSd(log_doc.as<JsonObject>()); 
+
+    // --- Plan EVERY tool call, in order ---
+    for (JsonVariant tc_variant : tool_calls) {
+        JsonObject tool_call = tc_variant.as<JsonObject>();
+        if (tool_call.isNull()) {
+            Serial.println("Planner Error: Tool call is invalid JSON, skipped.");
+            continue; // No id to answer to
+        }
+        JsonObject function_call = tool_call["function"].as<JsonObject>();
+        String id = tool_call["id"] | "";
+        String name = function_call["name"] | "unknown_tool";
+
+        if (turn_tool_count >= TURN_MAX_TOOL_CALLS) {
+            Serial.printf("Planner Error: More than %d tool calls, '%s' skipped.\n", TURN_MAX_TOOL_CALLS, name.c_str());
+            logInteractionToSd_Error("tool", id, name, "ERROR: Too many tool calls in one response.");
+            continue;
+        }
+        uint8_t tool = turn_tool_count++;
+        turn_tool_calls[tool].id = id;
+        turn_tool_calls[tool].name = name;
+        turn_tool_calls[tool].result = "";
+        planToolCall(tool, function_call["arguments"] | "");
+    }
+
+    Serial.printf("Planner: Added %d task(s) for %d tool call(s). Starting execution...\n", task_queue.size(), turn_tool_count);
+    _continue_task(); // Also finishes the turn right away if nothing got planned
+}
+
+// Plans the tasks of one tool call; every task is tagged with 'tool'.
+void EmilyBrain::planToolCall(uint8_t tool, const char* arguments) {
+    ToolCallResult& call = turn_tool_calls[tool];
+    const String& tool_name = call.name;
+    Serial.printf("Planner: Processing tool '%s' (ID: %s)\n", tool_name.c_str(), call.id.c_str());
+
+    // --- Parse ALLE Argumenten EENMALIG ---
+    StaticJsonDocument<1024> all_args_doc; 
+    DeserializationError error = deserializeJson(all_args_doc, arguments);
+
+    if (error) {
+        Serial.printf("Planner Error: Failed to parse arguments for tool '%s': %s\n", tool_name.c_str(), error.c_str());
+        call.result = "ERROR: Invalid arguments received: " + String(error.c_str());
+        return;
+    }
+    JsonObject all_args = all_args_doc.as<JsonObject>(); 
+    size_t tasks_before = task_queue.size();
+
+    // --- REVISED Planning Logic met Argument Filtering ---
+    bool main_task_planned = false;
+    
+    // === Stap 0: Plan OPTIONELE SFEERVERLICHTING ===
+    if (all_args.containsKey("led_effect")) {
+        const char* effect = all_args["led_effect"] | "none";
+        Task led_task(TaskType::CAMCANVAS_SET_LED);
+        led_task.led.r = all_args["led_r"] | 0; 
+        led_task.led.g = all_args["led_g"] | 0;
+        led_task.led.b = all_args["led_b"] | 0;
+        led_task.led.effect = (strcmp(effect, "pulse") == 0) ? emily_proto::LED_PULSE :
+                              (strcmp(effect, "blink") == 0) ? emily_proto::LED_BLINK : emily_proto::LED_NONE;
+        led_task.led.speed_ms = all_args["led_speed"] | 1000; 
+        addTask(tool, led_task); 
+    }
+
+    // === Step 1: Plan OPTIONAL Background Image FIRST ===
+    // JSON Key changed from 'begeleidende_afbeelding_prompt' to 'visual_prompt'
+    if (all_args.containsKey("visual_prompt")) {
+        Task image_task(TaskType::CANVAS_IMAGE_ASYNC);
+        image_task.image.prompt = task_queue.storeText(all_args["visual_prompt"]);
+        image_task.image.model = task_queue.storeText(all_args["image_model"]);
+        addTask(tool, image_task); 
+        Serial.println("Planner: Added ASYNC image task first.");
+    }
+    
+    // === Step 2: Plan the MAIN Action ===
+
+    // 1. Emotion: update_emotional_state
+    if (!main_task_planned && tool_name == "update_emotional_state") {
+        Task emotion_task(TaskType::PB_EMOTION);
+        emotion_task.emotion.arousal = all_args["new_arousal"] | NAN; // NAN: keep current
+        emotion_task.emotion.valence = all_args["new_valence"] | NAN;
+        addTask(tool, emotion_task); 
+        if (all_args.containsKey("sound_effect")) {
+            Task sound_task(TaskType::CB_SOUND_EMOTION);
+            sound_task.sound.path = task_queue.storeText(all_args["sound_effect"]);
+            addTask(tool, sound_task); 
+        }
+        main_task_planned = true;
+    }
+    // 2. Vision: analyze_visual_environment
+    else if (!main_task_planned && tool_name == "analyze_visual_environment") {
+        // (Old 'hoek' logic removed as requested)
+        Task analyze_task(TaskType::CAM_ANALYZE);
+        analyze_task.analyze.question = task_queue.storeText(all_args["question"]);
+        analyze_task.analyze.use_flash = all_args["use_flash"] | false;
+        addTask(tool, analyze_task); 
+        main_task_planned = true;
+    }
+
+    // 3. Speech: announce_message OR start_conversation
+    
+    else if (!main_task_planned && (tool_name == "announce_message" || tool_name == "start_conversation")) {
+        Task speak_task(TaskType::CB_SPEAK);
+        
+        // Map English keys to Internal keys
+        if (all_args.containsKey("announcement")) speak_task.speak.text = task_queue.storeText(all_args["announcement"]);
+        else if (all_args.containsKey("question")) speak_task.speak.text = task_queue.storeText(all_args["question"]);
+        
+        addTask(tool, speak_task);
+        main_task_planned = true;
+    }
+
+    // 4. Movement: move_head
+    
+    else if (!main_task_planned && tool_name == "move_head") {
+        Task head_task(TaskType::CAMCANVAS_MOVE_HEAD);
+        head_task.head.pan = all_args["pan"] | 90; 
+        head_task.head.tilt = all_args["tilt"] | 90; 
+        addTask(tool, head_task);
+        main_task_planned = true;
+    }
+
+    // 5. Image: generate_image
+    
+    else if (!main_task_planned && tool_name == "generate_image") {
+        Task image_task(TaskType::CANVAS_IMAGE_SYNC);
+        image_task.image.prompt = task_queue.storeText(all_args["prompt"]);
+        image_task.image.model = task_queue.storeText(all_args["image_model"]);
+        uint8_t image_handle = addTask(tool, image_task);
+        
+        if (all_args.containsKey("sound_effect")) {
+            Task sound_task(TaskType::CB_SOUND);
+            sound_task.sound.path = task_queue.storeText(all_args["sound_effect"]);
+            sound_task.after = image_handle; // The reveal sound waits for the image, not for the audio lane
+            addTask(tool, sound_task); 
+        }
+        main_task_planned = true;
+    }
+    // 6. Sound: play_sound_effect
+    else if (!main_task_planned && tool_name == "play_sound_effect") {
+        Task sound_task(TaskType::CB_SOUND);
+        sound_task.sound.path = task_queue.storeText(all_args["sound_path"]);
+        addTask(tool, sound_task);
+        main_task_planned = true;
+    }
+    // 7. Nod: nod_head
+    else if (!main_task_planned && tool_name == "nod_head") {
+        Task nod_task(TaskType::CAM_NOD);
+        nod_task.nod.angle = all_args["angle"] | 90;
+        addTask(tool, nod_task);
+        main_task_planned = true;
+    }
+    // 8. Photo: take_photo
+    else if (!main_task_planned && tool_name == "take_photo") {
+        addTask(tool, Task(TaskType::CAM_TAKE_PICTURE));
+        main_task_planned = true;
+    }
+
+    // 9. InputPad: activate_inputpad
+    
+    else if (!main_task_planned && tool_name == "activate_inputpad") {
+        const char* mode = all_args["mode"] | "IDLE";
+        Task input_task(TaskType::INPUTPAD_SET_MODE);
+        input_task.input.mode = (strcmp(mode, "DICE") == 0) ? emily_proto::PAD_DICE :
+                                (strcmp(mode, "YES_NO") == 0) ? emily_proto::PAD_YES_NO :
+                                (strcmp(mode, "A_B_C") == 0) ? emily_proto::PAD_A_B_C : emily_proto::PAD_IDLE;
+        input_task.input.max_value = all_args["max_value"] | 6; // English key
+        addTask(tool, input_task);
+        main_task_planned = true;
+    }
+
+    // 10. CMS Data: retrieve_local_data
+    
+    else if (!main_task_planned && tool_name == "retrieve_local_data") {
+        Task data_task(TaskType::EB_GET_LOCAL_DATA);
+        data_task.local_data.key = task_queue.storeText(all_args["key"]); // English key
+        addTask(tool, data_task);
+        main_task_planned = true;
+    }
+
+    // === Step 3: Handle Unknown Tool ===
+
+    if (task_queue.size() == tasks_before) {
+        Serial.printf("Planner Error: Unknown tool '%s' requested by AI.\n", tool_name.c_str());
+        call.result = "ERROR: Tool does not exist.";
+        addFollowUp("My cognitive core requested a tool '" + tool_name + "' which I do not have.");
+    }
+}
+ 
+
+// --- Need logInteractionToSd implementation (from CognitiveCore.ino) ---
+void EmilyBrain::logInteractionToSd(JsonObject log_data) {
+    ConfigLock lock(config_mutex); // The worker may be streaming history lines into a request
+    File history_file = SD.open(CHAT_HISTORY_PATH, FILE_APPEND);
+    if (history_file) {
+        uint32_t line_start = history_file.size();
+        size_t written = serializeJson(log_data, history_file);
+        history_file.println();
+        history_file.close();
+        // Serial.println("Interaction logged to SD."); // Optional debug
+
+        // Keep the offset index in sync (a stale index is rebuilt on next read)
+        if (written > 0 && history_index_ready) {
+            File index_file = SD.open(CHAT_HISTORY_INDEX_PATH, FILE_APPEND);
+            if (index_file) {
+                index_file.write((const uint8_t*)&line_start, sizeof(line_start));
+                index_file.close();
+                history_line_count++;
+            } else {
+                history_index_ready = false;
+            }
+        }
+    } else {
+        Serial.println("ERROR: Could not open chat_history.jsonl for logging.");
+    }
+}
+// --- Need a similar function for logging tool errors ---
+void EmilyBrain::logInteractionToSd_Error(const char* role, String tool_call_id, String tool_name, String content) {
+     StaticJsonDocument<512> log_doc;
+     log_doc["role"] = role;
+     log_doc["tool_call_id"] = tool_call_id;
+     log_doc["name"] = tool_name;
+     log_doc["content"] = content;
+     logInteractionToSd(log_doc.as<JsonObject>());
+}
+
+// --- Multipart form fields that precede the audio data ---
+String EmilyBrain::buildSttMultipartPrefix(const String& boundary) {
+    String prefix = "--" + boundary + "\r\n";
+    prefix += "Content-Disposition: form-data; name=\"model\"\r\n\r\nopenai/whisper-large-v3\r\n";
+    prefix += "--" + boundary + "\r\n";
+    prefix += "Content-Disposition: form-data; name=\"language\"\r\n\r\nen\r\n";
+    prefix += "--" + boundary + "\r\n";
+    prefix += "Content-Disposition: form-data; name=\"file\"; filename=\"stt_input.wav\"\r\n";
+    prefix += "Content-Type: audio/wav\r\n\r\n";
+    return prefix;
+}
+
+// --- Live STT Upload ---
+// Streams the utterance to Whisper while it is being recorded (chunked
+// transfer encoding), so only one round trip is left once the user stops
+// talking. The recording still goes to SD as well: if anything goes wrong
+// on the socket, transcribeAudioFromSd() uploads the file instead.
+bool EmilyBrain::beginLiveSttUpload() {
+    stt_upload_boundary = "----EmilyBoundary" + String(random(0xFFFFF), HEX);
+    String content_type = "multipart/form-data; boundary=" + stt_upload_boundary;
+
+    if (!venice.beginChunked("POST", VENICE_STT_PATH, content_type.c_str())) {
+        Serial.println("Live STT: Could not start upload, using SD fallback.");
+        return false;
+    }
+
+    // The WAV length isn't known yet: mark it as "unknown" (0xFFFFFFFF)
+    byte wav_header[44];
+    AudioEngine::createWavHeader(wav_header, 0);
+    memset(&wav_header[4], 0xFF, 4);
+    memset(&wav_header[40], 0xFF, 4);
+
+    String prefix = buildSttMultipartPrefix(stt_upload_boundary);
+    stt_upload_active = venice.writeChunk((const uint8_t*)prefix.c_str(), prefix.length()) &&
+                        venice.writeChunk(wav_header, sizeof(wav_header));
+    if (!stt_upload_active) {
+        Serial.println("Live STT: Upload failed at start, using SD fallback.");
+        venice.close();
+        return false;
+    }
+    Serial.println("Live STT: Upload started.");
+    return true;
+}
+
+void EmilyBrain::writeLiveSttUpload(const uint8_t* data, size_t len) {
+    if (!stt_upload_active) return;
+    if (!venice.writeChunk(data, len)) {
+        Serial.println("Live STT: Socket write failed, using SD fallback.");
+        abortLiveSttUpload();
+    }
+}
+
+// Ends the multipart body and reads the transcription response.
+bool EmilyBrain::finishLiveSttUpload(String& response_body) {
+    if (!stt_upload_active) return false;
+    stt_upload_active = false;
+
+    String suffix = "\r\n--" + stt_upload_boundary + "--\r\n";
+    HttpResponse response;
+    if (!venice.writeChunk((const uint8_t*)suffix.c_str(), suffix.length()) ||
+        !venice.finishChunked(response, 30000)) {
+        Serial.println("Live STT: No response, using SD fallback.");
+        venice.close();
+        return false;
+    }
+
+    bool ok = response.readString(response_body, 30000);
+    venice.release(response);
+    if (!ok || response.status() != 200) { // e.g. 411 if chunked bodies are refused
+        Serial.printf("Live STT: Bad response (%d), using SD fallback.\n", response.status());
+        return false;
+    }
+    response_body.trim();
+    return true;
+}
+
+void EmilyBrain::abortLiveSttUpload() {
+    if (!stt_upload_active) return;
+    stt_upload_active = false;
+    venice.close(); // A half-sent body can't be recovered
+}
+
+void EmilyBrain::transcribeAudioFromSd(const char* filename) {
+    File audioFile = SD.open(filename, FILE_READ);
+    if (!audioFile) {
+        processSttResponseAndTriggerAi("{\"error\":\"Could not read audio file.\"}");
+        return;
+    }
+    size_t file_size = audioFile.size();
+    if (file_size <= 44) {
+        audioFile.close();
+        processSttResponseAndTriggerAi("{\"error\":\"Audio file empty or invalid.\"}");
+        return;
+    }
+
+    Serial.printf("Starting STT streaming upload of %s (%d bytes)...\n", filename, file_size);
+    setState(EmilyState::PROCESSING_STT);
+
+    String boundary = "----EmilyBoundary" + String(random(0xFFFFF), HEX);
+
+    // --- Build request parts ---
+    String prefix = buildSttMultipartPrefix(boundary);
+    String suffix = "\r\n--" + boundary + "--\r\n";
+    size_t content_length = prefix.length() + file_size + suffix.length();
+    String content_type = "multipart/form-data; boundary=" + boundary;
+
+    // --- Stream the multipart body (repeatable: rewinds the file on a retry) ---
+    auto write_body = [&](Print& out) {
+        out.print(prefix);
+        audioFile.seek(0);
+        uint8_t buffer[1024];
+        size_t total_bytes_sent = 0;
+        while (total_bytes_sent < file_size) {
+            size_t bytes_read = audioFile.read(buffer, sizeof(buffer));
+            if (bytes_read == 0) break;
+            if (out.write(buffer, bytes_read) != bytes_read) {
+                Serial.println("!!! ERROR sending audio chunk!");
+                break;
+            }
+            total_bytes_sent += bytes_read;
+        }
+        out.print(suffix);
+        Serial.printf("Streaming upload complete (%u bytes sent).\n", total_bytes_sent);
+    };
+
+    HttpResponse response;
+    String response_body = "";
+    Serial.println("Streaming audio data to Venice STT...");
+    if (!venice.request("POST", VENICE_STT_PATH, content_type.c_str(), content_length,
+                        write_body, response, 30000)) {
+        audioFile.close();
+        Serial.println("!!! ERROR: No response from STT server.");
+        processSttResponseAndTriggerAi("{\"error\":\"No response from server\"}");
+        return;
+    }
+    audioFile.close();
+
+    // --- Read Body and Send Result ---
+    if (!response.readString(response_body, 30000)) {
+        response_body = "{\"error\":\"Invalid server response\"}";
+    }
+    venice.release(response);
+    response_body.trim();
+    processSttResponseAndTriggerAi(response_body);
+}
+
+
+
+// --- processSttResponseAndTriggerAi function (from CognitiveCore) ---
+void EmilyBrain::processSttResponseAndTriggerAi(const String& raw_api_payload) {
+    // ... (Implementation remains the same as in CognitiveCore, BUT sends result to AI cycle) ...
+
+    // --- ADJUSTMENT NEEDED (former sendSerialResult functie)---
+    // Instead of sending over SerialPB, if the result_type is "stt_transcript",
+    // we need to parse the transcript and call _start_ai_cycle with it.
+    // If it's an error, we might still call _start_ai_cycle with the error message.
+
+    Serial.println("processSttResponseAndTriggerAi (STT): Parsing transcript...");
+
+    StaticJsonDocument<512> data_doc; // Adjust size
+    DeserializationError error = deserializeJson(data_doc, raw_api_payload);
+    String transcript = "";
+    String error_msg = "";
+
+    if (!error && data_doc.containsKey("text")) {
+        transcript = data_doc["text"].as<String>();
+        Serial.printf("Transcript received: '%s'\n", transcript.c_str());
+    } else if (!error && data_doc.containsKey("error")) {
+        error_msg = data_doc["error"].as<String>();
+        Serial.printf("STT API Error received: '%s'\n", error_msg.c_str());
+    } else {
+        error_msg = "Failed to parse STT response or unknown format.";
+        Serial.println(error_msg);
+    }
+    
+    // --- Trigger AI Cycle with Result ---
+   if (!transcript.isEmpty()) {
+    // Combine the reason and the transcript into ONE string
+    
+    String trigger_string = "The user just said: " + transcript;
+    _start_ai_cycle(trigger_string.c_str()); // Pass ONE argument using .c_str()
+    } else {
+        // Combine the reason and the error into ONE string
+        // --- Optioneel: Log de STT error ook? ---
+        StaticJsonDocument<256> error_log_doc;
+        error_log_doc["role"] = "system"; // Of "internal"?
+        error_log_doc["content"] = "STT Error: " + error_msg;
+        logInteractionToSd(error_log_doc.as<JsonObject>());
+        // --- Einde optioneel ---
+        String trigger_string = "I tried listening but received no clear transcript. Error: " + error_msg;
+        _start_ai_cycle(trigger_string.c_str()); // Pass ONE argument using .c_str()
+    }
+    // Serial.println(">>> DEBUG: Returned from _start_ai_cycle (after STT).");
+    
+    // Note: State change happens inside _start_ai_cycle
+}
+
+// Starts a VAD recording on the audio engine. The AWAITING_SPEECH and
+// RECORDING_SPEECH handlers follow it up (live upload, then transcription).
+void EmilyBrain::listenAndTranscribe() {
+    Serial.println("Starting listen_and_transcribe process...");
+    abortLiveSttUpload();
+
+    stt_capture_ring.begin(STT_CAPTURE_RING_BYTES);
+    audio_job_id = audio.record(STT_INPUT_PATH, stt_capture_ring.isAllocated() ? &stt_capture_ring : nullptr);
+    if (audio_job_id == 0) {
+        processSttResponseAndTriggerAi("{\"error\":\"Recording failed\"}");
+        return;
+    }
+    setState(EmilyState::AWAITING_SPEECH);
+}
+
+// Moves captured microphone audio from the engine's ring onto the socket.
+void EmilyBrain::pumpLiveSttUpload() {
+    if (!stt_upload_active) return;
+    if (audio.captureOverflowed()) {
+        Serial.println("Live STT: Capture buffer overflowed, using SD fallback.");
+        abortLiveSttUpload();
+        return;
+    }
+    const uint8_t* span;
+    size_t n;
+    while (stt_upload_active && (n = stt_capture_ring.readSpan(&span)) > 0) {
+        if (n > 2048) n = 2048;
+        writeLiveSttUpload(span, n);
+        stt_capture_ring.consume(n);
+    }
+}
+
+// Called once the recording job reports RECORDING_DONE.
+void EmilyBrain::finishListening(uint32_t captured_bytes) {
+    audio_job_id = 0;
+
+    // If recording successful (speech detected), transcribe it
+    if (captured_bytes > 0) {
+        pumpLiveSttUpload(); // Whatever is left in the capture ring
+
+        // The audio is already on the server if the live upload held up
+        String live_response;
+        if (stt_upload_active) {
+            setState(EmilyState::PROCESSING_STT);
+            if (finishLiveSttUpload(live_response)) {
+                processSttResponseAndTriggerAi(live_response);
+                return;
+            }
+        }
+        transcribeAudioFromSd(STT_INPUT_PATH); // This function will set state and call AI cycle
+    } else {
+        // No speech detected or recording failed
+        abortLiveSttUpload();
+        Serial.println("No speech detected or recording failed. Returning to IDLE.");
+        processSttResponseAndTriggerAi("{\"error\":\"No speech detected\"}"); // Inform AI cycle
+    }
+}
+
+// --- Audio Engine Helpers ---
+// Returns the next event of the current audio job; events of jobs that were
+// stopped earlier are dropped.
+bool EmilyBrain::pollAudioEvent(AudioEvent& evt) {
+    while (audio.pollEvent(evt)) {
+        if (audio_job_id != 0 && evt.job_id == audio_job_id) return true;
+    }
+    return false;
+}
+
+// Interrupt: abort playback/recording and anything streaming alongside it.
+void EmilyBrain::stopAudio() {
+    audio.stop(); // Also silences fire-and-forget sound effects
+    audio_job_id = 0;
+    closeTtsStream();
+    resetSpeechPipeline();
+    abortLiveSttUpload();
+}
+
+// --- The Executor ---
+// Starts every task whose lane is free and whose 'after' task is done.
+// Lanes run in parallel; within a lane tasks keep their plan order, except
+// that a task waiting for its 'after' lets later ones go first. Called
+// after planning and whenever a running task completes (completeTask());
+// the turn is over once every task is DONE.
+void EmilyBrain::_continue_task() {
+    
+    if (task_queue.empty()) {
+        Serial.println("Executor: Task queue empty. Mission complete.");
+        finishTurn();
+        return;
+    }
+
+    // Instant tasks finish inside startTask() and may unblock others, so
+    // ask again after every start
+    int next;
+    while ((next = task_queue.nextStartable()) >= 0) {
+        Task& task = task_queue[next];
+        if (startTask(task)) {
+            task.status = TaskStatus::DONE;
+            physical_task_start_time = 0; 
+        } else if (task_queue.empty()) {
+            return; // The starter abandoned the turn (TTS failure)
+        } else {
+            task.status = TaskStatus::RUNNING;
+        }
+    }
+
+    if (task_queue.allDone()) {
+        Serial.println("Executor: All lanes drained. Mission complete.");
+        finishTurn();
+        return;
+    }
+
+    // Nothing running but not done means an 'after' can never be met
+    if (!task_queue.anyRunning()) {
+        Serial.println("Executor Error: Remaining tasks can never start, ending turn.");
+        abandonTurn("ERROR: Not executed, a dependency was never met.");
+        dropEarlySpeech();
+        setState(EmilyState::IDLE);
+        return;
+    }
+    updateTurnState();
+}
+
+// Runs the starter of one task. True if it completed immediately.
+bool EmilyBrain::startTask(Task& task) {
+    if (task.tool < turn_tool_count) {
+        active_tool_call_id = turn_tool_calls[task.tool].id; // The call this task belongs to
+        active_tool_call_name = turn_tool_calls[task.tool].name;
+    }
+    Serial.printf("Executor: Starting task type '%s' on the %s lane (%s)\n",
+                  taskTypeName(task.type), taskLaneName(taskLane(task.type)), active_tool_call_name.c_str());
+
+    // --- Task Dispatch ---
+    // Indexed by TaskType; keep the order in sync with the enum.
+    static const TaskStarter starters[] = {
+        &EmilyBrain::startEmotionTask,      // PB_EMOTION
+        &EmilyBrain::startSoundTask,        // CB_SOUND
+        &EmilyBrain::startSoundTask,        // CB_SOUND_EMOTION
+        &EmilyBrain::startSpeakTask,        // CB_SPEAK
+        &EmilyBrain::startMoveHeadTask,     // CAMCANVAS_MOVE_HEAD
+        &EmilyBrain::startSetLedTask,       // CAMCANVAS_SET_LED
+        &EmilyBrain::startAnalyzeTask,      // CAM_ANALYZE
+        &EmilyBrain::startNodTask,          // CAM_NOD
+        &EmilyBrain::startTakePictureTask,  // CAM_TAKE_PICTURE
+        &EmilyBrain::startImageSyncTask,    // CANVAS_IMAGE_SYNC
+        &EmilyBrain::startImageAsyncTask,   // CANVAS_IMAGE_ASYNC
+        &EmilyBrain::startInputPadTask,     // INPUTPAD_SET_MODE
+        &EmilyBrain::startLocalDataTask     // EB_GET_LOCAL_DATA
+    };
+    static_assert(sizeof(starters) / sizeof(starters[0]) == (size_t)TaskType::COUNT,
+                  "Task dispatch table out of sync with TaskType");
+
+    if (task.type < TaskType::COUNT) {
+        return (this->*starters[(size_t)task.type])(task);
+    }
+    Serial.printf("Executor Error: Unknown task type %u\n", (unsigned)task.type);
+    return true; // Unknown types are skipped
+}
+
+// The task running on 'lane', or nullptr if the lane is idle.
+Task* EmilyBrain::runningTask(TaskLane lane) {
+    int index = task_queue.running(lane);
+    return index >= 0 ? &task_queue[index] : nullptr;
+}
+
+bool EmilyBrain::taskRunning(TaskType type) {
+    Task* task = runningTask(taskLane(type));
+    return task != nullptr && task->type == type;
+}
+
+// A waiting task got its answer (or timed out): free its lane and start
+// whatever can run now.
+void EmilyBrain::completeTask(Task& task) {
+    task.status = TaskStatus::DONE;
+    _continue_task();
+}
+
+// Shows what the turn is waiting for. Speech owns the state while it runs
+// (the audio handlers drive it); otherwise the first busy lane decides.
+void EmilyBrain::updateTurnState() {
+    if (runningTask(TaskLane::AUDIO) != nullptr) return;
+
+    Task* task = runningTask(TaskLane::CAMCANVAS);
+    if (task != nullptr) {
+        setState(task->type == TaskType::CAM_ANALYZE ? EmilyState::SEEING : EmilyState::VISUALIZING);
+    } else if (runningTask(TaskLane::INPUTPAD) != nullptr) {
+        setState(EmilyState::AWAITING_INPUT);
+    } else if (runningTask(TaskLane::LOCAL) != nullptr) {
+        setState(EmilyState::PROCESSING_GAMEDATA);
+    }
+}
+
+// Polls the lanes that wait for a device, whatever the state machine is
+// doing (speech runs through its own states).
+void EmilyBrain::serviceTaskLanes() {
+    if (task_queue.empty()) return;
+
+    Task* task = runningTask(TaskLane::CAMCANVAS);
+    if (task != nullptr) {
+        if (task->type == TaskType::CAM_ANALYZE) serviceVisionTask(*task);
+        else if (task->type == TaskType::CANVAS_IMAGE_SYNC) serviceImageTask(*task);
+    }
+    // Re-fetched after each call: a completed task may have ended the turn
+    task = runningTask(TaskLane::INPUTPAD);
+    if (task != nullptr) serviceInputTask(*task);
+
+    task = runningTask(TaskLane::LOCAL);
+    if (task != nullptr) serviceLocalDataTask(*task);
+}
+
+// --- Turn Results ---
+// Result of the tool call 'task' belongs to. The first result
+// set wins (a failed step isn't overwritten by a later success).
+void EmilyBrain::setToolResult(const Task& task, const String& result) {
+    uint8_t tool = task.tool;
+    if (tool < turn_tool_count && turn_tool_calls[tool].result.isEmpty()) {
+        turn_tool_calls[tool].result = result;
+    }
+}
+
+// Queues a line for the follow-up AI cycle at the end of the turn.
+void EmilyBrain::addFollowUp(const String& trigger) {
+    if (!turn_followup.isEmpty()) turn_followup += "\n";
+    turn_followup += trigger;
+}
+
+// Logs one 'tool' result per tool call of the turn, in call order, so the
+// history answers every tool_call_id of the assistant message.
+void EmilyBrain::logToolResults(const char* default_result) {
+    for (uint8_t i = 0; i < turn_tool_count; i++) {
+        const ToolCallResult& call = turn_tool_calls[i];
+        logInteractionToSd_Error("tool", call.id, call.name, call.result.isEmpty() ? String(default_result) : call.result);
+    }
+    turn_tool_count = 0;
+    active_tool_call_id = "";
+    active_tool_call_name = "";
+}
+
+// All tasks done: log the results, then ask the LLM once about everything
+// that came back (vision, input, data, errors), or go idle.
+// A start_conversation listens once everything else is done as well.
+void EmilyBrain::finishTurn() {
+    logToolResults("SUCCESS: Action completed.");
+    task_queue.clear();
+    dropEarlySpeech(); // The turn didn't speak what was prefetched
+    EmilyState after_turn = next_state_after_audio;
+    next_state_after_audio = EmilyState::IDLE;
+
+    if (!turn_followup.isEmpty()) {
+        String trigger = turn_followup;
+        turn_followup = "";
+        Serial.println("Executor: Starting one follow-up cycle for this turn's results.");
+        _start_ai_cycle(trigger.c_str());
+    } else if (after_turn == EmilyState::AWAITING_SPEECH) {
+        Serial.println("Executor: Conversation turn done, starting listening.");
+        setState(EmilyState::AWAITING_SPEECH);
+        listenAndTranscribe();
+    } else {
+        setState(EmilyState::IDLE); // Return to idle
+    }
+}
+
+// Ends the turn early (failure or interrupt). Tool calls that didn't get
+// a result yet get 'reason'. The caller sets the next state.
+void EmilyBrain::abandonTurn(const char* reason) {
+    logToolResults(reason);
+    turn_followup = "";
+    next_state_after_audio = EmilyState::IDLE;
+    task_queue.clear();
+}
+
+bool EmilyBrain::startEmotionTask(Task& task) {
+    // Directly update internal emotional state
+    if (!isnan(task.emotion.arousal)) arousal = task.emotion.arousal; // Keep current if missing
+    if (!isnan(task.emotion.valence)) valence = task.emotion.valence;
+    Serial.printf("Executor: Emotion updated - Arousal=%.2f, Valence=%.2f\n", arousal, valence);
+
+    // Clear context if arousal drops below threshold (homeostasis)
+    if (arousal <= AROUSAL_THRESHOLD) {
+         if (current_arousal_context != nullptr) {
+            Serial.println("Executor: Homeostasis reached, clearing context.");
+            current_arousal_context = nullptr;
+         }
+    }
+    return true; // This task is instant
+}
+
+bool EmilyBrain::startSoundTask(Task& task) {
+    // Sound effects go to the mixer and play on top of whatever follows
+    // (sound_path from play_sound_effect, sound_effect from update_emotional_state)
+    const char* path = task.sound.path;
+    if (path != nullptr) {
+        // Ambience sits under Emily's voice instead of competing with it
+        float gain = (strncmp(path, "/sounds/ambiance/", 17) == 0) ? SOUND_AMBIENCE_GAIN : SOUND_EFFECT_GAIN;
+        Serial.printf("Executor: Playing sound '%s' (gain %.2f).\n", path, gain);
+        audio.playFile(path, gain, false);
+    } else {
+        Serial.println("Executor Warning: Sound task without a valid path.");
+    }
+    return true;
+}
+
+// --- CAMCANVAS_MOVE_HEAD (Vervangt oude OS_MOVE en Head moves) ---
+bool EmilyBrain::startMoveHeadTask(Task& task) {
+    emily_proto::MoveHead cmd;
+    cmd.pan = task.head.pan;
+    cmd.tilt = task.head.tilt;
+    Serial.printf("Executor: Sending CamCanvas command: move_head (pan %d, tilt %d)\n", cmd.pan, cmd.tilt);
+    sendNodeCommand(CAMCANVAS_IP_ADDRESS, CAMCANVAS_UDP_PORT, cmd);
+
+    Serial.println("Executor: move_head command sent to CamCanvas.");
+    return true; // No need to wait: the outbox retries until CamCanvas ACKs
+}
+
+// --- CB_SPEAK Task (Aangepast naar Engels) ---
+bool EmilyBrain::startSpeakTask(Task& task) {
+    const char* text_to_speak = task.speak.text;
+
+    if (text_to_speak == nullptr || strlen(text_to_speak) == 0) {
+        Serial.println("Executor Error: No text found for CB_SPEAK task.");
+        return true; // Skip this malformed task
+    }
+
+    Serial.printf("Executor: Starting TTS for: '%s'\n", text_to_speak);
+    setDisplayText(text_to_speak);
+
+    // Check against English tool name
+    if (active_tool_call_name == "start_conversation") {
+        next_state_after_audio = EmilyState::AWAITING_SPEECH; 
+        Serial.println("Executor: Will transition to AWAITING_SPEECH after speaking.");
+    } else { 
+        next_state_after_audio = EmilyState::IDLE;
+        Serial.println("Executor: Will transition to IDLE after speaking.");
+    }
+
+    // Start the TTS process (will set state internally)
+    if (!processTtsRequest(text_to_speak)) {
+        setToolResult(task, "ERROR: Failed to generate speech audio.");
+        abandonTurn("ERROR: Not executed, an earlier action failed.");
+        setState(EmilyState::IDLE);
+        return false;
+    }
+
+    // Set timer for TTS timeout monitoring
+    tts_task_start_time = millis();
+
+    return false; // TTS takes time; finishSpeaking() completes the task
+}
+
+// --- CAM_ANALYZE Task ---
+bool EmilyBrain::startAnalyzeTask(Task& task) {
+    const char* question = task.analyze.question ? task.analyze.question : "Describe what you see.";
+
+    emily_proto::AnalyzeVision cmd;
+    cmd.use_flash = task.analyze.use_flash ? 1 : 0;
+    Serial.printf("Executor: Sending CAM command: analyze_vision '%s'\n", question);
+    sendNodeCommand(CAMCANVAS_IP_ADDRESS, CAMCANVAS_UDP_PORT, cmd, question);
+
+    camcanvas_task_start_time = millis(); // Start timer
+    return false; // Waits on the CamCanvas lane (SEEING)
+}
+
+// --- CAM_NOD Task ---
+bool EmilyBrain::startNodTask(Task& task) {
+    emily_proto::NodHead cmd;
+    cmd.angle = task.nod.angle;
+    Serial.printf("Executor: Sending CAMCANVAS command (Nod): angle %d\n", cmd.angle);
+    sendNodeCommand(CAMCANVAS_IP_ADDRESS, CAMCANVAS_UDP_PORT, cmd);
+
+    Serial.println("Executor: Nod command sent to CAMCANVAS.");
+    return true;
+}
+
+bool EmilyBrain::startTakePictureTask(Task& task) {
+    Serial.println("Executor: Sending CAMCANVAS command: take_picture");
+    sendNodeCommand(CAMCANVAS_IP_ADDRESS, CAMCANVAS_UDP_PORT, emily_proto::TakePicture());
+    return true;
+}
+
+// --- CAMCANVAS_SET_LED Taak ---
+bool EmilyBrain::startSetLedTask(Task& task) {
+    static const char* const effect_names[] = { "none", "pulse", "blink" };
+
+    emily_proto::SetLed cmd;
+    cmd.r = task.led.r;
+    cmd.g = task.led.g;
+    cmd.b = task.led.b;
+    cmd.effect = task.led.effect;
+    cmd.speed_ms = task.led.speed_ms;
+    Serial.printf("Executor: Sending CamCanvas LED command: %s (%u,%u,%u)\n",
+                  effect_names[cmd.effect <= emily_proto::LED_BLINK ? cmd.effect : 0], cmd.r, cmd.g, cmd.b);
+    sendNodeCommand(CAMCANVAS_IP_ADDRESS, CAMCANVAS_UDP_PORT, cmd);
+    return true;
+}
+
+// --- CANVAS_IMAGE_SYNC Task (Blocking) ---
+bool EmilyBrain::startImageSyncTask(Task& task) {
+    const char* prompt = task.image.prompt ? task.image.prompt : "a robot";
+
+    emily_proto::GenerateImage cmd = {};
+    strlcpy(cmd.model, task.image.model ? task.image.model : "venice-sd35", sizeof(cmd.model));
+    Serial.printf("Executor: Sending CAMCANVAS command (SYNC): generate_image with %s\n", cmd.model);
+    sendNodeCommand(CAMCANVAS_IP_ADDRESS, CAMCANVAS_UDP_PORT, cmd, prompt);
+
+    camcanvas_task_start_time = millis(); 
+    return false; // Waits on the CamCanvas lane (VISUALIZING)
+}
+
+// --- CANVAS_IMAGE_ASYNC Task (Non-blocking) ---
+bool EmilyBrain::startImageAsyncTask(Task& task) {
+    const char* prompt = task.image.prompt ? task.image.prompt : "a robot";
+
+    emily_proto::GenerateImage cmd = {};
+    strlcpy(cmd.model, task.image.model ? task.image.model : "venice-sd35", sizeof(cmd.model));
+    Serial.printf("Executor: Sending CAMCANVAS command (ASYNC): generate_image with %s\n", cmd.model);
+    sendNodeCommand(CAMCANVAS_IP_ADDRESS, CAMCANVAS_UDP_PORT, cmd, prompt);
+
+    Serial.println("Executor: Async image command sent.");
+    return true; // ASYNC: Don't wait
+}
+
+// --- INPUTPAD Tools (Aangepast naar Engels) ---
+bool EmilyBrain::startInputPadTask(Task& task) {
+    static const char* const mode_names[] = { "IDLE", "DICE", "YES_NO", "A_B_C" };
+
+    emily_proto::SetMode cmd = {};
+    cmd.mode = task.input.mode;
+    cmd.dice_max = task.input.max_value;
+    Serial.printf("Executor: Sending INPUTPAD command: set_mode %s (max %u)\n",
+                  mode_names[cmd.mode <= emily_proto::PAD_A_B_C ? cmd.mode : 0], cmd.dice_max);
+    sendNodeCommand(INPUTPAD_IP_ADDRESS, INPUTPAD_UDP_PORT, cmd);
+
+    input_task_start_time = millis(); 
+    return false; // Waits on the InputPad lane (AWAITING_INPUT)
+}
+
+// --- EB_GET_LOCAL_DATA ---
+bool EmilyBrain::startLocalDataTask(Task& task) {
+    Serial.println("Executor: Local data lookup queued on the local lane");
+    return false; // serviceLocalDataTask() does the lookup next loop
+}
+
+
+// Feeds deserializeJson() no more than 'left' bytes of the file, so a span
+// that no longer matches the file can't make it parse on into what follows.
+struct SpanReader {
+    File& file;
+    uint32_t left;
+
+    int read() {
+        if (left == 0) return -1;
+        int c = file.read();
+        if (c >= 0) left--;
+        return c;
+    }
+    size_t readBytes(char* buffer, size_t length) {
+        if (length > left) length = left;
+        size_t n = file.read((uint8_t*)buffer, length);
+        left -= n;
+        return n;
+    }
+};
+
+String EmilyBrain::getDataFromJson(const char* key) {
+    if (strcmp(key, "ERROR_KEY") == 0) {
+        return "ERROR"; // Invalid key passed
+    }
+
+    ConfigLock lock(config_mutex); // An upload may be replacing the file
+    File file = SD.open(ADVENTURE_PATH);
+    if (!file) { 
+        Serial.println("ERROR: Could not open " ADVENTURE_PATH);
+        return "ERROR"; 
+    }
+
+    // A different size means the file was swapped behind our back (SD card edit)
+    if (!adventure_index_ready || file.size() != adventure_index_file_size) {
+        file.close();
+        if (!buildAdventureIndex()) return "ERROR";
+        file = SD.open(ADVENTURE_PATH);
+        if (!file) return "ERROR";
+    }
+
+    auto it = adventure_index.find(String(key));
+    if (it == adventure_index.end()) { 
+        file.close();
+        Serial.printf("ERROR: getDataFromJson - Key '%s' not found in json.\n", key);
+        return "ERROR";
+    }
+
+    // One seek, then parse only this node's bytes. The document grows with
+    // the node, so its size is capped through the input it may consume.
+    const JsonSpan& span = it->second;
+    if (span.length > ADVENTURE_MAX_VALUE) {
+        file.close();
+        Serial.printf("ERROR: getDataFromJson - Key '%s' holds %u bytes, more than %d.\n",
+                      key, span.length, ADVENTURE_MAX_VALUE);
+        return "ERROR";
+    }
+    if (!file.seek(span.offset)) {
+        file.close();
+        Serial.printf("ERROR: getDataFromJson - Seek to %u failed.\n", span.offset);
+        return "ERROR";
+    }
+    JsonDocument doc;
+    SpanReader reader = { file, span.length };
+    DeserializationError error = deserializeJson(doc, reader);
+    file.close();
+
+    if (!error && doc.overflowed()) error = DeserializationError::NoMemory;
+    if (error) { 
+        Serial.print("ERROR: JSON Deserialization failed: ");
+        Serial.println(error.c_str());
+        adventure_index_ready = false; // Offsets no longer match the file; re-map next time
+        return "ERROR"; 
+    }
+
+    String output_string;
+    serializeJson(doc, output_string);
+    
+    return output_string;
+}
+
+// --- Adventure Key Index ---
+// One pass over ADVENTURE_PATH that records, for every top-level key, where
+// its value starts and how many bytes it spans. Only string and nesting
+// state is tracked, so nothing is tokenized or allocated per node. Built at
+// boot and after every /upload of the file.
+bool EmilyBrain::buildAdventureIndex() {
+    ConfigLock lock(config_mutex);
+    adventure_index.clear();
+    adventure_index_ready = false;
+    adventure_index_file_size = 0;
+
+    File file = SD.open(ADVENTURE_PATH);
+    if (!file) {
+        Serial.println("Adventure index: no " ADVENTURE_PATH " on SD card.");
+        return false;
+    }
+
+    enum class Expect { KEY, COLON, VALUE, IN_VALUE, DONE };
+    Expect expect = Expect::KEY;
+    int depth = 0;
+    bool in_string = false;
+    bool escaped = false;
+    bool capturing_key = false;
+    bool key_too_long = false;
+    String key;
+    uint32_t value_start = 0;
+    uint32_t value_end = 0;     // One past the last byte of the current value
+    bool malformed = false;
+
+    auto addEntry = [&]() {
+        if (key_too_long) {
+            Serial.printf("Adventure index: Key '%s...' is longer than %d characters, skipped.\n",
+                          key.c_str(), ADVENTURE_MAX_KEY);
+            return;
+        }
+        adventure_index[key] = { value_start, value_end - value_start };
+    };
+
+    unsigned long start_ms = millis();
+    uint8_t buffer[512];
+    uint32_t file_pos = 0;
+    int bytes_read;
+    while (expect != Expect::DONE && !malformed && (bytes_read = file.read(buffer, sizeof(buffer))) > 0) {
+        for (int i = 0; i < bytes_read && expect != Expect::DONE; i++) {
+            char c = (char)buffer[i];
+            uint32_t pos = file_pos + i;
+
+            if (in_string) {
+                if (escaped) {
+                    escaped = false;
+                } else if (c == '\\') {
+                    escaped = true;
+                } else if (c == '"') {
+                    in_string = false;
+                    if (capturing_key) {
+                        capturing_key = false;
+                        expect = Expect::COLON;
+                        continue;
+                    }
+                }
+                if (capturing_key) {
+                    if (key.length() < ADVENTURE_MAX_KEY) key += c;
+                    else key_too_long = true; // Truncated it could collide with another key
+                } else if (expect == Expect::IN_VALUE) {
+                    value_end = pos + 1;
+                }
+                continue;
+            }
+            if (c == ' ' || c == '\t' || c == '\r' || c == '\n') continue;
+
+            // First byte of a top-level value
+            if (depth == 1 && expect == Expect::VALUE) {
+                value_start = pos;
+                expect = Expect::IN_VALUE;
+            }
+
+            switch (c) {
+                case '"':
+                    in_string = true;
+                    if (depth == 1 && expect == Expect::KEY) {
+                        capturing_key = true;
+                        key_too_long = false;
+                        key = "";
+                    }
+                    break;
+                case '{':
+                case '[':
+                    depth++;
+                    if (depth == 1 && c != '{') malformed = true; // Root must be an object
+                    break;
+                case '}':
+                case ']':
+                    depth--;
+                    if (depth == 0) {
+                        if (expect == Expect::IN_VALUE) addEntry();
+                        expect = Expect::DONE;
+                        continue;
+                    }
+                    if (depth < 0) malformed = true;
+                    break;
+                case ':':
+                    if (depth == 1 && expect == Expect::COLON) {
+                        expect = Expect::VALUE;
+                        continue;
+                    }
+                    break;
+                case ',':
+                    if (depth == 1 && expect == Expect::IN_VALUE) {
+                        addEntry();
+                        expect = Expect::KEY;
+                        continue;
+                    }
+                    break;
+                default:
+                    if (depth == 0) malformed = true; // Data outside the root object
+                    break;
+            }
+            if (expect == Expect::IN_VALUE) value_end = pos + 1;
+        }
+        file_pos += bytes_read;
+    }
+    adventure_index_file_size = file.size();
+    file.close();
+
+    if (malformed || expect != Expect::DONE) {
+        adventure_index.clear();
+        Serial.println("ERROR: Adventure index - " ADVENTURE_PATH " is not a complete JSON object.");
+        return false;
+    }
+
+    adventure_index_ready = true;
+    Serial.printf("Adventure index built (%u keys, %lu ms).\n", (unsigned)adventure_index.size(), millis() - start_ms);
+    return true;
+}
+
+
+// --- Helper Function for Significant Events ---
+void EmilyBrain::addSignificantEvent(const String& event_desc) {
+    // Check if deque is full
+    if (significant_events.size() >= MAX_SIGNIFICANT_EVENTS) {
+        significant_events.pop_front(); // Remove oldest event
+    }
+    // Add new event
+    significant_events.push_back(event_desc);
+    Serial.println("DEBUG: Added significant event: " + event_desc);
+}
+
+String EmilyBrain::buildTtsPayload(const char* textToSpeak) {
+    StaticJsonDocument<256> payload_doc; // Small doc is enough for TTS payload
+    payload_doc["model"] = "tts-kokoro";
+    payload_doc["input"] = textToSpeak;
+    payload_doc["voice"] = "af_nova";
+    payload_doc["response_format"] = "wav";
+    String payload_string;
+    serializeJson(payload_doc, payload_string);
+    return payload_string;
+}
+
+// Starts speaking 'text': state SPEAKING, or GENERATING_SPEECH while the
+// answer to the early request or the first SD segment is still on its way.
+// False if no audio could be made. Only the first segment is synthesized
+// here; handleSpeakingState() fetches the others while the previous one
+// plays.
+bool EmilyBrain::processTtsRequest(const char* text) {
+    Serial.println("Processing TTS request...");
+    
+    Serial.printf(">>> TTS: Free Heap: %u, Free PSRAM: %u\n", 
+                  ESP.getFreeHeap(), ESP.getFreePsram());
+
+    tts_task_start_time = millis();
+
+    // Requested while the AI was still answering (see prefetchSpeech())
+    if (speech_early && tts_request_pending && speech_text == text) {
+        // The answer beat the speech: handleGeneratingSpeechState() polls for it
+        speech_early = false; // The SPEAK task owns the request now
+        setState(EmilyState::GENERATING_SPEECH);
+        Serial.println(">>> DEBUG: Exiting processTtsRequest (waiting for the early request).");
+        return true;
+    }
+    if (speech_early && tts_stream_active && speech_text == text) {
+        speech_early = false;
+        setState(EmilyState::SPEAKING);
+        Serial.println(">>> DEBUG: Exiting processTtsRequest (prefetched stream).");
+        return true;
+    }
+    closeTtsStream(); // Prefetched for a different text
+    resetSpeechPipeline();
+    speech_text = text;
+    String segment;
+    if (!takeSpeechSegment(segment)) return false;
+
+    // Preferred: play the audio while it is still being synthesized
+    setState(EmilyState::GENERATING_SPEECH);
+    if (openTtsStream(segment.c_str())) {
+        setState(EmilyState::SPEAKING);
+        Serial.println(">>> DEBUG: Exiting processTtsRequest (streaming).");
+        return true;
+    }
+    Serial.println("TTS streaming unavailable, falling back to SD download...");
+
+    // handleGeneratingSpeechState() waits for the download (and retries once)
+    speech_pos = 0;  // The segment the stream didn't get
+    speech_file = 1; // Nothing plays yet: the first segment goes to TTS_FILE_A
+    prefetchSpeechFile();
+    Serial.println(">>> DEBUG: Exiting processTtsRequest (downloading).");
+    return true;
+}
+
+// --- Speech Pipeline ---
+// Next piece of speech_text to synthesize. False once everything is taken.
+bool EmilyBrain::takeSpeechSegment(String& segment) {
+    const char* text = speech_text.c_str();
+    size_t len = speech_text.length();
+    while (speech_pos < len && isspace((unsigned char)text[speech_pos])) speech_pos++;
+    if (speech_pos >= len) return false;
+
+    size_t end = speechSegmentEnd(text, speech_pos, len);
+    segment = speech_text.substring(speech_pos, end);
+    segment.trim();
+    Serial.printf("TTS: Segment of %u chars (%u of %u done)\n", segment.length(), end, len);
+    speech_pos = end;
+    return true;
+}
+
+void EmilyBrain::resetSpeechPipeline() {
+    endSpeechDownload(false);
+    speech_text = "";
+    speech_pos = 0;
+    speech_file = 0;
+    speech_file_ready = false;
+    speech_waiting = false;
+    speech_retried = false;
+    speech_early = false;
+}
+
+// Streamed AI answer (VENICE_EARLY_SPEECH): the announcement or question
+// arrived before the rest of the response, so its first segment is
+// requested right away and synthesized while the LLM finishes. The SPEAK
+// task takes the open stream over in processTtsRequest() if the text
+// matches.
+// This runs on the main task, so only the send is done here, and only on
+// the warm session left by the STT upload: a few hundred bytes, never a
+// DNS lookup or TLS handshake. Without one the text is spoken the normal
+// way later. Waiting for the synthesized audio is left to pollEarlySpeech().
+void EmilyBrain::prefetchSpeech(const String& text) {
+    closeTtsStream();
+    resetSpeechPipeline();
+    speech_text = text;
+    String segment;
+    if (!takeSpeechSegment(segment)) return;
+    if (!venice.hasWarmSession()) {
+        Serial.println("TTS: No warm session for the early request, speaking normally later.");
+        resetSpeechPipeline();
+        return;
+    }
+    if (!tts_ring.begin(TTS_RING_BYTES)) {
+        resetSpeechPipeline();
+        return;
+    }
+
+    Serial.printf("TTS Stream: Requesting audio early for '%s'\n", segment.c_str());
+    String payload_string = buildTtsPayload(segment.c_str());
+    if (!venice.send("POST", VENICE_TTS_PATH, "application/json", payload_string.length(),
+                     [&](Print& out) { out.print(payload_string); }, true)) { // Warm session only
+        Serial.println("TTS: Early request failed, speaking normally later.");
+        resetSpeechPipeline();
+        return;
+    }
+    tts_request_pending = true;
+    tts_requested_at = millis();
+    speech_early = true;
+    Serial.println("TTS: Speech requested while the AI is still answering.");
+}
+
+// PROCESSING_AI: reads the early response once the server starts answering,
+// then keeps the jitter buffer filled. Never waits on the socket.
+void EmilyBrain::pollEarlySpeech() {
+    if (!speech_early) return;
+    if (!tts_request_pending) {
+        pumpTtsStream();
+        return;
+    }
+    if (venice.responseReady()) {
+        finishEarlySpeech(); // The headers and WAV header are arriving now
+    } else if (millis() - tts_requested_at > TTS_RESPONSE_TIMEOUT_MS) {
+        Serial.println("TTS: Early request timed out.");
+        dropEarlySpeech();
+    }
+}
+
+// Parses the response to the early request once responseReady() says it
+// is arriving; the reads are bounded by TTS_HEADER_TIMEOUT_MS. On failure
+// the early speech is forgotten and the SPEAK task synthesizes the text
+// the normal way.
+bool EmilyBrain::finishEarlySpeech() {
+    tts_request_pending = false;
+    if (!venice.receive(tts_response, TTS_HEADER_TIMEOUT_MS)) {
+        Serial.println("TTS Stream ERROR: No response to the early request.");
+    } else if (acceptTtsResponse(TTS_HEADER_TIMEOUT_MS)) {
+        tts_stream_active = true;
+        return true;
+    }
+    Serial.println("TTS: Early request failed, speaking normally later.");
+    resetSpeechPipeline();
+    return false;
+}
+
+// Closes a prefetched stream nobody is going to play.
+void EmilyBrain::dropEarlySpeech() {
+    if (!speech_early) return;
+    Serial.println("TTS: Dropping unused early speech.");
+    closeTtsStream();
+    resetSpeechPipeline();
+}
+
+// Streams the next segment into the ring the engine is still playing the
+// previous one from, so the sentences follow each other without a gap.
+// On failure the segment is left for the SD fallback (see
+// playNextSpeechFile()) once the stream has played out.
+bool EmilyBrain::continueTtsStream() {
+    size_t segment_start = speech_pos;
+    String segment;
+    if (!takeSpeechSegment(segment)) return false;
+
+    int sample_rate = tts_stream_header.sampleRate;
+    closeTtsStream();
+    if (!requestTtsStream(segment.c_str())) {
+        speech_pos = segment_start;
+        return false;
+    }
+    if (tts_stream_header.sampleRate != sample_rate) {
+        Serial.println("TTS Stream ERROR: Segment has a different sample rate.");
+        venice.release(tts_response);
+        speech_pos = segment_start;
+        return false;
+    }
+    tts_stream_active = true;
+    return true;
+}
+
+// SD fallback: requests the next segment for the file that isn't playing.
+// Only the request is sent here; pumpSpeechDownload() writes the answer
+// to SD from loop() while the current segment plays, so loop() never
+// waits for the synthesis. False if nothing is left to say or the request
+// couldn't be sent (the rest of the text is skipped then).
+bool EmilyBrain::prefetchSpeechFile() {
+    if (speech_file_ready || speechDownloadBusy()) return true;
+    size_t segment_start = speech_pos;
+    String segment;
+    if (!takeSpeechSegment(segment)) return false;
+
+    speech_download_from = segment_start;
+    Serial.printf("TTS Download: Requesting audio for '%s' to %s\n",
+                  segment.c_str(), speech_file ? TTS_FILE_A : TTS_FILE_B);
+    String payload_string = buildTtsPayload(segment.c_str());
+    if (!venice.send("POST", VENICE_TTS_PATH, "application/json", payload_string.length(),
+                     [&](Print& out) { out.print(payload_string); })) {
+        Serial.println("TTS Download ERROR: Failed to connect to API.");
+        endSpeechDownload(false);
+        return false;
+    }
+    speech_download_pending = true;
+    speech_download_at = millis();
+    return true;
+}
+
+// SD fallback: moves the segment download along without waiting on the
+// socket. Reads the response headers once the server answers, then
+// writes whatever body bytes have arrived. Sets speech_file_ready when
+// the segment is complete.
+void EmilyBrain::pumpSpeechDownload() {
+    if (speech_download_pending) {
+        if (!venice.responseReady()) {
+            if (millis() - speech_download_at > TTS_RESPONSE_TIMEOUT_MS) {
+                Serial.println("TTS Download ERROR: No response from API.");
+                endSpeechDownload(false);
+            }
+            return;
+        }
+        speech_download_pending = false;
+        if (!venice.receive(tts_response, TTS_HEADER_TIMEOUT_MS)) {
+            Serial.println("TTS Download ERROR: No response from API.");
+            endSpeechDownload(false);
+            return;
+        }
+        speech_download_active = true;
+        if (tts_response.status() != 200) {
+            Serial.printf("TTS Download ERROR: API Error Code %d\n", tts_response.status());
+            String errorPayload;
+            tts_response.readString(errorPayload, TTS_HEADER_TIMEOUT_MS);
+            Serial.println("Error Payload: " + errorPayload);
+            endSpeechDownload(false);
+            return;
+        }
+        speech_download = SD.open(speech_file ? TTS_FILE_A : TTS_FILE_B, FILE_WRITE);
+        if (!speech_download) {
+            Serial.println("TTS Download ERROR: Could not open SD file for writing.");
+            endSpeechDownload(false);
+            return;
+        }
+        speech_download_bytes = 0;
+        speech_download_at = millis();
+    }
+    if (!speech_download_active) return;
+
+    uint8_t buffer[1024];
+    for (int i = 0; i < 16; i++) { // Bounded, so one call can't hog loop()
+        int n = tts_response.read(buffer, sizeof(buffer));
+        if (n <= 0) break;
+        if (speech_download.write(buffer, n) != (size_t)n) {
+            Serial.println("TTS Download ERROR: Failed to write to SD file.");
+            endSpeechDownload(false); // SD might be full or corrupted
+            return;
+        }
+        speech_download_bytes += n;
+        speech_download_at = millis();
+    }
+
+    if (tts_response.finished() && speech_download_bytes > 0) {
+        Serial.printf("TTS Download: Success (%u bytes written).\n", (unsigned)speech_download_bytes);
+        endSpeechDownload(true);
+    } else if (tts_response.finished() || tts_response.failed()) {
+        Serial.println("TTS Download ERROR: Audio stream ended early.");
+        endSpeechDownload(false);
+    } else if (millis() - speech_download_at > TTS_DOWNLOAD_STALL_MS) {
+        Serial.println("TTS Download ERROR: Timeout while downloading.");
+        endSpeechDownload(false);
+    }
+}
+
+// Closes the segment download, if any. On failure the rest of the text is
+// skipped; speech_download_from still tells where the failed segment
+// started.
+void EmilyBrain::endSpeechDownload(bool ok) {
+    if (speech_download) speech_download.close();
+    if (speech_download_pending) venice.close(); // An unread answer would be taken for the next response
+    if (speech_download_active) venice.release(tts_response); // Drops the session if the body wasn't fully read
+    speech_download_pending = false;
+    speech_download_active = false;
+    if (ok) speech_file_ready = true;
+    else speech_pos = speech_text.length();
+}
+
+// SD fallback: switches to the downloaded next segment and starts
+// downloading the one after it. False if it isn't there (yet).
+bool EmilyBrain::playNextSpeechFile() {
+    if (!speech_file_ready) {
+        prefetchSpeechFile(); // E.g. the segment a failed stream request left over
+        return false;
+    }
+    speech_file ^= 1;
+    speech_file_ready = false;
+    audio_job_id = audio.playFile(speech_file ? TTS_FILE_B : TTS_FILE_A);
+    if (audio_job_id == 0) return false;
+    prefetchSpeechFile();
+    return true;
+}
+
+// SD fallback: the current segment is done. Plays the next one, waits for
+// its download (speech_waiting), or finishes the speech.
+void EmilyBrain::continueSpeechFiles() {
+    speech_waiting = false;
+    if (playNextSpeechFile()) return;
+    if (speechDownloadBusy()) {
+        Serial.println("TTS: Waiting for the next segment...");
+        speech_waiting = true;
+        return;
+    }
+    finishSpeaking();
+}
+
+// The running CB_SPEAK task can't make its audio: ends the turn.
+void EmilyBrain::abandonSpeech(const char* result) {
+    Task* speak_task = runningTask(TaskLane::AUDIO);
+    if (speak_task != nullptr) setToolResult(*speak_task, result);
+    closeTtsStream();
+    resetSpeechPipeline();
+    abandonTurn("ERROR: Not executed, an earlier action failed.");
+    setState(EmilyState::IDLE); // Go back to IDLE on failure
+    tts_task_start_time = 0;
+}
+
+// --- Streaming TTS ---
+// Requests speech and reads the WAV header straight from the HTTPS response.
+// On success the response stays open (tts_stream_active) and the SPEAKING
+// handler feeds it to the audio engine.
+bool EmilyBrain::openTtsStream(const char* textToSpeak) {
+    closeTtsStream(); // Drop a stream left over from an interrupted turn
+
+    if (!tts_ring.begin(TTS_RING_BYTES)) return false;
+    if (!requestTtsStream(textToSpeak)) return false;
+
+    tts_stream_active = true;
+    return true;
+}
+
+// Sends one speech request; on success tts_response is positioned at the
+// first sample.
+bool EmilyBrain::requestTtsStream(const char* textToSpeak) {
+    Serial.printf("TTS Stream: Requesting audio for '%s'\n", textToSpeak);
+    String payload_string = buildTtsPayload(textToSpeak);
+    if (!venice.request("POST", VENICE_TTS_PATH, "application/json", payload_string.length(),
+                        [&](Print& out) { out.print(payload_string); },
+                        tts_response, TTS_RESPONSE_TIMEOUT_MS)) {
+        Serial.println("TTS Stream ERROR: Failed to connect to API.");
+        return false;
+    }
+    return acceptTtsResponse(10000);
+}
+
+// Checks the status of a speech response and reads its WAV header, leaving
+// tts_response at the first sample. Each read gives up after 'timeout_ms'
+// without progress. Releases the response on failure.
+bool EmilyBrain::acceptTtsResponse(unsigned long timeout_ms) {
+    if (tts_response.status() != 200) {
+        Serial.printf("TTS Stream ERROR: API Error Code %d\n", tts_response.status());
+        String errorPayload;
+        tts_response.readString(errorPayload, timeout_ms);
+        Serial.println("Error Payload: " + errorPayload);
+        venice.release(tts_response);
+        return false;
+    }
+    if (!readTtsStreamHeader(timeout_ms)) {
+        Serial.println("TTS Stream ERROR: Unusable WAV header in response.");
+        venice.release(tts_response);
+        return false;
+    }
+    return true;
+}
+
+// Walks the RIFF chunks at the start of the stream up to 'data'.
+bool EmilyBrain::readTtsStreamHeader(unsigned long timeout_ms) {
+    uint8_t buf[16];
+    if (!tts_response.readFully(buf, 12, timeout_ms)) return false;
+    if (memcmp(buf, "RIFF", 4) != 0 || memcmp(buf + 8, "WAVE", 4) != 0) return false;
+
+    tts_stream_header = WavHeader();
+    while (true) {
+        if (!tts_response.readFully(buf, 8, timeout_ms)) return false;
+        uint32_t chunk_size = buf[4] | (buf[5] << 8) | (buf[6] << 16) | ((uint32_t)buf[7] << 24);
+
+        if (memcmp(buf, "data", 4) == 0) {
+            // A streamed WAV may not know its length yet (0 or 0xFFFFFFFF)
+            tts_stream_sized = (chunk_size != 0 && chunk_size < 0x7FFFFFFF);
+            tts_stream_remaining = chunk_size;
+            break;
+        }
+
+        uint32_t skip = chunk_size + (chunk_size & 1); // Chunks are word aligned
+        if (skip > 65536) return false; // Not a header chunk we'd expect
+        if (memcmp(buf, "fmt ", 4) == 0 && chunk_size >= 16) {
+            if (!tts_response.readFully(buf, 16, timeout_ms)) return false;
+            tts_stream_header.channels = buf[2] | (buf[3] << 8);
+            tts_stream_header.sampleRate = buf[4] | (buf[5] << 8) | (buf[6] << 16) | (buf[7] << 24);
+            tts_stream_header.bitsPerSample = buf[14] | (buf[15] << 8);
+            skip -= 16;
+        }
+        while (skip > 0) {
+            size_t n = (skip < sizeof(buf)) ? skip : sizeof(buf);
+            if (!tts_response.readFully(buf, n, timeout_ms)) return false;
+            skip -= n;
+        }
+    }
+
+    Serial.printf("TTS Stream: %d Hz, %d-bit, %d ch, data %s\n",
+                  tts_stream_header.sampleRate, tts_stream_header.bitsPerSample, tts_stream_header.channels,
+                  tts_stream_sized ? String(tts_stream_remaining).c_str() : "until end of stream");
+    return tts_stream_header.sampleRate >= 8000 && tts_stream_header.channels == 1 &&
+           tts_stream_header.bitsPerSample == 16;
+}
+
+// Moves whatever the socket has ready into the ring buffer (non-blocking).
+size_t EmilyBrain::pumpTtsStream() {
+    size_t total = 0;
+    while (total < 32768) { // Bounded, so one call can't hog loop()
+        uint8_t* span;
+        size_t space = tts_ring.writeSpan(&span);
+        if (tts_stream_sized && tts_stream_remaining < space) space = tts_stream_remaining;
+        if (space == 0) break;
+        int n = tts_response.read(span, space);
+        if (n <= 0) break;
+        tts_ring.commit(n);
+        if (tts_stream_sized) tts_stream_remaining -= n;
+        total += n;
+    }
+    return total;
+}
+
+bool EmilyBrain::ttsStreamFinished() {
+    return tts_response.finished() || tts_response.failed() ||
+           (tts_stream_sized && tts_stream_remaining == 0);
+}
+
+// Writes the not-yet-played audio (ring buffer + rest of the stream) to a WAV file.
+bool EmilyBrain::spillTtsStreamToSd(const char* filename) {
+    File file = SD.open(filename, FILE_WRITE);
+    if (!file) {
+        Serial.println("TTS Stream ERROR: Could not open SD file for writing.");
+        return false;
+    }
+    byte wav_header[44];
+    AudioEngine::createWavHeader(wav_header, 0, tts_stream_header.sampleRate); // Dummy header first
+    file.write(wav_header, 44);
+
+    size_t data_size = 0;
+    bool write_ok = true;
+    unsigned long last_progress = millis();
+    while (write_ok) {
+        // Drain what's buffered first, then keep pulling from the network
+        const uint8_t* span;
+        size_t n;
+        while ((n = tts_ring.readSpan(&span)) > 0) {
+            if (file.write(span, n) != n) { write_ok = false; break; }
+            tts_ring.consume(n);
+            data_size += n;
+        }
+        if (!write_ok || !tts_stream_active || ttsStreamFinished()) break; // Between segments: the ring is all there is
+
+        if (pumpTtsStream() > 0) {
+            last_progress = millis();
+        } else if (millis() - last_progress > 30000) {
+            Serial.println("TTS Stream ERROR: Timeout while spilling to SD.");
+            break;
+        } else {
+            delay(1);
+        }
+    }
+
+    data_size &= ~(size_t)1;
+    AudioEngine::createWavHeader(wav_header, data_size, tts_stream_header.sampleRate);
+    file.seek(0);
+    file.write(wav_header, 44);
+    file.close();
+    Serial.printf("TTS Stream: %u bytes spilled to %s.\n", data_size, filename);
+    return write_ok && data_size > 0;
+}
+
+void EmilyBrain::closeTtsStream() {
+    if (tts_request_pending) {
+        venice.close(); // An unread answer would be taken for the next response
+        tts_request_pending = false;
+    }
+    if (!tts_stream_active) return;
+    // Skip any trailing chunks (LIST etc.) so the keep-alive session stays usable
+    if (!tts_response.failed()) tts_response.discard(2000);
+    venice.release(tts_response);
+    tts_stream_active = false;
+}
+
+String EmilyBrain::buildSelfAwarenessReport(JsonObject device_status) {
+    String report = "--- SELF-AWARENESS REPORT ---\n";
+    report += "This section describes my physical body and its capabilities.\n\n";
+    report += DESC_CORE; // Core description
+    report += "\nMy physical body has the following additional components currently online:\n";
+
+    
+    if (device_status["camcanvas_online"]) {
+        report += DESC_CAMCANVAS;
+    }
+    if (device_status["inputpad_online"]) {
+        report += DESC_INPUTPAD;
+    }
+    return report;
+}
+
+// --- Chat History Offset Index ---
+// CHAT_HISTORY_INDEX_PATH holds one little-endian uint32 per history line:
+// the byte offset where that line starts in CHAT_HISTORY_PATH. It is appended
+// by logInteractionToSd, so the payload builder can seek straight to the
+// Nth-from-last record instead of scanning the whole file every cycle.
+
+// Cheap consistency check: the index must be a whole number of entries and its
+// last entry must point at the start of the last line of the history file.
+bool EmilyBrain::ensureHistoryIndex() {
+    if (history_index_ready) return true;
+
+    File history_file = SD.open(CHAT_HISTORY_PATH);
+    size_t history_size = history_file ? history_file.size() : 0;
+    File index_file = SD.open(CHAT_HISTORY_INDEX_PATH);
+    size_t index_size = index_file ? index_file.size() : 0;
+
+    bool valid = (bool)index_file && (index_size % sizeof(uint32_t) == 0);
+    if (valid && index_size == 0) {
+        valid = (history_size == 0);
+    } else if (valid) {
+        uint32_t last_offset = 0;
+        index_file.seek(index_size - sizeof(uint32_t));
+        valid = index_file.read((uint8_t*)&last_offset, sizeof(last_offset)) == sizeof(last_offset) &&
+                last_offset < history_size;
+
+        // The byte before the last entry must end the previous line...
+        if (valid && last_offset > 0) {
+            history_file.seek(last_offset - 1);
+            valid = (history_file.read() == '\n');
+        }
+        // ...and the last entry must run to the end of the file.
+        if (valid) {
+            history_file.seek(last_offset);
+            uint8_t buffer[256];
+            size_t pos = last_offset;
+            int n;
+            while (valid && (n = history_file.read(buffer, sizeof(buffer))) > 0) {
+                for (int i = 0; i < n; i++) {
+                    if (buffer[i] == '\n' && pos + i + 1 < history_size) { valid = false; break; }
+                }
+                pos += n;
+            }
+        }
+    }
+    if (index_file) index_file.close();
+    if (history_file) history_file.close();
+
+    if (!valid) {
+        Serial.println("History index missing or stale, rebuilding...");
+        return rebuildHistoryIndex();
+    }
+
+    history_line_count = index_size / sizeof(uint32_t);
+    history_index_ready = true;
+    Serial.printf("History index OK (%u lines).\n", history_line_count);
+    return true;
+}
+
+// Full forward scan of the history file (only needed once after an upload,
+// an SD card swap, or an older firmware that did not maintain the index).
+bool EmilyBrain::rebuildHistoryIndex() {
+    history_index_ready = false;
+    history_line_count = 0;
+
+    File index_file = SD.open(CHAT_HISTORY_INDEX_PATH, FILE_WRITE);
+    if (!index_file) {
+        Serial.println("ERROR: Could not create chat history index.");
+        return false;
+    }
+
+    File history_file = SD.open(CHAT_HISTORY_PATH);
+    if (history_file) {
+        uint8_t buffer[512];
+        uint32_t file_pos = 0;
+        uint32_t line_start = 0;
+        bool line_has_content = false;
+
+        int bytes_read;
+        while ((bytes_read = history_file.read(buffer, sizeof(buffer))) > 0) {
+            for (int i = 0; i < bytes_read; i++) {
+                uint8_t c = buffer[i];
+                if (c == '\n') {
+                    if (line_has_content) {
+                        index_file.write((const uint8_t*)&line_start, sizeof(line_start));
+                        history_line_count++;
+                    }
+                    line_start = file_pos + i + 1;
+                    line_has_content = false;
+                } else if (c != '\r' && c != ' ' && c != '\t') {
+                    line_has_content = true;
+                }
+            }
+            file_pos += bytes_read;
+        }
+        // Last line without a trailing newline
+        if (line_has_content) {
+            index_file.write((const uint8_t*)&line_start, sizeof(line_start));
+            history_line_count++;
+        }
+        history_file.close();
+    }
+    index_file.close();
+
+    history_index_ready = true;
+    Serial.printf("History index rebuilt (%u lines).\n", history_line_count);
+    return true;
+}
+
+void EmilyBrain::invalidateHistoryIndex() {
+    SD.remove(CHAT_HISTORY_INDEX_PATH);
+    history_index_ready = false;
+    history_line_count = 0;
+}
+
+// A tool result whose assistant tool_calls message fell out of the window is
+// rejected by the API, so the window must never start with one.
+static bool isToolHistoryLine(File& history_file, uint32_t offset) {
+    char head[40];
+    if (!history_file.seek(offset)) return false;
+    int n = history_file.read((uint8_t*)head, sizeof(head) - 1);
+    if (n <= 0) return false;
+    head[n] = 0;
+    return strstr(head, "\"role\":\"tool\"") != nullptr;
+}
+
+// Reads 'count' index entries starting at line 'first'. Returns how many were read.
+size_t EmilyBrain::readHistoryOffsets(uint32_t first, uint32_t count, uint32_t* offsets) {
+    File index_file = SD.open(CHAT_HISTORY_INDEX_PATH);
+    if (!index_file || !index_file.seek(first * sizeof(uint32_t))) {
+        Serial.println("ERROR: Could not read chat history index.");
+        if (index_file) index_file.close();
+        history_index_ready = false; // Force a rebuild next time
+        return 0;
+    }
+    size_t bytes_read = index_file.read((uint8_t*)offsets, count * sizeof(uint32_t));
+    index_file.close();
+    return bytes_read / sizeof(uint32_t);
+}
+
+// --- Select the history lines that fit the token budget ---
+// Walks the index backwards, newest line first (see HistoryWindow). Only the
+// offsets are kept in RAM; the lines themselves are streamed from SD
+// straight into the request by writeChatHistory().
+void EmilyBrain::collectChatHistoryOffsets(std::vector<uint32_t>& offsets, uint32_t token_budget) {
+    offsets.clear();
+    history_window_start = 0;
+    if (!ensureHistoryIndex() || history_line_count == 0) {
+        Serial.println("Chat history not found or is empty.");
+        return;
+    }
+
+    File history_file = SD.open(CHAT_HISTORY_PATH);
+    if (!history_file) {
+        Serial.println("ERROR: Could not open chat history.");
+        return;
+    }
+
+    uint32_t oldest_allowed = (history_line_count > CONTEXT_HISTORY_MAX_LINES) ? history_line_count - CONTEXT_HISTORY_MAX_LINES : 0;
+    HistoryWindow window;
+    window.begin(history_line_count, oldest_allowed, history_file.size(), token_budget);
+
+    uint32_t block[32];
+    while (window.wantsOlder()) {
+        uint32_t block_first = (window.start() - oldest_allowed > 32) ? window.start() - 32 : oldest_allowed;
+        uint32_t n = window.start() - block_first;
+        if (readHistoryOffsets(block_first, n, block) != n) {
+            history_file.close();
+            return;
+        }
+        for (int i = n - 1; i >= 0; i--) {
+            if (!window.addOlder(block[i])) break;
+        }
+    }
+
+    while (!window.empty() && isToolHistoryLine(history_file, window.oldestOffset())) {
+        window.dropOldest();
+    }
+    history_file.close();
+    window.copyOffsets(offsets);
+    history_window_start = window.start();
+
+    Serial.printf("DEBUG: Selected %d of %u history lines (~%u tokens, summary covers %u).\n",
+                  offsets.size(), history_line_count, window.tokens(), history_summary_covers);
+}
+
+// --- Stream the selected history lines into the messages array ---
+// Each line is already a serialized message object, so it is copied verbatim.
+// Peak RAM is one history line.
+void EmilyBrain::writeChatHistory(Print& out, const std::vector<uint32_t>& offsets) {
+    if (offsets.empty()) return;
+
+    File history_file = SD.open(CHAT_HISTORY_PATH);
+    if (!history_file) {
+        Serial.println("ERROR: Could not re-open chat history for streaming.");
+        return;
+    }
+
+    for (uint32_t offset : offsets) {
+        if (!history_file.seek(offset)) continue;
+        String line = history_file.readStringUntil('\n');
+        line.trim(); // Remove potential \r or extra whitespace
+
+        // A torn line (e.g. power loss mid-write) would corrupt the whole request.
+        if (!line.startsWith("{") || !line.endsWith("}")) {
+            Serial.printf("!!! Skipping malformed history line at offset %u\n", offset);
+            continue;
+        }
+        out.print(",");
+        out.print(line);
+    }
+    history_file.close();
+}
+
+// --- Rolling History Summary ---
+// Turns that no longer fit the token budget are not simply forgotten: once
+// CONTEXT_SUMMARY_MIN_LINES of them have piled up and Emily has been idle for
+// a while, a small LLM request folds them into CHAT_SUMMARY_PATH. The summary
+// is sent as an extra system message, so the payload stays the same size no
+// matter how long the session runs.
+void EmilyBrain::loadHistorySummary() {
+    history_summary = "";
+    history_summary_covers = 0;
+
+    File summary_file = SD.open(CHAT_SUMMARY_PATH);
+    if (!summary_file) return;
+    JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, summary_file);
+    summary_file.close();
+
+    uint32_t covers = doc["covers"] | 0;
+    if (error || covers > history_line_count) {
+        Serial.println("History summary unreadable or stale, discarding it.");
+        resetHistorySummary();
+        return;
+    }
+    history_summary = doc["summary"] | "";
+    history_summary_covers = covers;
+    Serial.printf("History summary loaded (%u lines, %u chars).\n", covers, history_summary.length());
+}
+
+void EmilyBrain::resetHistorySummary() {
+    SD.remove(CHAT_SUMMARY_PATH);
+    history_summary = "";
+    history_summary_covers = 0;
+    summary_request_id = 0; // A result still in flight is stale now
+    history_window_start = 0;
+    last_summary_attempt = 0;
+}
+
+void EmilyBrain::maybeSummarizeHistory() {
+    if (summary_request_id != 0 || !history_index_ready) return;
+    if (history_window_start < history_summary_covers + CONTEXT_SUMMARY_MIN_LINES) return;
+    if (millis() - idle_since < CONTEXT_SUMMARY_IDLE_MS) return;
+    if (last_summary_attempt != 0 && millis() - last_summary_attempt < CONTEXT_SUMMARY_RETRY_MS) return;
+    last_summary_attempt = millis();
+
+    // Offsets of the evicted lines plus the start of the line after them
+    uint32_t first = history_summary_covers;
+    uint32_t count = history_window_start - first;
+    if (count > CONTEXT_SUMMARY_MAX_LINES) count = CONTEXT_SUMMARY_MAX_LINES;
+    uint32_t offsets[CONTEXT_SUMMARY_MAX_LINES + 1];
+    uint32_t wanted = (first + count < history_line_count) ? count + 1 : count;
+    if (readHistoryOffsets(first, wanted, offsets) != wanted) return;
+    if (wanted == count) {
+        File history_file = SD.open(CHAT_HISTORY_PATH);
+        if (!history_file) return;
+        offsets[count] = history_file.size();
+        history_file.close();
+    }
+
+    // Keep one request small: at least one line, then as many as fit the chunk
+    uint32_t lines = summaryChunkLines(offsets, count, CONTEXT_SUMMARY_CHUNK_BYTES);
+    uint32_t start_byte = offsets[0];
+    uint32_t end_byte = offsets[lines];
+
+    // Read here, on the task that appends to the file, so the worker body
+    // never touches the SD card
+    String records;
+    File history_file = SD.open(CHAT_HISTORY_PATH);
+    if (!history_file || !history_file.seek(start_byte)) {
+        if (history_file) history_file.close();
+        return;
+    }
+    records.reserve(end_byte - start_byte);
+    while (history_file.position() < end_byte && history_file.available()) {
+        String line = history_file.readStringUntil('\n');
+        line.trim();
+        if (line.length() == 0) continue;
+        records += line;
+        records += '\n';
+    }
+    history_file.close();
+
+    ChatRequest* request = new ChatRequest();
+    request->path = VENICE_CHAT_PATH;
+    request->timeout_ms = 30000;
+    request->background = true; // A chat turn must not wait for it
+    String previous = history_summary;
+    request->write_body = [this, previous, records](Print& out) {
+        writeSummaryPayload(out, previous, records);
+    };
+
+    summary_request_id = net_worker.submit(request);
+    summary_request_end = first + lines;
+    Serial.printf("History summary: folding lines %u-%u (%u bytes).\n", first, summary_request_end - 1, end_byte - start_byte);
+}
+
+// Body of the summary request: previous summary plus the raw history lines
+// (JSON records, up to CONTEXT_SUMMARY_CHUNK_BYTES) as one escaped user message.
+void EmilyBrain::writeSummaryPayload(Print& out, const String& previous, const String& records) {
+    out.print("{\"model\":\"llama-3.3-70b\",\"max_tokens\":400,\"messages\":[");
+    out.print("{\"role\":\"system\",\"content\":\"");
+    writeJsonEscaped(out, "You maintain the long-term memory of Emily, a desktop robot. "
+                          "Merge the previous summary and the new conversation records into one "
+                          "compact summary in plain prose, at most 150 words. Keep names, facts about "
+                          "the user, promises, open questions and adventure progress. Drop small talk "
+                          "and tool mechanics. Reply with the summary only.");
+    out.print("\"},{\"role\":\"user\",\"content\":\"");
+    writeJsonEscaped(out, "Previous summary:\n");
+    writeJsonEscaped(out, previous.length() > 0 ? previous.c_str() : "(none)");
+    writeJsonEscaped(out, "\n\nNew conversation records:\n");
+    writeJsonEscaped(out, records.c_str());
+    out.print("\"}]}");
+}
+
+void EmilyBrain::handleSummaryResult(ChatResult& result) {
+    if (!result.ok) {
+        Serial.printf("History summary failed: %s (retrying later)\n", result.error.c_str());
+        return;
+    }
+    String summary = result.doc["choices"][0]["message"]["content"] | "";
+    summary.trim();
+    if (summary.length() == 0) {
+        Serial.println("History summary: empty answer, keeping the previous one.");
+        return;
+    }
+    if (summary.length() > CONTEXT_SUMMARY_MAX_CHARS) {
+        summary = summary.substring(0, CONTEXT_SUMMARY_MAX_CHARS);
+    }
+
+    JsonDocument doc;
+    doc["covers"] = summary_request_end;
+    doc["summary"] = summary;
+    File summary_file = SD.open(CHAT_SUMMARY_PATH, FILE_WRITE);
+    if (!summary_file) {
+        Serial.println("ERROR: Could not write history summary.");
+        return;
+    }
+    serializeJson(doc, summary_file);
+    summary_file.close();
+
+    history_summary = summary;
+    history_summary_covers = summary_request_end;
+    last_summary_attempt = 0; // More evicted lines may be waiting
+    Serial.printf("History summary updated (covers %u lines, %u chars).\n", history_summary_covers, history_summary.length());
+}
+
+// --- Route finished network requests ---
+// Summary results are stored right away; anything else that is not the LLM
+// answer PROCESSING_AI is waiting for belongs to an abandoned cycle. Returns
+// that answer (caller deletes it), or nullptr.
+ChatResult* EmilyBrain::pollNetworkResults() {
+    ChatResult* result;
+    while (net_worker.pollResult(result)) {
+        if (summary_request_id != 0 && result->id == summary_request_id) {
+            summary_request_id = 0;
+            handleSummaryResult(*result);
+            delete result;
+            continue;
+        }
+        if (ai_request_id != 0 && result->id == ai_request_id && currentState == EmilyState::PROCESSING_AI) {
+            if (!result->partial) ai_request_id = 0; // The full answer follows a partial one
+            return result;
+        }
+        Serial.printf("[AI] Ignoring stale result %u.\n", result->id);
+        delete result;
+    }
+    return nullptr;
+}
+
+// --- Step A: Read, Filter, and Clean Tools (cached) ---
+// Parses tools_config.json once and pre-serializes the filtered "tools" array
+// for every combination of online devices. Each AI cycle then only has to
+// pick the right variant instead of re-parsing ~13KB of JSON.
+void EmilyBrain::rebuildToolsCache() {
+    for (int i = 0; i < TOOLS_CACHE_VARIANTS; i++) tools_cache[i] = "";
+
+    File tools_file = SD.open("/tools_config.json");
+    if (!tools_file) {
+        Serial.println("ERROR: Could not open tools_config.json!");
+        return;
+    }
+
+    JsonDocument all_tools_doc;
+    DeserializationError error = deserializeJson(all_tools_doc, tools_file);
+    tools_file.close();
+    if (error) {
+        Serial.printf("ERROR: Could not parse tools_config.json: %s\n", error.c_str());
+        return;
+    }
+
+    for (int i = 0; i < TOOLS_CACHE_VARIANTS; i++) tools_cache[i] = "[";
+
+    int tool_count = 0;
+    for (JsonObject tool : all_tools_doc.as<JsonArray>()) {
+        JsonObject function_obj = tool["function"];
+
+        // Which devices does this tool need?
+        uint8_t required_mask = 0;
+        for (JsonVariant device_var : function_obj["required_devices"].as<JsonArray>()) {
+            const char* device = device_var.as<const char*>();
+            if (!device) continue; // Skip if conversion fails
+            if (strcmp(device, "OS") == 0) required_mask |= TOOL_DEVICE_OS;
+            else if (strcmp(device, "CAMCANVAS") == 0) required_mask |= TOOL_DEVICE_CAMCANVAS;
+            else if (strcmp(device, "INPUTPAD") == 0) required_mask |= TOOL_DEVICE_INPUTPAD;
+        }
+
+        // Copy the tool, excluding 'required_devices'
+        JsonDocument clean_doc;
+        clean_doc["type"] = tool["type"];
+        JsonObject new_function = clean_doc["function"].to<JsonObject>();
+        for (JsonPair kvp : function_obj) {
+            if (strcmp(kvp.key().c_str(), "required_devices") != 0) {
+                new_function[kvp.key()] = kvp.value();
+            }
+        }
+        String tool_json;
+        serializeJson(clean_doc, tool_json);
+
+        // Append it to every variant in which all required devices are online
+        for (int mask = 0; mask < TOOLS_CACHE_VARIANTS; mask++) {
+            if ((required_mask & ~mask) != 0) continue;
+            if (tools_cache[mask].length() > 1) tools_cache[mask] += ",";
+            tools_cache[mask] += tool_json;
+        }
+        tool_count++;
+    }
+
+    for (int i = 0; i < TOOLS_CACHE_VARIANTS; i++) tools_cache[i] += "]";
+    Serial.printf("Tools cache built (%d tools, %u bytes with all devices online).\n",
+                  tool_count, tools_cache[TOOLS_CACHE_VARIANTS - 1].length());
+}
+
+uint8_t EmilyBrain::toolsMaskFor(JsonObject device_status) {
+    uint8_t mask = 0;
+    if (device_status["os_online"]) mask |= TOOL_DEVICE_OS;
+    if (device_status["camcanvas_online"]) mask |= TOOL_DEVICE_CAMCANVAS;
+    if (device_status["inputpad_online"]) mask |= TOOL_DEVICE_INPUTPAD;
+    return mask;
+}
+
+// --- Resolve everything the payload writer needs ---
+void EmilyBrain::prepareAiPayload(AiPayloadPlan& plan, const char* current_prompt_content, JsonObject device_status) {
+    Serial.println("DEBUG: Preparing AI payload plan...");
+
+    plan.tools_mask = toolsMaskFor(device_status);
+    plan.self_awareness_report = buildSelfAwarenessReport(device_status);
+
+    // The summary comes out of the same budget, so the total stays flat
+    plan.history_summary = history_summary;
+    collectChatHistoryOffsets(plan.history_offsets, historyTokenBudget(CONTEXT_HISTORY_TOKENS, history_summary.length()));
+    plan.user_content = current_prompt_content;
+}
+
+// --- Stream the chat completion request body ---
+// Writes {"tools":[...],"model":...,"messages":[system, summary, history..., user]}
+// directly to 'out'. Called twice per request: once into a CountingPrint to
+// get the Content-Length, once into the socket.
+void EmilyBrain::writeAiPayload(Print& out, const AiPayloadPlan& plan) {
+    out.print("{");
+
+    // --- Step A: Tools (pre-filtered variant from the cache) ---
+    const String& tools_json = tools_cache[plan.tools_mask];
+    if (tools_json.length() > 0) {
+        out.print("\"tools\":");
+        out.write((const uint8_t*)tools_json.c_str(), tools_json.length());
+        out.print(",");
+    }
+
+    // --- Step B: Model and 'messages' List ---
+#if VENICE_CHAT_STREAM
+    out.print("\"stream\":true,");
+#endif
+    out.print("\"model\":\"llama-3.3-70b\",\"messages\":[");
+
+    // 1. System Prompt (self-awareness report + persona, escaped on the fly)
+    out.print("{\"role\":\"system\",\"content\":\"");
+    writeJsonEscaped(out, plan.self_awareness_report.c_str());
+    writeJsonEscaped(out, "\n\n");
+    writeJsonEscaped(out, system_prompt_content.c_str());
+    out.print("\"}");
+
+    // 2. Summary of the turns that no longer fit the budget
+    if (plan.history_summary.length() > 0) {
+        out.print(",{\"role\":\"system\",\"content\":\"");
+        writeJsonEscaped(out, "Summary of the earlier conversation: ");
+        writeJsonEscaped(out, plan.history_summary.c_str());
+        out.print("\"}");
+    }
+
+    // 3. Chat History
+    writeChatHistory(out, plan.history_offsets);
+
+    // 4. User Message
+    out.print(",{\"role\":\"user\",\"content\":\"");
+    writeJsonEscaped(out, plan.user_content.c_str());
+    out.print("\"}]}");
+}
+
+void EmilyBrain::decayArousal() {
+    unsigned long current_time = millis();
+    // Only decay if arousal is positive and enough time has passed
+    if (arousal > 0.0 && (current_time - last_decay_time) >= 1000) { // Check every second
+        double decay_amount = AROUSAL_DECAY_RATE;
+        arousal -= decay_amount;
+        if (arousal < 0.0) {
+            arousal = 0.0; // Don't go below zero
+        }
+        // Serial.printf("Arousal decayed to: %.2f\n", arousal); // Optional debug
+        last_decay_time = current_time;
+    }
+}
+
+void EmilyBrain::loadConfigurations() {
+    ConfigLock lock(config_mutex);
+    Serial.println("Loading configurations from SD card...");
+
+    File prompt_file = SD.open("/system_prompt.txt");
+    if (prompt_file) {
+        // Lees de volledige inhoud van het bestand in de String-variabele
+        system_prompt_content = prompt_file.readString();
+        prompt_file.close();
+        
+        if (system_prompt_content.length() > 0) {
+            Serial.println("System prompt successfully loaded.");
+        } else {
+            Serial.println("WARNING: system_prompt.txt is empty.");
+        }
+    } else {
+        Serial.println("ERROR: Could not open system_prompt.txt!");
+        // We kunnen hier een standaard-prompt laden als terugval
+        system_prompt_content = "You are a helpful assistant.";
+    }
+
+    rebuildToolsCache();
+}
+
+void EmilyBrain::sendPings() {
+    unsigned long current_time = millis();
+    if (current_time - last_ping_time >= PING_INTERVAL_MS) {
+        if (wifi_status == WiFiStatus::CONNECTED) { // Only send if connected
+            // Removed OS Ping
+
+            sendNodeMessage(CAMCANVAS_IP_ADDRESS, CAMCANVAS_UDP_PORT, emily_proto::Ping());
+            sendNodeMessage(INPUTPAD_IP_ADDRESS, INPUTPAD_UDP_PORT, emily_proto::Ping());
+
+            // Serial.println("Pings sent."); // Optional debug
+        }
+        last_ping_time = current_time;
+    }
+}
+
+void EmilyBrain::handleUdpPackets() {
+    if (wifi_status != WiFiStatus::CONNECTED) {
+        return; // Don't process if not connected
+    }
+
+    // Dispatch everything the receive callback queued since the last loop.
+    // Bounded, so a flood of packets can't keep loop() in here.
+    for (int i = 0; i < UDP_RX_QUEUE_SLOTS; i++) {
+        const UdpPacket* packet = udp_rx_queue.front();
+        if (packet == nullptr) break;
+        handleUdpPacket(*packet);
+        udp_rx_queue.pop();
+    }
+
+    uint32_t dropped = udp_rx_queue.dropped();
+    if (dropped != udp_rx_dropped_reported) {
+        Serial.printf("UDP WARNING: Receive queue full, %u packets dropped so far.\n", dropped);
+        udp_rx_dropped_reported = dropped;
+    }
+}
+
+void EmilyBrain::handleUdpPacket(const UdpPacket& packet) {
+    const char* packetBuffer = (const char*)packet.data; // NUL-terminated by the queue
+    int len = packet.len;
+    if (len == 0) return; // Empty packet
+
+    String sender_ip_str = IPAddress(packet.addr).toString();
+    unsigned long current_time = millis();
+
+    // --- Identify Sender & Update Status ---
+
+    // (OS Block Removed)
+
+    // --- Handle CAMCANVAS Packets ---
+    if (sender_ip_str == CAMCANVAS_IP_ADDRESS) {
+        last_camcanvas_contact = current_time;
+        if (!camcanvas_connected) { Serial.println("CamCanvas Connected."); camcanvas_connected = true; }
+
+        // Binary frames are the normal case; JSON below is the debug fallback
+        emily_proto::Frame frame;
+        if (emily_proto::decode((const uint8_t*)packetBuffer, len, frame)) {
+            if (acceptNodeFrame(packet, frame)) handleCamCanvasFrame(frame);
+        }
+
+        // --- STATE-BASED PROCESSING (JSON) ---
+        // What do we expect right now?
+
+        // 1. Expecting VISION response?
+        else if (taskRunning(TaskType::CAM_ANALYZE)) {
+            // Serial.println(">>> DEBUG: (State=SEEING) Looking for 'vision'...");
+            StaticJsonDocument<1024> vision_doc;
+            DeserializationError error = deserializeJson(vision_doc, packetBuffer);
+            if (!error && vision_doc.containsKey("result_type") && strcmp(vision_doc["result_type"], "vision") == 0) {
+                Serial.println(">>> DEBUG: 'vision' result FOUND and processing.");
+                last_vision_response.set(vision_doc);
+            } 
+        }
+        
+        // 2. Expecting IMAGE COMPLETE response?
+        else if (taskRunning(TaskType::CANVAS_IMAGE_SYNC)) {
+            // Serial.println(">>> DEBUG: (State=VISUALIZING) Looking for 'image_complete'...");
+            StaticJsonDocument<256> confirmation_doc;
+            DeserializationError error = deserializeJson(confirmation_doc, packetBuffer);
+            if (!error && confirmation_doc.containsKey("result_type") && strcmp(confirmation_doc["result_type"], "image_complete") == 0) {
+                Serial.println(">>> DEBUG: 'image_complete' FOUND and processing.");
+                last_camcanvas_confirmation.set(confirmation_doc);
+            } 
+        }
+
+        // 3. General Updates (Heartbeats, Photos, etc.)
+        else {
+            StaticJsonDocument<512> other_doc; 
+            DeserializationError error = deserializeJson(other_doc, packetBuffer);
+            
+            // Check for Photo Confirmation
+            if (!error && other_doc.containsKey("result_type") && strcmp(other_doc["result_type"], "picture_taken") == 0) {
+                const char* status = other_doc["status"] | "error";
+                if (strcmp(status, "success") == 0) { addSignificantEvent("CAM: Photo saved."); }
+                else { addSignificantEvent("CAM: ERROR saving photo."); }
+            }
+            // Check for Heartbeat (Tilt/Pan info)
+            else if (!error && other_doc.containsKey("id") && other_doc.containsKey("state")) {
+                current_cam_tilt = other_doc["tilt_angle"] | 90.0f; 
+                current_cam_pan = other_doc["pan_angle"] | 90.0f;
+            }
+        }
+    } // --- END CAMCANVAS BLOCK ---    
+    
+    
+
+    // --- Handle INPUTPAD Packets ---
+    else if (sender_ip_str == INPUTPAD_IP_ADDRESS) {
+        last_inputpad_contact = current_time;
+        if (!inputpad_connected) { 
+            Serial.println("InputPad Connected."); 
+            inputpad_connected = true; 
+        }
+
+        emily_proto::Frame frame;
+        if (emily_proto::decode((const uint8_t*)packetBuffer, len, frame)) {
+            if (acceptNodeFrame(packet, frame)) handleInputPadFrame(frame);
+            return;
+        }
+
+        // JSON debug fallback
+        StaticJsonDocument<128> input_doc;
+        DeserializationError err = deserializeJson(input_doc, packetBuffer);
+    
+        if (!err) {
+            const char* event_type = input_doc["event"] | "unknown";
+        
+            if (strcmp(event_type, "input_received") == 0) {
+                Serial.println("Received INPUT_RECEIVED from InputPad.");
+                last_inputpad_response.clear();
+                last_inputpad_response["event"] = input_doc["event"];
+                last_inputpad_response["value"] = input_doc["value"];
+                Serial.printf(">>> Stored InputPad value: %s\n", 
+                            last_inputpad_response["value"].as<const char*>());
+            }
+        }
+    }
+}
+
+// --- Delivery layer (see EmilyReliable.h) ---
+// Acks frames that ask for it and consumes ACKs for our own commands.
+// Returns false if nothing is left for the message handlers: an ACK, or a
+// repeat of a result we already handled (its ACK got lost).
+bool EmilyBrain::acceptNodeFrame(const UdpPacket& packet, const emily_proto::Frame& frame) {
+    uint32_t sender = packet.addr;
+
+    if (frame.type == emily_proto::MSG_ACK) {
+        emily_proto::Ack ack;
+        if (emily_proto::read(frame, ack)) udp_outbox.acknowledge(sender, ack.seq);
+        return false;
+    }
+    if (!emily_proto::wantsAck(frame)) return true;
+
+    emily_proto::Ack ack;
+    ack.seq = frame.seq;
+    size_t len = emily_proto::encode(udp_tx_frame, sizeof(udp_tx_frame), ++udp_tx_seq, ack);
+    sendUdpFrame(IPAddress(packet.addr), packet.port, udp_tx_frame, len);
+
+    if (udp_seen.seen(sender, frame.seq)) {
+        Serial.printf("UDP: Duplicate message 0x%02X (seq %u) ignored.\n", frame.type, frame.seq);
+        return false;
+    }
+    return true;
+}
+
+void EmilyBrain::serviceNodeOutbox() {
+    if (wifi_status != WiFiStatus::CONNECTED) return;
+    udp_outbox.service(millis(),
+        [this](uint32_t addr, uint16_t port, const uint8_t* data, size_t len) {
+            sendUdpFrame(IPAddress(addr), port, data, len);
+        },
+        [this](uint32_t addr, uint16_t port, uint8_t type, uint16_t seq) {
+            handleNodeMessageLost(addr, type, seq);
+        });
+}
+
+void EmilyBrain::handleNodeMessageLost(uint32_t addr, uint8_t type, uint16_t seq) {
+    Serial.printf("UDP: No ACK from %s for message 0x%02X (seq %u), giving up.\n",
+                  IPAddress(addr).toString().c_str(), type, seq);
+
+    // The InputPad acks at once, so a lost set_mode means nobody will ever
+    // press a button: let the timeout path report it now instead of in 60s.
+    // CamCanvas doesn't read UDP during long jobs (image generation), so a
+    // missing ACK there isn't proof of loss; those waits keep their timeout.
+    if (type == emily_proto::MSG_SET_MODE && taskRunning(TaskType::INPUTPAD_SET_MODE) && input_task_start_time != 0) {
+        input_task_start_time = millis() - INPUT_TASK_TIMEOUT_MS - 1;
+    }
+}
+
+void EmilyBrain::sendUdpFrame(const IPAddress& ip, uint16_t port, const uint8_t* data, size_t len) {
+    if (len == 0) return;
+    udp.writeTo(data, len, ip, port);
+}
+
+// --- Binary messages from CamCanvas ---
+// Fills the same mailboxes as the JSON path, so the state handlers don't
+// care which format arrived.
+void EmilyBrain::handleCamCanvasFrame(const emily_proto::Frame& frame) {
+    emily_proto::Text text;
+    switch (frame.type) {
+        case emily_proto::MSG_HEARTBEAT: {
+            emily_proto::Heartbeat heartbeat;
+            if (emily_proto::read(frame, heartbeat)) {
+                current_cam_pan = heartbeat.pan;
+                current_cam_tilt = heartbeat.tilt;
+            }
+            break;
+        }
+        case emily_proto::MSG_VISION_RESULT: {
+            emily_proto::VisionResult result;
+            if (!taskRunning(TaskType::CAM_ANALYZE) || !emily_proto::read(frame, result, &text)) break;
+            Serial.println(">>> DEBUG: 'vision' result FOUND and processing.");
+            last_vision_response.clear();
+            last_vision_response["result_type"] = "vision";
+            if (result.status == emily_proto::STATUS_OK) {
+                last_vision_response["status"] = "success";
+                last_vision_response["description"] = JsonString(text.data, text.len);
+            } else {
+                char message[128];
+                text.copyTo(message, sizeof(message));
+                last_vision_response["status"] = "error";
+                last_vision_response["description"] = String("Vision error: ") + message;
+            }
+            break;
+        }
+        case emily_proto::MSG_IMAGE_COMPLETE: {
+            emily_proto::ImageComplete result;
+            if (!taskRunning(TaskType::CANVAS_IMAGE_SYNC) || !emily_proto::read(frame, result)) break;
+            Serial.println(">>> DEBUG: 'image_complete' FOUND and processing.");
+            last_camcanvas_confirmation.clear();
+            last_camcanvas_confirmation["result_type"] = "image_complete";
+            last_camcanvas_confirmation["status"] = (result.status == emily_proto::STATUS_OK) ? "success" : "error";
+            break;
+        }
+        case emily_proto::MSG_PICTURE_TAKEN: {
+            emily_proto::PictureTaken result;
+            if (!emily_proto::read(frame, result)) break;
+            if (result.status == emily_proto::STATUS_OK) { addSignificantEvent("CAM: Photo saved."); }
+            else { addSignificantEvent("CAM: ERROR saving photo."); }
+            break;
+        }
+        default:
+            Serial.printf("CamCanvas: Unexpected message type 0x%02X.\n", frame.type);
+            break;
+    }
+}
+
+// --- Binary messages from the InputPad ---
+void EmilyBrain::handleInputPadFrame(const emily_proto::Frame& frame) {
+    emily_proto::InputReceived input;
+    emily_proto::Text text;
+    if (frame.type == emily_proto::MSG_HEARTBEAT) return; // Contact time is all we need
+    if (!emily_proto::read(frame, input, &text)) {
+        Serial.printf("InputPad: Unexpected message type 0x%02X.\n", frame.type);
+        return;
+    }
+    Serial.println("Received INPUT_RECEIVED from InputPad.");
+    last_inputpad_response.clear();
+    last_inputpad_response["event"] = "input_received";
+    last_inputpad_response["value"] = JsonString(text.data, text.len);
+    Serial.printf(">>> Stored InputPad value: %s\n", last_inputpad_response["value"].as<const char*>());
+}
+
+void EmilyBrain::checkTimeouts() {
+    unsigned long current_time = millis();
+
+    // (OS Check Removed)
+
+    // --- CAMCANVAS CHECK ---
+    if (camcanvas_connected && (current_time - last_camcanvas_contact > CONNECTION_TIMEOUT_MS) &&
+        !taskRunning(TaskType::CAM_ANALYZE) &&           
+        !taskRunning(TaskType::CANVAS_IMAGE_SYNC))      
+    {
+        Serial.println("CamCanvas Disconnected (Timeout).");
+        camcanvas_connected = false;
+    }
+    // --- INPUTPAD CHECK ---
+    if (inputpad_connected && (current_time - last_inputpad_contact > CONNECTION_TIMEOUT_MS) &&
+        !taskRunning(TaskType::INPUTPAD_SET_MODE))   
+    {
+        Serial.println("InputPad Disconnected (Timeout).");
+        inputpad_connected = false;
+    }
+}
+
+// --- Status Display ---
+// Static parts (title bar, labels) are drawn straight to the panel once;
+// every value lives in its own sprite area that is redrawn off-screen
+// and pushed only when it changed. No Strings are built per frame, and
+// at most one frame runs per DISPLAY_FRAME_MS ('immediate' skips that
+// wait, e.g. to show a new state before a blocking call).
+void EmilyBrain::renderDisplay(bool immediate) {
+    unsigned long now = millis();
+    if (!immediate && now - last_display_frame < DISPLAY_FRAME_MS) return;
+    last_display_frame = now;
+
+    bool force_redraw = false;
+    if (!display_layout_drawn) {
+        drawDisplayLayout();
+        force_redraw = true;
+    }
+    DisplaySnapshot snap = takeDisplaySnapshot();
+    DisplaySnapshot& shown = display_shown;
+    char text_buffer[16];
+
+    // --- Connectivity Dots ---
+    DisplayRegion& dots = display_areas[AREA_DOTS];
+    if (dots.ready() && (force_redraw || snap.wifi != shown.wifi ||
+                         snap.camcanvas != shown.camcanvas || snap.inputpad != shown.inputpad)) {
+        TFT_eSprite& s = dots.clear();
+        int radius = 6;
+        s.fillCircle(10, 10, radius, snap.inputpad ? TFT_GREEN : TFT_RED);   // InputPad
+        s.fillCircle(35, 10, radius, snap.camcanvas ? TFT_GREEN : TFT_RED);  // CamCanvas
+        s.fillCircle(60, 10, radius, snap.wifi == WiFiStatus::CONNECTED ? TFT_BLUE : TFT_RED); // WiFi
+        dots.markDirty();
+    }
+
+    // --- Arousal Bar ---
+    DisplayRegion& arousal_bar = display_areas[AREA_AROUSAL];
+    if (arousal_bar.ready() && (force_redraw || snap.arousal_px != shown.arousal_px)) {
+        TFT_eSprite& s = arousal_bar.clear();
+        if (snap.arousal_px > 0) s.fillRect(0, 0, snap.arousal_px, arousal_bar.h, TFT_RED);
+        arousal_bar.markDirty();
+    }
+
+    // --- Valence Bar ---
+    // Map valence [-1.0, 1.0] to [0, barWidth], drawn from the middle
+    DisplayRegion& valence_bar = display_areas[AREA_VALENCE];
+    if (valence_bar.ready() && (force_redraw || snap.valence_px != shown.valence_px)) {
+        TFT_eSprite& s = valence_bar.clear();
+        int zeroPoint = valence_bar.w / 2;
+        int valPixel = snap.valence_px;
+        uint16_t valenceColor = (valPixel >= zeroPoint) ? TFT_GREEN : TFT_ORANGE;
+        if (valPixel > zeroPoint) {
+            s.fillRect(zeroPoint, 0, valPixel - zeroPoint, valence_bar.h, valenceColor);
+        } else if (valPixel < zeroPoint) {
+            s.fillRect(valPixel, 0, zeroPoint - valPixel, valence_bar.h, valenceColor);
+        }
+        valence_bar.markDirty();
+    }
+
+    // --- Line 1: Emily State ---
+    DisplayRegion& state_line = display_areas[AREA_STATE];
+    if (state_line.ready() && (force_redraw || snap.state != shown.state)) {
+        TFT_eSprite& s = state_line.clear();
+        s.setTextColor(TFT_YELLOW, TFT_BLACK);
+        s.drawString(stateToString(snap.state), 0, 2, 1);
+        state_line.markDirty();
+    }
+
+    // --- Lines 2 and 3: CC Status, Pan and Tilt ---
+    // Area-local columns: value at 0, labels at 110, values at 150
+    DisplayRegion& cc_lines = display_areas[AREA_CAMCANVAS];
+    if (cc_lines.ready() && (force_redraw || snap.camcanvas != shown.camcanvas ||
+                             snap.pan != shown.pan || snap.tilt != shown.tilt)) {
+        TFT_eSprite& s = cc_lines.clear();
+        uint16_t value_color = snap.camcanvas ? TFT_SKYBLUE : TFT_RED;
+        s.setTextColor(snap.camcanvas ? TFT_GREEN : TFT_RED, TFT_BLACK);
+        s.drawString(snap.camcanvas ? "Online" : "Offline", 0, 2, 1);
+
+        s.setTextColor(TFT_WHITE, TFT_BLACK);
+        s.drawString("Pan:", 110, 2, 1);
+        s.drawString("Tilt:", 110, 17, 1);
+        s.setTextColor(value_color, TFT_BLACK);
+        snprintf(text_buffer, sizeof(text_buffer), "%d deg", snap.pan);
+        s.drawString(snap.camcanvas ? text_buffer : "N/A", 150, 2, 1);
+        snprintf(text_buffer, sizeof(text_buffer), "%d deg", snap.tilt);
+        s.drawString(snap.camcanvas ? text_buffer : "N/A", 150, 17, 1);
+        cc_lines.markDirty();
+    }
+
+    // --- Chat / Info Window ---
+    DisplayRegion& chat = display_areas[AREA_CHAT];
+    if (chat.ready() && (force_redraw || snap.text_version != shown.text_version)) {
+        TFT_eSprite& s = chat.clear();
+        s.setTextColor(TFT_WHITE, TFT_BLACK);
+        s.setTextSize(1);
+        s.setTextWrap(true); // Wraps at the area's width; overflow is clipped at the bottom
+        s.setCursor(5, 2);
+        s.print(last_display_text);
+        chat.markDirty();
+    }
+
+    shown = snap;
+    display_renderer.flush(display_areas, AREA_COUNT);
+}
+
+// Draws the static layout and allocates the value areas (once, after
+// setupWiFi() has initialized the panel).
+void EmilyBrain::drawDisplayLayout() {
+    display.fillScreen(TFT_BLACK);
+    // --- Title Bar (1x) ---
+    display.fillRect(0, 0, display.width(), 30, TFT_DARKCYAN);
+    display.setTextColor(TFT_WHITE, TFT_DARKCYAN);
+    display.drawString("Emily", 5, 5, 4);
+
+    // --- Static Labels (1x) ---
+    int y_lineA = 45;
+    int y_lineV = 60;
+    int y_line1 = 75;
+    int y_line2 = 90;
+    int x_col1_lbl = 10;
+
+    display.setTextColor(TFT_WHITE, TFT_BLACK);
+
+    display.drawString("A:", x_col1_lbl, y_lineA + 2, 1); // Arousal Label
+    display.drawString("V:", x_col1_lbl, y_lineV + 2, 1); // Valence Label
+    display.drawString("State:", x_col1_lbl, y_line1 + 2, 1); // Translated
+    display.drawString("CC:", x_col1_lbl, y_line2 + 2, 1);
+
+    // --- Value Areas (sprites in PSRAM, before DMA is enabled) ---
+    int w = display.width();
+    int chat_start_y = 125;
+    display_areas[AREA_DOTS].begin(display, w - 85, 5, 70, 20, TFT_DARKCYAN);
+    display_areas[AREA_AROUSAL].begin(display, 30, 40, w - 40, 10, TFT_DARKGREY);
+    display_areas[AREA_VALENCE].begin(display, 30, 55, w - 40, 10, TFT_DARKGREY);
+    display_areas[AREA_STATE].begin(display, 50, y_line1, w - 50, 10, TFT_BLACK);
+    display_areas[AREA_CAMCANVAS].begin(display, 50, y_line2, w - 50, 25, TFT_BLACK);
+    display_areas[AREA_CHAT].begin(display, 0, chat_start_y, w, display.height() - chat_start_y, TFT_BLACK);
+    display_renderer.begin(display, w);
+
+    display_layout_drawn = true;
+}
+
+EmilyBrain::DisplaySnapshot EmilyBrain::takeDisplaySnapshot() {
+    DisplaySnapshot snap;
+    snap.wifi = wifi_status;
+    snap.camcanvas = camcanvas_connected;
+    snap.inputpad = inputpad_connected;
+
+    int bar_width = display_areas[AREA_AROUSAL].w;
+    snap.arousal_px = (int16_t)constrain((int)(arousal * bar_width), 0, bar_width);
+    bar_width = display_areas[AREA_VALENCE].w;
+    snap.valence_px = (int16_t)constrain((int)(((valence + 1.0) / 2.0) * bar_width), 0, bar_width);
+
+    snap.state = currentState;
+    snap.pan = (int16_t)lround(current_cam_pan);
+    snap.tilt = (int16_t)lround(current_cam_tilt);
+    snap.text_version = display_text_version;
+    return snap;
+}
+
+// Shows 'text' in the chat window with the next frame.
+void EmilyBrain::setDisplayText(const String& text) {
+    last_display_text = text;
+    display_text_version++;
+}
+
+// --- State Handlers ---
+void EmilyBrain::handleIdleState() {
+    // This function is only called when currentState == IDLE.
+
+    // --- Background: fold evicted history into the rolling summary ---
+    pollNetworkResults();
+    maybeSummarizeHistory();
+    
+    // --- CHECK 1: HIGH AROUSAL (Active Context) ---
+    // If arousal is high, we MUST react or continue reacting.
+    if (arousal > AROUSAL_THRESHOLD) {
+        
+        if (current_arousal_context != nullptr) {
+            // Option A: CONTINUATION. Previous action didn't resolve arousal.
+            Serial.println("Idle Handling: Continuing previous arousal context.");
+            _start_ai_cycle("CONTINUATION: Previous action did not resolve high arousal.");
+        
+        } else {
+            // Option B: High arousal but NO context (e.g. web trigger).
+            // Investigate cause.
+            Serial.println("Idle Handling: Arousal is high with NO context. Investigating.");
+            _start_ai_cycle("INTERNAL_TRIGGER: Arousal is high without context, investigating cause.");
+        }
+        return; // Exit function, AI cycle started.
+    }
+
+    // --- CHECK 2: LOW AROUSAL (Scan for NEW Triggers) ---
+    // If arousal is low, reset context and look for new stimuli.
+    if (arousal <= AROUSAL_THRESHOLD) {
+        if (current_arousal_context != nullptr) {
+             Serial.println("Idle Handling: Arousal low, clearing context.");
+             current_arousal_context = nullptr;
+        }
+
+        const char* new_trigger_reason = nullptr;
+        double new_arousal = 0.0;
+        double new_valence = 0.0;
+        bool trigger_found = false; 
+
+        // --- PRIORITY 1: WAKE BUTTON (Physical Interrupt) ---
+        if (checkWakeButton()) { 
+            Serial.println("Idle Handling: Wake Button pressed!");
+            new_trigger_reason = "USER_ACTION: Wake button pressed.";
+            new_arousal = 0.8; 
+            new_valence = 0.2; 
+            trigger_found = true;
+        }
+
+        // --- FUTURE PRIORITIES (Placeholders) ---
+        // 2. Agenda / Timer check
+        // 3. Vision-based presence detection or human presence detection
+
+        // --- DECISION: TRIGGER FOUND? ---
+        if (trigger_found) {
+            // Update internal state
+            arousal = new_arousal;
+            valence = new_valence;
+            last_decay_time = millis(); // Reset decay timer
+            current_arousal_context = new_trigger_reason; // Store new context
+
+            // Start AI Cycle (if online)
+            if (wifi_status == WiFiStatus::CONNECTED) {
+                 _start_ai_cycle(current_arousal_context);
+            } else {
+                 Serial.println("Trigger detected, but WiFi is offline. Cannot start AI cycle.");
+            }
+        }
+    }
+    // If we reach here: Either arousal was high (handled in Check 1), 
+    // or arousal was low but no NEW trigger was found. Do nothing.
+}
+
+// ---  _start_ai_cycle ---
+void EmilyBrain::_start_ai_cycle(const char* trigger_reason) {
+    
+    Serial.printf("AI Cycle Triggered! Reason: %s\n", trigger_reason);
+
+    // --- Log the trigger context as a 'user' message ---
+    StaticJsonDocument<1536> log_doc; 
+    log_doc["role"] = "user";
+    
+    // Construct the full "INTERNAL_REPORT:" string here
+    String report_content = "INTERNAL_REPORT:\n";
+    report_content += "- Triggering Event: " + String(trigger_reason) + "\n";
+    report_content += "- My Current Emotional State: arousal=" + String(arousal, 2) + ", valence=" + String(valence, 2) + "\n";
+    
+    log_doc["content"] = report_content;
+    logInteractionToSd(log_doc.as<JsonObject>()); // Log it!
+    
+    // --- Set State ---
+    setState(EmilyState::PROCESSING_AI);
+
+    // --- 1. Collect Context Data (JSON) ---
+    StaticJsonDocument<1024> context_doc; 
+
+    context_doc["trigger"] = trigger_reason;
+    
+    JsonObject emotion = context_doc.createNestedObject("emotion");
+    emotion["arousal"] = arousal;
+    emotion["valence"] = valence;
+
+    JsonObject device_status = context_doc.createNestedObject("device_status");
+    // Removed os_online
+    device_status["camcanvas_online"] = camcanvas_connected;
+    device_status["inputpad_online"] = inputpad_connected;
+
+    // --- 2. Build Full Prompt String (Text) ---
+    String ai_prompt = "INTERNAL_REPORT:\n";
+    ai_prompt += "- Triggering Event: " + String(trigger_reason) + "\n";
+    ai_prompt += "- My Current Emotional State: arousal=" + String(arousal, 2) + ", valence=" + String(valence, 2) + "\n";
+    
+    // --- World Summary (Cleaned Up) ---
+    ai_prompt += "- Peripherals: ";
+    ai_prompt += "CamCanvas=" + String(camcanvas_connected ? "Online" : "Offline") + ", ";
+    ai_prompt += "InputPad=" + String(inputpad_connected ? "Online" : "Offline") + ".\n";
+
+    // Only Pan/Tilt remains (Head Position)
+    ai_prompt += "- Head Position: Pan=" + String(current_cam_pan, 0) + " deg, ";
+    ai_prompt += "Tilt=" + String(current_cam_tilt, 0) + " deg.\n";
+    
+    // --- Significant Events ---
+    if (!significant_events.empty()) {
+        ai_prompt += "- Recent Events: ";
+        for (const String& evt : significant_events) {
+            ai_prompt += "[" + evt + "] ";
+        }
+        ai_prompt += "\n";
+    }
+    
+    // --- End Prompt Build ---
+    Serial.println("--- Context for AI (Prompt String) ---");
+    Serial.println(ai_prompt);
+    Serial.println("------------------------------------");
+    
+    // --- AI Call ---
+    Serial.println("Calling processAiProxyRequest...");
+    processAiProxyRequest(ai_prompt.c_str(), context_doc["device_status"].as<JsonObject>());
+}
+
+void EmilyBrain::handleAwaitingSpeechState() { 
+    // The audio engine is waiting for the VAD to detect speech.
+    pollListening();
+}
+void EmilyBrain::handleRecordingSpeechState() { 
+    // The audio engine is recording; stream what it captured so far.
+    pumpLiveSttUpload();
+    pollListening();
+}
+
+void EmilyBrain::pollListening() {
+    AudioEvent evt;
+    while (pollAudioEvent(evt)) {
+        if (evt.type == AudioEventType::SPEECH_STARTED) {
+            setState(EmilyState::RECORDING_SPEECH);
+            beginLiveSttUpload();
+        } else if (evt.type == AudioEventType::RECORDING_DONE) {
+            finishListening(evt.value);
+            return;
+        }
+    }
+}
+void EmilyBrain::handleProcessingSttState() { 
+    // We are waiting for the transcribeAudioFromSd function (Whisper API call)
+    // to complete. That function is currently *blocking*.
+    // If transcription were asynchronous, this handler would check for completion.
+    // We *could* add a timeout check here for the API call.
+    // Serial.print("T"); // Optional debug indicator 
+}
+
+// --- Local lane: EB_GET_LOCAL_DATA ---
+void EmilyBrain::serviceLocalDataTask(Task& current_task) {
+    Serial.println("Handler: Running local data lookup.");
+
+    // 1. Get the data key
+    // --- KEY CORRECTION ---
+    const char* key = current_task.local_data.key ? current_task.local_data.key : "ERROR_KEY"; // Changed from 'sleutel' to 'key'
+    // --- END CORRECTION ---
+
+    Serial.printf("Handler: Reading local CMS data for key: %s...\n", key);
+    
+    // Call helper function (assuming getDataFromJson exists and works)
+    String field_data_str = getDataFromJson(key); 
+
+    // 2. Process the result
+    if (field_data_str == "ERROR") {
+        // Log error
+        setToolResult(current_task, "ERROR: Failed to read local data.");
+        addFollowUp("GAME_DATA_ERROR: Failed to read local game data for key " + String(key));
+    } else {
+        // Log success
+        setToolResult(current_task, "SUCCESS: Data retrieved.");
+        
+        // Construct natural language trigger for AI
+        addFollowUp("GAME_DATA: Retrieved info for key '" + String(key) + "': " + field_data_str);
+    }
+
+    // 3. Free the lane; the result goes into the turn's follow-up cycle
+    completeTask(current_task);
+}
+
+void EmilyBrain::handleProcessingAiState() {
+    // The network worker is running the LLM request; loop() keeps serving
+    // the display, UDP, web remote and wake button in the meantime.
+    ChatResult* result = pollNetworkResults();
+    if (result) {
+        handleAiResult(*result);
+        delete result;
+    }
+    pollEarlySpeech(); // Fill the jitter buffer meanwhile
+}
+
+// Waits for the first audio without blocking loop(): the answer to the
+// early request (the SPEAK task came before it), or the first segment
+// downloading to SD (the stream wasn't available).
+void EmilyBrain::handleGeneratingSpeechState() {
+    // --- Early request (see prefetchSpeech()) ---
+    if (tts_request_pending) {
+        bool ready = venice.responseReady();
+        if (!ready && millis() - tts_requested_at <= TTS_RESPONSE_TIMEOUT_MS) return;
+        String text = speech_text; // finishEarlySpeech() forgets it on failure
+        if (ready && finishEarlySpeech()) {
+            setState(EmilyState::SPEAKING);
+            return;
+        }
+        if (!ready) Serial.println("TTS: Early request timed out.");
+        closeTtsStream();
+        resetSpeechPipeline();
+        if (!processTtsRequest(text.c_str())) abandonSpeech("ERROR: Failed to generate speech audio.");
+        return;
+    }
+
+    // --- SD fallback: first segment ---
+    pumpSpeechDownload();
+    if (speech_file_ready) {
+        setState(EmilyState::SPEAKING); // Plays it and fetches the next segment
+        return;
+    }
+    if (!speechDownloadBusy()) {
+        if (!speech_retried) {
+            Serial.println("TTS first attempt failed, retrying...");
+            speech_retried = true;
+            speech_pos = speech_download_from;
+            prefetchSpeechFile();
+            return;
+        }
+        Serial.println("TTS Request FAILED after retry.");
+        abandonSpeech("ERROR: Failed to generate speech audio.");
+        return;
+    }
+    if (tts_task_start_time != 0 && (millis() - tts_task_start_time > TTS_GENERATION_TIMEOUT_MS)) {
+        Serial.println("!!! TIMEOUT during TTS Generation/Download!");
+        abandonSpeech("ERROR: Timeout generating speech audio.");
+    }
+}
+
+void EmilyBrain::handleSpeakingState() {
+    // This state is entered once TTS audio is available (streaming or on SD).
+    // --- SD fallback: played out, the next segment is still downloading ---
+    if (speech_waiting) {
+        pumpSpeechDownload();
+        if (!speechDownloadBusy()) continueSpeechFiles();
+        return;
+    }
+
+    // --- Start playback on entry ---
+    if (audio_job_id == 0) {
+        Serial.println("Handler: Entering SPEAKING state. Starting playback...");
+        if (tts_stream_active) {
+            size_t prebuffer_bytes = (size_t)tts_stream_header.sampleRate * 2 * TTS_PREBUFFER_MS / 1000;
+            audio_job_id = audio.playStream(&tts_ring, tts_stream_header.sampleRate, prebuffer_bytes);
+        } else {
+            playNextSpeechFile(); // First segment, downloaded in GENERATING_SPEECH; the second one follows
+        }
+        if (audio_job_id == 0) finishSpeaking();
+        return;
+    }
+
+    // --- Keep the stream fed while the engine plays it ---
+    // A finished segment is followed by the next one in the same ring;
+    // the stream only ends after the last.
+    if (tts_stream_active) {
+        pumpTtsStream();
+        if (ttsStreamFinished() && !continueTtsStream()) audio.endStream();
+    }
+    pumpSpeechDownload(); // SD fallback: the next segment arrives while this one plays
+
+    AudioEvent evt;
+    while (pollAudioEvent(evt)) {
+        if (evt.type == AudioEventType::STREAM_UNDERRUN) {
+            // The network can't keep up: finish via SD (the ring is ours again)
+            // The remaining segments follow through the SD fallback as well.
+            Serial.println("TTS Stream: Network underrun, finishing playback via SD card...");
+            bool spilled = spillTtsStreamToSd(speech_file ? TTS_FILE_B : TTS_FILE_A);
+            closeTtsStream();
+            audio_job_id = spilled ? audio.playFile(speech_file ? TTS_FILE_B : TTS_FILE_A) : 0;
+            if (audio_job_id != 0) prefetchSpeechFile();
+            else continueSpeechFiles();
+            return;
+        }
+        if (evt.type == AudioEventType::PLAYBACK_DONE) {
+            audio_job_id = 0;
+            closeTtsStream();
+            continueSpeechFiles(); // Next segment (prefetched on SD), or done
+            return;
+        }
+    }
+    // Still playing...
+}
+
+void EmilyBrain::finishSpeaking() {
+    Serial.println("Handler: Playback finished.");
+    tts_task_start_time = 0; // Reset timer after successful playback
+    resetSpeechPipeline();
+
+    // --- Task Completion ---
+    // Free the audio lane. next_state_after_audio (listen or not) is
+    // applied by finishTurn() once the other lanes have drained too.
+    Task* speak_task = runningTask(TaskLane::AUDIO);
+    if (speak_task != nullptr && speak_task->type == TaskType::CB_SPEAK) {
+        Serial.printf("Handler: After this turn: %s\n", stateToString(next_state_after_audio));
+        completeTask(*speak_task);
+    } else {
+        Serial.println("Handler Warning: SPEAKING finished, but no CB_SPEAK task was running?");
+        _continue_task();
+    }
+}
+
+void EmilyBrain::handleExecutingPhysicalToolState() { 
+    // Not used anymore (OS removed). 
+    // If we somehow end up here, return to IDLE immediately.
+    setState(EmilyState::IDLE);
+}
+
+
+// --- CamCanvas lane: CAM_ANALYZE ---
+void EmilyBrain::serviceVisionTask(Task& task) {
+    // Check 1: Have we received the vision result?
+    if (!last_vision_response.isNull()) {
+        Serial.println("Handler: Vision result received.");
+        // Process the result - For now, just log it and trigger AI cycle
+        String description = last_vision_response["description"] | "Vision error.";
+        setDisplayText(description);
+        Serial.printf("Vision Result: %s\n", description.c_str());
+
+        // Result for this tool call; logged with the others at the end of the turn
+        setToolResult(task, description);
+        addFollowUp("My visual analysis returned: " + description);
+
+        // Clear the postbus
+        last_vision_response.clear();
+        camcanvas_task_start_time = 0; // Reset timer
+
+        // Free the lane; the description goes into the follow-up cycle
+        completeTask(task);
+        return; // Next task started (or turn finished), exit handler
+    }
+
+    // Check 2: Timeout
+    if (camcanvas_task_start_time != 0 && (millis() - camcanvas_task_start_time > CAM_TASK_TIMEOUT_MS)) {
+        Serial.println("!!! Handler TIMEOUT: Waiting for CAM vision result!");
+        // Record error, clear postbus, reset timer, free the lane (error goes into the follow-up)
+        setToolResult(task, "ERROR: Timeout waiting for vision analysis.");
+        addFollowUp("I requested visual analysis but received no response in time.");
+        last_vision_response.clear();
+        camcanvas_task_start_time = 0;
+        completeTask(task);
+        return; // Exit handler
+    }
+    // Still waiting...
+}
+
+// --- CamCanvas lane: CANVAS_IMAGE_SYNC ---
+void EmilyBrain::serviceImageTask(Task& task) {
+     // Check 1: Have we received the image complete confirmation?
+    if (!last_camcanvas_confirmation.isNull()) {
+        Serial.println("Handler: Image generation complete confirmation received.");
+        // Confirmation received, the task is done.
+
+        // Clear postbus, reset timer
+        last_camcanvas_confirmation.clear();
+        camcanvas_task_start_time = 0;
+
+        // Free the lane and continue with whatever waited for the image
+        completeTask(task);
+        return; // Next task started (or went IDLE), exit handler
+    }
+
+    // Check 2: Timeout
+    if (camcanvas_task_start_time != 0 && (millis() - camcanvas_task_start_time > CANVAS_TASK_TIMEOUT_MS)) {
+        Serial.println("!!! Handler TIMEOUT: Waiting for CANVAS image completion!");
+        // Log error, clear postbus, reset timer, remove task, trigger AI cycle with error? Or just continue?
+        // Let's log error and continue the task queue for now.
+        setToolResult(task, "ERROR: Timeout waiting for image generation.");
+        last_camcanvas_confirmation.clear();
+        camcanvas_task_start_time = 0;
+        completeTask(task); // Try to continue with the next task
+        return; // Exit handler
+    }
+    // Still waiting...
+}
+
+// --- InputPad lane: INPUTPAD_SET_MODE ---
+void EmilyBrain::serviceInputTask(Task& task) {
+    // Check 1: Did we receive input?
+    if (!last_inputpad_response.isNull()) {
+        Serial.println("Handler: InputPad result received.");
+        String value = last_inputpad_response["value"] | "ERROR";
+        
+        // Result for this tool call; logged with the others at the end of the turn
+        setToolResult(task, value);
+        addFollowUp("USER_INPUT: Received '" + value + "' from InputPad.");
+
+        last_inputpad_response.clear(); // Clear the mailbox
+        input_task_start_time = 0;      // Reset timer
+
+        // Free the lane; the value goes into the follow-up cycle
+        completeTask(task);
+        return;
+    }
+
+    // Check 2: Timeout
+    if (input_task_start_time != 0 && (millis() - input_task_start_time > INPUT_TASK_TIMEOUT_MS)) {
+        Serial.println("!!! Handler TIMEOUT: Waiting for InputPad!");
+        setToolResult(task, "ERROR: Timeout waiting for user input.");
+        addFollowUp("I requested user input via the InputPad, but received no response in time.");
+        
+        last_inputpad_response.clear();
+        input_task_start_time = 0;
+        completeTask(task);
+        return;
+    }
+}
+
+
+void EmilyBrain::loop() {
+    // Serial.printf(">>> DEBUG: Top of loop. Current State = %s\n", stateToString(currentState)); // Optional Debug
+
+    // --- If NO WiFi, run AP Server ---
+    if (WiFi.status() != WL_CONNECTED) {
+        venice.close();                 // The TLS session won't survive a WiFi drop
+        ptms_server.handleClient();     // Handle AP web page
+        dnsServer.processNextRequest(); // Handle Captive Portal
+        delay(10);                      // Give AP tasks breathing room
+        return;                         // Stop the rest of the loop
+    }
+    
+    // --- Handle Web Server ---
+    ptms_server.handleClient(); // Check for incoming web requests FIRST
+
+    // --- Check for INTERRUPT first ---
+    if (currentState != EmilyState::IDLE && checkWakeButton()) {
+        Serial.println("INTERRUPT received via button press!");
+        // Force back to IDLE
+        arousal = 0.0;
+        valence = 0.0;
+        current_arousal_context = nullptr;
+        abandonTurn("ERROR: Interrupted by the user.");
+        stopAudio();
+        setState(EmilyState::IDLE);
+        
+        delay(100); // Small delay to prevent immediate re-trigger
+        return; // Skip the rest of this loop cycle
+    }
+
+    // --- Update Emotional State ---
+    // decayArousal(); // Let arousal decrease over time (Currently disabled)
+
+    // --- Handle Network ---
+    sendPings();         // Send periodic pings
+    serviceNodeOutbox(); // Retransmit unacknowledged commands
+    handleUdpPackets();  // Check for incoming data
+    checkTimeouts();     // Check if modules have gone offline
+    serviceTaskLanes();  // CamCanvas, InputPad and local tasks run next to speech
+
+    // --- State Machine Dispatcher ---
+    switch (currentState) {
+        case EmilyState::IDLE:
+            handleIdleState();
+            break;
+        case EmilyState::AWAITING_SPEECH:
+            handleAwaitingSpeechState();
+            break;
+        case EmilyState::RECORDING_SPEECH:
+            handleRecordingSpeechState();
+            break;
+        case EmilyState::PROCESSING_STT:
+            handleProcessingSttState();
+            break;
+        case EmilyState::PROCESSING_AI:
+            handleProcessingAiState();
+            break;
+        case EmilyState::GENERATING_SPEECH:
+            handleGeneratingSpeechState();
+            break;
+        case EmilyState::SPEAKING:
+            handleSpeakingState();
+            break;
+        case EmilyState::EXECUTING_PHYSICAL_TOOL:
+            handleExecutingPhysicalToolState();
+            break;
+        case EmilyState::SEEING:
+        case EmilyState::VISUALIZING:
+        case EmilyState::AWAITING_INPUT:
+        case EmilyState::PROCESSING_GAMEDATA: 
+            break; // Display states of a running turn; serviceTaskLanes() does the work
+    }
+
+    // --- Update Display ---
+    renderDisplay();
+
+    delay(30);
+}
+
+
+// --- setupWiFi() ---
+// Determines mode (STA/AP) and initializes display.
+void EmilyBrain::setupWiFi() {
+    preferences.begin("emily-wifi", false);
+    String stored_ssid = preferences.getString("ssid", "");
+    String stored_pass = preferences.getString("pass", "");
+    preferences.end();
+
+    // --- TRY CONNECTING FIRST ---
+    if (stored_ssid.length() > 0) {
+        Serial.println("Stored credentials found. Attempting to connect...");
+        
+        // --- DISPLAY INIT (for STA mode) ---
+        display.init();
+        display.setRotation(1);
+        display.fillScreen(TFT_BLACK);
+        display.setCursor(10, 10);
+        display.setTextSize(2);
+        display.println("Connecting...");
+        // --- END DISPLAY INIT ---
+
+        if (connectToWiFi(stored_ssid, stored_pass)) {
+            Serial.println("Connection successful with stored credentials.");
+            display.fillScreen(TFT_BLACK);
+            display.setCursor(10, 10);
+            display.println("Connected!");
+            display.setTextSize(1);
+            display.println(WiFi.localIP().toString());
+            delay(1000);
+            
+            // --- STATE FIX ---
+            wifi_status = WiFiStatus::CONNECTED; 
+            // --- END FIX ---
+            
+            // Start normal services
+            // Datagrams are queued from the network task as they arrive;
+            // handleUdpPackets() dispatches them from loop().
+            udp_rx_queue.begin(UDP_RX_QUEUE_SLOTS);
+            if (udp.listen(UDP_LISTEN_PORT)) {
+                udp.onPacket([this](AsyncUDPPacket& packet) {
+                    udp_rx_queue.push((uint32_t)packet.remoteIP(), packet.remotePort(), packet.data(), packet.length());
+                });
+            } else {
+                Serial.printf("UDP ERROR: Could not listen on port %d.\n", UDP_LISTEN_PORT);
+            }
+            udp_tx_seq = (uint16_t)esp_random(); // Nodes still remember sequence numbers from before a reboot
+            setupWebServer(); // Calls ptms_server.begin()
+            Serial.println("PTMS server started.");
+            return; // Success!
+        }
+        Serial.println("Connection failed with stored credentials.");
+        display.fillScreen(TFT_RED);
+        display.setCursor(10, 10);
+        display.println("Config Error.");
+        delay(1000);
+    } else {
+        Serial.println("No stored credentials found.");
+    }
+    
+    // --- FAILED OR NO CREDS: START AP MODE ---
+    startAPMode();
+}
+
+bool EmilyBrain::connectToWiFi(String ssid, String pass) {
+    WiFi.mode(WIFI_STA);
+    
+    // --- STATIC IP CONFIG ---
+    IPAddress staticIP(192, 168, 68, 201);
+    IPAddress gateway(192, 168, 68, 1);
+    IPAddress subnet(255, 255, 255, 0);
+    IPAddress primaryDNS(8, 8, 8, 8);
+    
+    if (!WiFi.config(staticIP, gateway, subnet, primaryDNS)) {
+        Serial.println("Static IP configuration failed!");
+    }
+    // --- End Static IP ---
+
+    WiFi.begin(ssid.c_str(), pass.c_str());
+    Serial.print("Connecting to " + ssid);
+
+    unsigned long startTijd = millis();
+    while (WiFi.status() != WL_CONNECTED && millis() - startTijd < 15000) {
+        delay(500); Serial.print(".");
+    }
+    return (WiFi.status() == WL_CONNECTED);
+}
+
+void EmilyBrain::startAPMode() {
+    Serial.println("Starting AP Mode ('Emily_Setup')...");
+    
+    // --- STEP 1: START WI-FI AP FIRST ---
+    WiFi.softAP("Emily_Setup", "12345678");
+    IPAddress AP_IP(192, 168, 4, 1);
+    dnsServer.start(53, "*", AP_IP);
+    Serial.println("WiFi AP Mode active.");
+    delay(500); 
+
+    // --- STEP 2: INITIALIZE DISPLAY ---
+    Serial.println("Initializing display for AP instructions...");
+    display.init();
+    display.setRotation(1);
+    display.fillScreen(TFT_BLACK);
+    
+    // Show AP instructions
+    display.setCursor(10, 10);
+    display.setTextSize(2);
+    display.println("SETUP MODE");
+    display.setTextSize(1);
+    display.println("\nConnect phone to WiFi:");
+    display.setTextColor(TFT_CYAN, TFT_BLACK);
+    display.println("Emily_Setup");
+    display.setTextColor(TFT_WHITE, TFT_BLACK);
+    display.println("\nPassword: 12345678");
+    display.println("\nGo to 192.168.4.1 in browser.");
+
+    // Reconfigure server for AP mode
+    ptms_server.onNotFound([this](){ this->handleRoot(); });
+    ptms_server.on("/", HTTP_GET, [this](){ this->handleRoot(); });
+    ptms_server.on("/save", HTTP_POST, [this](){ this->handleSave(); });
+    ptms_server.begin(); 
+    Serial.println("AP Web Server started at 192.168.4.1");
+}
+
+void EmilyBrain::handleRoot() {
+    // HTML for setup page
+    String html = R"(
+        <!DOCTYPE HTML><html><head><title>Emily WiFi Setup</title><meta name='viewport' content='width=device-width, initial-scale=1'></head>
+        <body style='font-family: sans-serif; background: #222; color: #EEE; text-align: center;'>
+        <h2 style='color: #0AF;'>Emily WiFi Setup</h2>
+        <p>Choose your network:</p>
+        <form action='/save' method='POST' style='display: grid; max-width: 300px; margin: auto; gap: 10px;'>
+            <input type='text' name='ssid' placeholder='Network Name (SSID)' style='padding: 10px; border-radius: 5px; border: none;'>
+            <input type='password' name='pass' placeholder='Password' style='padding: 10px; border-radius: 5px; border: none;'>
+            <input type='submit' value='Save & Reboot' style='padding: 10px; background: #0AF; color: white; border: none; border-radius: 5px; font-weight: bold;'>
+        </form>
+        </body></html>
+    )";
+    ptms_server.send(200, "text/html", html);
+}
+
+void EmilyBrain::handleSave() {
+    Serial.println("New credentials received!");
+    String ssid = ptms_server.arg("ssid");
+    String pass = ptms_server.arg("pass");
+
+    if (ssid.length() > 0 && pass.length() > 0) {
+        preferences.begin("emily-wifi", false);
+        preferences.putString("ssid", ssid);
+        preferences.putString("pass", pass);
+        preferences.end();
+
+        Serial.println("Credentials saved to flash. Rebooting...");
+        String html = "<html><body style='font-family: sans-serif; background: #222; color: #EEE; text-align: center;'><h2>Success!</h2><p>Credentials saved. Emily is rebooting and connecting to '" + ssid + "'.</p><p>Reconnect your phone to normal WiFi.</p></body></html>";
+        ptms_server.send(200, "text/html", html);
+        
+        delay(2000);
+        ESP.restart();
+    } else {
+        ptms_server.send(400, "text/plain", "SSID or password missing.");
+    }
+}
+
+// --- Serve Remote Control Page ---
+void EmilyBrain::handleRemotePage() {
+    String html = R"(
+        <!DOCTYPE HTML><html><head><title>Emily Remote</title>
+        <meta name='viewport' content='width=device-width, initial-scale=1'>
+        <style>
+            body { font-family: sans-serif; background: #222; color: #EEE; display: flex; flex-direction: column; height: 90vh; }
+            h2 { color: #0AF; text-align: center; }
+            form { display: flex; width: 100%; padding: 10px; box-sizing: border-box; }
+            input[type='text'] { flex-grow: 1; padding: 15px; border-radius: 5px; border: none; font-size: 1.1em; background: #444; color: #EEE; }
+            input[type='submit'] { padding: 15px; background: #0AF; color: white; border: none; border-radius: 5px; font-weight: bold; margin-left: 10px; }
+            
+            /* Button styles */
+            .button_bar { display: flex; justify-content: space-around; padding: 10px; }
+            .button { padding: 10px 15px; text-decoration: none; background: #555; color: #FFF; border-radius: 5px; font-size: 0.9em; }
+            .button.red { background: #900; }
+        </style>
+        </head>
+        <body>
+            <h2>Emily Web Remote</h2>
+            
+            <form action='/send' method='POST'>
+                <input type='text' name='user_text' placeholder='Type message...' autofocus>
+                <input type='submit' value='Send'>
+            </form>
+
+            <div class='button_bar'>
+                <a href='/force-idle' class='button red'>STOP (IDLE)</a>
+                <a href='/center-head' class='button'>Center Head</a>
+                <a href='/delete-history' class='button'>Clear History</a>
+                <a href='/force-reboot' class='button'>Reboot EB</a>
+            </div>
+            
+        </body></html>
+    )";
+    ptms_server.send(200, "text/html", html);
+}
+
+// --- Process Remote Input ---
+void EmilyBrain::handleRemoteInput() {
+    Serial.println(">>> Web Remote: Input received via POST...");
+
+    // Check IDLE state
+    if (currentState != EmilyState::IDLE) {
+        ptms_server.send(429, "text/plain", "Emily is busy. Try again shortly.");
+        return; 
+    }
+
+    if (ptms_server.hasArg("user_text")) {
+        String text = ptms_server.arg("user_text");
+        Serial.printf(">>> Web Remote: Text = %s\n", text.c_str());
+
+        if (text.length() > 0) {
+            // --- TRIGGER ---
+            String trigger_string = "USER_INPUT (Web): " + text;
+            _start_ai_cycle(trigger_string.c_str());
+            // --- END TRIGGER ---
+            
+            ptms_server.sendHeader("Location", "/remote");
+            ptms_server.send(302, "text/plain", "Input received, processing...");
+        } else {
+            ptms_server.sendHeader("Location", "/remote");
+            ptms_server.send(302, "text/plain", "Empty message, try again.");
+        }
+    } else {
+        ptms_server.send(400, "text/plain", "Error: 'user_text' field missing.");
+    }
+}
+
+// --- FORCE IDLE Handler ---
+void EmilyBrain::handleForceIdle() {
+    Serial.println(">>> Web Remote: FORCE IDLE received.");
+    
+    // Interrupt logic
+    arousal = 0.0;
+    valence = 0.0;
+    current_arousal_context = nullptr;
+    abandonTurn("ERROR: Interrupted by the user."); 
+    stopAudio();
+    
+    setState(EmilyState::IDLE);
+    ptms_server.sendHeader("Location", "/remote");
+    ptms_server.send(302, "text/plain", "Forced to IDLE.");
+}
+
+// --- CENTER HEAD Handler ---
+void EmilyBrain::handleCenterHead() {
+    Serial.println(">>> Web Remote: CENTER HEAD received.");
+    
+    emily_proto::MoveHead cmd;
+    cmd.pan = 90;
+    cmd.tilt = 90;
+    sendNodeCommand(CAMCANVAS_IP_ADDRESS, CAMCANVAS_UDP_PORT, cmd);
+
+    ptms_server.sendHeader("Location", "/remote");
+    ptms_server.send(302, "text/plain", "Center command sent.");
+}
+
+// --- REBOOT Handler ---
+void EmilyBrain::handleForceReboot() {
+    Serial.println(">>> Web Remote: FORCE REBOOT received. Rebooting...");
+    
+    String html = "<html><body style='font-family: sans-serif; background: #222; color: #EEE; text-align: center;'><h2>EmilyBrain Rebooting...</h2><p>Page reloads in 5 seconds.</p><script>setTimeout(() => { window.location.href = '/remote'; }, 5000);</script></body></html>";
+    ptms_server.send(200, "text/html", html);
+    
+    delay(1000); 
+    ESP.restart(); 
+}
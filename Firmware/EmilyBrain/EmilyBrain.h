@@ -1,295 +1,599 @@
-#ifndef EMILYBRAIN_H
-#define EMILYBRAIN_H
-
-#include <Arduino.h>
-#include <TFT_eSPI.h> 
-#include "SPI.h"
-#include "SD.h"
-#include "FS.h"
-#include <Adafruit_NeoPixel.h>
-#include <WiFi.h>
-#include <WiFiUdp.h>
-#include "driver/i2s.h" // For direct I2S control
-#include <HTTPClient.h>
-#include <WiFiClientSecure.h>
-#include <WebServer.h>
-
-#include <DNSServer.h>
-#include <Preferences.h> // For saving WiFi creds to flash
-
-#include <deque>
-#include <ArduinoJson.h>
-#include "esp_heap_caps.h"
-
-// --- SD Card Pins ---
-#define PIN_SD_SCLK 45
-#define PIN_SD_MISO 47
-#define PIN_SD_MOSI 38
-#define PIN_SD_CS   1
-
-// --- I2S Audio Pins ---
-#define PIN_I2S_BCK     17 
-#define PIN_I2S_WS      18 
-#define PIN_I2S_DATA_IN 19 // (Microphone SD to ESP32)
-#define PIN_I2S_DATA_OUT 21 // (ESP32 to Amplifier DIN)
-
-// --- Other Pins ---
-#define PIN_WAKE_BUTTON  4
-#define PIN_NEOPIXEL 48
-
-// --- WiFi Configuration (Credentials are Obsolete) ---
-#define UDP_LISTEN_PORT 12345
-
-// --- IP Addresses for Modules (Static Config) ---
-#define OS_IP_ADDRESS "192.168.68.200"
-#define OS_UDP_PORT 12346
-#define CAMCANVAS_IP_ADDRESS "192.168.68.203"
-#define CAMCANVAS_UDP_PORT 12347
-#define INPUTPAD_IP_ADDRESS "192.168.68.205" 
-#define INPUTPAD_UDP_PORT 12349            
-
-// --- Timeouts & Intervals ---
-#define CONNECTION_TIMEOUT_MS 10000 // 10 second timeout for modules
-#define PING_INTERVAL_MS 3000       // Send a PING every 3 seconds
-#define INPUT_TASK_TIMEOUT_MS 60000 // 60 seconds waiting for user input
-#define PHYSICAL_TASK_TIMEOUT_MS 30000 // Timeout for motor movements
-#define TTS_GENERATION_TIMEOUT_MS 30000 // Timeout for Speech Generation
-#define CAM_TASK_TIMEOUT_MS 60000    // Timeout for vision analysis
-#define CANVAS_TASK_TIMEOUT_MS 60000 // Timeout for image generation
-
-#define DEBOUNCE_DELAY_MS 50 // Button debounce time
-
-// --- Emotional Model Parameters ---
-#define AROUSAL_DECAY_RATE 0.05 // Decrease per second
-#define AROUSAL_THRESHOLD 0.1   // Activity threshold
-#define LOUD_SOUND_THRESHOLD 800
-
-// --- API Configuration ---
-// WARNING: Do not share your API keys publicly!
-#define VENICE_API_KEY "YOUR_VENICE_API_KEY" // <-- CHANGE THIS
-#define VENICE_API_URL "https://api.venice.ai/api/v1/chat/completions"
-
-// --- JSON Capacity ---
-// Memory reserved for the main LLM context window
-#define JSON_DOC_CAPACITY 32768 // 32KB
-
-// --- VAD (Voice Activity Detection) Parameters ---
-#define SPEECH_START_THRESHOLD  145
-#define SILENCE_THRESHOLD       25
-#define SILENCE_DURATION_MS     1500
-#define MAX_RECORDING_MS        20000
-
-#define SOUND_RADAR_THRESHOLD 70 // Minimum intensity for radar
-#define MAX_SOUND_EVENTS 3       // Track last 3 significant sounds
-
-// --- State Machine Definitions ---
-enum class EmilyState {
-    IDLE,
-    AWAITING_SPEECH,
-    RECORDING_SPEECH,
-    PROCESSING_STT,
-    PROCESSING_AI,
-    GENERATING_SPEECH,
-    SPEAKING,
-    EXECUTING_PHYSICAL_TOOL,
-    SEEING,
-    VISUALIZING,
-    PLAYING_SOUND,
-    AWAITING_INPUT,
-    PROCESSING_GAMEDATA
-};
-
-// --- Task Structure ---
-struct Task {
-    String type;
-    StaticJsonDocument<1024> args; 
-};
-
-struct WavHeader {
-    int sampleRate = 0; 
-    int bitsPerSample = 0;
-    int channels = 0;
-};
-
-// --- Sound Event Structure ---
-struct SoundEvent {
-    int intensity = 0;
-    float direction = 0.0;
-};
-
-
-class EmilyBrain {
-public:
-    EmilyBrain();
-    void setup();
-    void loop();
-
-private:   
-    // --- Hardware Objects ---
-    TFT_eSPI display;
-    Adafruit_NeoPixel status_led;
-    WiFiUDP udp; 
-
-    WebServer ptms_server;
-    DNSServer dnsServer; // Captive Portal
-    Preferences preferences; 
-
-    // --- WiFi Helpers ---
-    void setupWiFi(); 
-    bool connectToWiFi(String ssid, String pass);
-    void startAPMode(); 
-    void handleRoot(); 
-    void handleSave(); 
-
-    // --- Web Remote Handlers ---
-    void handleRemotePage(); 
-    void handleRemoteInput();  
-
-    enum class WiFiStatus { DISCONNECTED, CONNECTING, CONNECTED };
-    WiFiStatus wifi_status = WiFiStatus::DISCONNECTED;
-
-    SPIClass* spiSD = nullptr; 
-
-    // --- Connectivity Tracking ---
-    bool os_connected = false;
-    bool camcanvas_connected = false;
-    bool inputpad_connected = false;
-
-    unsigned long last_os_contact = 0;
-    unsigned long last_camcanvas_contact = 0;
-    unsigned long last_inputpad_contact = 0;
-    unsigned long last_ping_time = 0;
-
-    // --- Emotional Model ---
-    double arousal = 0.0;
-    double valence = 0.0; 
-    unsigned long last_decay_time = 0;
-
-    // --- Previous States (Display Optimization) ---
-    WiFiStatus prev_wifi_status = WiFiStatus::DISCONNECTED;
-    EmilyState prev_EmilyState = EmilyState::IDLE;
-
-    bool prev_os_connected = false; 
-    bool prev_camcanvas_connected = false;
-    bool prev_inputpad_connected = false; 
-    
-    double prev_arousal = -1.0; 
-    double prev_valence = -1.0;
-    
-    String prev_line1_L = "", prev_line1_R = ""; // State | Mode
-    String prev_line2_L = "", prev_line2_R = ""; // CC Status | Pan
-    String prev_line3_R = "";                    // Tilt
-
-    String last_display_text = "Booting..."; 
-    String prev_display_text = "";
-
-    // --- Wake Button ---
-    int last_button_state = HIGH;      
-    int debounced_state = HIGH;    
-    unsigned long last_debounce_time = 0; 
-
-    // --- OS State Storage ---
-    String os_act_state = "Offline";
-    float os_angle = 0.0; // Was: os_hoek
-    String current_attention_mode = "PASSIVE";
-    int last_sound_int = 0;
-    float last_sound_dir = 0.0;
-    std::deque<SoundEvent> sound_radar;
-
-    // --- CamCanvas State ---
-    float current_cam_tilt = 90.0; 
-    float current_cam_pan = 90.0;   
-    float prev_cam_tilt = -999.0;
-    float prev_cam_pan = -999.0;
-
-    unsigned long physical_task_start_time = 0; 
-    
-    EmilyState currentState = EmilyState::IDLE;
-    const char* current_arousal_context = nullptr; 
-    unsigned long ai_simulation_start_time = 0;
-    String system_prompt_content;
-
-    // --- Task Queue & Execution ---
-    std::deque<Task> task_queue;
-    JsonObject active_tool_call_args; 
-    String active_tool_call_id;       
-    String active_tool_call_name;     
-
-    EmilyState next_state_after_audio = EmilyState::IDLE; 
-    unsigned long tts_task_start_time = 0; 
-    unsigned long camcanvas_task_start_time = 0;      
-    unsigned long inputpad_task_start_time = 0;   
-    unsigned long input_task_start_time = 0;
-
-    // --- Significant Event Tracking ---
-    std::deque<String> significant_events;
-    const size_t MAX_SIGNIFICANT_EVENTS = 5; 
-    StaticJsonDocument<512> prev_os_heartbeat_data; 
-
-    // --- Response Mailboxes ---
-    JsonDocument last_vision_response;       
-    StaticJsonDocument<256> last_camcanvas_confirmation; 
-    StaticJsonDocument<128> last_inputpad_response; 
-
-    // --- Private Helper Functions ---
-    void renderDisplay();
-    void sendPings(); 
-    void handleUdpPackets();
-    void setupWebServer();
-    void handleFileUpload();
-    void handleFileDownload();
-    void handleHistoryDelete();
-
-    void checkTimeouts(); 
-    bool checkWakeButton();
-    void decayArousal();
-    const char* stateToString(EmilyState state);
-    void setState(EmilyState newState);
-    void _start_ai_cycle(const char* trigger_reason);
-    String buildSelfAwarenessReport(JsonObject device_status);
-    void addChatHistoryToMessages(JsonArray messages, int max_history_items);
-    
-    void buildAiPayload(StaticJsonDocument<JSON_DOC_CAPACITY>& doc, const char* current_prompt_content, JsonObject device_status);
-    void loadConfigurations();
-    void processAiProxyRequest(const char* current_prompt_content, JsonObject device_status);
-    void processTtsRequest(const char* text);
-    bool downloadTtsToSd(const char* textToSpeak, const char* filename);
-    bool recordAudioToWav(const char* filename);
-    void createWavHeader(byte* header, size_t total_data_size);
-    void transcribeAudioFromSd(const char* filename);
-    void listenAndTranscribe();
-    void processSttResponseAndTriggerAi(const String& raw_api_payload);
-    void _handle_ai_response(const char* user_prompt_json_str, JsonArray tool_calls); 
-    void _continue_task(); 
-    void logInteractionToSd(JsonObject log_data); 
-    void logInteractionToSd_Error(const char* role, String tool_call_id, String tool_name, String content);
-    void playWavFromSd(const char* filename);
-    WavHeader parseWavHeader(const char* path);
-    void addTask(const String& type, JsonVariantConst args_variant);
-    bool isOsEventSignificant(const JsonDocument& current_heartbeat);
-    void handlePlayingSoundState();
-    void addSignificantEvent(const String& event_desc);
-    String getDataFromJson(const char* key);
-    
-    // State Handlers
-    void handleIdleState();
-    void handleAwaitingSpeechState();
-    void handleRecordingSpeechState();
-    void handleProcessingSttState();
-    void handleProcessingAiState();
-    void handleGeneratingSpeechState();
-    void handleSpeakingState();
-    void handleExecutingPhysicalToolState();
-    void handleSeeingState();
-    void handleVisualizingState();
-    void handleAwaitingInputState();
-    void handleProcessGamedataState();
-
-    // Web Remote Handlers
-    void handleForceIdle();
-    void handleCenterHead();
-    void handleForceReboot();
-};
-
-#endif // EMILYBRAIN_H
-
+#ifndef EMILYBRAIN_H
+#define EMILYBRAIN_H
+
+#include <Arduino.h>
+#include <TFT_eSPI.h> 
+#include "SPI.h"
+#include "SD.h"
+#include "FS.h"
+#include <Adafruit_NeoPixel.h>
+#include <WiFi.h>
+#include <AsyncUDP.h>
+#include "driver/i2s.h" // For direct I2S control
+#include <HTTPClient.h>
+#include <WiFiClientSecure.h>
+#include <WebServer.h>
+
+#include <DNSServer.h>
+#include <Preferences.h> // For saving WiFi creds to flash
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <memory>
+#include <vector>
+#include <ArduinoJson.h>
+#include "esp_heap_caps.h"
+#include "HttpStream.h"
+#include "VeniceConnection.h"
+#include "RingBuffer.h"
+#include "AudioEngine.h"
+#include "NetworkWorker.h"
+#include "PacketQueue.h"
+#include "TaskQueue.h"
+#include "HistoryWindow.h"
+#include "SpeechSegmenter.h"
+#include "DisplayRegion.h"
+#include <EmilyProtocol.h>  // Firmware/libraries/EmilyProtocol
+#include <EmilyReliable.h>
+
+// --- SD Card Pins ---
+#define PIN_SD_SCLK 45
+#define PIN_SD_MISO 47
+#define PIN_SD_MOSI 38
+#define PIN_SD_CS   1
+
+// --- I2S Audio Pins ---
+#define PIN_I2S_BCK     17 
+#define PIN_I2S_WS      18 
+#define PIN_I2S_DATA_IN 19 // (Microphone SD to ESP32)
+#define PIN_I2S_DATA_OUT 21 // (ESP32 to Amplifier DIN)
+
+// --- Other Pins ---
+#define PIN_WAKE_BUTTON  4
+#define PIN_NEOPIXEL 48
+
+// --- WiFi Configuration (Credentials are Obsolete) ---
+#define UDP_LISTEN_PORT 12345
+
+// --- IP Addresses for Modules (Static Config) ---
+#define OS_IP_ADDRESS "192.168.68.200"
+#define OS_UDP_PORT 12346
+#define CAMCANVAS_IP_ADDRESS "192.168.68.203"
+#define CAMCANVAS_UDP_PORT 12347
+#define INPUTPAD_IP_ADDRESS "192.168.68.205" 
+#define INPUTPAD_UDP_PORT 12349            
+
+// --- Timeouts & Intervals ---
+#define CONNECTION_TIMEOUT_MS 10000 // 10 second timeout for modules
+#define PING_INTERVAL_MS 3000       // Send a PING every 3 seconds
+#define NODE_OUTBOX_SLOTS 6         // Commands awaiting an ACK from CamCanvas/InputPad
+#define UDP_RX_QUEUE_SLOTS 32       // Datagrams buffered between the network task and loop()
+#define INPUT_TASK_TIMEOUT_MS 60000 // 60 seconds waiting for user input
+#define PHYSICAL_TASK_TIMEOUT_MS 30000 // Timeout for motor movements
+#define TTS_GENERATION_TIMEOUT_MS 30000 // Timeout for Speech Generation
+#define CAM_TASK_TIMEOUT_MS 60000    // Timeout for vision analysis
+#define CANVAS_TASK_TIMEOUT_MS 60000 // Timeout for image generation
+
+#define DEBOUNCE_DELAY_MS 50 // Button debounce time
+
+// --- Emotional Model Parameters ---
+#define AROUSAL_DECAY_RATE 0.05 // Decrease per second
+#define AROUSAL_THRESHOLD 0.1   // Activity threshold
+#define LOUD_SOUND_THRESHOLD 800
+
+// --- API Configuration ---
+// WARNING: Do not share your API keys publicly!
+#define VENICE_API_KEY "YOUR_VENICE_API_KEY" // <-- CHANGE THIS
+#define VENICE_API_HOST "api.venice.ai"
+#define VENICE_CHAT_PATH "/api/v1/chat/completions"
+#define VENICE_TTS_PATH "/api/v1/audio/speech"
+#define VENICE_STT_PATH "/api/v1/audio/transcriptions"
+#define VENICE_CHAT_STREAM 1 // Stream the LLM answer (SSE) so speech can start before it is complete
+#define VENICE_EARLY_SPEECH 0 // Request that speech before the answer is complete (needs VENICE_CHAT_STREAM
+                              // and heap for a second TLS session, see EmilyBrain::venice)
+
+// --- Chat History Files ---
+#define CHAT_HISTORY_PATH       "/chat_history.jsonl"
+#define CHAT_HISTORY_INDEX_PATH "/chat_history.idx" // uint32 line offsets
+#define CHAT_SUMMARY_PATH       "/chat_summary.json" // Rolling summary of evicted turns
+
+// --- LLM Context Window ---
+// History is replayed newest-first until the token budget is used up; older
+// turns are folded into a rolling summary by an idle-time LLM request.
+// The token estimate lives in HistoryWindow.h.
+#define CONTEXT_HISTORY_TOKENS      3000    // Budget for summary + replayed history
+#define CONTEXT_HISTORY_MAX_LINES   120     // Hard cap, whatever the budget
+#define CONTEXT_SUMMARY_MIN_LINES   12      // Evicted lines before the summary is refreshed
+#define CONTEXT_SUMMARY_MAX_LINES   32      // History lines folded in per summary request
+#define CONTEXT_SUMMARY_CHUNK_BYTES 8192    // History bytes folded in per summary request
+#define CONTEXT_SUMMARY_MAX_CHARS   1200    // Longer summaries are cut
+#define CONTEXT_SUMMARY_IDLE_MS     5000    // Only summarize after being idle this long
+#define CONTEXT_SUMMARY_RETRY_MS    60000   // Back-off after a failed summary request
+
+// --- Adventure Data ---
+#define ADVENTURE_PATH          "/adventure.json"   // Read by retrieve_local_data
+#define ADVENTURE_MAX_KEY       64                  // Longer top-level keys are skipped by the index
+#define ADVENTURE_MAX_VALUE     16384               // Bytes of JSON a lookup parses, at most
+
+// --- VAD (Voice Activity Detection) Parameters ---
+// Thresholds follow the tracked noise floor: start = max(MIN, floor * RATIO)
+#define VAD_START_RATIO         4
+#define VAD_START_MIN           90
+#define VAD_STOP_RATIO          2
+#define VAD_STOP_MIN            25
+#define VAD_ONSET_FRAMES        2       // Loud frames in a row before speech starts
+#define VAD_HANGOVER_MS         700     // Quiet time that ends an utterance
+#define VAD_WARMUP_MS           200     // Floor learning before speech can start
+#define VAD_PREROLL_MS          300     // Audio kept from before the speech onset
+#define MAX_RECORDING_MS        20000
+
+// --- Sound Effect Mix Levels ---
+#define SOUND_EFFECT_GAIN       0.8f    // One-shot effects
+#define SOUND_AMBIENCE_GAIN     0.45f   // /sounds/ambiance/ tracks under speech
+
+// --- Streaming TTS Parameters ---
+#define TTS_RING_BYTES          (192 * 1024) // ~4s of 24kHz mono audio, in PSRAM
+#define TTS_PREBUFFER_MS        300          // Jitter buffer before the speaker starts
+#define TTS_UNDERRUN_GRACE_MS   100          // Starved this long -> finish via SD
+#define TTS_RESPONSE_TIMEOUT_MS 30000        // Request sent -> first response byte
+#define TTS_HEADER_TIMEOUT_MS   2000         // First response byte -> headers read (polled requests)
+#define TTS_DOWNLOAD_STALL_MS   30000        // SD fallback: no body bytes this long -> give up
+
+// --- Speech Pipeline ---
+// Long texts are synthesized sentence by sentence (see SpeechSegmenter.h),
+// the next while the current one plays.
+#define TTS_FILE_A              "/tts_output.wav"   // SD fallback alternates between these
+#define TTS_FILE_B              "/tts_output_b.wav"
+
+// --- Live STT Parameters ---
+#define STT_INPUT_PATH          "/stt_input.wav"
+#define STT_CAPTURE_RING_BYTES  (64 * 1024)  // ~2s of 16kHz mono while the upload connects
+
+// --- Status Display ---
+#define DISPLAY_FRAME_MS        50           // Frame budget: at most 20 redraws per second
+
+#define SOUND_RADAR_THRESHOLD 70 // Minimum intensity for radar
+#define MAX_SOUND_EVENTS 3       // Track last 3 significant sounds
+
+// --- State Machine Definitions ---
+enum class EmilyState {
+    IDLE,
+    AWAITING_SPEECH,
+    RECORDING_SPEECH,
+    PROCESSING_STT,
+    PROCESSING_AI,
+    GENERATING_SPEECH,
+    SPEAKING,
+    EXECUTING_PHYSICAL_TOOL,
+    SEEING,
+    VISUALIZING,
+    AWAITING_INPUT,
+    PROCESSING_GAMEDATA
+};
+
+// --- LLM Request Plan ---
+// Resolved once per AI cycle so the payload writer can run twice
+// (measure + send) and produce identical bytes both times.
+struct AiPayloadPlan {
+    uint8_t tools_mask = 0;                 // Device bitmask selecting the cached tools array
+    String self_awareness_report;
+    String history_summary;                 // Summary of the turns before history_offsets
+    std::vector<uint32_t> history_offsets;  // Start offsets of the history lines to include
+    String user_content;
+};
+
+// --- Config Lock ---
+// The network worker streams the chat payload from the system prompt, the
+// tools cache and the history file. The main task holds this lock while it
+// replaces any of those (uploads, history delete, config reload).
+class ConfigLock {
+public:
+    explicit ConfigLock(SemaphoreHandle_t mutex) : mutex(mutex) {
+        if (mutex) xSemaphoreTakeRecursive(mutex, portMAX_DELAY);
+    }
+    ~ConfigLock() {
+        if (mutex) xSemaphoreGiveRecursive(mutex);
+    }
+private:
+    SemaphoreHandle_t mutex;
+};
+
+// --- Tools Cache ---
+// Bits of the device-availability mask used to key the filtered tools cache.
+#define TOOL_DEVICE_OS          0x01
+#define TOOL_DEVICE_CAMCANVAS   0x02
+#define TOOL_DEVICE_INPUTPAD    0x04
+#define TOOLS_CACHE_VARIANTS    8
+
+// --- Tool Call Results ---
+#define TURN_MAX_TOOL_CALLS     8       // Tool calls planned per response; extra ones get an error result
+
+// Outcome of one tool call of the current turn, logged as its 'tool' message.
+struct ToolCallResult {
+    String id;
+    String name;
+    String result;          // Empty = "SUCCESS: Action completed."
+};
+
+
+// --- Sound Event Structure ---
+struct SoundEvent {
+    int intensity = 0;
+    float direction = 0.0;
+};
+
+
+class EmilyBrain {
+public:
+    EmilyBrain();
+    void setup();
+    void loop();
+
+private:   
+    // --- Hardware Objects ---
+    TFT_eSPI display;
+    Adafruit_NeoPixel status_led;
+    AsyncUDP udp;            // Receives in the network task, see udp_rx_queue
+    PacketQueue udp_rx_queue;
+    uint32_t udp_rx_dropped_reported = 0;
+    uint8_t udp_tx_frame[EMILY_PROTO_MAX_FRAME]; // Encode buffer for sendNodeMessage()
+    uint16_t udp_tx_seq = 0;
+    emily_proto::Outbox<NODE_OUTBOX_SLOTS> udp_outbox;   // Commands awaiting an ACK
+    emily_proto::DuplicateFilter udp_seen;              // Results already handled
+    // Shared keep-alive session for TTS and STT. It is a second TLS session
+    // next to the network worker's (roughly 40 KB of internal heap each, for
+    // mbedTLS buffers). With VENICE_EARLY_SPEECH both are open while an early
+    // speech request overlaps the LLM answer.
+    VeniceConnection venice;
+    AudioEngine audio;       // I2S playback/recording task
+
+    WebServer ptms_server;
+    DNSServer dnsServer; // Captive Portal
+    Preferences preferences; 
+
+    // --- WiFi Helpers ---
+    void setupWiFi(); 
+    bool connectToWiFi(String ssid, String pass);
+    void startAPMode(); 
+    void handleRoot(); 
+    void handleSave(); 
+
+    // --- Web Remote Handlers ---
+    void handleRemotePage(); 
+    void handleRemoteInput();  
+
+    enum class WiFiStatus { DISCONNECTED, CONNECTING, CONNECTED };
+    WiFiStatus wifi_status = WiFiStatus::DISCONNECTED;
+
+    SPIClass* spiSD = nullptr; 
+
+    // --- Connectivity Tracking ---
+    bool os_connected = false;
+    bool camcanvas_connected = false;
+    bool inputpad_connected = false;
+
+    unsigned long last_os_contact = 0;
+    unsigned long last_camcanvas_contact = 0;
+    unsigned long last_inputpad_contact = 0;
+    unsigned long last_ping_time = 0;
+
+    // --- Emotional Model ---
+    double arousal = 0.0;
+    double valence = 0.0; 
+    unsigned long last_decay_time = 0;
+
+    // --- Status Display ---
+    // Every area has its own sprite; a frame only redraws and pushes the
+    // areas whose values changed since the last one (see renderDisplay()).
+    enum DisplayArea : uint8_t {
+        AREA_DOTS,          // WiFi / CamCanvas / InputPad dots in the title bar
+        AREA_AROUSAL,
+        AREA_VALENCE,
+        AREA_STATE,
+        AREA_CAMCANVAS,     // Online status, pan and tilt
+        AREA_CHAT,
+        AREA_COUNT
+    };
+    // What the screen shows, in the units it is drawn in (no Strings).
+    struct DisplaySnapshot {
+        WiFiStatus wifi;
+        bool camcanvas;
+        bool inputpad;
+        int16_t arousal_px;         // Filled bar width
+        int16_t valence_px;         // Bar position of the valence, zero in the middle
+        EmilyState state;
+        int16_t pan;                // Whole degrees
+        int16_t tilt;
+        uint32_t text_version;
+    };
+    DisplayRegion display_areas[AREA_COUNT];
+    RegionRenderer display_renderer;
+    DisplaySnapshot display_shown;
+    bool display_layout_drawn = false;
+    unsigned long last_display_frame = 0;
+
+    String last_display_text = "Booting..."; 
+    uint32_t display_text_version = 1;  // Bumped by setDisplayText()
+
+    // --- Wake Button ---
+    int last_button_state = HIGH;      
+    int debounced_state = HIGH;    
+    unsigned long last_debounce_time = 0; 
+
+    // --- OS State Storage ---
+    String os_act_state = "Offline";
+    float os_angle = 0.0; // Was: os_hoek
+    String current_attention_mode = "PASSIVE";
+    int last_sound_int = 0;
+    float last_sound_dir = 0.0;
+    std::deque<SoundEvent> sound_radar;
+
+    // --- CamCanvas State ---
+    float current_cam_tilt = 90.0; 
+    float current_cam_pan = 90.0;   
+    float prev_cam_tilt = -999.0;
+    float prev_cam_pan = -999.0;
+
+    unsigned long physical_task_start_time = 0; 
+    
+    EmilyState currentState = EmilyState::IDLE;
+    const char* current_arousal_context = nullptr; 
+    String system_prompt_content;
+    SemaphoreHandle_t config_mutex = nullptr;
+
+    // --- LLM Request (runs on the network worker) ---
+    NetworkWorker net_worker;
+    uint32_t ai_request_id = 0;  // Request whose result PROCESSING_AI waits for
+
+    // --- Chat History Index ---
+    bool history_index_ready = false; // Index verified against the history file
+    uint32_t history_line_count = 0;
+
+    // --- Rolling History Summary ---
+    String history_summary;               // Condensed turns that no longer fit the budget
+    uint32_t history_summary_covers = 0;  // History lines [0, covers) are folded into it
+    uint32_t history_window_start = 0;    // First history line replayed by the last payload
+    uint32_t summary_request_id = 0;      // Summary request running on the network worker
+    uint32_t summary_request_end = 0;     // New 'covers' once that request succeeds
+    unsigned long last_summary_attempt = 0;
+    unsigned long idle_since = 0;         // When IDLE was last entered
+
+    // --- Adventure Key Index ---
+    struct JsonSpan { uint32_t offset; uint32_t length; }; // Value bytes in ADVENTURE_PATH
+    std::map<String, JsonSpan> adventure_index;
+    size_t adventure_index_file_size = 0; // Size of ADVENTURE_PATH when the index was built
+    bool adventure_index_ready = false;
+
+    // --- Streaming TTS ---
+    HttpResponse tts_response;   // Open speech response (stream, or SD fallback download)
+    RingBuffer tts_ring;         // Jitter buffer between socket and I2S
+    WavHeader tts_stream_header;
+    bool tts_stream_active = false;
+    bool tts_stream_sized = false;      // 'data' chunk length known up front
+    uint32_t tts_stream_remaining = 0;  // Bytes of 'data' not yet received
+
+    // --- Speech Pipeline ---
+    String speech_text;                 // Utterance being spoken
+    size_t speech_pos = 0;              // Start of the first segment not yet requested
+    uint8_t speech_file = 0;            // SD fallback: file playing now (0 = A, 1 = B)
+    bool speech_file_ready = false;     // SD fallback: next segment is in the other file
+    bool speech_waiting = false;        // SD fallback: played out, next segment still downloading
+    bool speech_retried = false;        // SD fallback: the first segment was requested again
+    File speech_download;               // SD fallback: segment file being written
+    bool speech_download_pending = false; // Segment request sent, response not read yet
+    bool speech_download_active = false;  // Segment response open in tts_response
+    size_t speech_download_from = 0;    // Start of that segment in speech_text
+    size_t speech_download_bytes = 0;
+    unsigned long speech_download_at = 0; // Request sent / last body bytes written
+    bool speech_early = false;          // Stream opened while the AI was still answering
+    bool tts_request_pending = false;   // Early request sent, response not read yet
+    unsigned long tts_requested_at = 0;
+
+    // --- Audio Jobs ---
+    uint32_t audio_job_id = 0;        // Running playback/recording job (0 = none)
+
+    // --- Live STT Upload ---
+    RingBuffer stt_capture_ring;      // Mic audio from the engine, waiting for the socket
+    bool stt_upload_active = false;   // Chunked upload running next to the recording
+    String stt_upload_boundary;
+
+    // --- Tools Cache ---
+    // Pre-serialized "tools" array for every device-availability mask.
+    // Rebuilt from tools_config.json on boot and after each upload.
+    String tools_cache[TOOLS_CACHE_VARIANTS];
+
+    // --- Task Queue & Execution ---
+    TaskQueue task_queue;             // Preallocated; see TaskQueue.h
+    JsonObject active_tool_call_args; 
+    String active_tool_call_id;       // Tool call of the running task
+    String active_tool_call_name;     
+    ToolCallResult turn_tool_calls[TURN_MAX_TOOL_CALLS]; // Every tool call of the current turn
+    uint8_t turn_tool_count = 0;
+    String turn_followup;             // Trigger for the one follow-up AI cycle, if any
+
+    EmilyState next_state_after_audio = EmilyState::IDLE; 
+    unsigned long tts_task_start_time = 0; 
+    unsigned long camcanvas_task_start_time = 0;      
+    unsigned long inputpad_task_start_time = 0;   
+    unsigned long input_task_start_time = 0;
+
+    // --- Significant Event Tracking ---
+    std::deque<String> significant_events;
+    const size_t MAX_SIGNIFICANT_EVENTS = 5; 
+    StaticJsonDocument<512> prev_os_heartbeat_data; 
+
+    // --- Response Mailboxes ---
+    JsonDocument last_vision_response;       
+    StaticJsonDocument<256> last_camcanvas_confirmation; 
+    StaticJsonDocument<128> last_inputpad_response; 
+
+    // --- Private Helper Functions ---
+    void renderDisplay(bool immediate = false);
+    void drawDisplayLayout();
+    DisplaySnapshot takeDisplaySnapshot();
+    void setDisplayText(const String& text);
+    void sendPings(); 
+    void handleUdpPackets();
+    void handleUdpPacket(const UdpPacket& packet);
+    bool acceptNodeFrame(const UdpPacket& packet, const emily_proto::Frame& frame);
+    void handleCamCanvasFrame(const emily_proto::Frame& frame);
+    void handleInputPadFrame(const emily_proto::Frame& frame);
+    void serviceNodeOutbox();
+    void handleNodeMessageLost(uint32_t addr, uint8_t type, uint16_t seq);
+    void sendUdpFrame(const IPAddress& ip, uint16_t port, const uint8_t* data, size_t len);
+
+    // Encodes 'body' (+ optional text) as a binary frame and sends it to a node
+    // once. For pings; the next one replaces a lost one.
+    template <typename T>
+    void sendNodeMessage(const char* ip, uint16_t port, const T& body, const char* text = nullptr) {
+        size_t len = emily_proto::encode(udp_tx_frame, sizeof(udp_tx_frame), ++udp_tx_seq, body, text);
+        IPAddress addr;
+        addr.fromString(ip);
+        sendUdpFrame(addr, port, udp_tx_frame, len);
+    }
+
+    // Same, but the node must ACK it: serviceNodeOutbox() retransmits with
+    // backoff until it does. For every command.
+    template <typename T>
+    void sendNodeCommand(const char* ip, uint16_t port, const T& body, const char* text = nullptr) {
+        size_t len = emily_proto::encode(udp_tx_frame, sizeof(udp_tx_frame), ++udp_tx_seq, body, text);
+        IPAddress addr;
+        addr.fromString(ip);
+        if (!udp_outbox.track(udp_tx_frame, len, (uint32_t)addr, port, millis())) {
+            Serial.println("UDP: Outbox full, command sent without retransmit.");
+        }
+        sendUdpFrame(addr, port, udp_tx_frame, len);
+    }
+    void setupWebServer();
+    void handleFileUpload();
+    void handleFileDownload();
+    void handleHistoryDelete();
+
+    void checkTimeouts(); 
+    bool checkWakeButton();
+    void decayArousal();
+    const char* stateToString(EmilyState state);
+    void setState(EmilyState newState);
+    void _start_ai_cycle(const char* trigger_reason);
+    String buildSelfAwarenessReport(JsonObject device_status);
+    bool ensureHistoryIndex();
+    bool rebuildHistoryIndex();
+    void invalidateHistoryIndex();
+    size_t readHistoryOffsets(uint32_t first, uint32_t count, uint32_t* offsets);
+    void collectChatHistoryOffsets(std::vector<uint32_t>& offsets, uint32_t token_budget);
+    void writeChatHistory(Print& out, const std::vector<uint32_t>& offsets);
+    void loadHistorySummary();
+    void resetHistorySummary();
+    void maybeSummarizeHistory();
+    void writeSummaryPayload(Print& out, const String& previous, const String& records);
+    void handleSummaryResult(ChatResult& result);
+    ChatResult* pollNetworkResults();
+    void rebuildToolsCache();
+    uint8_t toolsMaskFor(JsonObject device_status);
+    
+    void prepareAiPayload(AiPayloadPlan& plan, const char* current_prompt_content, JsonObject device_status);
+    void writeAiPayload(Print& out, const AiPayloadPlan& plan);
+    void loadConfigurations();
+    void processAiProxyRequest(const char* current_prompt_content, JsonObject device_status);
+    void handleAiResult(ChatResult& result);
+    bool processTtsRequest(const char* text);
+    String buildTtsPayload(const char* textToSpeak);
+    bool openTtsStream(const char* textToSpeak);
+    bool requestTtsStream(const char* textToSpeak);
+    bool continueTtsStream();
+    bool takeSpeechSegment(String& segment);
+    bool prefetchSpeechFile();
+    void pumpSpeechDownload();
+    void endSpeechDownload(bool ok);
+    bool speechDownloadBusy() const { return speech_download_pending || speech_download_active; }
+    bool playNextSpeechFile();
+    void continueSpeechFiles();
+    void abandonSpeech(const char* result);
+    void resetSpeechPipeline();
+    void prefetchSpeech(const String& text);
+    void dropEarlySpeech();
+    void pollEarlySpeech();
+    bool finishEarlySpeech();
+    bool acceptTtsResponse(unsigned long timeout_ms);
+    bool readTtsStreamHeader(unsigned long timeout_ms);
+    size_t pumpTtsStream();
+    bool ttsStreamFinished();
+    bool spillTtsStreamToSd(const char* filename);
+    void closeTtsStream();
+    void transcribeAudioFromSd(const char* filename);
+    String buildSttMultipartPrefix(const String& boundary);
+    bool beginLiveSttUpload();
+    void writeLiveSttUpload(const uint8_t* data, size_t len);
+    bool finishLiveSttUpload(String& response_body);
+    void abortLiveSttUpload();
+    void listenAndTranscribe();
+    void pumpLiveSttUpload();
+    void finishListening(uint32_t captured_bytes);
+    void pollListening();
+    bool pollAudioEvent(AudioEvent& evt);
+    void stopAudio();
+    void finishSpeaking();
+    void processSttResponseAndTriggerAi(const String& raw_api_payload);
+    void _handle_ai_response(const char* user_prompt_json_str, JsonArray tool_calls); 
+    void _continue_task(); 
+    void logInteractionToSd(JsonObject log_data); 
+    void logInteractionToSd_Error(const char* role, String tool_call_id, String tool_name, String content);
+    uint8_t addTask(uint8_t tool, Task task);
+    void planToolCall(uint8_t tool, const char* arguments);
+    bool startTask(Task& task);
+    void completeTask(Task& task);
+    Task* runningTask(TaskLane lane);
+    bool taskRunning(TaskType type);
+    void updateTurnState();
+    void serviceTaskLanes();
+    void setToolResult(const Task& task, const String& result);
+    void addFollowUp(const String& trigger);
+    void logToolResults(const char* default_result);
+    void finishTurn();
+    void abandonTurn(const char* reason);
+
+    // Task starters, one per TaskType (dispatch table in startTask()).
+    // Each returns true if its task is already done, false if it keeps its
+    // lane busy until a lane handler calls completeTask().
+    typedef bool (EmilyBrain::*TaskStarter)(Task& task);
+    bool startEmotionTask(Task& task);
+    bool startSoundTask(Task& task);
+    bool startSpeakTask(Task& task);
+    bool startMoveHeadTask(Task& task);
+    bool startSetLedTask(Task& task);
+    bool startAnalyzeTask(Task& task);
+    bool startNodTask(Task& task);
+    bool startTakePictureTask(Task& task);
+    bool startImageSyncTask(Task& task);
+    bool startImageAsyncTask(Task& task);
+    bool startInputPadTask(Task& task);
+    bool startLocalDataTask(Task& task);
+    bool isOsEventSignificant(const JsonDocument& current_heartbeat);
+    void addSignificantEvent(const String& event_desc);
+    String getDataFromJson(const char* key);
+    bool buildAdventureIndex();
+    
+    // State Handlers
+    void handleIdleState();
+    void handleAwaitingSpeechState();
+    void handleRecordingSpeechState();
+    void handleProcessingSttState();
+    void handleProcessingAiState();
+    void handleGeneratingSpeechState();
+    void handleSpeakingState();
+    void handleExecutingPhysicalToolState();
+    // Lane handlers, polled by serviceTaskLanes() while their task runs
+    void serviceVisionTask(Task& task);
+    void serviceImageTask(Task& task);
+    void serviceInputTask(Task& task);
+    void serviceLocalDataTask(Task& task);
+
+    // Web Remote Handlers
+    void handleForceIdle();
+    void handleCenterHead();
+    void handleForceReboot();
+};
+
+#endif // EMILYBRAIN_H
+
@@ -0,0 +1,59 @@
+#include "HistoryWindow.h"
+
+uint32_t estimateTokens(size_t bytes) {
+    return bytes / CONTEXT_BYTES_PER_TOKEN + CONTEXT_MESSAGE_OVERHEAD;
+}
+
+uint32_t historyTokenBudget(uint32_t budget, size_t summary_bytes) {
+    uint32_t summary_tokens = summary_bytes > 0 ? estimateTokens(summary_bytes) : 0;
+    return budget > summary_tokens ? budget - summary_tokens : 0;
+}
+
+void HistoryWindow::begin(uint32_t line_count, uint32_t first_allowed_, uint32_t end_, uint32_t token_budget_) {
+    selected.clear();
+    end = end_;
+    first_allowed = first_allowed_ < line_count ? first_allowed_ : line_count;
+    start_line = line_count;
+    token_budget = token_budget_;
+    used_tokens = 0;
+    full = false;
+}
+
+// Tokens of selected[index]: up to the start of the line after it
+uint32_t HistoryWindow::lineTokens(size_t index) const {
+    uint32_t next_start = index > 0 ? selected[index - 1] : end;
+    return estimateTokens(next_start - selected[index]);
+}
+
+bool HistoryWindow::addOlder(uint32_t offset) {
+    if (!wantsOlder()) return false;
+    uint32_t next_start = selected.empty() ? end : selected.back();
+    uint32_t tokens = estimateTokens(next_start - offset);
+    if (used_tokens + tokens > token_budget) {
+        full = true;
+        return false;
+    }
+    used_tokens += tokens;
+    selected.push_back(offset);
+    start_line--;
+    return true;
+}
+
+void HistoryWindow::dropOldest() {
+    if (selected.empty()) return;
+    used_tokens -= lineTokens(selected.size() - 1);
+    selected.pop_back();
+    start_line++;
+    full = true; // The line before it is gone for good, nothing older can follow
+}
+
+void HistoryWindow::copyOffsets(std::vector<uint32_t>& offsets) const {
+    offsets.assign(selected.rbegin(), selected.rend());
+}
+
+uint32_t summaryChunkLines(const uint32_t* offsets, uint32_t count, uint32_t chunk_bytes) {
+    if (count == 0) return 0;
+    uint32_t lines = 1;
+    while (lines < count && offsets[lines + 1] - offsets[0] <= chunk_bytes) lines++;
+    return lines;
+}
@@ -0,0 +1,66 @@
+#ifndef HISTORYWINDOW_H
+#define HISTORYWINDOW_H
+
+#include <Arduino.h>
+#include <vector>
+
+#define CONTEXT_BYTES_PER_TOKEN     4       // Rough estimate for English JSON
+#define CONTEXT_MESSAGE_OVERHEAD    4       // Tokens the API adds per message
+
+// --- Token Estimate ---
+// No tokenizer on the device: bytes / CONTEXT_BYTES_PER_TOKEN is close enough
+// for English JSON to keep the prompt size under control.
+uint32_t estimateTokens(size_t bytes);
+
+// Tokens left for replayed history once the rolling summary (sent as its
+// own message) is taken out of 'budget'.
+uint32_t historyTokenBudget(uint32_t budget, size_t summary_bytes);
+
+// --- History Window ---
+// The newest chat history lines that fit a token budget, by their start
+// offsets in the history file. Lines are offered newest first; a line's
+// size is the distance to the start of the line after it, so nothing but
+// the index is read.
+class HistoryWindow {
+public:
+    // Lines [first_allowed, line_count) may be selected; 'end' is the
+    // history file size (where the line after the newest one would start).
+    void begin(uint32_t line_count, uint32_t first_allowed, uint32_t end, uint32_t token_budget);
+
+    // True while an older line may still fit.
+    bool wantsOlder() const { return !full && start_line > first_allowed; }
+    // Offers line start() - 1. False, and the window is closed, if it
+    // doesn't fit the budget.
+    bool addOlder(uint32_t offset);
+
+    // Drops the oldest selected line and gives its tokens back (a tool
+    // result whose tool_calls message fell out of the window).
+    void dropOldest();
+    uint32_t oldestOffset() const { return selected.empty() ? 0 : selected.back(); }
+
+    bool empty() const { return selected.empty(); }
+    uint32_t start() const { return start_line; }   // First selected line
+    uint32_t tokens() const { return used_tokens; }
+    // The selected offsets, oldest first.
+    void copyOffsets(std::vector<uint32_t>& offsets) const;
+
+private:
+    std::vector<uint32_t> selected;     // Newest first
+    uint32_t end = 0;
+    uint32_t first_allowed = 0;
+    uint32_t start_line = 0;
+    uint32_t token_budget = 0;
+    uint32_t used_tokens = 0;
+    bool full = false;
+
+    uint32_t lineTokens(size_t index) const;
+};
+
+// --- Summary Chunk ---
+// How many of the 'count' evicted lines starting at offsets[0] one summary
+// request folds in, to keep it small: at least one, then as many as end
+// within 'chunk_bytes'. 'offsets' holds count + 1 entries, the last one
+// where the line after them starts.
+uint32_t summaryChunkLines(const uint32_t* offsets, uint32_t count, uint32_t chunk_bytes);
+
+#endif // HISTORYWINDOW_H
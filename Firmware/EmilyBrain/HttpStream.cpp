@@ -0,0 +1,275 @@
+#include "HttpStream.h"
+
+// --- BufferedPrint ---
+size_t BufferedPrint::write(const uint8_t* data, size_t size) {
+    if (write_failed) return 0;
+    size_t accepted = 0;
+    while (accepted < size) {
+        size_t space = BUFFER_SIZE - used;
+        size_t n = (size - accepted < space) ? (size - accepted) : space;
+        memcpy(buffer + used, data + accepted, n);
+        used += n;
+        accepted += n;
+        if (used == BUFFER_SIZE) {
+            flush();
+            if (write_failed) return accepted;
+        }
+    }
+    return accepted;
+}
+
+void BufferedPrint::flush() {
+    if (used == 0 || write_failed) return;
+    size_t sent = 0;
+    while (sent < used) {
+        size_t n = client.write(buffer + sent, used - sent);
+        if (n == 0) {
+            Serial.println("BufferedPrint ERROR: Socket write failed.");
+            write_failed = true;
+            break;
+        }
+        sent += n;
+    }
+    total_written += sent;
+    used = 0;
+}
+
+// --- JSON string escaping ---
+void writeJsonEscaped(Print& out, const char* text) {
+    if (text == nullptr) return;
+    const char* run_start = text; // Start of the current run of "safe" characters
+    const char* p = text;
+    for (; *p; p++) {
+        unsigned char c = (unsigned char)*p;
+        const char* escape = nullptr;
+        char unicode_escape[7];
+        switch (c) {
+            case '"':  escape = "\\\""; break;
+            case '\\': escape = "\\\\"; break;
+            case '\n': escape = "\\n"; break;
+            case '\r': escape = "\\r"; break;
+            case '\t': escape = "\\t"; break;
+            case '\b': escape = "\\b"; break;
+            case '\f': escape = "\\f"; break;
+            default:
+                if (c < 0x20) {
+                    snprintf(unicode_escape, sizeof(unicode_escape), "\\u%04x", c);
+                    escape = unicode_escape;
+                }
+                break;
+        }
+        if (escape) {
+            if (p > run_start) out.write((const uint8_t*)run_start, p - run_start);
+            out.print(escape);
+            run_start = p + 1;
+        }
+    }
+    if (p > run_start) out.write((const uint8_t*)run_start, p - run_start);
+}
+
+// --- HttpResponse ---
+bool HttpResponse::readHeaderLine(String& line, unsigned long deadline) {
+    line = "";
+    while ((long)(deadline - millis()) > 0) {
+        if (client->available()) {
+            char c = (char)client->read();
+            if (c == '\n') {
+                line.trim(); // Strips the trailing '\r'
+                return true;
+            }
+            if (line.length() < 512) line += c; // Ignore absurdly long header values
+        } else if (!client->connected()) {
+            return false;
+        } else {
+            delay(1);
+        }
+    }
+    return false;
+}
+
+bool HttpResponse::begin(Client& c, unsigned long timeout_ms) {
+    client = &c;
+    status_code = 0;
+    content_length = -1;
+    chunked = false;
+    keep_alive = true;
+    body_state = BodyState::FAILED;
+    remaining = 0;
+    line_len = 0;
+
+    unsigned long deadline = millis() + timeout_ms;
+    String line;
+
+    // Skip any interim "100 Continue" responses
+    do {
+        if (!readHeaderLine(line, deadline)) return false;
+        if (!line.startsWith("HTTP/")) return false;
+        int space = line.indexOf(' ');
+        if (space < 0) return false;
+        status_code = line.substring(space + 1).toInt();
+        if (line.startsWith("HTTP/1.0")) keep_alive = false;
+
+        // --- Headers ---
+        while (true) {
+            if (!readHeaderLine(line, deadline)) return false;
+            if (line.length() == 0) break; // End of headers
+
+            int colon = line.indexOf(':');
+            if (colon < 0) continue;
+            String name = line.substring(0, colon);
+            String value = line.substring(colon + 1);
+            name.toLowerCase();
+            value.trim();
+            value.toLowerCase();
+
+            if (name == "content-length") {
+                content_length = value.toInt();
+            } else if (name == "transfer-encoding" && value.indexOf("chunked") >= 0) {
+                chunked = true;
+            } else if (name == "connection") {
+                if (value.indexOf("close") >= 0) keep_alive = false;
+                else if (value.indexOf("keep-alive") >= 0) keep_alive = true;
+            }
+        }
+    } while (status_code >= 100 && status_code < 200);
+
+    // --- Decide how the body is framed ---
+    if (status_code == 204 || status_code == 304) {
+        body_state = BodyState::DONE;
+    } else if (chunked) {
+        body_state = BodyState::CHUNK_SIZE;
+    } else if (content_length >= 0) {
+        remaining = (size_t)content_length;
+        body_state = (remaining > 0) ? BodyState::FIXED : BodyState::DONE;
+    } else {
+        body_state = BodyState::UNTIL_CLOSE;
+        keep_alive = false; // The server will close to mark the end of the body
+    }
+    return true;
+}
+
+// Accumulates one CRLF-terminated line for the chunked decoder without blocking.
+// Returns true once a complete line is in line_buf.
+bool HttpResponse::pumpChunkLine() {
+    while (client->available()) {
+        char c = (char)client->read();
+        if (c == '\n') {
+            if (line_len > 0 && line_buf[line_len - 1] == '\r') line_len--;
+            line_buf[line_len] = '\0';
+            line_len = 0;
+            return true;
+        }
+        if (line_len < sizeof(line_buf) - 1) line_buf[line_len++] = c; // Extensions get truncated
+    }
+    return false;
+}
+
+int HttpResponse::read(uint8_t* buf, size_t len) {
+    size_t total = 0;
+    while (total < len) {
+        switch (body_state) {
+            case BodyState::FIXED:
+            case BodyState::CHUNK_DATA:
+            case BodyState::UNTIL_CLOSE: {
+                int avail = client->available();
+                if (avail <= 0) {
+                    if (!client->connected()) {
+                        body_state = (body_state == BodyState::UNTIL_CLOSE) ? BodyState::DONE : BodyState::FAILED;
+                    }
+                    return total;
+                }
+                size_t want = len - total;
+                if ((size_t)avail < want) want = avail;
+                if (body_state != BodyState::UNTIL_CLOSE && remaining < want) want = remaining;
+
+                int n = client->read(buf + total, want);
+                if (n <= 0) return total;
+                total += n;
+
+                if (body_state != BodyState::UNTIL_CLOSE) {
+                    remaining -= n;
+                    if (remaining == 0) {
+                        body_state = (body_state == BodyState::FIXED) ? BodyState::DONE : BodyState::CHUNK_CRLF;
+                    }
+                }
+                break;
+            }
+
+            case BodyState::CHUNK_SIZE:
+            case BodyState::CHUNK_CRLF:
+            case BodyState::TRAILERS: {
+                if (!pumpChunkLine()) {
+                    if (!client->connected() && !client->available()) body_state = BodyState::FAILED;
+                    return total;
+                }
+                if (body_state == BodyState::CHUNK_SIZE) {
+                    remaining = strtoul(line_buf, nullptr, 16);
+                    body_state = (remaining > 0) ? BodyState::CHUNK_DATA : BodyState::TRAILERS;
+                } else if (body_state == BodyState::CHUNK_CRLF) {
+                    body_state = (line_buf[0] == '\0') ? BodyState::CHUNK_SIZE : BodyState::FAILED;
+                } else if (line_buf[0] == '\0') {
+                    body_state = BodyState::DONE; // Empty line ends the trailers
+                }
+                break;
+            }
+
+            default: // IDLE, DONE, FAILED
+                return total;
+        }
+    }
+    return total;
+}
+
+bool HttpResponse::readString(String& out, unsigned long timeout_ms) {
+    if (content_length > 0) out.reserve(out.length() + content_length);
+    uint8_t buf[512];
+    unsigned long last_progress = millis();
+    while (!finished() && !failed()) {
+        int n = read(buf, sizeof(buf));
+        if (n > 0) {
+            out.concat((const char*)buf, n);
+            last_progress = millis();
+        } else if (millis() - last_progress > timeout_ms) {
+            Serial.println("HttpResponse ERROR: Timeout while reading body.");
+            body_state = BodyState::FAILED;
+        } else {
+            delay(2);
+        }
+    }
+    return finished();
+}
+
+bool HttpResponse::readFully(uint8_t* buf, size_t len, unsigned long timeout_ms) {
+    size_t got = 0;
+    unsigned long last_progress = millis();
+    while (got < len) {
+        int n = read(buf + got, len - got);
+        if (n > 0) {
+            got += n;
+            last_progress = millis();
+        } else if (finished() || failed()) {
+            return false; // Body ended early
+        } else if (millis() - last_progress > timeout_ms) {
+            return false;
+        } else {
+            delay(1);
+        }
+    }
+    return true;
+}
+
+bool HttpResponse::discard(unsigned long timeout_ms) {
+    uint8_t buf[256];
+    unsigned long last_progress = millis();
+    while (!finished() && !failed()) {
+        int n = read(buf, sizeof(buf));
+        if (n > 0) {
+            last_progress = millis();
+        } else if (millis() - last_progress > timeout_ms) {
+            body_state = BodyState::FAILED;
+        } else {
+            delay(2);
+        }
+    }
+    return finished();
+}
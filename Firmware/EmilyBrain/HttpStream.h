@@ -0,0 +1,99 @@
+#ifndef HTTPSTREAM_H
+#define HTTPSTREAM_H
+
+#include <Arduino.h>
+#include <Client.h>
+
+// --- Streaming HTTP helpers ---
+// Small building blocks for talking HTTP/1.1 over a raw (TLS) socket without
+// holding whole request or response bodies in RAM.
+
+// Print sink that only counts bytes. Used for a "dry run" of a payload writer
+// so the Content-Length is known before the real bytes go onto the socket.
+class CountingPrint : public Print {
+public:
+    size_t write(uint8_t) override { count++; return 1; }
+    size_t write(const uint8_t* buffer, size_t size) override { count += size; return size; }
+    size_t count = 0;
+};
+
+// Print adapter that coalesces many small writes into larger socket writes.
+// Every write() on WiFiClientSecure becomes its own TLS record, so printing a
+// JSON document byte by byte directly onto the client is extremely slow.
+class BufferedPrint : public Print {
+public:
+    explicit BufferedPrint(Client& client) : client(client) {}
+    ~BufferedPrint() { flush(); }
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override;
+    void flush() override;
+
+    size_t bytesWritten() const { return total_written; }
+    bool failed() const { return write_failed; }
+
+private:
+    static const size_t BUFFER_SIZE = 1024;
+    Client& client;
+    uint8_t buffer[BUFFER_SIZE];
+    size_t used = 0;
+    size_t total_written = 0;
+    bool write_failed = false;
+};
+
+// Writes 'text' as a JSON string body (WITHOUT the surrounding quotes),
+// escaping quotes, backslashes and control characters.
+void writeJsonEscaped(Print& out, const char* text);
+
+// --- Incremental HTTP/1.1 response reader ---
+// Parses the status line and headers, then hands out the decoded body
+// (Content-Length, chunked, or read-until-close) in caller-sized pieces.
+class HttpResponse {
+public:
+    // Reads status line and headers. Blocks up to timeout_ms. Returns false
+    // if the connection dropped or the status line was malformed.
+    bool begin(Client& client, unsigned long timeout_ms);
+
+    int status() const { return status_code; }
+    long contentLength() const { return content_length; }
+    bool isChunked() const { return chunked; }
+    bool keepAlive() const { return keep_alive; }
+    bool finished() const { return body_state == BodyState::DONE; }
+    bool failed() const { return body_state == BodyState::FAILED; }
+
+    // Non-blocking: copies up to 'len' decoded body bytes that are already
+    // available on the socket. Returns 0 if nothing is available yet (check
+    // finished()/failed() to tell the difference), otherwise the byte count.
+    int read(uint8_t* buf, size_t len);
+
+    // Blocking convenience: reads the remaining body into 'out'.
+    // Gives up after timeout_ms without progress.
+    bool readString(String& out, unsigned long timeout_ms);
+
+    // Blocking: reads exactly 'len' body bytes (e.g. a file header at the
+    // start of a streamed body). Gives up after timeout_ms without progress.
+    bool readFully(uint8_t* buf, size_t len, unsigned long timeout_ms);
+
+    // Blocking: reads and discards the remaining body so the connection can
+    // be reused for the next request.
+    bool discard(unsigned long timeout_ms);
+
+private:
+    enum class BodyState { IDLE, FIXED, CHUNK_SIZE, CHUNK_DATA, CHUNK_CRLF, TRAILERS, UNTIL_CLOSE, DONE, FAILED };
+
+    bool readHeaderLine(String& line, unsigned long deadline);
+    bool pumpChunkLine();
+
+    Client* client = nullptr;
+    int status_code = 0;
+    long content_length = -1;
+    bool chunked = false;
+    bool keep_alive = true;
+
+    BodyState body_state = BodyState::IDLE;
+    size_t remaining = 0;   // Bytes left in the fixed body or current chunk
+    char line_buf[24];      // Partial chunk-size / CRLF / trailer line
+    uint8_t line_len = 0;
+};
+
+#endif // HTTPSTREAM_H
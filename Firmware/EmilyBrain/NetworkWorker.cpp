@@ -0,0 +1,223 @@
+#include "NetworkWorker.h"
+
+// Forwards exactly 'length' bytes: anything beyond is dropped, a shortfall
+// is padded with spaces (valid JSON whitespace). Keeps the Content-Length
+// honest if the payload sources change between the measure and send pass.
+class FixedLengthPrint : public Print {
+public:
+    FixedLengthPrint(Print& out, size_t length) : out(out), remaining(length) {}
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override {
+        size_t n = size < remaining ? size : remaining;
+        if (n > 0) out.write(buffer, n);
+        remaining -= n;
+        return size;
+    }
+    void pad() { while (remaining > 0) { out.write(' '); remaining--; } }
+private:
+    Print& out;
+    size_t remaining;
+};
+
+bool NetworkWorker::begin() {
+    request_queue = xQueueCreate(NET_QUEUE_LEN, sizeof(ChatRequest*));
+    result_queue = xQueueCreate(NET_QUEUE_LEN, sizeof(ChatResult*));
+    if (request_queue == nullptr || result_queue == nullptr) {
+        Serial.println("NetworkWorker ERROR: Could not create queues.");
+        return false;
+    }
+    BaseType_t result = xTaskCreatePinnedToCore(taskEntry, "net_worker", NET_TASK_STACK, this,
+                                                NET_TASK_PRIORITY, &task, NET_TASK_CORE);
+    if (result != pdPASS) {
+        Serial.println("NetworkWorker ERROR: Could not start task.");
+        return false;
+    }
+    Serial.println("NetworkWorker started.");
+    return true;
+}
+
+// --- Public API (called from loop()) ---
+// Once queued, the request belongs to the worker, which may run and delete
+// it before xQueueSend() returns here: nothing reads it after the send.
+// chat_waiting is raised before a chat request is queued, so the worker
+// can't clear it (run()) before it is set.
+uint32_t NetworkWorker::submit(ChatRequest* request) {
+    uint32_t id = next_id++;
+    request->id = id;
+    bool background = request->background;
+    // Chat requests jump the queue; a summary queued earlier runs after them
+    BaseType_t queued = pdFALSE;
+    if (request_queue != nullptr) {
+        if (background) {
+            queued = xQueueSendToBack(request_queue, &request, 0);
+        } else {
+            chat_waiting = true;
+            queued = xQueueSendToFront(request_queue, &request, 0);
+            if (queued != pdTRUE) chat_waiting = false;
+        }
+    }
+    if (queued != pdTRUE) {
+        Serial.println("NetworkWorker ERROR: Request queue full.");
+        delete request;
+        return 0;
+    }
+    return id;
+}
+
+bool NetworkWorker::pollResult(ChatResult*& result) {
+    return result_queue != nullptr && xQueueReceive(result_queue, &result, 0) == pdTRUE;
+}
+
+void NetworkWorker::discardResults() {
+    ChatResult* result;
+    while (pollResult(result)) {
+        Serial.printf("NetworkWorker: Dropping stale result %u.\n", result->id);
+        delete result;
+    }
+}
+
+// --- Worker Task ---
+void NetworkWorker::taskEntry(void* arg) {
+    static_cast<NetworkWorker*>(arg)->run();
+}
+
+void NetworkWorker::run() {
+    while (true) {
+        ChatRequest* request;
+        if (xQueueReceive(request_queue, &request, portMAX_DELAY) != pdTRUE) continue;
+        if (!request->background) chat_waiting = false;
+
+        ChatResult* result = new ChatResult();
+        result->id = request->id;
+        execute(*request, *result);
+        delete request;
+
+        // loop() drains this queue every PROCESSING_AI pass and before each
+        // new request, so blocking here only waits for the main task.
+        xQueueSend(result_queue, &result, portMAX_DELAY);
+    }
+}
+
+void NetworkWorker::execute(const ChatRequest& request, ChatResult& result) {
+    if (WiFi.status() != WL_CONNECTED) {
+        connection.close();
+        result.error = "WiFi offline";
+        return;
+    }
+
+    if (request.background && chat_waiting) {
+        result.error = "Yielded to a chat request";
+        return;
+    }
+
+    // --- Step 1: Measure the payload (dry run, nothing is stored) ---
+    CountingPrint counter;
+    request.write_body(counter);
+    Serial.printf("NetworkWorker: Request %u, payload %u bytes.\n", request.id, counter.count);
+
+    // --- Step 2: Send it and read the answer ---
+    HttpResponse response;
+    String response_body;
+    size_t length = counter.count;
+    VeniceConnection::BodyWriter send_body = [&](Print& out) {
+        FixedLengthPrint fixed(out, length);
+        request.write_body(fixed);
+        fixed.pad();
+    };
+    bool answered = request.background
+        ? requestYielding(request, length, send_body, response, result)
+        : connection.request("POST", request.path, "application/json", length,
+                             send_body, response, request.timeout_ms);
+    if (!answered) {
+        if (result.error.length() == 0) result.error = "No response from server";
+    } else {
+        result.status = response.status();
+        if (request.stream && result.status == 200) {
+            // Parsed event by event while it arrives (no Step 3)
+            bool streamed = readStream(request, response, result);
+            connection.release(response);
+            result.ok = streamed;
+            return;
+        }
+        response.readString(response_body, request.timeout_ms);
+        if (result.status != 200) {
+            Serial.println("Error payload: " + response_body);
+            result.error = "API call failed (" + String(result.status) + ")";
+        }
+    }
+    connection.release(response);
+    if (result.error.length() > 0) return;
+
+    // --- Step 3: Parse on this task too ---
+    DeserializationError error = deserializeJson(result.doc, response_body);
+    if (error) {
+        result.error = String("Invalid JSON: ") + error.c_str();
+        return;
+    }
+    result.ok = true;
+}
+
+// Background requests wait for their answer in small steps and drop the
+// session as soon as a chat request is queued, instead of holding the
+// worker for up to their whole timeout. Dropping costs the chat request a
+// fresh TLS handshake, which is far shorter than an LLM answer.
+bool NetworkWorker::requestYielding(const ChatRequest& request, size_t length,
+                                    VeniceConnection::BodyWriter& send_body,
+                                    HttpResponse& response, ChatResult& result) {
+    if (!connection.send("POST", request.path, "application/json", length, send_body)) return false;
+
+    unsigned long start = millis();
+    while (!connection.responseReady()) {
+        if (chat_waiting) {
+            connection.close(); // Its answer must not arrive on the chat request's session
+            result.error = "Yielded to a chat request";
+            return false;
+        }
+        if (millis() - start > request.timeout_ms) {
+            connection.close();
+            return false;
+        }
+        delay(10);
+    }
+    return connection.receive(response, request.timeout_ms);
+}
+
+// Feeds the SSE body through a ChatStream as it arrives. Posts a partial
+// result as soon as the speech is complete, so loop() can start the TTS
+// request while the model is still generating the rest of the turn.
+bool NetworkWorker::readStream(const ChatRequest& request, HttpResponse& response, ChatResult& result) {
+    ChatStream stream;
+    uint8_t buf[512];
+    unsigned long last_progress = millis();
+    while (!response.finished() && !response.failed() && !stream.done()) {
+        int n = response.read(buf, sizeof(buf));
+        if (n > 0) {
+            stream.feed((const char*)buf, n);
+            last_progress = millis();
+
+            String speech;
+            if (stream.takeEarlySpeech(speech)) {
+                Serial.printf("NetworkWorker: Request %u, speech complete mid-stream.\n", request.id);
+                ChatResult* partial = new ChatResult();
+                partial->id = request.id;
+                partial->partial = true;
+                partial->early_speech = speech;
+                xQueueSend(result_queue, &partial, portMAX_DELAY);
+            }
+        } else if (millis() - last_progress > request.timeout_ms) {
+            Serial.println("NetworkWorker ERROR: Timeout while reading stream.");
+            break;
+        } else {
+            delay(2);
+        }
+    }
+
+    bool complete = stream.done() || response.finished();
+    if (stream.done()) response.discard(1000); // Terminating chunk, keeps the session reusable
+    if (complete) {
+        stream.toDocument(result.doc);
+    } else {
+        result.error = "Stream ended early";
+    }
+    return complete;
+}
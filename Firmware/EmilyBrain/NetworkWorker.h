@@ -0,0 +1,78 @@
+#ifndef NETWORKWORKER_H
+#define NETWORKWORKER_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <atomic>
+#include "VeniceConnection.h"
+#include "ChatStream.h"
+#include "HttpStream.h"
+
+// --- Network Worker Task Parameters ---
+#define NET_TASK_CORE           0
+#define NET_TASK_PRIORITY       3       // Below the audio engine
+#define NET_TASK_STACK          16384   // TLS handshake + JSON parsing
+#define NET_QUEUE_LEN           2
+
+// One chat completion request. The body writer runs on the worker task.
+struct ChatRequest {
+    uint32_t id = 0;
+    const char* path = nullptr;
+    VeniceConnection::BodyWriter write_body;
+    unsigned long timeout_ms = 90000;
+    bool stream = false;            // Body asks for "stream": true (SSE response)
+    bool background = false;        // Yields to chat requests (history summaries)
+};
+
+// Parsed answer to a ChatRequest. 'doc' holds the full response JSON when
+// ok is true; otherwise 'error' describes what went wrong. A streamed
+// request can post one 'partial' result first, carrying only the text
+// Emily is going to speak, while the rest of the response is still coming.
+struct ChatResult {
+    uint32_t id = 0;
+    bool partial = false;
+    String early_speech;
+    bool ok = false;
+    int status = 0;
+    String error;
+    JsonDocument doc;
+};
+
+// --- Network Worker ---
+// Runs the slow LLM round trip on its own FreeRTOS task with its own TLS
+// session, so loop() (display, UDP, web remote, wake button) keeps running
+// while Emily is thinking. Requests go in through submit(); results come
+// back through pollResult() and must be deleted by the caller.
+//
+// A chat request goes ahead of queued background requests, and one that is
+// already waiting for its answer gives the session up (the result carries
+// an error), so Emily never thinks for longer because of a summary.
+class NetworkWorker {
+public:
+    NetworkWorker(const char* host, const char* api_key) : connection(host, api_key) {}
+
+    bool begin();
+
+    // Takes ownership of 'request'. Returns its id, or 0 if it was rejected.
+    uint32_t submit(ChatRequest* request);
+    bool pollResult(ChatResult*& result);
+    // Drops results nobody is waiting for anymore.
+    void discardResults();
+
+private:
+    static void taskEntry(void* arg);
+    void run();
+    void execute(const ChatRequest& request, ChatResult& result);
+    bool readStream(const ChatRequest& request, HttpResponse& response, ChatResult& result);
+    bool requestYielding(const ChatRequest& request, size_t length, VeniceConnection::BodyWriter& send_body,
+                         HttpResponse& response, ChatResult& result);
+
+    VeniceConnection connection;   // Only touched by the worker task
+    QueueHandle_t request_queue = nullptr;
+    QueueHandle_t result_queue = nullptr;
+    TaskHandle_t task = nullptr;
+    uint32_t next_id = 1;
+    std::atomic<bool> chat_waiting{false}; // A chat request is queued
+};
+
+#endif // NETWORKWORKER_H
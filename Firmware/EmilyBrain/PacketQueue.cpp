@@ -0,0 +1,76 @@
+#include "PacketQueue.h"
+#include "esp_heap_caps.h"
+
+bool PacketQueue::begin(size_t slot_count) {
+    if (slots != nullptr && size == slot_count + 1) {
+        head = 0;
+        tail = 0;
+        return true;
+    }
+    end();
+    size_t bytes = (slot_count + 1) * sizeof(UdpPacket);
+    slots = (UdpPacket*)heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (slots == nullptr) {
+        slots = (UdpPacket*)malloc(bytes);
+    }
+    if (slots == nullptr) {
+        Serial.printf("PacketQueue ERROR: Could not allocate %u bytes.\n", (unsigned)bytes);
+        return false;
+    }
+    size = slot_count + 1;
+    head = 0;
+    tail = 0;
+    drops = 0;
+    return true;
+}
+
+void PacketQueue::end() {
+    if (slots != nullptr) {
+        heap_caps_free(slots);
+        slots = nullptr;
+    }
+    size = 0;
+    head = 0;
+    tail = 0;
+}
+
+bool PacketQueue::push(uint32_t addr, uint16_t port, const uint8_t* data, size_t len) {
+    if (size == 0) return false;
+    size_t h = head.load(std::memory_order_relaxed);
+    size_t next = (h + 1 == size) ? 0 : h + 1;
+    if (next == tail.load(std::memory_order_acquire)) {
+        drops.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    UdpPacket& packet = slots[h];
+    if (len > UDP_PACKET_MAX_BYTES) len = UDP_PACKET_MAX_BYTES;
+    packet.addr = addr;
+    packet.port = port;
+    packet.len = (uint16_t)len;
+    memcpy(packet.data, data, len);
+    packet.data[len] = 0;
+
+    head.store(next, std::memory_order_release);
+    return true;
+}
+
+const UdpPacket* PacketQueue::front() const {
+    if (size == 0) return nullptr;
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire)) return nullptr;
+    return &slots[t];
+}
+
+void PacketQueue::pop() {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (size == 0 || t == head.load(std::memory_order_acquire)) return;
+    tail.store((t + 1 == size) ? 0 : t + 1, std::memory_order_release);
+}
+
+size_t PacketQueue::count() const {
+    if (size == 0) return 0;
+    size_t h = head.load(std::memory_order_acquire);
+    size_t t = tail.load(std::memory_order_acquire);
+    return (h >= t) ? (h - t) : (size - t + h);
+}
@@ -0,0 +1,50 @@
+#ifndef PACKETQUEUE_H
+#define PACKETQUEUE_H
+
+#include <Arduino.h>
+#include <atomic>
+
+#define UDP_PACKET_MAX_BYTES    1536    // Longer datagrams are truncated (binary frames are <= 1400)
+
+// One received datagram. 'data' is always NUL-terminated, so JSON text can
+// be parsed in place.
+struct UdpPacket {
+    uint32_t addr;      // Sender IPv4 address (IPAddress converts to and from it)
+    uint16_t port;      // Sender port
+    uint16_t len;
+    uint8_t data[UDP_PACKET_MAX_BYTES + 1];
+};
+
+// --- Received datagram queue (PSRAM backed) ---
+// Fixed slots, single producer / single consumer: the network task that
+// receives the packets only calls push(), loop() only front()/pop(). No
+// locks, and the consumer reads the packet in place.
+class PacketQueue {
+public:
+    ~PacketQueue() { end(); }
+
+    // Allocates 'slots' packets (PSRAM first, internal RAM as fallback).
+    bool begin(size_t slots);
+    void end();
+
+    // Producer side. Copies the datagram; false (and counted as dropped)
+    // when the queue is full.
+    bool push(uint32_t addr, uint16_t port, const uint8_t* data, size_t len);
+
+    // Consumer side. The oldest packet, or nullptr if the queue is empty;
+    // stays valid until pop().
+    const UdpPacket* front() const;
+    void pop();
+
+    size_t count() const;
+    uint32_t dropped() const { return drops.load(std::memory_order_relaxed); }
+
+private:
+    UdpPacket* slots = nullptr;
+    size_t size = 0;                 // One slot stays empty to tell full from empty
+    std::atomic<size_t> head{0};     // Next slot to fill (producer)
+    std::atomic<size_t> tail{0};     // Next slot to read (consumer)
+    std::atomic<uint32_t> drops{0};
+};
+
+#endif // PACKETQUEUE_H
@@ -0,0 +1,38 @@
+#include "Resampler.h"
+
+void Resampler::begin(uint32_t in_rate, uint32_t out_rate) {
+    step = (in_rate == out_rate || out_rate == 0) ? ONE : (uint32_t)(((uint64_t)in_rate << 16) / out_rate);
+    lowpass = out_rate < in_rate;
+    phase = 0;
+    prev = 0;
+    lp_x1 = 0;
+    lp_x2 = 0;
+}
+
+size_t Resampler::process(const int16_t* in, size_t in_count, int16_t* out) {
+    if (isPassthrough()) {
+        memmove(out, in, in_count * sizeof(int16_t));
+        return in_count;
+    }
+
+    size_t produced = 0;
+    int16_t a = prev;
+    for (size_t i = 0; i < in_count; i++) {
+        int16_t b = in[i];
+        if (lowpass) {
+            int16_t x = b;
+            b = (int16_t)(((int32_t)x + 2 * lp_x1 + lp_x2) >> 2);
+            lp_x2 = lp_x1;
+            lp_x1 = x;
+        }
+        // Emit every output sample that falls between a (index 0) and b (index 1)
+        while (phase < ONE) {
+            out[produced++] = (int16_t)(a + (((int32_t)(b - a) * (int32_t)(phase >> 1)) >> 15));
+            phase += step;
+        }
+        phase -= ONE;
+        a = b;
+    }
+    prev = a;
+    return produced;
+}
@@ -0,0 +1,34 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <Arduino.h>
+
+// --- Streaming sample-rate converter (mono, int16) ---
+// Linear interpolation with a Q16 phase accumulator; state carries over
+// between blocks so a stream can be converted buffer by buffer. When
+// downsampling, a [1 2 1]/4 smoothing filter runs first to keep the worst
+// of the aliasing out of the voice band.
+class Resampler {
+public:
+    void begin(uint32_t in_rate, uint32_t out_rate);
+    bool isPassthrough() const { return step == ONE; }
+
+    // Upper bound of output samples produced for 'in_count' input samples.
+    size_t maxOutput(size_t in_count) const { return ((uint64_t)in_count * ONE) / step + 2; }
+
+    // Converts all 'in_count' samples; 'out' must hold maxOutput(in_count).
+    // Returns the number of output samples written.
+    size_t process(const int16_t* in, size_t in_count, int16_t* out);
+
+private:
+    static const uint32_t ONE = 1UL << 16;
+
+    uint32_t step = ONE;   // Input samples advanced per output sample (Q16)
+    uint32_t phase = 0;    // Position relative to 'prev' (Q16)
+    int16_t prev = 0;      // Last (filtered) input sample of the previous block
+    bool lowpass = false;
+    int16_t lp_x1 = 0;     // Smoothing filter history
+    int16_t lp_x2 = 0;
+};
+
+#endif // RESAMPLER_H
@@ -0,0 +1,105 @@
+#include "RingBuffer.h"
+#include "esp_heap_caps.h"
+
+bool RingBuffer::begin(size_t capacity) {
+    if (storage != nullptr && size == capacity + 1) {
+        clear();
+        return true;
+    }
+    end();
+    storage = (uint8_t*)heap_caps_malloc(capacity + 1, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (storage == nullptr) {
+        storage = (uint8_t*)malloc(capacity + 1);
+    }
+    if (storage == nullptr) {
+        Serial.printf("RingBuffer ERROR: Could not allocate %u bytes.\n", capacity);
+        return false;
+    }
+    size = capacity + 1;
+    clear();
+    return true;
+}
+
+void RingBuffer::end() {
+    if (storage != nullptr) {
+        heap_caps_free(storage);
+        storage = nullptr;
+    }
+    size = 0;
+    clear();
+}
+
+size_t RingBuffer::available() const {
+    if (size == 0) return 0;
+    size_t h = head.load(std::memory_order_acquire);
+    size_t t = tail.load(std::memory_order_acquire);
+    return (h >= t) ? (h - t) : (size - t + h);
+}
+
+size_t RingBuffer::space() const {
+    if (size == 0) return 0;
+    return size - 1 - available();
+}
+
+size_t RingBuffer::writeSpan(uint8_t** data) {
+    if (size == 0) return 0;
+    size_t h = head.load(std::memory_order_relaxed);
+    size_t t = tail.load(std::memory_order_acquire);
+    size_t span;
+    if (h >= t) {
+        span = size - h;
+        if (t == 0) span--; // Don't fill the last slot when the reader sits at 0
+    } else {
+        span = t - h - 1;
+    }
+    *data = storage + h;
+    return span;
+}
+
+void RingBuffer::commit(size_t len) {
+    size_t h = head.load(std::memory_order_relaxed) + len;
+    if (h >= size) h -= size;
+    head.store(h, std::memory_order_release);
+}
+
+size_t RingBuffer::readSpan(const uint8_t** data) {
+    if (size == 0) return 0;
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t h = head.load(std::memory_order_acquire);
+    *data = storage + t;
+    return (h >= t) ? (h - t) : (size - t);
+}
+
+void RingBuffer::consume(size_t len) {
+    size_t t = tail.load(std::memory_order_relaxed) + len;
+    if (t >= size) t -= size;
+    tail.store(t, std::memory_order_release);
+}
+
+size_t RingBuffer::write(const uint8_t* data, size_t len) {
+    size_t written = 0;
+    while (written < len) {
+        uint8_t* span_ptr;
+        size_t span = writeSpan(&span_ptr);
+        if (span == 0) break;
+        size_t n = (len - written < span) ? (len - written) : span;
+        memcpy(span_ptr, data + written, n);
+        commit(n);
+        written += n;
+    }
+    return written;
+}
+
+size_t RingBuffer::read(uint8_t* data, size_t len) {
+    size_t got = 0;
+    while (got < len) {
+        const uint8_t* span_ptr;
+        size_t span = readSpan(&span_ptr);
+        if (span == 0) break;
+        size_t n = (len - got < span) ? (len - got) : span;
+        memcpy(data + got, span_ptr, n);
+        consume(n);
+        got += n;
+    }
+    return got;
+}
@@ -0,0 +1,43 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// --- Byte ring buffer (PSRAM backed) ---
+// Single producer / single consumer: one side only calls the write/commit
+// functions, the other only read/consume. That keeps it safe to share
+// between two FreeRTOS tasks without a lock.
+class RingBuffer {
+public:
+    ~RingBuffer() { end(); }
+
+    // Allocates the storage (PSRAM first, internal RAM as fallback).
+    // Calling it again with the same capacity just clears the buffer.
+    bool begin(size_t capacity);
+    void end();
+    void clear() { head = 0; tail = 0; }
+
+    bool isAllocated() const { return storage != nullptr; }
+    size_t capacity() const { return size > 0 ? size - 1 : 0; }
+    size_t available() const;   // Bytes ready to read
+    size_t space() const;       // Bytes that can still be written
+
+    size_t write(const uint8_t* data, size_t len);
+    size_t read(uint8_t* data, size_t len);
+
+    // Zero-copy access: the largest contiguous span that can be written to
+    // (then commit()) or read from (then consume()) right now.
+    size_t writeSpan(uint8_t** data);
+    void commit(size_t len);
+    size_t readSpan(const uint8_t** data);
+    void consume(size_t len);
+
+private:
+    uint8_t* storage = nullptr;
+    size_t size = 0;                 // One slot stays empty to tell full from empty
+    std::atomic<size_t> head{0};     // Next write position (producer)
+    std::atomic<size_t> tail{0};     // Next read position (consumer)
+};
+
+#endif // RINGBUFFER_H
@@ -0,0 +1,80 @@
+#include "SoundCache.h"
+#include "esp_heap_caps.h"
+
+void SoundCache::begin(size_t budget_bytes, size_t max_entry_bytes) {
+    clear();
+    budget = budget_bytes;
+    max_entry = max_entry_bytes;
+}
+
+void SoundCache::clear() {
+    for (CachedSound* entry : entries) {
+        heap_caps_free(entry->samples);
+        delete entry;
+    }
+    entries.clear();
+    used_bytes = 0;
+}
+
+CachedSound* SoundCache::find(const char* path) {
+    for (CachedSound* entry : entries) {
+        if (entry->ready && entry->path == path) {
+            entry->last_used = ++tick;
+            return entry;
+        }
+    }
+    return nullptr;
+}
+
+CachedSound* SoundCache::insert(const char* path, size_t sample_count, int sample_rate) {
+    size_t bytes = sample_count * sizeof(int16_t);
+    if (bytes == 0 || bytes > max_entry || bytes > budget) return nullptr;
+
+    for (CachedSound* entry : entries) {
+        if (entry->path == path) return nullptr; // Cached or being filled already
+    }
+
+    while (used_bytes + bytes > budget) {
+        if (!evictOldest()) return nullptr;
+    }
+
+    // PSRAM only: a sound cache must never eat the internal heap
+    int16_t* samples = (int16_t*)heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (samples == nullptr) {
+        Serial.printf("SoundCache: No PSRAM for %s (%u bytes).\n", path, bytes);
+        return nullptr;
+    }
+
+    CachedSound* entry = new CachedSound();
+    entry->path = path;
+    entry->samples = samples;
+    entry->sample_count = sample_count;
+    entry->sample_rate = sample_rate;
+    entry->last_used = ++tick;
+    entries.push_back(entry);
+    used_bytes += bytes;
+    return entry;
+}
+
+void SoundCache::remove(CachedSound* entry) {
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (entries[i] != entry) continue;
+        used_bytes -= entry->sample_count * sizeof(int16_t);
+        heap_caps_free(entry->samples);
+        delete entry;
+        entries.erase(entries.begin() + i);
+        return;
+    }
+}
+
+bool SoundCache::evictOldest() {
+    CachedSound* oldest = nullptr;
+    for (CachedSound* entry : entries) {
+        if (entry->users > 0) continue; // Still playing
+        if (oldest == nullptr || entry->last_used < oldest->last_used) oldest = entry;
+    }
+    if (oldest == nullptr) return false;
+    Serial.printf("SoundCache: Evicting %s.\n", oldest->path.c_str());
+    remove(oldest);
+    return true;
+}
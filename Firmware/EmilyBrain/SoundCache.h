@@ -0,0 +1,56 @@
+#ifndef SOUNDCACHE_H
+#define SOUNDCACHE_H
+
+#include <Arduino.h>
+#include <vector>
+
+// One decoded sound effect held in PSRAM (mono 16-bit PCM).
+struct CachedSound {
+    String path;
+    int16_t* samples = nullptr;
+    size_t sample_count = 0;
+    int sample_rate = 0;
+    uint32_t last_used = 0;   // LRU tick
+    bool ready = false;       // Fully loaded (insert() hands out unfilled entries)
+    int users = 0;            // Voices playing or filling it; never evicted while > 0
+};
+
+// --- PSRAM sound-effect cache ---
+// Keeps frequently played WAVs in memory within a byte budget and evicts
+// the least recently used ones when a new sound doesn't fit. Only the audio
+// engine task touches it, so there is no locking.
+class SoundCache {
+public:
+    ~SoundCache() { clear(); }
+
+    void begin(size_t budget_bytes, size_t max_entry_bytes);
+    void clear();
+
+    // Returns the ready sound and marks it as recently used, or nullptr.
+    CachedSound* find(const char* path);
+
+    // Allocates an (unfilled) entry for 'sample_count' samples, evicting as
+    // needed. Returns nullptr if it can't be cached or the path is already
+    // present. The caller fills 'samples', then sets 'ready' or calls
+    // remove() if that fails.
+    CachedSound* insert(const char* path, size_t sample_count, int sample_rate);
+    void remove(CachedSound* entry);
+
+    // Voices pin the entry they play from so eviction can't free it.
+    void pin(CachedSound* entry) { entry->users++; }
+    void unpin(CachedSound* entry) { entry->users--; }
+
+    size_t usedBytes() const { return used_bytes; }
+    size_t count() const { return entries.size(); }
+
+private:
+    bool evictOldest();
+
+    std::vector<CachedSound*> entries;
+    size_t budget = 0;
+    size_t max_entry = 0;
+    size_t used_bytes = 0;
+    uint32_t tick = 0;
+};
+
+#endif // SOUNDCACHE_H
@@ -0,0 +1,45 @@
+#include "SpeechSegmenter.h"
+
+// Words that are followed by a period without ending the sentence.
+static const char* const ABBREVIATIONS[] = { "mr", "mrs", "ms", "dr", "prof", "st", "jr", "sr", "vs" };
+
+// True if the '.' at text[dot] closes an abbreviation or an initial
+// rather than a sentence. Only letters since 'from' count as the word.
+static bool isAbbreviation(const char* text, size_t from, size_t dot) {
+    size_t start = dot;
+    while (start > from && isalpha((unsigned char)text[start - 1])) start--;
+    size_t word_len = dot - start;
+    if (word_len == 0) return false;
+    if (word_len == 1) return text[start] != 'I'; // "J. Smith", "e.g."; not "so did I."
+
+    for (const char* abbreviation : ABBREVIATIONS) {
+        if (strlen(abbreviation) != word_len) continue;
+        size_t i = 0;
+        while (i < word_len && tolower((unsigned char)text[start + i]) == abbreviation[i]) i++;
+        if (i == word_len) return true;
+    }
+    return false;
+}
+
+size_t speechSegmentEnd(const char* text, size_t from, size_t len) {
+    size_t limit = (len - from > TTS_SEGMENT_MAX_CHARS) ? from + TTS_SEGMENT_MAX_CHARS : len;
+    size_t soft_break = 0;
+    for (size_t i = from; i < limit; i++) {
+        char c = text[i];
+        if (c == '.' || c == '!' || c == '?' || c == '\n') {
+            size_t end = i + 1;
+            while (end < len && strchr(".!?\"')", text[end]) != nullptr) end++; // "?!", "...", closing quotes
+            if (end >= len) return len;
+            bool sentence = c == '\n' || isspace((unsigned char)text[end]);
+            if (c == '.' && end == i + 1 && isAbbreviation(text, from, i)) sentence = false; // "Dr. Smith"
+            if (sentence && end - from >= TTS_SEGMENT_MIN_CHARS) return end;
+            i = end - 1;
+        } else if (c == ',' || c == ';' || c == ' ') {
+            soft_break = i + 1;
+        }
+    }
+    if (limit == len) return len;
+    if (soft_break > from) return soft_break;
+    while (limit > from + 1 && ((uint8_t)text[limit] & 0xC0) == 0x80) limit--; // Don't split a UTF-8 character
+    return limit;
+}
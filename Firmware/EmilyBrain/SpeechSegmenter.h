@@ -0,0 +1,21 @@
+#ifndef SPEECHSEGMENTER_H
+#define SPEECHSEGMENTER_H
+
+#include <Arduino.h>
+
+#define TTS_SEGMENT_MIN_CHARS   40           // Shorter sentences ride along with the next one
+#define TTS_SEGMENT_MAX_CHARS   300          // No sentence end by then: cut at a comma or space
+
+// --- Speech Segments ---
+// Long texts are synthesized sentence by sentence, the next while the
+// current one plays. Returns the end (exclusive) of the segment that
+// starts at 'from' in text[0, len): just after the first sentence end
+// (. ! ? or a line break, with any closing quotes) once the segment has
+// TTS_SEGMENT_MIN_CHARS, else after the last comma or space before
+// TTS_SEGMENT_MAX_CHARS, else at TTS_SEGMENT_MAX_CHARS without splitting
+// a UTF-8 character. The rest of the text is one segment once it fits.
+// Decimals ("3.5"), titles ("Dr.", "Mrs.") and initials ("J. R. R.",
+// "e.g.") don't end a sentence.
+size_t speechSegmentEnd(const char* text, size_t from, size_t len);
+
+#endif // SPEECHSEGMENTER_H
@@ -0,0 +1,116 @@
+#include "TaskQueue.h"
+
+const char* taskTypeName(TaskType type) {
+    static const char* const names[] = {
+        "PB_EMOTION",
+        "CB_SOUND",
+        "CB_SOUND_EMOTION",
+        "CB_SPEAK",
+        "CAMCANVAS_MOVE_HEAD",
+        "CAMCANVAS_SET_LED",
+        "CAM_ANALYZE",
+        "CAM_NOD",
+        "CAM_TAKE_PICTURE",
+        "CANVAS_IMAGE_SYNC",
+        "CANVAS_IMAGE_ASYNC",
+        "INPUTPAD_SET_MODE",
+        "EB_GET_LOCAL_DATA"
+    };
+    static_assert(sizeof(names) / sizeof(names[0]) == (size_t)TaskType::COUNT, "Task name table out of sync");
+    size_t index = (size_t)type;
+    return index < (size_t)TaskType::COUNT ? names[index] : "UNKNOWN";
+}
+
+TaskLane taskLane(TaskType type) {
+    static const TaskLane lanes[] = {
+        TaskLane::LOCAL,        // PB_EMOTION
+        TaskLane::AUDIO,        // CB_SOUND
+        TaskLane::AUDIO,        // CB_SOUND_EMOTION
+        TaskLane::AUDIO,        // CB_SPEAK
+        TaskLane::CAMCANVAS,    // CAMCANVAS_MOVE_HEAD
+        TaskLane::CAMCANVAS,    // CAMCANVAS_SET_LED
+        TaskLane::CAMCANVAS,    // CAM_ANALYZE
+        TaskLane::CAMCANVAS,    // CAM_NOD
+        TaskLane::CAMCANVAS,    // CAM_TAKE_PICTURE
+        TaskLane::CAMCANVAS,    // CANVAS_IMAGE_SYNC
+        TaskLane::CAMCANVAS,    // CANVAS_IMAGE_ASYNC
+        TaskLane::INPUTPAD,     // INPUTPAD_SET_MODE
+        TaskLane::LOCAL         // EB_GET_LOCAL_DATA
+    };
+    static_assert(sizeof(lanes) / sizeof(lanes[0]) == (size_t)TaskType::COUNT, "Task lane table out of sync");
+    size_t index = (size_t)type;
+    return index < (size_t)TaskType::COUNT ? lanes[index] : TaskLane::LOCAL;
+}
+
+const char* taskLaneName(TaskLane lane) {
+    static const char* const names[] = { "audio", "camcanvas", "inputpad", "local" };
+    static_assert(sizeof(names) / sizeof(names[0]) == (size_t)TaskLane::COUNT, "Lane name table out of sync");
+    size_t index = (size_t)lane;
+    return index < (size_t)TaskLane::COUNT ? names[index] : "unknown";
+}
+
+uint8_t TaskQueue::push_back(const Task& task) {
+    if (count == TASK_QUEUE_SLOTS) {
+        Serial.printf("TaskQueue ERROR: Full, dropping task %s.\n", taskTypeName(task.type));
+        return 0;
+    }
+    slots[count] = task;
+    count++;
+    return (uint8_t)count;
+}
+
+void TaskQueue::clear() {
+    count = 0;
+    text_used = 0;
+}
+
+int TaskQueue::nextStartable() const {
+    bool lane_busy[(size_t)TaskLane::COUNT] = {};
+    for (size_t i = 0; i < count; i++) {
+        if (slots[i].status == TaskStatus::RUNNING) lane_busy[(size_t)taskLane(slots[i].type)] = true;
+    }
+    for (size_t i = 0; i < count; i++) {
+        const Task& task = slots[i];
+        if (task.status != TaskStatus::PENDING || lane_busy[(size_t)taskLane(task.type)]) continue;
+        if (task.after != 0 && (task.after > count || slots[task.after - 1].status != TaskStatus::DONE)) {
+            continue; // Waits for its dependency without holding up its lane
+        }
+        return (int)i;
+    }
+    return -1;
+}
+
+int TaskQueue::running(TaskLane lane) const {
+    for (size_t i = 0; i < count; i++) {
+        if (slots[i].status == TaskStatus::RUNNING && taskLane(slots[i].type) == lane) return (int)i;
+    }
+    return -1;
+}
+
+bool TaskQueue::anyRunning() const {
+    for (size_t i = 0; i < count; i++) {
+        if (slots[i].status == TaskStatus::RUNNING) return true;
+    }
+    return false;
+}
+
+bool TaskQueue::allDone() const {
+    for (size_t i = 0; i < count; i++) {
+        if (slots[i].status != TaskStatus::DONE) return false;
+    }
+    return true;
+}
+
+const char* TaskQueue::storeText(JsonVariantConst value) {
+    if (!value.is<const char*>()) return nullptr;
+    const char* str = value.as<const char*>();
+    size_t len = strlen(str);
+    if (text_used + len + 1 > sizeof(text)) {
+        Serial.printf("TaskQueue ERROR: Text storage full, dropping %u bytes.\n", (unsigned)len);
+        return nullptr;
+    }
+    char* copy = text + text_used;
+    memcpy(copy, str, len + 1);
+    text_used += len + 1;
+    return copy;
+}
@@ -0,0 +1,167 @@
+#ifndef TASKQUEUE_H
+#define TASKQUEUE_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#define TASK_QUEUE_SLOTS        16      // Tasks one plan can hold (handles fit a uint8_t)
+#define TASK_TEXT_BYTES         4096    // Shared storage for the tasks' strings (prompts, speech)
+
+// --- Task Types ---
+// Also the index into EmilyBrain's dispatch table: keep the order in sync.
+enum class TaskType : uint8_t {
+    PB_EMOTION,
+    CB_SOUND,
+    CB_SOUND_EMOTION,
+    CB_SPEAK,
+    CAMCANVAS_MOVE_HEAD,
+    CAMCANVAS_SET_LED,
+    CAM_ANALYZE,
+    CAM_NOD,
+    CAM_TAKE_PICTURE,
+    CANVAS_IMAGE_SYNC,
+    CANVAS_IMAGE_ASYNC,
+    INPUTPAD_SET_MODE,
+    EB_GET_LOCAL_DATA,
+    COUNT
+};
+
+const char* taskTypeName(TaskType type);
+
+// --- Lanes ---
+// Each device works through its own tasks in plan order, one at a time,
+// while the lanes run in parallel: Emily can speak while CamCanvas moves
+// the head or paints an image.
+enum class TaskLane : uint8_t {
+    AUDIO,          // Speech and sound effects (I2S)
+    CAMCANVAS,      // Head, LEDs, camera and canvas
+    INPUTPAD,
+    LOCAL,          // Emotion and SD lookups on the Brain itself
+    COUNT
+};
+
+TaskLane taskLane(TaskType type);
+const char* taskLaneName(TaskLane lane);
+
+enum class TaskStatus : uint8_t {
+    PENDING,
+    RUNNING,        // Started, waiting for its device
+    DONE
+};
+
+// --- Per-type arguments ---
+// Strings point into the TaskQueue's text storage (see storeText()) and
+// may be nullptr when the planner didn't get them; the executor falls
+// back to its defaults then.
+struct EmotionArgs {
+    float arousal;          // NAN = keep the current value
+    float valence;
+};
+
+struct SoundArgs {
+    const char* path;
+};
+
+struct SpeakArgs {
+    const char* text;       // 'announcement' or 'question'
+};
+
+struct HeadArgs {
+    int16_t pan;
+    int16_t tilt;
+};
+
+struct LedArgs {
+    uint8_t r, g, b;
+    uint8_t effect;         // emily_proto::LedEffect
+    uint16_t speed_ms;
+};
+
+struct AnalyzeArgs {
+    const char* question;
+    bool use_flash;
+};
+
+struct NodArgs {
+    int16_t angle;
+};
+
+struct ImageArgs {
+    const char* prompt;
+    const char* model;
+};
+
+struct InputArgs {
+    uint8_t mode;           // emily_proto::PadMode
+    uint16_t max_value;
+};
+
+struct LocalDataArgs {
+    const char* key;
+};
+
+struct Task {
+    TaskType type;
+    uint8_t tool;           // Index of the tool call (of this turn) that planned it
+    TaskStatus status;      // Maintained by the executor
+    uint8_t after;          // Handle of a task (any lane) that must be DONE first, 0 = none;
+                            // later tasks of the same lane don't wait for it meanwhile
+    union {
+        EmotionArgs emotion;
+        SoundArgs sound;
+        SpeakArgs speak;
+        HeadArgs head;
+        LedArgs led;
+        AnalyzeArgs analyze;
+        NodArgs nod;
+        ImageArgs image;
+        InputArgs input;
+        LocalDataArgs local_data;
+    };
+
+    explicit Task(TaskType t = TaskType::PB_EMOTION) {
+        memset((void*)this, 0, sizeof(*this)); // Whichever args are used start zeroed
+        type = t;
+    }
+};
+
+// --- Task Queue ---
+// The tasks of one turn in plan order, plus a bump allocator for their
+// strings, so planning a turn never touches the heap. Lanes finish tasks
+// out of order, so they stay in place (see Task::status) until the turn
+// is over and clear() rewinds everything. Only used from loop(), no
+// locking.
+class TaskQueue {
+public:
+    // Returns the task's handle (index + 1) for Task::after; 0 (and
+    // logged) when full.
+    uint8_t push_back(const Task& task);
+    Task& operator[](size_t index) { return slots[index]; }
+    const Task& operator[](size_t index) const { return slots[index]; }
+    void clear();
+
+    bool empty() const { return count == 0; }
+    size_t size() const { return count; }
+
+    // --- Lane scheduling ---
+    // Index of the task to start next, -1 if none can start now: the first
+    // PENDING task whose lane has nothing RUNNING and whose 'after' is DONE.
+    // So a lane runs its tasks in plan order, one at a time, and a task
+    // waiting for its 'after' doesn't hold up the rest of its lane.
+    int nextStartable() const;
+    int running(TaskLane lane) const;   // Index of the lane's RUNNING task, -1 if idle
+    bool anyRunning() const;
+    bool allDone() const;
+
+    // Copies a JSON string into the text storage. nullptr if 'value'
+    // isn't a string or the storage is full.
+    const char* storeText(JsonVariantConst value);
+
+private:
+    Task slots[TASK_QUEUE_SLOTS];
+    size_t count = 0;
+    char text[TASK_TEXT_BYTES];
+    size_t text_used = 0;
+};
+
+#endif // TASKQUEUE_H
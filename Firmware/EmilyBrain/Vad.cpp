@@ -0,0 +1,60 @@
+#include "Vad.h"
+#include "EmilyBrain.h" // VAD parameters
+
+void Vad::begin(int frame_ms_) {
+    frame_ms = frame_ms_ > 0 ? frame_ms_ : 20;
+    noise_floor = 0;
+    frames_seen = 0;
+    loud_frames = 0;
+    quiet_ms = 0;
+    in_speech = false;
+}
+
+uint32_t Vad::startThreshold() const {
+    uint32_t t = noise_floor * VAD_START_RATIO;
+    return t > VAD_START_MIN ? t : VAD_START_MIN;
+}
+
+uint32_t Vad::stopThreshold() const {
+    uint32_t t = noise_floor * VAD_STOP_RATIO;
+    return t > VAD_STOP_MIN ? t : VAD_STOP_MIN;
+}
+
+// Follows drops quickly and rises slowly, so a burst of speech does not
+// drag the floor up but a fan that switches on is learned within seconds.
+void Vad::trackNoise(uint32_t energy) {
+    if (frames_seen == 0) {
+        noise_floor = energy;
+    } else if (energy < noise_floor) {
+        noise_floor -= (noise_floor - energy + 3) / 4;
+    } else {
+        noise_floor += (energy - noise_floor + 127) / 128;
+    }
+    frames_seen++;
+}
+
+Vad::Result Vad::process(uint32_t energy) {
+    if (!in_speech) {
+        // Warm-up: learn the floor before anything can count as speech
+        if (frames_seen < (uint32_t)(VAD_WARMUP_MS / frame_ms) || energy <= startThreshold()) {
+            loud_frames = 0;
+            trackNoise(energy);
+            return Result::SILENCE;
+        }
+        if (++loud_frames < VAD_ONSET_FRAMES) return Result::SILENCE;
+        in_speech = true;
+        quiet_ms = 0;
+        return Result::SPEECH_START;
+    }
+
+    // --- Hangover ---
+    if (energy >= stopThreshold()) {
+        quiet_ms = 0;
+        return Result::SPEECH;
+    }
+    quiet_ms += frame_ms;
+    if (quiet_ms < VAD_HANGOVER_MS) return Result::SPEECH;
+    in_speech = false;
+    loud_frames = 0;
+    return Result::SPEECH_END;
+}
@@ -0,0 +1,34 @@
+#ifndef VAD_H
+#define VAD_H
+
+#include <Arduino.h>
+
+// --- Voice Activity Detector ---
+// Works on per-frame energy (see frameEnergy()). The noise floor is tracked
+// continuously, so there is no calibration wait and a noisy room just raises
+// the thresholds. Speech starts after VAD_ONSET_FRAMES loud frames in a row
+// and ends after VAD_HANGOVER_MS without any frame above the stop threshold.
+class Vad {
+public:
+    enum class Result { SILENCE, SPEECH_START, SPEECH, SPEECH_END };
+
+    void begin(int frame_ms);
+    Result process(uint32_t energy);
+
+    bool inSpeech() const { return in_speech; }
+    uint32_t noiseFloor() const { return noise_floor; }
+    uint32_t startThreshold() const;
+    uint32_t stopThreshold() const;
+
+private:
+    int frame_ms = 20;
+    uint32_t noise_floor = 0;       // Q0 energy, updated outside speech
+    uint32_t frames_seen = 0;
+    int loud_frames = 0;            // Consecutive frames above the start threshold
+    int quiet_ms = 0;               // Time since the last frame above the stop threshold
+    bool in_speech = false;
+
+    void trackNoise(uint32_t energy);
+};
+
+#endif // VAD_H
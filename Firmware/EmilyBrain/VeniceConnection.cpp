@@ -0,0 +1,197 @@
+#include "VeniceConnection.h"
+
+VeniceConnection::VeniceConnection(const char* host, const char* api_key, uint16_t port)
+    : host(host), api_key(api_key), port(port) {
+    tls.setInsecure(); // Allow connection without checking certificate (easier for ESP32)
+}
+
+// --- DNS cache ---
+// Re-resolves only when the cached address is older than DNS_CACHE_MS or a
+// connect to it failed.
+bool VeniceConnection::resolveHost() {
+    if (ip_valid && millis() - dns_resolved_at < DNS_CACHE_MS) return true;
+
+    IPAddress ip;
+    if (WiFi.hostByName(host, ip) != 1) {
+        Serial.printf("Venice ERROR: DNS lookup for %s failed.\n", host);
+        ip_valid = false;
+        return false;
+    }
+    cached_ip = ip;
+    ip_valid = true;
+    dns_resolved_at = millis();
+    Serial.printf("Venice: %s resolved to %s\n", host, cached_ip.toString().c_str());
+    return true;
+}
+
+bool VeniceConnection::ensureConnected(bool& reused) {
+    reused = false;
+    if (tls.connected()) {
+        if (millis() - last_used > IDLE_TIMEOUT_MS) {
+            Serial.println("Venice: Idle session expired, reconnecting.");
+            tls.stop();
+        } else if (tls.available()) {
+            // Unread bytes on an idle session (leftover body or close_notify)
+            Serial.println("Venice: Idle session not clean, reconnecting.");
+            tls.stop();
+        } else {
+            reused = true;
+            return true;
+        }
+    }
+
+    if (!resolveHost()) return false;
+
+    unsigned long start = millis();
+    // Connect by IP but pass the host name for SNI
+    if (!tls.connect(cached_ip, port, host, nullptr, nullptr, nullptr)) {
+        Serial.printf("Venice ERROR: Could not connect to %s.\n", host);
+        ip_valid = false; // Maybe the address changed; look it up again next time
+        return false;
+    }
+    requests_on_session = 0;
+    Serial.printf("Venice: TLS session opened in %lu ms.\n", millis() - start);
+    return true;
+}
+
+// Request line plus the headers every request shares. The caller adds the
+// body framing header and the blank line.
+String VeniceConnection::buildHead(const char* method, const char* path, const char* content_type) {
+    String head = String(method) + " " + path + " HTTP/1.1\r\n";
+    head += "Host: " + String(host) + "\r\n";
+    head += "Authorization: Bearer " + String(api_key) + "\r\n";
+    head += "Content-Type: " + String(content_type) + "\r\n";
+    head += "Connection: keep-alive\r\n";
+    return head;
+}
+
+bool VeniceConnection::sendRequest(const char* method, const char* path, const char* content_type,
+                                   size_t content_length, BodyWriter& write_body) {
+    String head = buildHead(method, path, content_type);
+    head += "Content-Length: " + String(content_length) + "\r\n\r\n";
+    if (tls.print(head) != head.length()) return false;
+
+    BufferedPrint body_out(tls);
+    write_body(body_out);
+    body_out.flush();
+    if (body_out.failed() || body_out.bytesWritten() != content_length) {
+        Serial.printf("Venice ERROR: Body upload failed (%u of %u bytes sent).\n",
+                      body_out.bytesWritten(), content_length);
+        return false;
+    }
+    return true;
+}
+
+bool VeniceConnection::request(const char* method, const char* path, const char* content_type,
+                               size_t content_length, BodyWriter write_body,
+                               HttpResponse& response, unsigned long timeout_ms) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+        bool reused = false;
+        if (!ensureConnected(reused)) return false;
+
+        bool sent = sendRequest(method, path, content_type, content_length, write_body);
+        if (sent && response.begin(tls, timeout_ms)) {
+            requests_on_session++;
+            last_used = millis();
+            Serial.printf("Venice: %s %s -> %d (%s session, request #%u)\n", method, path,
+                          response.status(), reused ? "reused" : "new", requests_on_session);
+            return true;
+        }
+
+        // A reused session may have been closed by the server while idle.
+        // That's only detectable when using it, so retry once on a fresh one.
+        bool stale = reused && (!sent || !tls.connected());
+        tls.stop();
+        if (!stale) break;
+        Serial.println("Venice: Reused session was stale, retrying on a new one...");
+    }
+    return false;
+}
+
+bool VeniceConnection::send(const char* method, const char* path, const char* content_type,
+                            size_t content_length, BodyWriter write_body, bool warm_only) {
+    if (warm_only && !hasWarmSession()) return false;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        bool reused = false;
+        if (!ensureConnected(reused)) return false;
+        if (sendRequest(method, path, content_type, content_length, write_body)) {
+            last_used = millis();
+            return true;
+        }
+        tls.stop();
+        if (!reused || warm_only) break;
+        Serial.println("Venice: Reused session was stale, retrying on a new one...");
+    }
+    return false;
+}
+
+// Same checks as ensureConnected() makes before reusing the session.
+bool VeniceConnection::hasWarmSession() {
+    return tls.connected() && millis() - last_used <= IDLE_TIMEOUT_MS && tls.available() == 0;
+}
+
+bool VeniceConnection::receive(HttpResponse& response, unsigned long timeout_ms) {
+    if (!response.begin(tls, timeout_ms)) {
+        tls.stop();
+        return false;
+    }
+    requests_on_session++;
+    last_used = millis();
+    Serial.printf("Venice: Response -> %d (request #%u)\n", response.status(), requests_on_session);
+    return true;
+}
+
+bool VeniceConnection::beginChunked(const char* method, const char* path, const char* content_type) {
+    String head = buildHead(method, path, content_type);
+    head += "Transfer-Encoding: chunked\r\n\r\n";
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        bool reused = false;
+        if (!ensureConnected(reused)) return false;
+        if (tls.print(head) == head.length()) return true;
+        tls.stop();
+        if (!reused) break;
+        Serial.println("Venice: Reused session was stale, retrying on a new one...");
+    }
+    return false;
+}
+
+bool VeniceConnection::writeChunk(const uint8_t* data, size_t len) {
+    if (len == 0) return true; // A zero-length chunk would end the body
+    char size_line[12];
+    snprintf(size_line, sizeof(size_line), "%X\r\n", (unsigned int)len);
+
+    BufferedPrint out(tls); // Size line, data and CRLF in as few TLS records as possible
+    out.print(size_line);
+    out.write(data, len);
+    out.print("\r\n");
+    out.flush();
+    if (out.failed()) {
+        tls.stop();
+        return false;
+    }
+    return true;
+}
+
+bool VeniceConnection::finishChunked(HttpResponse& response, unsigned long timeout_ms) {
+    if (tls.print("0\r\n\r\n") != 5 || !response.begin(tls, timeout_ms)) {
+        tls.stop();
+        return false;
+    }
+    requests_on_session++;
+    last_used = millis();
+    Serial.printf("Venice: Chunked upload -> %d (request #%u)\n", response.status(), requests_on_session);
+    return true;
+}
+
+void VeniceConnection::release(HttpResponse& response) {
+    if (response.keepAlive() && response.finished() && tls.connected()) {
+        last_used = millis(); // Keep the session warm for the next request
+    } else {
+        tls.stop();
+    }
+}
+
+void VeniceConnection::close() {
+    tls.stop();
+}
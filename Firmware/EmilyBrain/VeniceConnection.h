@@ -0,0 +1,92 @@
+#ifndef VENICECONNECTION_H
+#define VENICECONNECTION_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiClientSecure.h>
+#include <functional>
+#include "HttpStream.h"
+
+// --- Persistent HTTPS connection to one API host ---
+// Keeps a single TLS session open between requests (HTTP/1.1 keep-alive) so
+// the chat, TTS and STT round trips of a conversation turn don't each pay for
+// a fresh DNS lookup and TLS handshake.
+//
+// Usage:
+//   HttpResponse response;
+//   if (conn.request("POST", path, "application/json", len, writer, response, 30000)) {
+//       ... read the body via response.read()/readString() ...
+//   }
+//   conn.release(response); // ALWAYS, also after errors
+class VeniceConnection {
+public:
+    // Writes exactly 'content_length' body bytes. May be called a second time
+    // if a reused connection turns out to be stale, so it must be repeatable.
+    typedef std::function<void(Print&)> BodyWriter;
+
+    VeniceConnection(const char* host, const char* api_key, uint16_t port = 443);
+
+    // Sends the request and parses the response status line and headers.
+    // Returns false if no response could be obtained (even after one retry on
+    // a fresh connection).
+    bool request(const char* method, const char* path, const char* content_type,
+                 size_t content_length, BodyWriter write_body,
+                 HttpResponse& response, unsigned long timeout_ms);
+
+    // Hands the connection back after a request. Keeps it open only if the
+    // server allows keep-alive and the body was fully consumed.
+    void release(HttpResponse& response);
+
+    // --- Split request ---
+    // For callers on a task that must not wait while the server works (the
+    // early speech request on the main task). send() connects and puts the
+    // request on the wire, responseReady() polls for the first answer byte
+    // and receive() then parses the status line and headers. A session that
+    // goes stale after send() is not retried; receive() just fails.
+    // With 'warm_only', send() only uses a kept-alive session (see
+    // hasWarmSession()) and fails instead of connecting, so the caller
+    // never waits for a DNS lookup or TLS handshake.
+    bool send(const char* method, const char* path, const char* content_type,
+              size_t content_length, BodyWriter write_body, bool warm_only = false);
+    bool responseReady() { return tls.available() > 0 || !tls.connected(); }
+    bool receive(HttpResponse& response, unsigned long timeout_ms);
+
+    // --- Streaming upload (chunked transfer encoding) ---
+    // For bodies whose length isn't known when the request starts, e.g. live
+    // microphone audio. beginChunked() sends the headers, each writeChunk()
+    // puts one chunk on the wire, finishChunked() terminates the body and
+    // parses the response headers. Follow up with release() as usual.
+    bool beginChunked(const char* method, const char* path, const char* content_type);
+    bool writeChunk(const uint8_t* data, size_t len);
+    bool finishChunked(HttpResponse& response, unsigned long timeout_ms);
+
+    // Drops the session (e.g. after WiFi loss).
+    void close();
+
+    bool isConnected() { return tls.connected(); }
+    // True if the next request can go out on the open session right away.
+    bool hasWarmSession();
+
+private:
+    bool ensureConnected(bool& reused);
+    bool resolveHost();
+    String buildHead(const char* method, const char* path, const char* content_type);
+    bool sendRequest(const char* method, const char* path, const char* content_type,
+                     size_t content_length, BodyWriter& write_body);
+
+    static const unsigned long IDLE_TIMEOUT_MS = 45000;      // Close before the server does
+    static const unsigned long DNS_CACHE_MS = 10UL * 60 * 1000;
+
+    const char* host;
+    const char* api_key;
+    uint16_t port;
+
+    WiFiClientSecure tls;
+    IPAddress cached_ip;
+    bool ip_valid = false;
+    unsigned long dns_resolved_at = 0;
+    unsigned long last_used = 0;
+    uint32_t requests_on_session = 0;
+};
+
+#endif // VENICECONNECTION_H
@@ -0,0 +1,155 @@
+#include "WavReader.h"
+
+#define WAVE_FORMAT_PCM         0x0001
+#define WAVE_FORMAT_IEEE_FLOAT  0x0003
+#define WAVE_FORMAT_EXTENSIBLE  0xFFFE
+
+static uint16_t le16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+static uint32_t le32(const uint8_t* p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24); }
+
+bool WavReader::open(const char* path) {
+    File f = SD.open(path, FILE_READ);
+    if (!f) {
+        Serial.printf("WavReader ERROR: Could not open file %s\n", path);
+        return false;
+    }
+    if (!open(f)) {
+        Serial.printf("WavReader ERROR: %s is not a playable WAV file.\n", path);
+        return false;
+    }
+    return true;
+}
+
+bool WavReader::open(File f) {
+    file = f;
+    header = WavHeader();
+    block_align = 0;
+    data_size = 0;
+    data_left = 0;
+    if (!parse()) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void WavReader::close() {
+    if (file) file.close();
+    data_left = 0;
+}
+
+// --- RIFF chunk walk ---
+bool WavReader::parse() {
+    uint8_t buf[40];
+    if (file.read(buf, 12) != 12 || memcmp(buf, "RIFF", 4) != 0 || memcmp(buf + 8, "WAVE", 4) != 0) {
+        return false;
+    }
+
+    uint32_t file_size = file.size();
+    uint32_t pos = 12;
+    bool have_fmt = false;
+    while (pos + 8 <= file_size) {
+        if (!file.seek(pos) || file.read(buf, 8) != 8) return false;
+        uint32_t chunk_size = le32(buf + 4);
+        uint32_t body = pos + 8;
+        bool is_data = memcmp(buf, "data", 4) == 0;
+        // A chunk claiming more than the file holds is corrupt, and skipping
+        // it would wrap 'pos' (possibly back to an earlier chunk)
+        if (!is_data && chunk_size > file_size - body) return false;
+
+        if (memcmp(buf, "fmt ", 4) == 0) {
+            size_t n = chunk_size < sizeof(buf) ? chunk_size : sizeof(buf);
+            if (n < 16 || file.read(buf, n) != n) return false;
+            uint16_t format_tag = le16(buf);
+            if (format_tag == WAVE_FORMAT_EXTENSIBLE && n >= 26) format_tag = le16(buf + 24); // SubFormat GUID
+            header.channels = le16(buf + 2);
+            header.sampleRate = le32(buf + 4);
+            block_align = le16(buf + 12);
+            header.bitsPerSample = le16(buf + 14);
+            is_float = (format_tag == WAVE_FORMAT_IEEE_FLOAT);
+            if (format_tag != WAVE_FORMAT_PCM && !is_float) {
+                Serial.printf("WavReader: Unsupported format tag 0x%04x.\n", format_tag);
+                return false;
+            }
+            have_fmt = true;
+        } else if (is_data) {
+            if (!have_fmt) return false; // 'fmt ' must come first
+            // Streamed/unfinished files carry 0 or 0xFFFFFFFF: play to the end
+            uint32_t available = file_size - body;
+            data_size = (chunk_size == 0 || chunk_size > available) ? available : chunk_size;
+            break;
+        }
+        pos = body + chunk_size + (chunk_size & 1); // Chunks are word aligned
+    }
+    if (!have_fmt || data_size == 0) return false;
+
+    bytes_per_sample = (header.bitsPerSample + 7) / 8;
+    if (header.channels < 1 || header.sampleRate <= 0 || bytes_per_sample < 1 || bytes_per_sample > 4 ||
+        (is_float && bytes_per_sample != 4) || block_align < header.channels * bytes_per_sample) {
+        return false;
+    }
+    data_size -= data_size % block_align;
+    data_left = data_size;
+
+    Serial.println("--- Parsed WAV Header ---");
+    Serial.printf("  Sample Rate: %d Hz\n", header.sampleRate);
+    Serial.printf("  Bits/Sample: %d%s\n", header.bitsPerSample, is_float ? " (float)" : "");
+    Serial.printf("  Channels:    %d\n", header.channels);
+    Serial.printf("  Data:        %u bytes\n", data_size);
+    Serial.println("-------------------------");
+    return true;
+}
+
+// --- Sample conversion ---
+int16_t WavReader::sampleAt(const uint8_t* p) const {
+    switch (bytes_per_sample) {
+        case 1: return (int16_t)(((int)p[0] - 128) << 8);   // 8-bit WAV is unsigned
+        case 2: return (int16_t)le16(p);
+        case 3: return (int16_t)le16(p + 1);                 // Keep the top 16 bits
+        default:
+            if (is_float) {
+                float f;
+                memcpy(&f, p, 4);
+                if (f > 1.0f) f = 1.0f;
+                if (f < -1.0f) f = -1.0f;
+                return (int16_t)(f * 32767.0f);
+            }
+            return (int16_t)le16(p + 2);
+    }
+}
+
+size_t WavReader::read(int16_t* out, size_t max_frames) {
+    uint8_t raw[768];
+    size_t frames_per_read = sizeof(raw) / block_align;
+    size_t produced = 0;
+
+    while (produced < max_frames && data_left > 0) {
+        size_t frames = max_frames - produced;
+        if (frames > frames_per_read) frames = frames_per_read;
+        if (frames > data_left / block_align) frames = data_left / block_align;
+
+        // Plain mono 16-bit: straight into the output buffer
+        if (header.channels == 1 && bytes_per_sample == 2 && block_align == 2 && !is_float) {
+            int got = file.read((uint8_t*)(out + produced), frames * 2);
+            if (got <= 0) { data_left = 0; break; }
+            produced += got / 2;
+            data_left -= got - (got & 1);
+            continue;
+        }
+
+        int got = file.read(raw, frames * block_align);
+        if (got <= 0) { data_left = 0; break; }
+        size_t whole = got / block_align;
+        for (size_t f = 0; f < whole; f++) {
+            const uint8_t* frame = raw + f * block_align;
+            int32_t sum = 0;
+            for (int c = 0; c < header.channels; c++) {
+                sum += sampleAt(frame + c * bytes_per_sample);
+            }
+            out[produced++] = (int16_t)(sum / header.channels);
+        }
+        data_left -= whole * block_align;
+        if (whole < frames) { data_left = 0; break; } // Truncated file
+    }
+    return produced;
+}
@@ -0,0 +1,49 @@
+#ifndef WAVREADER_H
+#define WAVREADER_H
+
+#include <Arduino.h>
+#include "SD.h"
+#include "FS.h"
+
+struct WavHeader {
+    int sampleRate = 0;
+    int bitsPerSample = 0;
+    int channels = 0;
+};
+
+// --- WAV file reader ---
+// Walks the RIFF chunks to find 'fmt ' and 'data' wherever they are (LIST,
+// fact, id3 and other chunks are skipped, also when they trail the audio),
+// then streams the samples as mono 16-bit: stereo/multichannel is
+// averaged, 8/24/32-bit integer and 32-bit float PCM are converted. Rate
+// conversion is left to the caller's Resampler.
+class WavReader {
+public:
+    // Parses the header from an open file and leaves it at the first sample.
+    // The reader keeps the handle; close() closes it.
+    bool open(File file);
+    bool open(const char* path);
+    void close();
+
+    const WavHeader& format() const { return header; }
+    size_t frameCount() const { return block_align ? data_size / block_align : 0; }
+    size_t framesLeft() const { return block_align ? data_left / block_align : 0; }
+
+    // Reads up to 'max_frames' frames as mono int16. Returns frames written;
+    // 0 at the end of the 'data' chunk.
+    size_t read(int16_t* out, size_t max_frames);
+
+private:
+    bool parse();
+    int16_t sampleAt(const uint8_t* p) const;
+
+    File file;
+    WavHeader header;
+    bool is_float = false;
+    uint16_t block_align = 0;
+    uint16_t bytes_per_sample = 0;
+    uint32_t data_size = 0;
+    uint32_t data_left = 0;
+};
+
+#endif // WAVREADER_H
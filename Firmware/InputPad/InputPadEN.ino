@@ -12,6 +12,8 @@
 #include <ArduinoJson.h>
 #include <TFT_eSPI.h> // Ensure User_Setup.h matches your hardware!
 #include <SPI.h>
+#include <EmilyProtocol.h>  // Firmware/libraries/EmilyProtocol
+#include <EmilyReliable.h>
 
 // --- WIFI MANAGER INCLUDES ---
 #include <WebServer.h>
@@ -52,6 +54,12 @@ unsigned long last_press_time = 0;
 const int DEBOUNCE_DELAY = 250;
 unsigned long lastHeartbeatTime = 0;
 
+// --- BINARY PROTOCOL ---
+uint8_t tx_frame[EMILY_PROTO_MAX_FRAME];
+uint16_t tx_seq = 0;
+emily_proto::Outbox<2, 64> outbox;        // Input results awaiting the brain's ACK
+emily_proto::DuplicateFilter seen_frames; // Commands already applied
+
 // --- PROTOTYPES ---
 void setupWiFi();
 bool connectToWiFi(String ssid, String pass);
@@ -63,7 +71,9 @@ void checkForButtonPress();
 void sendHeartbeat();
 void updateDisplay();
 void sendInputResult(String value);
-void sendUdpResponse(const JsonDocument& doc);
+void applyMode(const char* mode, int max_value);
+bool acceptFrame(const emily_proto::Frame& frame);
+void serviceOutbox();
 
 // ========================
 // ===      SETUP       ===
@@ -89,6 +99,7 @@ void setup() {
   // Only proceed if connected
   if (WiFi.status() == WL_CONNECTED) {
     udp.begin(INPUTPAD_LISTEN_PORT);
+    tx_seq = (uint16_t)esp_random(); // The brain still remembers sequence numbers from before a reboot
     Serial.printf("UDP Listening on port %d\n", INPUTPAD_LISTEN_PORT);
     current_mode = "IDLE";
     updateDisplay();
@@ -111,6 +122,7 @@ void loop() {
   checkForCommands();
   checkForButtonPress();
   sendHeartbeat();
+  serviceOutbox();
   delay(20);
 }
 
@@ -217,11 +229,15 @@ void handleSave() {
 
 void sendHeartbeat() {
   if (millis() - lastHeartbeatTime > 1500) { 
-    StaticJsonDocument<128> doc;
-    doc["id"] = "inputpad_v1"; 
-    doc["state"] = current_mode; 
-    doc["result_type"] = "heartbeat";
-    sendUdpResponse(doc); 
+    emily_proto::Heartbeat heartbeat = {};
+    heartbeat.node = emily_proto::NODE_INPUTPAD;
+    heartbeat.state = (current_mode == "DICE") ? emily_proto::PAD_DICE :
+                      (current_mode == "YES_NO") ? emily_proto::PAD_YES_NO :
+                      (current_mode == "A_B_C") ? emily_proto::PAD_A_B_C : emily_proto::PAD_IDLE;
+    size_t len = emily_proto::encode(tx_frame, sizeof(tx_frame), ++tx_seq, heartbeat);
+    udp.beginPacket(EMILYBRAIN_IP, EMILYBRAIN_PORT);
+    udp.write(tx_frame, len);
+    udp.endPacket();
     lastHeartbeatTime = millis();
   }
 }
@@ -255,43 +271,97 @@ void updateDisplay() {
   }
 }
 
+// Handles every datagram that is waiting, not just the first one.
 void checkForCommands() {
-  int packetSize = udp.parsePacket();
-  if (packetSize) {
+  int packetSize;
+  while ((packetSize = udp.parsePacket()) > 0) {
     char packetBuffer[packetSize + 1];
     udp.read(packetBuffer, packetSize);
     packetBuffer[packetSize] = '\0';
-    
+
+    // Binary frame from the brain
+    emily_proto::Frame frame;
+    emily_proto::SetMode set_mode;
+    if (emily_proto::decode((const uint8_t*)packetBuffer, packetSize, frame)) {
+        if (!acceptFrame(frame)) continue; // ACK or repeated command
+        if (emily_proto::read(frame, set_mode)) {
+          const char* mode = (set_mode.mode == emily_proto::PAD_DICE) ? "DICE" :
+                             (set_mode.mode == emily_proto::PAD_YES_NO) ? "YES_NO" :
+                             (set_mode.mode == emily_proto::PAD_A_B_C) ? "A_B_C" : "IDLE";
+          applyMode(mode, set_mode.dice_max);
+        }
+        continue; // PING and anything else: nothing to do
+    }
+
+    // JSON fallback (debugging by hand)
     StaticJsonDocument<512> doc;
     DeserializationError error = deserializeJson(doc, packetBuffer);
 
     if (!error) {
         const char* command = doc["command"];
         if (command && strcmp(command, "set_mode") == 0) {
-          current_mode = doc["mode"] | "IDLE";
-          dice_max = doc["max"] | 6; 
-          updateDisplay(); 
+          applyMode(doc["mode"] | "IDLE", doc["max"] | 6);
         }
     }
   }
 }
 
+void applyMode(const char* mode, int max_value) {
+  current_mode = mode;
+  dice_max = max_value > 0 ? max_value : 6;
+  updateDisplay();
+}
+
 // Zorg dat de prototypes kloppen, we verplaatsen de logica iets voor de zekerheid
 // Maar met de prototypes bovenin zou dit moeten werken.
 
-void sendUdpResponse(const JsonDocument& doc) {
-  String output_string;
-  serializeJson(doc, output_string);
+// Acknowledged by the brain; serviceOutbox() retransmits until then, so a
+// dropped datagram doesn't lose the player's choice.
+void sendInputResult(String value) {
+  size_t len = emily_proto::encode(tx_frame, sizeof(tx_frame), ++tx_seq, emily_proto::InputReceived(), value.c_str());
+  IPAddress brain_ip;
+  brain_ip.fromString(EMILYBRAIN_IP);
+  if (!outbox.track(tx_frame, len, (uint32_t)brain_ip, EMILYBRAIN_PORT, millis())) {
+    Serial.println("Outbox full, input sent without retransmit.");
+  }
   udp.beginPacket(EMILYBRAIN_IP, EMILYBRAIN_PORT);
-  udp.print(output_string);
+  udp.write(tx_frame, len);
   udp.endPacket();
 }
 
-void sendInputResult(String value) {
-  StaticJsonDocument<128> doc;
-  doc["event"] = "input_received";
-  doc["value"] = value;
-  sendUdpResponse(doc);
+// --- Delivery layer (see EmilyReliable.h) ---
+// Acks the brain's commands and drops repeats. Returns false if there's
+// nothing left to handle.
+bool acceptFrame(const emily_proto::Frame& frame) {
+  uint32_t sender = (uint32_t)udp.remoteIP();
+
+  if (frame.type == emily_proto::MSG_ACK) {
+    emily_proto::Ack ack;
+    if (emily_proto::read(frame, ack)) outbox.acknowledge(sender, ack.seq);
+    return false;
+  }
+  if (!emily_proto::wantsAck(frame)) return true;
+
+  emily_proto::Ack ack;
+  ack.seq = frame.seq;
+  size_t len = emily_proto::encode(tx_frame, sizeof(tx_frame), ++tx_seq, ack);
+  udp.beginPacket(udp.remoteIP(), udp.remotePort());
+  udp.write(tx_frame, len);
+  udp.endPacket();
+
+  return !seen_frames.seen(sender, frame.seq);
+}
+
+void serviceOutbox() {
+  outbox.service(millis(),
+    [](uint32_t addr, uint16_t port, const uint8_t* data, size_t len) {
+      udp.beginPacket(IPAddress(addr), port);
+      udp.write(data, len);
+      udp.endPacket();
+    },
+    [](uint32_t addr, uint16_t port, uint8_t type, uint16_t seq) {
+      Serial.printf("No ACK from brain for input (seq %u), giving up.\n", seq);
+    });
 }
 
 void checkForButtonPress() {
@@ -0,0 +1,268 @@
+#ifndef EMILYPROTOCOL_H
+#define EMILYPROTOCOL_H
+
+// === Emily Node Protocol (EmilyBrain <-> CamCanvas <-> InputPad) ===
+// Compact binary UDP messages: a fixed 8 byte header followed by a packed
+// payload struct and, for some types, a trailing text field. Shared by all
+// three sketches, so a message type is defined in exactly one place.
+//
+// Plain C++ without Arduino dependencies: encoding and decoding work on
+// caller-owned buffers, never allocate, and compile on a desktop host too.
+// All fields are little-endian (every node is an ESP32).
+//
+// JSON is still accepted by every receiver as a debug fallback (e.g. from
+// Tools/camcanvas_commander.py). A binary frame is recognised by its first
+// byte (EMILY_PROTO_MAGIC), which can never start a JSON text.
+//
+// Delivery guarantees (ACKs, retransmits, duplicate suppression) are layered
+// on top in EmilyReliable.h.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <type_traits>
+
+#define EMILY_PROTO_MAGIC       0xE7
+#define EMILY_PROTO_VERSION     1
+#define EMILY_PROTO_MAX_FRAME   1400    // Stays below the WiFi MTU (no IP fragmentation)
+
+// --- Header flags ---
+#define EMILY_PROTO_FLAG_ACK_REQ 0x01   // Receiver answers with MSG_ACK (see EmilyReliable.h)
+
+namespace emily_proto {
+
+// --- Message Types ---
+enum MsgType : uint8_t {
+    // Link
+    MSG_PING            = 0x01,     // Brain -> node: "I'm here", starts the heartbeats
+    MSG_HEARTBEAT       = 0x02,     // Node -> brain, every 1.5s
+    MSG_ACK             = 0x03,     // Either way: confirms a frame sent with EMILY_PROTO_FLAG_ACK_REQ
+
+    // CamCanvas commands (brain -> CamCanvas)
+    MSG_MOVE_HEAD       = 0x10,
+    MSG_NOD_HEAD        = 0x11,
+    MSG_SET_LED         = 0x12,
+    MSG_TAKE_PICTURE    = 0x13,
+    MSG_ANALYZE_VISION  = 0x14,     // Text: the question
+    MSG_GENERATE_IMAGE  = 0x15,     // Text: the image prompt
+
+    // CamCanvas results (CamCanvas -> brain)
+    MSG_VISION_RESULT   = 0x30,     // Text: description, or error message
+    MSG_PICTURE_TAKEN   = 0x31,     // Text: saved path, or error message
+    MSG_IMAGE_COMPLETE  = 0x32,
+
+    // InputPad
+    MSG_SET_MODE        = 0x20,     // Brain -> InputPad
+    MSG_INPUT_RECEIVED  = 0x21      // InputPad -> brain. Text: the value ("A", "YES", "4", ...)
+};
+
+// --- Header ---
+struct __attribute__((packed)) FrameHeader {
+    uint8_t magic;          // EMILY_PROTO_MAGIC
+    uint8_t version;        // EMILY_PROTO_VERSION
+    uint8_t type;           // MsgType
+    uint8_t flags;          // EMILY_PROTO_FLAG_*
+    uint16_t seq;           // Per-sender message counter
+    uint16_t length;        // Payload bytes after the header
+};
+
+#define EMILY_PROTO_MAX_PAYLOAD (EMILY_PROTO_MAX_FRAME - sizeof(emily_proto::FrameHeader))
+
+// --- Enumerations used in payloads ---
+enum NodeId : uint8_t { NODE_BRAIN = 0, NODE_CAMCANVAS = 1, NODE_INPUTPAD = 2 };
+enum Status : uint8_t { STATUS_OK = 0, STATUS_ERROR = 1 };
+enum LedEffect : uint8_t { LED_NONE = 0, LED_PULSE = 1, LED_BLINK = 2 };
+enum PadMode : uint8_t { PAD_IDLE = 0, PAD_DICE = 1, PAD_YES_NO = 2, PAD_A_B_C = 3 };
+
+// --- Payloads ---
+// Each struct names its own message type, so encode()/read() can't mix them up.
+struct __attribute__((packed)) Ping {
+    static const uint8_t TYPE = MSG_PING;
+};
+
+struct __attribute__((packed)) Heartbeat {
+    static const uint8_t TYPE = MSG_HEARTBEAT;
+    uint8_t node;           // NodeId
+    uint8_t state;          // CamCanvas: 0 = ready. InputPad: PadMode
+    int16_t pan;            // CamCanvas head position (degrees), 0 otherwise
+    int16_t tilt;
+};
+
+struct __attribute__((packed)) Ack {
+    static const uint8_t TYPE = MSG_ACK;
+    uint16_t seq;           // Sequence number of the acknowledged frame
+};
+
+struct __attribute__((packed)) MoveHead {
+    static const uint8_t TYPE = MSG_MOVE_HEAD;
+    int16_t pan;
+    int16_t tilt;
+};
+
+struct __attribute__((packed)) NodHead {
+    static const uint8_t TYPE = MSG_NOD_HEAD;
+    int16_t angle;
+};
+
+struct __attribute__((packed)) SetLed {
+    static const uint8_t TYPE = MSG_SET_LED;
+    uint8_t r, g, b;
+    uint8_t effect;         // LedEffect
+    uint16_t speed_ms;      // Period of pulse/blink
+};
+
+struct __attribute__((packed)) TakePicture {
+    static const uint8_t TYPE = MSG_TAKE_PICTURE;
+};
+
+struct __attribute__((packed)) AnalyzeVision {
+    static const uint8_t TYPE = MSG_ANALYZE_VISION;
+    uint8_t use_flash;
+};
+
+struct __attribute__((packed)) GenerateImage {
+    static const uint8_t TYPE = MSG_GENERATE_IMAGE;
+    char model[32];         // NUL-padded
+};
+
+struct __attribute__((packed)) VisionResult {
+    static const uint8_t TYPE = MSG_VISION_RESULT;
+    uint8_t status;         // Status
+};
+
+struct __attribute__((packed)) PictureTaken {
+    static const uint8_t TYPE = MSG_PICTURE_TAKEN;
+    uint8_t status;
+};
+
+struct __attribute__((packed)) ImageComplete {
+    static const uint8_t TYPE = MSG_IMAGE_COMPLETE;
+    uint8_t status;
+};
+
+struct __attribute__((packed)) SetMode {
+    static const uint8_t TYPE = MSG_SET_MODE;
+    uint8_t mode;           // PadMode
+    uint8_t reserved;
+    uint16_t dice_max;
+};
+
+struct __attribute__((packed)) InputReceived {
+    static const uint8_t TYPE = MSG_INPUT_RECEIVED;
+};
+
+// --- Decoded frame ---
+// Points into the receive buffer; valid as long as that buffer is.
+struct Frame {
+    uint8_t type = 0;
+    uint8_t flags = 0;
+    uint16_t seq = 0;
+    const uint8_t* payload = nullptr;
+    uint16_t payload_len = 0;
+};
+
+// Trailing text field (not NUL-terminated on the wire).
+struct Text {
+    const char* data = nullptr;
+    size_t len = 0;
+
+    // Copies into 'out' (always NUL-terminated, truncated to fit).
+    size_t copyTo(char* out, size_t out_size) const {
+        if (out_size == 0) return 0;
+        size_t n = len < out_size - 1 ? len : out_size - 1;
+        if (n > 0) memcpy(out, data, n);
+        out[n] = 0;
+        return n;
+    }
+};
+
+// --- Encoding ---
+// Writes header + body + text into 'out'. Text that doesn't fit the frame
+// is truncated. Returns the frame length, or 0 if 'out' is too small for
+// the header and body.
+inline size_t encodeRaw(uint8_t* out, size_t out_size, uint8_t type, uint16_t seq,
+                        const void* body, size_t body_len, const char* text, size_t text_len) {
+    const size_t header_len = sizeof(FrameHeader);
+    size_t capacity = out_size < EMILY_PROTO_MAX_FRAME ? out_size : EMILY_PROTO_MAX_FRAME;
+    if (capacity < header_len + body_len) return 0;
+    if (text_len > capacity - header_len - body_len) text_len = capacity - header_len - body_len;
+
+    FrameHeader header;
+    header.magic = EMILY_PROTO_MAGIC;
+    header.version = EMILY_PROTO_VERSION;
+    header.type = type;
+    header.flags = 0;
+    header.seq = seq;
+    header.length = (uint16_t)(body_len + text_len);
+    memcpy(out, &header, header_len);
+    if (body_len > 0) memcpy(out + header_len, body, body_len);
+    if (text_len > 0) memcpy(out + header_len + body_len, text, text_len);
+    return header_len + body_len + text_len;
+}
+
+// Empty structs still have sizeof 1 in C++; they carry no bytes on the wire.
+template <typename T>
+inline size_t bodySize() { return std::is_empty<T>::value ? 0 : sizeof(T); }
+
+template <typename T>
+inline size_t encode(uint8_t* out, size_t out_size, uint16_t seq, const T& body,
+                     const char* text = nullptr, size_t text_len = (size_t)-1) {
+    if (text == nullptr) text_len = 0;
+    else if (text_len == (size_t)-1) text_len = strlen(text);
+    return encodeRaw(out, out_size, T::TYPE, seq, &body, bodySize<T>(), text, text_len);
+}
+
+// Sets the header flags of an already encoded frame.
+inline void setFlags(uint8_t* frame, uint8_t flags) {
+    frame[offsetof(FrameHeader, flags)] = flags;
+}
+
+// --- Decoding ---
+// True if 'data' starts like a binary frame (as opposed to JSON text).
+inline bool isFrame(const uint8_t* data, size_t len) {
+    return len >= 1 && data[0] == EMILY_PROTO_MAGIC;
+}
+
+// Validates the header and fills 'frame'. Rejects other protocol versions
+// and frames whose length field doesn't match the datagram.
+inline bool decode(const uint8_t* data, size_t len, Frame& frame) {
+    if (len < sizeof(FrameHeader) || len > EMILY_PROTO_MAX_FRAME) return false;
+    FrameHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != EMILY_PROTO_MAGIC || header.version != EMILY_PROTO_VERSION) return false;
+    if ((size_t)header.length != len - sizeof(FrameHeader)) return false;
+
+    frame.type = header.type;
+    frame.flags = header.flags;
+    frame.seq = header.seq;
+    frame.payload = data + sizeof(FrameHeader);
+    frame.payload_len = header.length;
+    return true;
+}
+
+// Reads type and sequence number back out of an encoded frame.
+inline void peekHeader(const uint8_t* frame, uint8_t& type, uint16_t& seq) {
+    FrameHeader header;
+    memcpy(&header, frame, sizeof(header));
+    type = header.type;
+    seq = header.seq;
+}
+
+// Copies the fixed payload of a 'T' message into 'body' (memcpy, so the
+// receive buffer needs no alignment) and points 'text' at the rest.
+// False if the frame is of another type or too short.
+template <typename T>
+inline bool read(const Frame& frame, T& body, Text* text = nullptr) {
+    size_t body_len = bodySize<T>();
+    if (frame.type != T::TYPE || frame.payload_len < body_len) return false;
+    if (body_len > 0) memcpy(&body, frame.payload, body_len);
+    if (text) {
+        text->data = (const char*)frame.payload + body_len;
+        text->len = frame.payload_len - body_len;
+    }
+    return true;
+}
+
+} // namespace emily_proto
+
+#endif // EMILYPROTOCOL_H
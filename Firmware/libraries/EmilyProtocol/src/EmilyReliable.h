@@ -0,0 +1,155 @@
+#ifndef EMILYRELIABLE_H
+#define EMILYRELIABLE_H
+
+// === Emily Node Protocol: at-least-once delivery ===
+// Commands and results that must not get lost on a busy network are sent
+// with EMILY_PROTO_FLAG_ACK_REQ set. The sender keeps a copy in its Outbox
+// and retransmits it with exponential backoff until a MSG_ACK carrying the
+// same sequence number comes back, or the attempts run out. The receiver
+// acks every flagged frame (also repeats: the lost datagram may have been
+// the ACK) and uses a DuplicateFilter so a repeat is only acted on once.
+//
+// Heartbeats and pings stay unacknowledged; the next one replaces them.
+//
+// Sequence numbers should start at a random value after boot, so a node
+// that restarts doesn't collide with what the peer still remembers.
+
+#include "EmilyProtocol.h"
+
+#define EMILY_RELIABLE_RETRY_MS       200   // First retransmit, doubles per attempt...
+#define EMILY_RELIABLE_RETRY_MAX_MS   2000  // ...up to this interval
+#define EMILY_RELIABLE_ATTEMPTS       8     // Transmissions before giving up (~12s in total)
+#define EMILY_RELIABLE_DEDUP_SLOTS    16    // Recently seen (address, seq) pairs per receiver
+
+namespace emily_proto {
+
+// True if the sender wants this frame acknowledged.
+inline bool wantsAck(const Frame& frame) {
+    return (frame.flags & EMILY_PROTO_FLAG_ACK_REQ) != 0;
+}
+
+// --- Outbox ---
+// Frames waiting for their ACK. Peers are identified by IPv4 address (as
+// uint32_t, which IPAddress converts to and from) and port, so the class
+// stays independent of the network stack. Not thread safe; use it from
+// the task that sends and receives.
+template <size_t SLOTS, size_t FRAME_BYTES = EMILY_PROTO_MAX_FRAME>
+class Outbox {
+public:
+    // Flags the encoded frame in 'frame' as ACK-requested and keeps a copy
+    // for retransmission. The caller then sends 'frame' as usual. Returns
+    // false if no slot is free (the frame is sent once, unguarded).
+    bool track(uint8_t* frame, size_t len, uint32_t addr, uint16_t port, uint32_t now) {
+        if (len > FRAME_BYTES) return false;
+        Entry* entry = nullptr;
+        for (size_t i = 0; i < SLOTS; i++) {
+            if (!entries[i].used) { entry = &entries[i]; break; }
+        }
+        if (entry == nullptr) return false;
+
+        setFlags(frame, EMILY_PROTO_FLAG_ACK_REQ);
+        memcpy(entry->data, frame, len);
+        entry->used = true;
+        entry->len = (uint16_t)len;
+        entry->addr = addr;
+        entry->port = port;
+        peekHeader(frame, entry->type, entry->seq);
+        entry->attempts = 1;
+        entry->next_at = now + EMILY_RELIABLE_RETRY_MS;
+        return true;
+    }
+
+    // Drops the frame confirmed by an ACK from 'addr'. False if it was
+    // unknown (a late ACK for a retransmitted frame, for example).
+    bool acknowledge(uint32_t addr, uint16_t seq) {
+        for (size_t i = 0; i < SLOTS; i++) {
+            Entry& entry = entries[i];
+            if (entry.used && entry.addr == addr && entry.seq == seq) {
+                entry.used = false;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Retransmits every frame whose timer ran out through
+    // send(addr, port, data, len). Frames out of attempts are dropped and
+    // reported through lost(addr, port, type, seq).
+    template <typename SendFn, typename LostFn>
+    void service(uint32_t now, SendFn send, LostFn lost) {
+        for (size_t i = 0; i < SLOTS; i++) {
+            Entry& entry = entries[i];
+            if (!entry.used || (int32_t)(now - entry.next_at) < 0) continue;
+
+            if (entry.attempts >= EMILY_RELIABLE_ATTEMPTS) {
+                entry.used = false;
+                lost(entry.addr, entry.port, entry.type, entry.seq);
+                continue;
+            }
+            send(entry.addr, entry.port, (const uint8_t*)entry.data, (size_t)entry.len);
+            uint32_t interval = (uint32_t)EMILY_RELIABLE_RETRY_MS << entry.attempts;
+            if (interval > EMILY_RELIABLE_RETRY_MAX_MS) interval = EMILY_RELIABLE_RETRY_MAX_MS;
+            entry.attempts++;
+            entry.next_at = now + interval;
+        }
+    }
+
+    size_t pending() const {
+        size_t count = 0;
+        for (size_t i = 0; i < SLOTS; i++) {
+            if (entries[i].used) count++;
+        }
+        return count;
+    }
+
+    void clear() {
+        for (size_t i = 0; i < SLOTS; i++) entries[i].used = false;
+    }
+
+private:
+    struct Entry {
+        bool used = false;
+        uint8_t type = 0;
+        uint16_t seq = 0;
+        uint16_t port = 0;
+        uint16_t len = 0;
+        uint32_t addr = 0;
+        uint8_t attempts = 0;       // Transmissions so far
+        uint32_t next_at = 0;       // Time of the next retransmit (ms)
+        uint8_t data[FRAME_BYTES];
+    };
+    Entry entries[SLOTS];
+};
+
+// --- Duplicate filter ---
+// Remembers the last EMILY_RELIABLE_DEDUP_SLOTS ACK-requested frames, so a
+// retransmitted command or result isn't executed twice.
+class DuplicateFilter {
+public:
+    // True if the frame was seen before; otherwise remembers it.
+    bool seen(uint32_t addr, uint16_t seq) {
+        for (size_t i = 0; i < EMILY_RELIABLE_DEDUP_SLOTS; i++) {
+            const Entry& entry = entries[i];
+            if (entry.used && entry.addr == addr && entry.seq == seq) return true;
+        }
+        Entry& entry = entries[next];
+        entry.used = true;
+        entry.addr = addr;
+        entry.seq = seq;
+        next = (next + 1) % EMILY_RELIABLE_DEDUP_SLOTS;
+        return false;
+    }
+
+private:
+    struct Entry {
+        bool used = false;
+        uint16_t seq = 0;
+        uint32_t addr = 0;
+    };
+    Entry entries[EMILY_RELIABLE_DEDUP_SLOTS];
+    size_t next = 0;
+};
+
+} // namespace emily_proto
+
+#endif // EMILYRELIABLE_H
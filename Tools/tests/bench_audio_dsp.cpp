@@ -0,0 +1,48 @@
+// Microbenchmark for frameEnergy(): the old byte loop, the scalar path
+// (unaligned frame) and the word path (aligned frame), per VAD frame size.
+// Host numbers only show the relative cost of the loop shapes; run it on
+// the target to judge the Xtensa build.
+//
+//   bench_audio_dsp [iterations]
+#include "AudioDsp.h"
+#include <chrono>
+#include <random>
+#include <vector>
+
+static int oldFrameEnergy(const uint8_t* record_buffer, size_t bytes_read) {
+    long long total_amplitude = 0;
+    for (size_t i = 0; i < bytes_read; i += 2) {
+        total_amplitude += abs((int16_t)(record_buffer[i] | (record_buffer[i + 1] << 8)));
+    }
+    return (bytes_read > 0) ? (int)(total_amplitude / (bytes_read / 2)) : 0;
+}
+
+static volatile uint32_t sink; // Keeps the results alive
+
+template <typename Fn>
+static double nsPerFrame(long iterations, Fn fn) {
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < iterations; i++) sink = sink + fn();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+}
+
+int main(int argc, char** argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : 200000;
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> any_sample(-32768, 32767);
+    std::vector<int16_t> buffer(1024 + 2);
+    for (int16_t& s : buffer) s = (int16_t)any_sample(rng);
+
+    printf("%-8s %12s %12s %12s\n", "samples", "old ns", "scalar ns", "word ns");
+    // 10/20/32 ms at 16 kHz, and a 48 ms read at 16 kHz
+    for (size_t count : {160u, 320u, 512u, 768u}) {
+        const int16_t* aligned = buffer.data();
+        const int16_t* unaligned = buffer.data() + 1;
+        double old_ns = nsPerFrame(iterations, [&] { return (uint32_t)oldFrameEnergy((const uint8_t*)aligned, count * 2); });
+        double scalar_ns = nsPerFrame(iterations, [&] { return frameEnergy(unaligned, count); });
+        double word_ns = nsPerFrame(iterations, [&] { return frameEnergy(aligned, count); });
+        printf("%-8zu %12.1f %12.1f %12.1f\n", count, old_ns, scalar_ns, word_ns);
+    }
+    return 0;
+}
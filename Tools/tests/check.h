@@ -0,0 +1,45 @@
+#ifndef EMILY_TESTS_CHECK_H
+#define EMILY_TESTS_CHECK_H
+
+// --- Minimal test helpers ---
+// Just enough to keep the host tests free of third-party frameworks: a
+// failed check prints its location and the test binary exits non-zero
+// through checkResult().
+
+#include <stdio.h>
+#include <string.h>
+
+inline int check_failures = 0;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            check_failures++; \
+        } \
+    } while (0)
+
+#define CHECK_EQ(a, b) do { \
+        long long check_a_ = (long long)(a), check_b_ = (long long)(b); \
+        if (check_a_ != check_b_) { \
+            printf("FAIL %s:%d: %s == %s (%lld vs %lld)\n", __FILE__, __LINE__, #a, #b, check_a_, check_b_); \
+            check_failures++; \
+        } \
+    } while (0)
+
+#define CHECK_STR(a, b) do { \
+        const char* check_a_ = (a); const char* check_b_ = (b); \
+        if (check_a_ == nullptr || check_b_ == nullptr || strcmp(check_a_, check_b_) != 0) { \
+            printf("FAIL %s:%d: %s == %s (\"%s\" vs \"%s\")\n", __FILE__, __LINE__, #a, #b, \
+                   check_a_ ? check_a_ : "(null)", check_b_ ? check_b_ : "(null)"); \
+            check_failures++; \
+        } \
+    } while (0)
+
+// Prints the summary; use as main()'s return value.
+inline int checkResult(const char* name) {
+    if (check_failures == 0) printf("%s: OK\n", name);
+    else printf("%s: %d check(s) failed\n", name, check_failures);
+    return check_failures == 0 ? 0 : 1;
+}
+
+#endif // EMILY_TESTS_CHECK_H
@@ -0,0 +1,126 @@
+#ifndef EMILY_TESTS_ARDUINO_SHIM_H
+#define EMILY_TESTS_ARDUINO_SHIM_H
+
+// --- Arduino core shim for host builds ---
+// The subset of the ESP32 Arduino core the firmware modules under test
+// use: String, Print/Serial, millis()/delay(). Not a full emulation;
+// extend it when a new module needs more.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+typedef uint8_t byte;
+
+unsigned long millis();
+void delay(unsigned long ms);
+
+// --- String ---
+class String {
+public:
+    String() {}
+    String(const char* text) : s(text ? text : "") {}
+    String(const std::string& text) : s(text) {}
+    String(char c) : s(1, c) {}
+    explicit String(int value) : s(std::to_string(value)) {}
+    explicit String(unsigned value) : s(std::to_string(value)) {}
+    explicit String(long value) : s(std::to_string(value)) {}
+    explicit String(unsigned long value) : s(std::to_string(value)) {}
+
+    const char* c_str() const { return s.c_str(); }
+    unsigned int length() const { return (unsigned int)s.size(); }
+    bool isEmpty() const { return s.empty(); }
+    bool reserve(unsigned int size) { s.reserve(size); return true; }
+
+    bool concat(const char* text, unsigned int len) { s.append(text, len); return true; }
+    String& operator+=(const String& other) { s += other.s; return *this; }
+    String& operator+=(const char* text) { if (text) s += text; return *this; }
+    String& operator+=(char c) { s += c; return *this; }
+    friend String operator+(const String& a, const String& b) { return String(a.s + b.s); }
+    friend String operator+(const String& a, const char* b) { return String(a.s + (b ? b : "")); }
+    friend String operator+(const char* a, const String& b) { return String((a ? a : "") + b.s); }
+
+    char operator[](unsigned int index) const { return index < s.size() ? s[index] : 0; }
+    bool operator==(const String& other) const { return s == other.s; }
+    bool operator==(const char* text) const { return s == (text ? text : ""); }
+    bool operator!=(const String& other) const { return s != other.s; }
+    bool operator!=(const char* text) const { return !(*this == text); }
+    bool operator<(const String& other) const { return s < other.s; }
+
+    bool startsWith(const char* prefix) const { return s.compare(0, strlen(prefix), prefix) == 0; }
+    bool endsWith(const char* suffix) const {
+        size_t n = strlen(suffix);
+        return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+    }
+    int indexOf(char c, unsigned int from = 0) const {
+        size_t pos = s.find(c, from);
+        return pos == std::string::npos ? -1 : (int)pos;
+    }
+    String substring(unsigned int from) const { return from < s.size() ? String(s.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const {
+        if (from >= s.size() || to <= from) return String();
+        return String(s.substr(from, to - from));
+    }
+    void remove(unsigned int index) { if (index < s.size()) s.erase(index); }
+    void remove(unsigned int index, unsigned int count) { if (index < s.size()) s.erase(index, count); }
+    void trim() {
+        size_t first = s.find_first_not_of(" \t\r\n");
+        if (first == std::string::npos) { s.clear(); return; }
+        s = s.substr(first, s.find_last_not_of(" \t\r\n") - first + 1);
+    }
+    long toInt() const { return atol(s.c_str()); }
+
+private:
+    std::string s;
+};
+
+// --- Print / Serial ---
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size) {
+        size_t n = 0;
+        while (size--) n += write(*buffer++);
+        return n;
+    }
+    size_t write(const char* text) { return write((const uint8_t*)text, strlen(text)); }
+    virtual void flush() {}
+
+    size_t print(const char* text) { return write(text); }
+    size_t print(const String& text) { return write(text.c_str()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int value) { return print(String(value)); }
+    size_t println() { return write("\n"); }
+    template <typename T>
+    size_t println(const T& value) { return print(value) + println(); }
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+        char buffer[512];
+        va_list args;
+        va_start(args, format);
+        int n = vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+        if (n < 0) return 0;
+        return write((const uint8_t*)buffer, (size_t)n < sizeof(buffer) ? (size_t)n : sizeof(buffer) - 1);
+    }
+};
+
+// Log output of the modules under test; goes to stdout unless
+// EMILY_TESTS_QUIET is set in the environment.
+class HostSerial : public Print {
+public:
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+};
+extern HostSerial Serial;
+
+#endif // EMILY_TESTS_ARDUINO_SHIM_H
@@ -0,0 +1,716 @@
+#ifndef EMILY_TESTS_ARDUINOJSON_SHIM_H
+#define EMILY_TESTS_ARDUINOJSON_SHIM_H
+
+// --- ArduinoJson 7 shim for host builds ---
+// The subset of the DOM API the firmware modules under test use, with the
+// same semantics where it matters to them:
+//  - operator[] on a mutable variant only creates members when written to
+//    (assignment, to<T>(), add<T>()), reading never changes the document;
+//  - reads through a missing path give a null variant, '|' supplies the
+//    default, a const char* conversion of a non-string is nullptr;
+//  - deserializeJson() decodes \uXXXX escapes (surrogate pairs too) to
+//    UTF-8 and applies DeserializationOption::Filter;
+//  - serializeJson() writes compact JSON in member insertion order.
+// JsonObject and JsonArray are thin variants that only differ in what
+// to<T>()/add<T>() create; the read-only views share JsonVariantConst but
+// stay separate from the mutable ones, so writes through them don't
+// compile, as on the target.
+
+#include "Arduino.h"
+#include <functional>
+#include <list>
+#include <utility>
+
+// --- Node ---
+struct JsonNode {
+    enum class Type { Null, Bool, Int, Float, String, Array, Object };
+    Type type = Type::Null;
+    bool b = false;
+    long long i = 0;
+    double f = 0;
+    std::string s;
+    std::list<JsonNode> items;                              // Array (stable addresses)
+    std::list<std::pair<std::string, JsonNode>> members;    // Object, in insertion order
+
+    void reset(Type t) {
+        type = t;
+        s.clear();
+        items.clear();
+        members.clear();
+    }
+    const JsonNode* member(const char* key) const {
+        if (type != Type::Object) return nullptr;
+        for (const auto& m : members) {
+            if (m.first == key) return &m.second;
+        }
+        return nullptr;
+    }
+    const JsonNode* item(size_t index) const {
+        if (type != Type::Array || index >= items.size()) return nullptr;
+        auto it = items.begin();
+        std::advance(it, index);
+        return &*it;
+    }
+    size_t size() const {
+        if (type == Type::Array) return items.size();
+        if (type == Type::Object) return members.size();
+        return 0;
+    }
+};
+
+class JsonVariant;
+class JsonVariantConst;
+class JsonObject;
+class JsonArray;
+typedef JsonVariantConst JsonObjectConst;
+typedef JsonVariantConst JsonArrayConst;
+
+// --- Read-only view ---
+class JsonVariantConst {
+public:
+    JsonVariantConst(const JsonNode* node = nullptr) : n(node) {}
+
+    const JsonNode* node() const { return n; }
+    bool isNull() const { return n == nullptr || n->type == JsonNode::Type::Null; }
+    size_t size() const { return n ? n->size() : 0; }
+
+    JsonVariantConst operator[](const char* key) const { return JsonVariantConst(n ? n->member(key) : nullptr); }
+    JsonVariantConst operator[](const String& key) const { return (*this)[key.c_str()]; }
+    JsonVariantConst operator[](int index) const { return (*this)[(size_t)index]; }
+    JsonVariantConst operator[](size_t index) const { return JsonVariantConst(n ? n->item(index) : nullptr); }
+
+    operator const char*() const { return str(); }
+
+    template <typename T> T as() const;
+    template <typename T> bool is() const;
+
+    const char* operator|(const char* fallback) const {
+        const char* value = str();
+        return value ? value : fallback;
+    }
+    int operator|(int fallback) const {
+        if (n && n->type == JsonNode::Type::Int) return (int)n->i;
+        if (n && n->type == JsonNode::Type::Float) return (int)n->f;
+        return fallback;
+    }
+    bool operator|(bool fallback) const { return n && n->type == JsonNode::Type::Bool ? n->b : fallback; }
+
+    // --- Range-for over array elements ---
+    class iterator {
+    public:
+        iterator(std::list<JsonNode>::const_iterator it) : it(it) {}
+        JsonVariantConst operator*() const { return JsonVariantConst(&*it); }
+        iterator& operator++() { ++it; return *this; }
+        bool operator!=(const iterator& other) const { return it != other.it; }
+    private:
+        std::list<JsonNode>::const_iterator it;
+    };
+    iterator begin() const { return iterator(isArray() ? n->items.begin() : empty().begin()); }
+    iterator end() const { return iterator(isArray() ? n->items.end() : empty().end()); }
+
+private:
+    const char* str() const { return n && n->type == JsonNode::Type::String ? n->s.c_str() : nullptr; }
+    bool isArray() const { return n && n->type == JsonNode::Type::Array; }
+    static const std::list<JsonNode>& empty() {
+        static const std::list<JsonNode> none;
+        return none;
+    }
+    const JsonNode* n;
+};
+
+template <> inline const char* JsonVariantConst::as<const char*>() const { return str(); }
+template <> inline String JsonVariantConst::as<String>() const {
+    const char* value = as<const char*>();
+    return String(value ? value : "");
+}
+template <> inline int JsonVariantConst::as<int>() const { return *this | 0; }
+template <> inline long JsonVariantConst::as<long>() const { return *this | 0; }
+template <> inline bool JsonVariantConst::as<bool>() const { return *this | false; }
+template <> inline float JsonVariantConst::as<float>() const {
+    if (n && n->type == JsonNode::Type::Float) return (float)n->f;
+    return (float)(*this | 0);
+}
+template <> inline JsonVariantConst JsonVariantConst::as<JsonVariantConst>() const { return *this; }
+
+template <> inline bool JsonVariantConst::is<const char*>() const { return str() != nullptr; }
+template <> inline bool JsonVariantConst::is<int>() const { return n && n->type == JsonNode::Type::Int; }
+template <> inline bool JsonVariantConst::is<bool>() const { return n && n->type == JsonNode::Type::Bool; }
+template <> inline bool JsonVariantConst::is<float>() const {
+    return n && (n->type == JsonNode::Type::Float || n->type == JsonNode::Type::Int);
+}
+
+// --- Mutable reference ---
+// Holds the path to its node rather than the node, so a missing member is
+// only created when something is written through it.
+class JsonVariant {
+public:
+    typedef std::function<JsonNode*(bool create)> Resolver;
+
+    JsonVariant() {}
+    JsonVariant(const JsonVariant&) = default;
+    explicit JsonVariant(Resolver resolve) : resolve(std::move(resolve)) {}
+    static JsonVariant of(JsonNode* node) {
+        return JsonVariant([node](bool) { return node; });
+    }
+
+    JsonNode* node() const { return resolve ? resolve(false) : nullptr; }
+    operator JsonVariantConst() const { return JsonVariantConst(node()); }
+    bool isNull() const { return JsonVariantConst(node()).isNull(); }
+    size_t size() const { return JsonVariantConst(node()).size(); }
+
+    JsonVariant operator[](const char* key) const {
+        Resolver parent = resolve;
+        std::string name(key);
+        return JsonVariant([parent, name](bool create) -> JsonNode* {
+            JsonNode* p = parent ? parent(create) : nullptr;
+            if (p == nullptr) return nullptr;
+            if (p->type != JsonNode::Type::Object) {
+                if (!create || p->type != JsonNode::Type::Null) return nullptr;
+                p->reset(JsonNode::Type::Object);
+            }
+            for (auto& m : p->members) {
+                if (m.first == name) return &m.second;
+            }
+            if (!create) return nullptr;
+            p->members.emplace_back(name, JsonNode());
+            return &p->members.back().second;
+        });
+    }
+    JsonVariant operator[](const String& key) const { return (*this)[key.c_str()]; }
+    JsonVariant operator[](int index) const { return (*this)[(size_t)index]; }
+    JsonVariant operator[](size_t index) const {
+        Resolver parent = resolve;
+        return JsonVariant([parent, index](bool create) -> JsonNode* {
+            JsonNode* p = parent ? parent(create) : nullptr;
+            if (p == nullptr) return nullptr;
+            if (p->type != JsonNode::Type::Array) {
+                if (!create || p->type != JsonNode::Type::Null) return nullptr;
+                p->reset(JsonNode::Type::Array);
+            }
+            if (index >= p->items.size()) {
+                if (!create || index != p->items.size()) return nullptr; // Only appends, like ArduinoJson
+                p->items.emplace_back();
+            }
+            auto it = p->items.begin();
+            std::advance(it, index);
+            return &*it;
+        });
+    }
+
+    operator const char*() const { return JsonVariantConst(node()).as<const char*>(); }
+    template <typename T> T as() const { return JsonVariantConst(node()).as<T>(); }
+    template <typename T> bool is() const { return JsonVariantConst(node()).is<T>(); }
+    const char* operator|(const char* fallback) const { return JsonVariantConst(node()) | fallback; }
+    int operator|(int fallback) const { return JsonVariantConst(node()) | fallback; }
+    bool operator|(bool fallback) const { return JsonVariantConst(node()) | fallback; }
+
+    // --- Writing ---
+    const JsonVariant& operator=(const char* value) const {
+        if (value == nullptr) return set(JsonNode::Type::Null);
+        JsonNode* p = create();
+        if (p) { p->reset(JsonNode::Type::String); p->s = value; }
+        return *this;
+    }
+    const JsonVariant& operator=(const String& value) const { return *this = value.c_str(); }
+    const JsonVariant& operator=(bool value) const {
+        JsonNode* p = create();
+        if (p) { p->reset(JsonNode::Type::Bool); p->b = value; }
+        return *this;
+    }
+    const JsonVariant& operator=(int value) const { return setInt(value); }
+    const JsonVariant& operator=(unsigned value) const { return setInt(value); }
+    const JsonVariant& operator=(long value) const { return setInt(value); }
+    const JsonVariant& operator=(unsigned long value) const { return setInt((long long)value); }
+    const JsonVariant& operator=(double value) const {
+        JsonNode* p = create();
+        if (p) { p->reset(JsonNode::Type::Float); p->f = value; }
+        return *this;
+    }
+    const JsonVariant& operator=(const JsonVariant& other) const { return *this = JsonVariantConst(other.node()); }
+    const JsonVariant& operator=(JsonVariantConst other) const {
+        JsonNode* p = create();
+        if (p) {
+            if (other.node()) *p = *other.node();
+            else p->reset(JsonNode::Type::Null);
+        }
+        return *this;
+    }
+
+    // Replaces the value with an empty object or array.
+    template <typename T> T to() const;
+    // Appends an element to the array (created if null): an empty object
+    // or array, or a null variant to assign to.
+    template <typename T> T add() const;
+    template <typename T> bool add(const T& value) const {
+        add<JsonVariant>() = value;
+        return true;
+    }
+
+    void clear() const {
+        JsonNode* p = node();
+        if (p) p->reset(p->type == JsonNode::Type::Array || p->type == JsonNode::Type::Object ? p->type : JsonNode::Type::Null);
+    }
+
+    JsonVariantConst::iterator begin() const { return JsonVariantConst(node()).begin(); }
+    JsonVariantConst::iterator end() const { return JsonVariantConst(node()).end(); }
+
+private:
+    JsonNode* create() const { return resolve ? resolve(true) : nullptr; }
+    const JsonVariant& set(JsonNode::Type type) const {
+        JsonNode* p = create();
+        if (p) p->reset(type);
+        return *this;
+    }
+    const JsonVariant& setInt(long long value) const {
+        JsonNode* p = create();
+        if (p) { p->reset(JsonNode::Type::Int); p->i = value; }
+        return *this;
+    }
+    JsonNode* emptyContainer(JsonNode::Type type) const {
+        JsonNode* p = create();
+        if (p) p->reset(type);
+        return p;
+    }
+    JsonNode* append() const {
+        JsonNode* p = create();
+        if (p == nullptr) return nullptr;
+        if (p->type == JsonNode::Type::Null) p->reset(JsonNode::Type::Array);
+        if (p->type != JsonNode::Type::Array) return nullptr;
+        p->items.emplace_back();
+        return &p->items.back();
+    }
+
+    Resolver resolve;
+};
+
+class JsonObject : public JsonVariant {
+public:
+    JsonObject() {}
+    JsonObject(const JsonVariant& v) : JsonVariant(v) {}
+    using JsonVariant::operator=;
+};
+
+class JsonArray : public JsonVariant {
+public:
+    JsonArray() {}
+    JsonArray(const JsonVariant& v) : JsonVariant(v) {}
+    using JsonVariant::operator=;
+};
+
+template <> inline JsonObject JsonVariant::to<JsonObject>() const {
+    JsonNode* p = emptyContainer(JsonNode::Type::Object);
+    return p ? JsonObject(of(p)) : JsonObject();
+}
+template <> inline JsonArray JsonVariant::to<JsonArray>() const {
+    JsonNode* p = emptyContainer(JsonNode::Type::Array);
+    return p ? JsonArray(of(p)) : JsonArray();
+}
+
+template <> inline JsonVariant JsonVariant::add<JsonVariant>() const {
+    JsonNode* p = append();
+    return p ? of(p) : JsonVariant();
+}
+template <> inline JsonObject JsonVariant::add<JsonObject>() const {
+    JsonNode* p = append();
+    if (p) p->reset(JsonNode::Type::Object);
+    return p ? JsonObject(of(p)) : JsonObject();
+}
+template <> inline JsonArray JsonVariant::add<JsonArray>() const {
+    JsonNode* p = append();
+    if (p) p->reset(JsonNode::Type::Array);
+    return p ? JsonArray(of(p)) : JsonArray();
+}
+
+// as<JsonObject>()/as<JsonArray>(): the same path, or null if the value
+// is of another kind.
+template <> inline JsonObject JsonVariant::as<JsonObject>() const {
+    JsonNode* p = node();
+    return p && p->type == JsonNode::Type::Object ? JsonObject(*this) : JsonObject();
+}
+template <> inline JsonArray JsonVariant::as<JsonArray>() const {
+    JsonNode* p = node();
+    return p && p->type == JsonNode::Type::Array ? JsonArray(*this) : JsonArray();
+}
+
+// --- Document ---
+class JsonDocument {
+public:
+    JsonVariant operator[](const char* key) { return root()[key]; }
+    JsonVariant operator[](const String& key) { return root()[key]; }
+    JsonVariant operator[](int index) { return root()[index]; }
+    JsonVariantConst operator[](const char* key) const { return JsonVariantConst(&node)[key]; }
+    JsonVariantConst operator[](const String& key) const { return JsonVariantConst(&node)[key]; }
+    JsonVariantConst operator[](int index) const { return JsonVariantConst(&node)[index]; }
+
+    template <typename T> T as() { return root().as<T>(); }
+    template <typename T> T as() const { return JsonVariantConst(&node).as<T>(); }
+    template <typename T> T to() { return root().template to<T>(); }
+    template <typename T> T add() { return root().template add<T>(); }
+
+    operator JsonVariant() { return root(); }
+    operator JsonVariantConst() const { return JsonVariantConst(&node); }
+
+    bool isNull() const { return node.type == JsonNode::Type::Null; }
+    size_t size() const { return node.size(); }
+    void clear() { node.reset(JsonNode::Type::Null); }
+    bool overflowed() const { return false; }
+
+    JsonNode& rootNode() { return node; }
+    const JsonNode& rootNode() const { return node; }
+
+private:
+    JsonVariant root() { return JsonVariant::of(&node); }
+    JsonNode node;
+};
+
+// --- Deserialization ---
+class DeserializationError {
+public:
+    enum Code { Ok, EmptyInput, IncompleteInput, InvalidInput, NoMemory, TooDeep };
+
+    DeserializationError(Code code = Ok) : c(code) {}
+    Code code() const { return c; }
+    explicit operator bool() const { return c != Ok; }
+    bool operator==(Code other) const { return c == other; }
+    bool operator!=(Code other) const { return c != other; }
+    const char* c_str() const {
+        static const char* const names[] = {"Ok", "EmptyInput", "IncompleteInput", "InvalidInput", "NoMemory", "TooDeep"};
+        return names[c];
+    }
+
+private:
+    Code c;
+};
+
+namespace DeserializationOption {
+class Filter {
+public:
+    explicit Filter(const JsonDocument& doc) : node(&doc.rootNode()) {}
+    const JsonNode* node;
+};
+} // namespace DeserializationOption
+
+namespace json_shim {
+
+class Parser {
+public:
+    Parser(const char* begin, const char* end) : p(begin), end(end) {}
+
+    DeserializationError parse(JsonNode& out) {
+        skipSpace();
+        if (p == end) return DeserializationError::EmptyInput;
+        return value(out, 0);
+    }
+
+private:
+    static const int MAX_NESTING = 10; // ArduinoJson's default
+
+    void skipSpace() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) p++;
+    }
+
+    DeserializationError value(JsonNode& out, int depth) {
+        skipSpace();
+        if (p == end) return DeserializationError::IncompleteInput;
+        switch (*p) {
+            case '{': return object(out, depth + 1);
+            case '[': return array(out, depth + 1);
+            case '"':
+                out.reset(JsonNode::Type::String);
+                return string(out.s);
+            case 't': return literal("true", out, JsonNode::Type::Bool, true);
+            case 'f': return literal("false", out, JsonNode::Type::Bool, false);
+            case 'n': return literal("null", out, JsonNode::Type::Null, false);
+            default:  return number(out);
+        }
+    }
+
+    DeserializationError literal(const char* word, JsonNode& out, JsonNode::Type type, bool b) {
+        for (const char* w = word; *w; w++, p++) {
+            if (p == end) return DeserializationError::IncompleteInput;
+            if (*p != *w) return DeserializationError::InvalidInput;
+        }
+        out.reset(type);
+        out.b = b;
+        return DeserializationError::Ok;
+    }
+
+    DeserializationError number(JsonNode& out) {
+        const char* start = p;
+        bool is_float = false;
+        if (p < end && (*p == '-' || *p == '+')) p++;
+        while (p < end && (isdigit((unsigned char)*p) || *p == '.' || *p == 'e' || *p == 'E' ||
+                           ((*p == '-' || *p == '+') && (p[-1] == 'e' || p[-1] == 'E')))) {
+            if (!isdigit((unsigned char)*p)) is_float = true;
+            p++;
+        }
+        if (p == start || (p - start == 1 && !isdigit((unsigned char)*start))) return DeserializationError::InvalidInput;
+        std::string text(start, p);
+        if (is_float) {
+            out.reset(JsonNode::Type::Float);
+            out.f = strtod(text.c_str(), nullptr);
+        } else {
+            out.reset(JsonNode::Type::Int);
+            out.i = strtoll(text.c_str(), nullptr, 10);
+        }
+        return DeserializationError::Ok;
+    }
+
+    bool hex4(uint32_t& value) {
+        value = 0;
+        for (int k = 0; k < 4; k++, p++) {
+            if (p == end) return false;
+            char c = *p;
+            value <<= 4;
+            if (c >= '0' && c <= '9') value |= c - '0';
+            else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+            else return false;
+        }
+        return true;
+    }
+
+    static void utf8(std::string& out, uint32_t cp) {
+        if (cp < 0x80) {
+            out += (char)cp;
+        } else if (cp < 0x800) {
+            out += (char)(0xC0 | (cp >> 6));
+            out += (char)(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            out += (char)(0xE0 | (cp >> 12));
+            out += (char)(0x80 | ((cp >> 6) & 0x3F));
+            out += (char)(0x80 | (cp & 0x3F));
+        } else {
+            out += (char)(0xF0 | (cp >> 18));
+            out += (char)(0x80 | ((cp >> 12) & 0x3F));
+            out += (char)(0x80 | ((cp >> 6) & 0x3F));
+            out += (char)(0x80 | (cp & 0x3F));
+        }
+    }
+
+    DeserializationError string(std::string& out) {
+        p++; // Opening quote
+        uint32_t high_surrogate = 0;
+        while (true) {
+            if (p == end) return DeserializationError::IncompleteInput;
+            char c = *p++;
+            if (c == '"') return DeserializationError::Ok;
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (p == end) return DeserializationError::IncompleteInput;
+            c = *p++;
+            switch (c) {
+                case '"': case '\\': case '/': out += c; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    uint32_t cp;
+                    if (!hex4(cp)) return p == end ? DeserializationError::IncompleteInput : DeserializationError::InvalidInput;
+                    if (cp >= 0xD800 && cp <= 0xDBFF) {
+                        high_surrogate = cp;
+                        continue;
+                    }
+                    if (cp >= 0xDC00 && cp <= 0xDFFF && high_surrogate != 0) {
+                        cp = 0x10000 + ((high_surrogate - 0xD800) << 10) + (cp - 0xDC00);
+                    }
+                    utf8(out, cp);
+                    break;
+                }
+                default: return DeserializationError::InvalidInput;
+            }
+            high_surrogate = 0;
+        }
+    }
+
+    DeserializationError object(JsonNode& out, int depth) {
+        if (depth > MAX_NESTING) return DeserializationError::TooDeep;
+        out.reset(JsonNode::Type::Object);
+        p++;
+        skipSpace();
+        if (p < end && *p == '}') { p++; return DeserializationError::Ok; }
+        while (true) {
+            skipSpace();
+            if (p == end) return DeserializationError::IncompleteInput;
+            if (*p != '"') return DeserializationError::InvalidInput;
+            std::string key;
+            DeserializationError err = string(key);
+            if (err) return err;
+            skipSpace();
+            if (p == end) return DeserializationError::IncompleteInput;
+            if (*p++ != ':') return DeserializationError::InvalidInput;
+            out.members.emplace_back(key, JsonNode());
+            err = value(out.members.back().second, depth);
+            if (err) return err;
+            skipSpace();
+            if (p == end) return DeserializationError::IncompleteInput;
+            char c = *p++;
+            if (c == '}') return DeserializationError::Ok;
+            if (c != ',') return DeserializationError::InvalidInput;
+        }
+    }
+
+    DeserializationError array(JsonNode& out, int depth) {
+        if (depth > MAX_NESTING) return DeserializationError::TooDeep;
+        out.reset(JsonNode::Type::Array);
+        p++;
+        skipSpace();
+        if (p < end && *p == ']') { p++; return DeserializationError::Ok; }
+        while (true) {
+            out.items.emplace_back();
+            DeserializationError err = value(out.items.back(), depth);
+            if (err) return err;
+            skipSpace();
+            if (p == end) return DeserializationError::IncompleteInput;
+            char c = *p++;
+            if (c == ']') return DeserializationError::Ok;
+            if (c != ',') return DeserializationError::InvalidInput;
+        }
+    }
+
+    const char* p;
+    const char* end;
+};
+
+// Keeps what the filter asks for: 'true' keeps a value whole, an object
+// keeps the listed members, an array applies its first element to every
+// element.
+inline bool applyFilter(JsonNode& node, const JsonNode& filter) {
+    if (filter.type == JsonNode::Type::Bool) return filter.b;
+    if (filter.type == JsonNode::Type::Object) {
+        if (node.type != JsonNode::Type::Object) return false;
+        for (auto it = node.members.begin(); it != node.members.end();) {
+            const JsonNode* sub = filter.member(it->first.c_str());
+            if (sub && applyFilter(it->second, *sub)) ++it;
+            else it = node.members.erase(it);
+        }
+        return true;
+    }
+    if (filter.type == JsonNode::Type::Array) {
+        if (node.type != JsonNode::Type::Array || filter.items.empty()) return false;
+        for (JsonNode& item : node.items) {
+            if (!applyFilter(item, filter.items.front())) item.reset(JsonNode::Type::Null);
+        }
+        return true;
+    }
+    return false;
+}
+
+} // namespace json_shim
+
+inline DeserializationError deserializeJson(JsonDocument& doc, const char* input, size_t len) {
+    doc.clear();
+    json_shim::Parser parser(input, input + len);
+    DeserializationError err = parser.parse(doc.rootNode());
+    if (err) doc.clear();
+    return err;
+}
+inline DeserializationError deserializeJson(JsonDocument& doc, const char* input) {
+    return deserializeJson(doc, input, input ? strlen(input) : 0);
+}
+inline DeserializationError deserializeJson(JsonDocument& doc, const String& input) {
+    return deserializeJson(doc, input.c_str(), input.length());
+}
+inline DeserializationError deserializeJson(JsonDocument& doc, const String& input,
+                                            DeserializationOption::Filter filter) {
+    DeserializationError err = deserializeJson(doc, input);
+    if (!err && !json_shim::applyFilter(doc.rootNode(), *filter.node)) doc.clear();
+    return err;
+}
+inline DeserializationError deserializeJson(JsonDocument& doc, const char* input,
+                                            DeserializationOption::Filter filter) {
+    return deserializeJson(doc, String(input), filter);
+}
+
+// --- Serialization ---
+namespace json_shim {
+
+inline void writeString(std::string& out, const std::string& s) {
+    out += '"';
+    for (unsigned char c : s) {
+        switch (c) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    char buf[8];
+                    snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else {
+                    out += (char)c;
+                }
+        }
+    }
+    out += '"';
+}
+
+inline void write(std::string& out, const JsonNode& node) {
+    switch (node.type) {
+        case JsonNode::Type::Null:   out += "null"; break;
+        case JsonNode::Type::Bool:   out += node.b ? "true" : "false"; break;
+        case JsonNode::Type::Int:    out += std::to_string(node.i); break;
+        case JsonNode::Type::Float: {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "%.9g", node.f);
+            out += buf;
+            break;
+        }
+        case JsonNode::Type::String: writeString(out, node.s); break;
+        case JsonNode::Type::Array: {
+            out += '[';
+            bool first = true;
+            for (const JsonNode& item : node.items) {
+                if (!first) out += ',';
+                first = false;
+                write(out, item);
+            }
+            out += ']';
+            break;
+        }
+        case JsonNode::Type::Object: {
+            out += '{';
+            bool first = true;
+            for (const auto& m : node.members) {
+                if (!first) out += ',';
+                first = false;
+                writeString(out, m.first);
+                out += ':';
+                write(out, m.second);
+            }
+            out += '}';
+            break;
+        }
+    }
+}
+
+} // namespace json_shim
+
+inline size_t serializeJson(JsonVariantConst value, String& out) {
+    std::string text;
+    if (value.node()) json_shim::write(text, *value.node());
+    else text = "null";
+    out = String(text);
+    return text.size();
+}
+inline size_t serializeJson(const JsonDocument& doc, String& out) {
+    return serializeJson(JsonVariantConst(&doc.rootNode()), out);
+}
+inline size_t serializeJson(JsonVariantConst value, Print& out) {
+    String text;
+    serializeJson(value, text);
+    return out.write((const uint8_t*)text.c_str(), text.length());
+}
+inline size_t serializeJson(const JsonDocument& doc, Print& out) {
+    return serializeJson(JsonVariantConst(&doc.rootNode()), out);
+}
+
+#endif // EMILY_TESTS_ARDUINOJSON_SHIM_H
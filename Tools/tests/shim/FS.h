@@ -0,0 +1,44 @@
+#ifndef EMILY_TESTS_FS_SHIM_H
+#define EMILY_TESTS_FS_SHIM_H
+
+// --- fs::File shim ---
+// A File is a shared handle on a host file, copyable like the ESP32 one.
+
+#include "Arduino.h"
+#include <memory>
+
+#define FILE_READ   "r"
+#define FILE_WRITE  "w"
+#define FILE_APPEND "a"
+
+class File {
+public:
+    File() {}
+    explicit File(FILE* f) { if (f) handle.reset(f, fclose); }
+
+    explicit operator bool() const { return handle != nullptr; }
+    void close() { handle.reset(); }
+
+    size_t read(uint8_t* buf, size_t size) { return handle ? fread(buf, 1, size, handle.get()) : 0; }
+    int read() {
+        uint8_t c;
+        return read(&c, 1) == 1 ? c : -1;
+    }
+    size_t write(const uint8_t* buf, size_t size) { return handle ? fwrite(buf, 1, size, handle.get()) : 0; }
+    bool seek(uint32_t pos) { return handle && fseek(handle.get(), pos, SEEK_SET) == 0; }
+    size_t position() const { return handle ? (size_t)ftell(handle.get()) : 0; }
+    size_t size() const {
+        if (!handle) return 0;
+        long here = ftell(handle.get());
+        fseek(handle.get(), 0, SEEK_END);
+        long end = ftell(handle.get());
+        fseek(handle.get(), here, SEEK_SET);
+        return (size_t)end;
+    }
+    int available() const { return (int)(size() - position()); }
+
+private:
+    std::shared_ptr<FILE> handle;
+};
+
+#endif // EMILY_TESTS_FS_SHIM_H
@@ -0,0 +1,24 @@
+#ifndef EMILY_TESTS_SD_SHIM_H
+#define EMILY_TESTS_SD_SHIM_H
+
+// --- SD card shim ---
+// Paths are host paths; tests pass absolute ones.
+
+#include "FS.h"
+
+class SDClass {
+public:
+    File open(const char* path, const char* mode = FILE_READ) {
+        std::string host_mode = std::string(mode) + "b";
+        return File(fopen(path, host_mode.c_str()));
+    }
+    bool exists(const char* path) {
+        FILE* f = fopen(path, "rb");
+        if (f) fclose(f);
+        return f != nullptr;
+    }
+};
+
+inline SDClass SD;
+
+#endif // EMILY_TESTS_SD_SHIM_H
@@ -0,0 +1,30 @@
+#include "Arduino.h"
+#include <chrono>
+#include <thread>
+
+HostSerial Serial;
+
+static bool serialQuiet() {
+    static const bool quiet = getenv("EMILY_TESTS_QUIET") != nullptr;
+    return quiet;
+}
+
+size_t HostSerial::write(uint8_t c) {
+    if (!serialQuiet()) fputc(c, stdout);
+    return 1;
+}
+
+size_t HostSerial::write(const uint8_t* buffer, size_t size) {
+    if (!serialQuiet()) fwrite(buffer, 1, size, stdout);
+    return size;
+}
+
+unsigned long millis() {
+    static const auto start = std::chrono::steady_clock::now();
+    return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+void delay(unsigned long ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
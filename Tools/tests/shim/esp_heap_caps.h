@@ -0,0 +1,16 @@
+#ifndef EMILY_TESTS_ESP_HEAP_CAPS_SHIM_H
+#define EMILY_TESTS_ESP_HEAP_CAPS_SHIM_H
+
+// --- ESP-IDF heap capabilities shim ---
+// One heap on the host: every capability is plain malloc().
+
+#include <stdlib.h>
+
+#define MALLOC_CAP_8BIT     (1 << 2)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_SPIRAM   (1 << 10)
+
+inline void* heap_caps_malloc(size_t size, unsigned caps) { (void)caps; return malloc(size); }
+inline void heap_caps_free(void* ptr) { free(ptr); }
+
+#endif // EMILY_TESTS_ESP_HEAP_CAPS_SHIM_H
@@ -0,0 +1,61 @@
+// frameEnergy() against the loop recordAudioToWav() used before it.
+#include "AudioDsp.h"
+#include "check.h"
+#include <random>
+#include <vector>
+
+// The original VAD formula: samples rebuilt from bytes, 64-bit sum,
+// integer mean.
+static int oldFrameEnergy(const uint8_t* record_buffer, size_t bytes_read) {
+    long long total_amplitude = 0;
+    for (size_t i = 0; i < bytes_read; i += 2) {
+        total_amplitude += abs((int16_t)(record_buffer[i] | (record_buffer[i + 1] << 8)));
+    }
+    return (bytes_read > 0) ? (int)(total_amplitude / (bytes_read / 2)) : 0;
+}
+
+// Checks 'count' samples at 'samples' (any alignment) against the old loop.
+static void checkFrame(const int16_t* samples, size_t count) {
+    int expected = oldFrameEnergy((const uint8_t*)samples, count * 2);
+    CHECK_EQ(frameEnergy(samples, count), expected);
+}
+
+int main() {
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<int> any_sample(-32768, 32767);
+
+    // --- Empty frame ---
+    int16_t dummy = 0;
+    CHECK_EQ(frameEnergy(&dummy, 0), 0);
+
+    // --- Random frames, every length around the unroll boundaries ---
+    // +1 sample from a 4-byte aligned base takes the unaligned path.
+    std::vector<int16_t> buffer(70000);
+    for (int16_t& s : buffer) s = (int16_t)any_sample(rng);
+    for (size_t count = 1; count <= 40; count++) {
+        checkFrame(buffer.data(), count);
+        checkFrame(buffer.data() + 1, count);
+    }
+    for (size_t count : {160u, 320u, 321u, 512u, 767u, 768u}) {
+        checkFrame(buffer.data(), count);
+        checkFrame(buffer.data() + 1, count);
+    }
+
+    // --- Extremes: abs(-32768) and the largest documented frame ---
+    std::vector<int16_t> loud(65536, -32768);
+    checkFrame(loud.data(), loud.size());
+    CHECK_EQ(frameEnergy(loud.data(), loud.size()), 32768);
+    std::fill(loud.begin(), loud.end(), 32767);
+    checkFrame(loud.data() + 1, loud.size() - 1);
+    for (size_t i = 0; i < loud.size(); i++) loud[i] = (i & 1) ? -32768 : 32767;
+    checkFrame(loud.data(), loud.size());
+
+    // --- Silence and a single click ---
+    std::vector<int16_t> quiet(320, 0);
+    CHECK_EQ(frameEnergy(quiet.data(), quiet.size()), 0);
+    quiet[317] = -3200;
+    checkFrame(quiet.data(), quiet.size());
+    CHECK_EQ(frameEnergy(quiet.data(), quiet.size()), 10);
+
+    return checkResult("test_audio_dsp");
+}
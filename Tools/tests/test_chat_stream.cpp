@@ -0,0 +1,214 @@
+// ChatStream replaying recorded-style SSE transcripts (data/chat_stream),
+// fed whole, byte by byte and split at every offset, plus the SseReader
+// and JsonStringWatcher pieces on their own.
+//
+// Each <name>.sse has a <name>.json next to it: the document toDocument()
+// must build from it, serialized compactly.
+#include "ChatStream.h"
+#include "check.h"
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static std::string readFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    std::stringstream text;
+    text << in.rdbuf();
+    return text.str();
+}
+
+struct Replay {
+    bool speech_taken = false;
+    std::string speech;
+    size_t speech_at = 0;       // Bytes fed when takeEarlySpeech() first succeeded
+    int speech_count = 0;       // Successful takeEarlySpeech() calls (must stay <= 1)
+    bool done = false;
+    std::string document;
+};
+
+// Feeds 'sse' in pieces ending at the offsets in 'cuts' (ascending, the
+// last one sse.size()), polling takeEarlySpeech() after each.
+static Replay replay(const std::string& sse, const std::vector<size_t>& cuts) {
+    Replay result;
+    ChatStream stream;
+    size_t fed = 0;
+    for (size_t cut : cuts) {
+        stream.feed(sse.data() + fed, cut - fed);
+        fed = cut;
+        String speech;
+        if (stream.takeEarlySpeech(speech)) {
+            result.speech_count++;
+            if (!result.speech_taken) {
+                result.speech_taken = true;
+                result.speech = speech.c_str();
+                result.speech_at = fed;
+            }
+        }
+    }
+    result.done = stream.done();
+    JsonDocument doc;
+    stream.toDocument(doc);
+    String text;
+    serializeJson(doc, text);
+    result.document = text.c_str();
+    return result;
+}
+
+struct Transcript {
+    const char* name;
+    const char* speech;         // Expected early speech, nullptr for none
+    const char* speech_before;  // The speech must be out before this text arrives
+    bool done;                  // [DONE] seen
+};
+
+static void checkTranscript(const Transcript& t) {
+    std::string base = std::string(CHAT_STREAM_DATA_DIR) + "/" + t.name;
+    std::string sse = readFile(base + ".sse");
+    std::string expected = readFile(base + ".json");
+    while (!expected.empty() && (expected.back() == '\n' || expected.back() == '\r')) expected.pop_back();
+    CHECK(!sse.empty());
+    CHECK(!expected.empty());
+
+    auto verify = [&](const Replay& r, const char* how) {
+        bool ok = r.done == t.done && r.document == expected && r.speech_count <= 1 &&
+                  r.speech_taken == (t.speech != nullptr) && (!t.speech || r.speech == t.speech);
+        if (!ok) {
+            printf("  %s (%s): done=%d speech=%d x%d '%s'\n    got      %s\n    expected %s\n", t.name, how,
+                   r.done, r.speech_taken, r.speech_count, r.speech.c_str(), r.document.c_str(), expected.c_str());
+        }
+        CHECK(ok);
+        return ok;
+    };
+
+    // In one piece
+    verify(replay(sse, {sse.size()}), "whole");
+
+    // Byte by byte: also shows when the speech became available
+    std::vector<size_t> bytes;
+    for (size_t i = 1; i <= sse.size(); i++) bytes.push_back(i);
+    Replay by_byte = replay(sse, bytes);
+    verify(by_byte, "byte by byte");
+    if (t.speech && t.speech_before) {
+        size_t marker = sse.find(t.speech_before);
+        CHECK(marker != std::string::npos);
+        if (by_byte.speech_at > marker) {
+            printf("  %s: speech only after %zu bytes, expected before %zu\n", t.name, by_byte.speech_at, marker);
+        }
+        CHECK(by_byte.speech_at <= marker);
+    }
+
+    // Split in two at every offset: cuts through lines, escapes and UTF-8
+    for (size_t cut = 1; cut < sse.size(); cut++) {
+        if (!verify(replay(sse, {cut, sse.size()}), "split")) {
+            printf("    at offset %zu\n", cut);
+            break;
+        }
+    }
+}
+
+// --- Transcripts ---
+static void checkTranscripts() {
+    // Arguments fragments split inside ü, after a backslash and between
+    // the halves of a surrogate pair; speech complete before "mood"
+    checkTranscript({"announce_message",
+                     "Grüße aus dem Labor, \"Emily\" sagt hallo \xF0\x9F\x98\x80\nBis gleich/ciao",
+                     "\\\"mood\\\"", true});
+    // Arguments first, then the name in two parts; CRLF and comments
+    checkTranscript({"name_after_arguments", "Welche Tür nimmst du?", "listen", true});
+    // Calls 0 and 2 interleaved, no 1; index 9 over the limit; a broken
+    // event in between. Nested and value-position "announcement" ignored.
+    checkTranscript({"index_gaps", "Das hier zuerst.", "finish_reason\": \"tool_calls", true});
+    // Content only: no speech, no tool_calls in the document
+    checkTranscript({"content_only", nullptr, nullptr, true});
+    // Cut off without [DONE]: speech was complete, the stream isn't
+    checkTranscript({"truncated", "Gleich geht es los.", nullptr, false});
+}
+
+// --- SseReader ---
+static void checkSseReader() {
+    SseReader reader;
+    std::vector<std::string> events;
+    auto collect = [&](const String& payload) { events.push_back(payload.c_str()); };
+    const char* text =
+        ": comment\n"
+        "event: message\n"
+        "data:no space\n\n"
+        "data: first\r\n"
+        "data: second\r\n\r\n"
+        "id: 7\n\n"                 // No data: no event
+        "data: tail";               // Not terminated yet
+    reader.feed(text, strlen(text), collect);
+    CHECK_EQ(events.size(), 2);
+    if (events.size() == 2) {
+        CHECK_STR(events[0].c_str(), "no space");
+        CHECK_STR(events[1].c_str(), "first\nsecond");
+    }
+    reader.feed("\n\n", 2, collect);
+    CHECK_EQ(events.size(), 3);
+    if (events.size() == 3) CHECK_STR(events[2].c_str(), "tail");
+
+    // An over-long line is dropped, the stream recovers on the next event
+    events.clear();
+    std::string huge = "data: " + std::string(SSE_LINE_MAX_BYTES + 10, 'x') + "\n\ndata: ok\n\n";
+    reader.feed(huge.data(), huge.size(), collect);
+    CHECK_EQ(events.size(), 1);
+    if (events.size() == 1) CHECK_STR(events[0].c_str(), "ok");
+
+    // reset() forgets a half-received event
+    events.clear();
+    reader.feed("data: stale", 11, collect);
+    reader.reset();
+    reader.feed("\n\ndata: fresh\n\n", 15, collect);
+    CHECK_EQ(events.size(), 1);
+    if (events.size() == 1) CHECK_STR(events[0].c_str(), "fresh");
+}
+
+// --- JsonStringWatcher ---
+static const char* const WATCH_KEYS[] = {"announcement", "question"};
+
+static std::string watch(const std::string& json, bool* complete = nullptr) {
+    JsonStringWatcher watcher;
+    watcher.begin(WATCH_KEYS, 2);
+    for (char c : json) watcher.feed(&c, 1);
+    if (complete) *complete = watcher.complete();
+    return watcher.value().c_str();
+}
+
+static void checkJsonStringWatcher() {
+    bool complete = false;
+    CHECK_STR(watch("{\"question\":\"Ja?\"}").c_str(), "Ja?");
+    CHECK_STR(watch(" { \"announcement\" : \"a\\\\b\\/c\\t\\\"d\\\"\" } ").c_str(), "a\\b/c\t\"d\"");
+    // First watched key wins, either one
+    CHECK_STR(watch("{\"question\":\"q\",\"announcement\":\"a\"}").c_str(), "q");
+    // \u escapes: 2- and 3-byte UTF-8, surrogate pair, lone low surrogate
+    CHECK_STR(watch("{\"question\":\"\\u00e9\\u20ac\\uD83D\\uDE00\\udc00!\"}").c_str(),
+              "\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80!");
+    // Raw UTF-8 passes through
+    CHECK_STR(watch("{\"question\":\"T\xC3\xBCr \xF0\x9F\x9A\xAA\"}").c_str(), "T\xC3\xBCr \xF0\x9F\x9A\xAA");
+
+    // Not ours: nested keys, the key as a value, non-string values
+    watch("{\"meta\":{\"question\":\"no\"},\"x\":[\"question\",\"no\"],\"note\":\"question\"}", &complete);
+    CHECK(!complete);
+    watch("{\"question\":42,\"announcement\":null}", &complete);
+    CHECK(!complete);
+    CHECK_STR(watch("{\"question\":[\"no\"],\"announcement\":\"yes\"}").c_str(), "yes");
+
+    // Complete at the closing quote, before the object is
+    JsonStringWatcher watcher;
+    watcher.begin(WATCH_KEYS, 2);
+    const char* partial = "{\"announcement\":\"Hallo\"";
+    CHECK(watcher.feed(partial, strlen(partial)));
+    CHECK_STR(watcher.value().c_str(), "Hallo");
+    // Later input is ignored, the value stays
+    CHECK(watcher.feed(", \"question\":\"x\"}", 17));
+    CHECK(watcher.complete());
+    CHECK_STR(watcher.value().c_str(), "Hallo");
+}
+
+int main() {
+    checkSseReader();
+    checkJsonStringWatcher();
+    checkTranscripts();
+    return checkResult("test_chat_stream");
+}
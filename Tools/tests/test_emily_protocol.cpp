@@ -0,0 +1,288 @@
+// EmilyProtocol frames (encode/decode round trips, rejected datagrams) and
+// the EmilyReliable Outbox and DuplicateFilter.
+#include "EmilyProtocol.h"
+#include "EmilyReliable.h"
+#include "check.h"
+#include <string>
+#include <vector>
+
+using namespace emily_proto;
+
+// --- Frames ---
+static void checkSetLedWithText() {
+    uint8_t buf[EMILY_PROTO_MAX_FRAME];
+    SetLed led;
+    led.r = 255;
+    led.g = 16;
+    led.b = 1;
+    led.effect = LED_PULSE;
+    led.speed_ms = 1500;
+    size_t len = encode(buf, sizeof(buf), 0x1234, led, "hello");
+    CHECK_EQ(len, sizeof(FrameHeader) + sizeof(SetLed) + 5);
+
+    // Wire layout: magic, version, type, flags, seq and length little-endian
+    const uint8_t expected_header[] = {EMILY_PROTO_MAGIC, EMILY_PROTO_VERSION, MSG_SET_LED, 0, 0x34, 0x12, 11, 0};
+    CHECK(memcmp(buf, expected_header, sizeof(expected_header)) == 0);
+    CHECK(isFrame(buf, len));
+
+    Frame frame;
+    CHECK(decode(buf, len, frame));
+    CHECK_EQ(frame.type, MSG_SET_LED);
+    CHECK_EQ(frame.seq, 0x1234);
+    CHECK_EQ(frame.flags, 0);
+    CHECK(!wantsAck(frame));
+
+    SetLed got = {};
+    Text text;
+    CHECK(read(frame, got, &text));
+    CHECK_EQ(got.r, 255);
+    CHECK_EQ(got.g, 16);
+    CHECK_EQ(got.b, 1);
+    CHECK_EQ(got.effect, LED_PULSE);
+    CHECK_EQ(got.speed_ms, 1500);
+    char out[32];
+    CHECK_EQ(text.copyTo(out, sizeof(out)), 5);
+    CHECK_STR(out, "hello");
+    CHECK_EQ(text.copyTo(out, 4), 3); // Truncated, still terminated
+    CHECK_STR(out, "hel");
+    CHECK_EQ(text.copyTo(out, 0), 0);
+
+    // Another payload type doesn't read it
+    Ping ping;
+    MoveHead move;
+    CHECK(!read(frame, ping));
+    CHECK(!read(frame, move));
+
+    uint8_t type;
+    uint16_t seq;
+    peekHeader(buf, type, seq);
+    CHECK_EQ(type, MSG_SET_LED);
+    CHECK_EQ(seq, 0x1234);
+}
+
+static void checkPing() {
+    uint8_t buf[64];
+    size_t len = encode(buf, sizeof(buf), 7, Ping());
+    CHECK_EQ(len, sizeof(FrameHeader)); // Empty payloads carry no bytes
+
+    Frame frame;
+    CHECK(decode(buf, len, frame));
+    CHECK_EQ(frame.type, MSG_PING);
+    CHECK_EQ(frame.payload_len, 0);
+    Ping ping;
+    Text text;
+    CHECK(read(frame, ping, &text));
+    CHECK_EQ(text.len, 0);
+    Heartbeat heartbeat;
+    CHECK(!read(frame, heartbeat));
+}
+
+static void checkOtherPayloads() {
+    uint8_t buf[128];
+    Heartbeat heartbeat = {NODE_CAMCANVAS, 0, -45, 30};
+    Frame frame;
+    CHECK(decode(buf, encode(buf, sizeof(buf), 1, heartbeat), frame));
+    Heartbeat got_heartbeat = {};
+    CHECK(read(frame, got_heartbeat));
+    CHECK_EQ(got_heartbeat.node, NODE_CAMCANVAS);
+    CHECK_EQ(got_heartbeat.pan, -45);
+    CHECK_EQ(got_heartbeat.tilt, 30);
+
+    GenerateImage image = {};
+    strncpy(image.model, "flux-dev", sizeof(image.model));
+    CHECK(decode(buf, encode(buf, sizeof(buf), 2, image, "a red fox"), frame));
+    GenerateImage got_image = {};
+    Text prompt;
+    CHECK(read(frame, got_image, &prompt));
+    CHECK_STR(got_image.model, "flux-dev");
+    CHECK_EQ(prompt.len, 9);
+    CHECK(memcmp(prompt.data, "a red fox", 9) == 0);
+
+    // Text with an explicit length may contain anything
+    InputReceived input;
+    CHECK(decode(buf, encode(buf, sizeof(buf), 3, input, "A\0B", 3), frame));
+    Text value;
+    CHECK(read(frame, input, &value));
+    CHECK_EQ(value.len, 3);
+    CHECK_EQ(value.data[2], 'B');
+}
+
+static void checkTruncation() {
+    // Text is cut to the buffer...
+    uint8_t small[20];
+    SetLed led = {};
+    size_t len = encode(small, sizeof(small), 1, led, "a long text that doesn't fit");
+    CHECK_EQ(len, sizeof(small));
+    Frame frame;
+    CHECK(decode(small, len, frame));
+    Text text;
+    CHECK(read(frame, led, &text));
+    CHECK_EQ(text.len, sizeof(small) - sizeof(FrameHeader) - sizeof(SetLed));
+
+    // ...and to EMILY_PROTO_MAX_FRAME however large the buffer is
+    std::vector<uint8_t> big(4096);
+    std::string prompt(3000, 'x');
+    len = encode(big.data(), big.size(), 1, led, prompt.c_str());
+    CHECK_EQ(len, EMILY_PROTO_MAX_FRAME);
+    CHECK(decode(big.data(), len, frame));
+
+    // No room for header and body: nothing is written
+    uint8_t tiny[sizeof(FrameHeader) + 2];
+    CHECK_EQ(encode(tiny, sizeof(tiny), 1, led), 0);
+}
+
+static void checkRejected() {
+    uint8_t buf[64];
+    size_t len = encode(buf, sizeof(buf), 9, MoveHead{10, -10});
+    Frame frame;
+    CHECK(decode(buf, len, frame));
+
+    CHECK(!decode(buf, len - 1, frame));                 // Length field says more
+    CHECK(!decode(buf, len + 1, frame));                 // Trailing garbage
+    CHECK(!decode(buf, sizeof(FrameHeader) - 1, frame)); // Shorter than a header
+    CHECK(!decode(buf, EMILY_PROTO_MAX_FRAME + 1, frame));
+
+    uint8_t bad[64];
+    memcpy(bad, buf, len);
+    bad[1] = EMILY_PROTO_VERSION + 1;
+    CHECK(!decode(bad, len, frame));
+    memcpy(bad, buf, len);
+    bad[0] = '{';
+    CHECK(!isFrame(bad, len));
+    CHECK(!decode(bad, len, frame));
+    CHECK(!isFrame(bad, 0));
+
+    // Right type, payload too short for the struct
+    memcpy(bad, buf, len);
+    bad[2] = MSG_SET_LED;
+    CHECK(decode(bad, len, frame));
+    SetLed led;
+    CHECK(!read(frame, led));
+}
+
+// --- Outbox ---
+struct Sent {
+    uint32_t addr;
+    uint16_t port;
+    uint32_t at;
+    std::vector<uint8_t> data;
+};
+
+static void checkOutboxRetryAndLoss() {
+    Outbox<2> outbox;
+    std::vector<Sent> sent;
+    std::vector<uint16_t> lost;
+    uint32_t now = 0;
+    auto send = [&](uint32_t addr, uint16_t port, const uint8_t* data, size_t len) {
+        sent.push_back({addr, port, now, std::vector<uint8_t>(data, data + len)});
+    };
+    auto on_lost = [&](uint32_t addr, uint16_t port, uint8_t type, uint16_t seq) {
+        CHECK_EQ(addr, 0x0A00000A);
+        CHECK_EQ(port, 12345);
+        CHECK_EQ(type, MSG_NOD_HEAD);
+        lost.push_back(seq);
+    };
+
+    uint8_t frame[64];
+    size_t len = encode(frame, sizeof(frame), 40, NodHead{15});
+    now = 1000;
+    CHECK(outbox.track(frame, len, 0x0A00000A, 12345, now));
+    Frame decoded;
+    CHECK(decode(frame, len, decoded));
+    CHECK(wantsAck(decoded)); // track() flags the caller's copy too
+    CHECK_EQ(outbox.pending(), 1);
+
+    // Retransmits after 200, 400, 800, 1600 ms, then every 2000 ms
+    const uint32_t expected_at[] = {1200, 1600, 2400, 4000, 6000, 8000, 10000};
+    for (now = 1000; now <= 20000; now += 50) outbox.service(now, send, on_lost);
+    CHECK_EQ(sent.size(), EMILY_RELIABLE_ATTEMPTS - 1);
+    for (size_t i = 0; i < sent.size() && i < 7; i++) {
+        CHECK_EQ(sent[i].at, expected_at[i]);
+        CHECK(sent[i].data == std::vector<uint8_t>(frame, frame + len));
+    }
+    CHECK_EQ(lost.size(), 1);
+    if (!lost.empty()) CHECK_EQ(lost[0], 40);
+    CHECK_EQ(outbox.pending(), 0);
+}
+
+static void checkOutboxAck() {
+    Outbox<2> outbox;
+    int sends = 0, losses = 0;
+    auto send = [&](uint32_t, uint16_t, const uint8_t*, size_t) { sends++; };
+    auto on_lost = [&](uint32_t, uint16_t, uint8_t, uint16_t) { losses++; };
+
+    uint8_t a[64], b[64], c[64];
+    size_t a_len = encode(a, sizeof(a), 1, TakePicture());
+    size_t b_len = encode(b, sizeof(b), 2, TakePicture());
+    size_t c_len = encode(c, sizeof(c), 3, TakePicture());
+    CHECK(outbox.track(a, a_len, 1, 100, 0));
+    CHECK(outbox.track(b, b_len, 2, 100, 0));
+    CHECK(!outbox.track(c, c_len, 1, 100, 0)); // Full
+    CHECK_EQ(outbox.pending(), 2);
+
+    CHECK(!outbox.acknowledge(2, 1));  // Right seq, wrong peer
+    CHECK(outbox.acknowledge(1, 1));
+    CHECK(!outbox.acknowledge(1, 1));  // Late duplicate ACK
+    CHECK_EQ(outbox.pending(), 1);
+
+    outbox.service(200, send, on_lost);
+    CHECK_EQ(sends, 1);                // Only the unacknowledged frame
+    CHECK(outbox.acknowledge(2, 2));
+    for (uint32_t now = 200; now < 20000; now += 100) outbox.service(now, send, on_lost);
+    CHECK_EQ(sends, 1);
+    CHECK_EQ(losses, 0);
+
+    // The freed slot is reusable; frames bigger than a slot are refused
+    CHECK(outbox.track(c, c_len, 1, 100, 0));
+    Outbox<1, 16> narrow;
+    uint8_t long_frame[64];
+    size_t long_len = encode(long_frame, sizeof(long_frame), 4, SetLed{}, "0123456789");
+    CHECK(!narrow.track(long_frame, long_len, 1, 100, 0));
+    outbox.clear();
+    CHECK_EQ(outbox.pending(), 0);
+}
+
+static void checkOutboxClockWrap() {
+    Outbox<1> outbox;
+    int sends = 0;
+    auto send = [&](uint32_t, uint16_t, const uint8_t*, size_t) { sends++; };
+    auto on_lost = [&](uint32_t, uint16_t, uint8_t, uint16_t) {};
+
+    uint8_t frame[64];
+    size_t len = encode(frame, sizeof(frame), 5, Ping());
+    uint32_t start = 0xFFFFFF00u; // millis() wraps 56 ms later
+    CHECK(outbox.track(frame, len, 1, 100, start));
+    outbox.service(start + 199, send, on_lost);
+    CHECK_EQ(sends, 0);
+    outbox.service(start + 200, send, on_lost);
+    CHECK_EQ(sends, 1);
+}
+
+// --- Duplicate filter ---
+static void checkDuplicateFilter() {
+    DuplicateFilter filter;
+    CHECK(!filter.seen(1, 100));
+    CHECK(filter.seen(1, 100));    // Retransmission
+    CHECK(!filter.seen(2, 100));   // Same seq from another node
+    CHECK(!filter.seen(1, 101));
+
+    // Only the last EMILY_RELIABLE_DEDUP_SLOTS frames are remembered
+    for (uint16_t seq = 200; seq < 200 + EMILY_RELIABLE_DEDUP_SLOTS - 3; seq++) CHECK(!filter.seen(1, seq));
+    CHECK(filter.seen(1, 100));
+    CHECK(!filter.seen(3, 1));     // Pushes (1, 100) out
+    CHECK(!filter.seen(1, 100));
+    CHECK(filter.seen(3, 1));
+}
+
+int main() {
+    checkSetLedWithText();
+    checkPing();
+    checkOtherPayloads();
+    checkTruncation();
+    checkRejected();
+    checkOutboxRetryAndLoss();
+    checkOutboxAck();
+    checkOutboxClockWrap();
+    checkDuplicateFilter();
+    return checkResult("test_emily_protocol");
+}
@@ -0,0 +1,204 @@
+// Chat history window (token budget, tool results at the window start) and
+// the summary cutover: which evicted lines a summary request folds in.
+#include "HistoryWindow.h"
+#include "check.h"
+#include <string>
+#include <vector>
+
+// A history file made of lines with the given sizes (newline included).
+struct History {
+    std::vector<uint32_t> offsets;  // Start of every line, as in the index
+    std::vector<bool> tool;         // Line is a "role":"tool" result
+    uint32_t size = 0;
+
+    void add(uint32_t bytes, bool is_tool = false) {
+        offsets.push_back(size);
+        tool.push_back(is_tool);
+        size += bytes;
+    }
+    uint32_t lineBytes(uint32_t line) const {
+        return (line + 1 < offsets.size() ? offsets[line + 1] : size) - offsets[line];
+    }
+};
+
+// The walk collectChatHistoryOffsets() does, with the index in RAM.
+static void selectWindow(const History& h, uint32_t budget, uint32_t max_lines, HistoryWindow& window) {
+    uint32_t count = h.offsets.size();
+    uint32_t oldest_allowed = count > max_lines ? count - max_lines : 0;
+    window.begin(count, oldest_allowed, h.size, budget);
+    while (window.wantsOlder()) {
+        if (!window.addOlder(h.offsets[window.start() - 1])) break;
+    }
+    while (!window.empty() && h.tool[window.start()]) window.dropOldest();
+}
+
+// Tokens of lines [first, count), counted independently of HistoryWindow.
+static uint32_t tokensFrom(const History& h, uint32_t first) {
+    uint32_t total = 0;
+    for (uint32_t line = first; line < h.offsets.size(); line++) total += estimateTokens(h.lineBytes(line));
+    return total;
+}
+
+static void checkWindowMatches(const History& h, const HistoryWindow& window) {
+    std::vector<uint32_t> offsets;
+    window.copyOffsets(offsets);
+    CHECK_EQ(offsets.size(), h.offsets.size() - window.start());
+    bool same = true;
+    for (size_t i = 0; i < offsets.size(); i++) same = same && offsets[i] == h.offsets[window.start() + i];
+    CHECK(same);
+    CHECK_EQ(window.tokens(), tokensFrom(h, window.start()));
+}
+
+// --- Token estimate and budget ---
+static void checkEstimate() {
+    CHECK_EQ(estimateTokens(0), CONTEXT_MESSAGE_OVERHEAD);
+    CHECK_EQ(estimateTokens(100), 100 / CONTEXT_BYTES_PER_TOKEN + CONTEXT_MESSAGE_OVERHEAD);
+    CHECK_EQ(historyTokenBudget(3000, 0), 3000);
+    CHECK_EQ(historyTokenBudget(3000, 400), 3000 - estimateTokens(400));
+    CHECK_EQ(historyTokenBudget(100, 4000), 0);
+}
+
+// --- Budget ---
+static void checkBudget() {
+    History h;
+    for (int i = 0; i < 10; i++) h.add(100);     // 29 tokens each
+    uint32_t line = estimateTokens(100);
+
+    HistoryWindow window;
+    selectWindow(h, 3 * line + line - 1, 120, window); // One token short of four lines
+    CHECK_EQ(window.start(), 7);
+    checkWindowMatches(h, window);
+
+    selectWindow(h, 4 * line, 120, window);          // Exactly four
+    CHECK_EQ(window.start(), 6);
+    checkWindowMatches(h, window);
+
+    selectWindow(h, 100000, 120, window);            // Everything
+    CHECK_EQ(window.start(), 0);
+    checkWindowMatches(h, window);
+
+    selectWindow(h, 100000, 3, window);              // Line cap
+    CHECK_EQ(window.start(), 7);
+    checkWindowMatches(h, window);
+
+    selectWindow(h, line - 1, 120, window);          // Not even the newest line
+    CHECK(window.empty());
+    CHECK_EQ(window.start(), 10);
+    CHECK_EQ(window.tokens(), 0);
+
+    History empty;
+    selectWindow(empty, 3000, 120, window);
+    CHECK(window.empty());
+    CHECK_EQ(window.start(), 0);
+
+    // A big line stops the walk; smaller older ones behind it are not taken
+    History mixed;
+    mixed.add(40);
+    mixed.add(40);
+    mixed.add(4000);
+    mixed.add(120);
+    selectWindow(mixed, 500, 120, window);
+    CHECK_EQ(window.start(), 3);
+    checkWindowMatches(mixed, window);
+}
+
+// --- Tool results at the window start ---
+// Dropped together with their tokens: the logged count stays right and
+// the tokens are free again.
+static void checkToolLines() {
+    History h;
+    h.add(300);         // 0 user
+    h.add(400);         // 1 assistant with tool_calls
+    h.add(200, true);   // 2 tool
+    h.add(200, true);   // 3 tool
+    h.add(300);         // 4 assistant
+    h.add(100);         // 5 user
+
+    // Budget ends between the assistant message and its tool results
+    uint32_t budget = tokensFrom(h, 2) + 10;
+    HistoryWindow window;
+    selectWindow(h, budget, 120, window);
+    CHECK_EQ(window.start(), 4);
+    checkWindowMatches(h, window);
+    CHECK_EQ(window.tokens(), tokensFrom(h, 4));
+    CHECK(!window.wantsOlder());
+
+    // Step by step: each drop gives exactly that line's tokens back
+    window.begin(6, 0, h.size, budget);
+    for (uint32_t line = 5; line >= 2; line--) CHECK(window.addOlder(h.offsets[line]));
+    CHECK(!window.addOlder(h.offsets[1]));
+    uint32_t before = window.tokens();
+    window.dropOldest();
+    CHECK_EQ(window.tokens(), before - estimateTokens(h.lineBytes(2)));
+    CHECK_EQ(window.oldestOffset(), h.offsets[3]);
+    window.dropOldest();
+    CHECK_EQ(window.tokens(), tokensFrom(h, 4));
+
+    // The whole window is tool results
+    History tools;
+    tools.add(100);
+    tools.add(100, true);
+    tools.add(100, true);
+    selectWindow(tools, 2 * estimateTokens(100), 120, window);
+    CHECK(window.empty());
+    CHECK_EQ(window.start(), 3);
+    CHECK_EQ(window.tokens(), 0);
+}
+
+// --- Summary cutover ---
+// The summary shrinks the history budget, so the window start moves on;
+// every evicted line is folded in exactly once and nothing the window
+// still replays is.
+static void checkSummaryCutover() {
+    const uint32_t BUDGET = 3000, MIN_LINES = 12, MAX_LINES = 32, CHUNK = 8192;
+
+    CHECK_EQ(summaryChunkLines(nullptr, 0, CHUNK), 0);
+    uint32_t even[] = {0, 200, 400, 600};
+    CHECK_EQ(summaryChunkLines(even, 3, CHUNK), 3);
+    CHECK_EQ(summaryChunkLines(even, 3, 400), 2);
+    CHECK_EQ(summaryChunkLines(even, 3, 399), 1);
+    uint32_t huge[] = {0, 20000, 20100};
+    CHECK_EQ(summaryChunkLines(huge, 2, CHUNK), 1); // Always at least one line
+
+    History h;
+    uint32_t covers = 0;
+    size_t summary_bytes = 0;
+    uint32_t requests = 0;
+    bool overlap = false;
+    uint32_t last_start = 0;
+    for (int turn = 0; turn < 400; turn++) {
+        h.add(150 + (turn * 37) % 500);
+        HistoryWindow window;
+        selectWindow(h, historyTokenBudget(BUDGET, summary_bytes), 120, window);
+        checkWindowMatches(h, window);
+        CHECK(window.tokens() + (summary_bytes ? estimateTokens(summary_bytes) : 0) <= BUDGET);
+        last_start = window.start();
+
+        // maybeSummarizeHistory(), answered right away
+        if (window.start() >= covers + MIN_LINES) {
+            uint32_t count = window.start() - covers;
+            if (count > MAX_LINES) count = MAX_LINES;
+            std::vector<uint32_t> offsets(h.offsets.begin() + covers, h.offsets.begin() + covers + count);
+            offsets.push_back(covers + count < h.offsets.size() ? h.offsets[covers + count] : h.size);
+            uint32_t lines = summaryChunkLines(offsets.data(), count, CHUNK);
+            CHECK(lines >= 1);
+            overlap = overlap || covers + lines > window.start();
+            covers += lines;
+            summary_bytes = 1200; // CONTEXT_SUMMARY_MAX_CHARS
+            requests++;
+        }
+    }
+    CHECK(!overlap);
+    CHECK(requests > 0);
+    // Folding keeps up: fewer than MIN_LINES evicted lines are left unsummarized
+    CHECK(covers <= last_start);
+    CHECK(last_start - covers < MIN_LINES);
+}
+
+int main() {
+    checkEstimate();
+    checkBudget();
+    checkToolLines();
+    checkSummaryCutover();
+    return checkResult("test_history_window");
+}
@@ -0,0 +1,149 @@
+// PacketQueue: slot accounting across the wrap, the full queue, truncation
+// and a producer/consumer run on two threads like AsyncUDP and loop().
+#include "PacketQueue.h"
+#include "check.h"
+#include <thread>
+#include <vector>
+
+static bool pushByte(PacketQueue& queue, uint8_t value, size_t len = 1) {
+    std::vector<uint8_t> data(len, value);
+    return queue.push(0x0A000001, 4000 + value, data.data(), data.size());
+}
+
+// --- Empty queue ---
+static void checkEmpty() {
+    PacketQueue unallocated;
+    CHECK(unallocated.front() == nullptr);
+    CHECK_EQ(unallocated.count(), 0);
+    CHECK(!pushByte(unallocated, 1));
+    unallocated.pop(); // No-op
+
+    PacketQueue queue;
+    CHECK(queue.begin(4));
+    CHECK(queue.front() == nullptr);
+    queue.pop();
+    CHECK_EQ(queue.count(), 0);
+    CHECK_EQ(queue.dropped(), 0);
+}
+
+// --- Full queue ---
+static void checkFull() {
+    PacketQueue queue;
+    CHECK(queue.begin(4));
+    for (uint8_t i = 0; i < 4; i++) CHECK(pushByte(queue, i));
+    CHECK_EQ(queue.count(), 4);
+    CHECK(!pushByte(queue, 9));
+    CHECK(!pushByte(queue, 9));
+    CHECK_EQ(queue.dropped(), 2);
+    CHECK_EQ(queue.count(), 4);
+
+    // The queued packets are untouched by the rejected ones
+    for (uint8_t i = 0; i < 4; i++) {
+        const UdpPacket* packet = queue.front();
+        CHECK(packet != nullptr);
+        if (packet == nullptr) return;
+        CHECK_EQ(packet->data[0], i);
+        CHECK_EQ(packet->port, 4000 + i);
+        CHECK_EQ(packet->addr, 0x0A000001);
+        queue.pop();
+    }
+    CHECK(queue.front() == nullptr);
+    CHECK(pushByte(queue, 5)); // Room again
+    CHECK_EQ(queue.dropped(), 2);
+
+    // begin() again with the same size rewinds but keeps the slots
+    CHECK(queue.begin(4));
+    CHECK_EQ(queue.count(), 0);
+}
+
+// --- Wrap-around ---
+// count() and FIFO order hold at every head/tail position.
+static void checkWrap() {
+    PacketQueue queue;
+    CHECK(queue.begin(3));
+    uint8_t next_push = 0, next_pop = 0;
+    for (int round = 0; round < 50; round++) {
+        int pushes = 1 + round % 3;
+        for (int i = 0; i < pushes; i++) {
+            if (pushByte(queue, next_push)) next_push++;
+        }
+        CHECK_EQ(queue.count(), (uint8_t)(next_push - next_pop));
+        CHECK(queue.count() <= 3);
+        int pops = 1 + (round * 7) % 3;
+        for (int i = 0; i < pops && queue.front() != nullptr; i++) {
+            CHECK_EQ(queue.front()->data[0], next_pop);
+            queue.pop();
+            next_pop++;
+        }
+        CHECK_EQ(queue.count(), (uint8_t)(next_push - next_pop));
+    }
+    CHECK(next_pop > 50); // The slots went round many times
+}
+
+// --- Truncation ---
+static void checkTruncation() {
+    PacketQueue queue;
+    CHECK(queue.begin(2));
+    CHECK(pushByte(queue, 'a', UDP_PACKET_MAX_BYTES + 100));
+    const UdpPacket* packet = queue.front();
+    CHECK(packet != nullptr);
+    if (packet == nullptr) return;
+    CHECK_EQ(packet->len, UDP_PACKET_MAX_BYTES);
+    CHECK_EQ(packet->data[UDP_PACKET_MAX_BYTES - 1], 'a');
+    CHECK_EQ(packet->data[UDP_PACKET_MAX_BYTES], 0);
+    queue.pop();
+
+    // Text is NUL-terminated in place, whatever the slot held before
+    const char* text = "{\"type\":\"ping\"}";
+    CHECK(queue.push(1, 2, (const uint8_t*)text, strlen(text)));
+    packet = queue.front();
+    CHECK(packet != nullptr);
+    if (packet == nullptr) return;
+    CHECK_EQ(packet->len, strlen(text));
+    CHECK_STR((const char*)packet->data, text);
+
+    CHECK(queue.push(1, 2, (const uint8_t*)text, 0));
+    queue.pop();
+    CHECK_EQ(queue.front()->len, 0);
+    CHECK_EQ(queue.front()->data[0], 0);
+}
+
+// --- Two threads ---
+// Every packet arrives once, in order, or is counted as dropped.
+static void checkThreads() {
+    const uint32_t TOTAL = 200000;
+    PacketQueue queue;
+    CHECK(queue.begin(8));
+    std::thread producer([&] {
+        for (uint32_t i = 0; i < TOTAL; i++) queue.push(i, 0, (const uint8_t*)&i, sizeof(i));
+    });
+    uint32_t received = 0, last = 0, out_of_order = 0;
+    bool first = true;
+    auto drain = [&] {
+        const UdpPacket* packet;
+        while ((packet = queue.front()) != nullptr) {
+            uint32_t value;
+            memcpy(&value, packet->data, sizeof(value));
+            if (value != packet->addr || packet->len != sizeof(value) || (!first && value <= last)) out_of_order++;
+            last = value;
+            first = false;
+            received++;
+            queue.pop();
+        }
+    };
+    while (received + queue.dropped() < TOTAL) drain();
+    producer.join();
+    drain();
+    CHECK_EQ(out_of_order, 0);
+    CHECK_EQ(received + queue.dropped(), TOTAL);
+    CHECK(received > 0);
+}
+
+int main() {
+    checkEmpty();
+    checkFull();
+    checkWrap();
+    checkTruncation();
+    checkThreads();
+    return checkResult("test_packet_queue");
+}
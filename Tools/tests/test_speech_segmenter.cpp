@@ -0,0 +1,138 @@
+// Speech segments: sentence ends, abbreviations, text without a final
+// punctuation mark and the maximum segment length.
+#include "SpeechSegmenter.h"
+#include "check.h"
+#include <string>
+#include <vector>
+
+// Splits 'text' the way EmilyBrain::takeSpeechSegment() walks it
+// (leading whitespace skipped, segments trimmed).
+static std::vector<std::string> split(const std::string& text) {
+    std::vector<std::string> segments;
+    size_t pos = 0;
+    while (true) {
+        while (pos < text.size() && isspace((unsigned char)text[pos])) pos++;
+        if (pos >= text.size()) break;
+        size_t end = speechSegmentEnd(text.c_str(), pos, text.size());
+        if (end <= pos) { segments.push_back("<stuck>"); break; }
+        std::string segment = text.substr(pos, end - pos);
+        while (!segment.empty() && isspace((unsigned char)segment.back())) segment.pop_back();
+        segments.push_back(segment);
+        pos = end;
+    }
+    return segments;
+}
+
+static std::string join(const std::vector<std::string>& segments) {
+    std::string all;
+    for (const std::string& segment : segments) all += "[" + segment + "]";
+    return all;
+}
+
+#define CHECK_SPLIT(text, expected) do { \
+        std::string got_ = join(split(text)); \
+        CHECK_STR(got_.c_str(), expected); \
+    } while (0)
+
+// --- Sentence ends ---
+static void checkSentences() {
+    CHECK_SPLIT("", "");
+    CHECK_SPLIT("Hi.", "[Hi.]");
+    // Short sentences ride along until the segment has TTS_SEGMENT_MIN_CHARS
+    CHECK_SPLIT("Hi there. How are you? I am fine, thanks for asking! And you?",
+                "[Hi there. How are you? I am fine, thanks for asking!][And you?]");
+    CHECK_SPLIT("This first sentence is long enough on its own. Second one.",
+                "[This first sentence is long enough on its own.][Second one.]");
+    // Closing quotes and repeated marks stay with their sentence
+    CHECK_SPLIT("She said \"this sentence is long enough to stand alone!\" Then left.",
+                "[She said \"this sentence is long enough to stand alone!\"][Then left.]");
+    CHECK_SPLIT("Are you really sure that you want to go there now?! Okay...",
+                "[Are you really sure that you want to go there now?!][Okay...]");
+    // Line breaks end a segment even without a space after them
+    CHECK_SPLIT("A list that is already long enough to split:\nfirst\nsecond",
+                "[A list that is already long enough to split:][first\nsecond]");
+    // A decimal point is not an end
+    CHECK_SPLIT("The temperature outside is about 3.5 degrees right now. Brr.",
+                "[The temperature outside is about 3.5 degrees right now.][Brr.]");
+}
+
+// --- Abbreviations ---
+// Each one sits past TTS_SEGMENT_MIN_CHARS, where a sentence end would cut.
+static void checkAbbreviations() {
+    CHECK_SPLIT("This morning I spoke about your cough with Dr. Smith at the clinic. He agreed.",
+                "[This morning I spoke about your cough with Dr. Smith at the clinic.][He agreed.]");
+    CHECK_SPLIT("Please say hello from all of us to dear old Mrs. Jones and to Mr. Brown. Thanks!",
+                "[Please say hello from all of us to dear old Mrs. Jones and to Mr. Brown.][Thanks!]");
+    CHECK_SPLIT("That long book about the ring was written by J. R. R. Tolkien. Read it.",
+                "[That long book about the ring was written by J. R. R. Tolkien.][Read it.]");
+    CHECK_SPLIT("Bring something warm to wear when you go outside, e.g. a coat. Bye.",
+                "[Bring something warm to wear when you go outside, e.g. a coat.][Bye.]");
+    CHECK_SPLIT("The big match in the stadium tonight is Ajax vs. Feyenoord. Fun!",
+                "[The big match in the stadium tonight is Ajax vs. Feyenoord.][Fun!]");
+    // "I" is a word, not an initial; longer words are sentence ends
+    CHECK_SPLIT("Everybody went home early, and so did I. Then it started to rain.",
+                "[Everybody went home early, and so did I.][Then it started to rain.]");
+    CHECK_SPLIT("We walked along the long road towards the old mill. Dr. Who waved.",
+                "[We walked along the long road towards the old mill.][Dr. Who waved.]");
+}
+
+// --- No final punctuation ---
+static void checkNoFinalPunctuation() {
+    CHECK_SPLIT("hello there", "[hello there]");
+    CHECK_SPLIT("This first sentence is long enough on its own. and then this",
+                "[This first sentence is long enough on its own.][and then this]");
+    CHECK_SPLIT("   leading spaces only   ", "[leading spaces only]");
+    // Ends in a mark without a space after it: the rest is one segment
+    CHECK_SPLIT("A sentence that is long enough to stand on its own.", "[A sentence that is long enough to stand on its own.]");
+}
+
+// --- Maximum segment length ---
+static void checkMaxLength() {
+    // No sentence end: cut after the last comma or space before the limit
+    std::string words;
+    while (words.size() < 1000) words += "word ";
+    std::vector<std::string> segments = split(words);
+    bool within = true;
+    std::string rejoined;
+    for (size_t i = 0; i < segments.size(); i++) {
+        const std::string& segment = segments[i];
+        within = within && segment.size() <= TTS_SEGMENT_MAX_CHARS;
+        if (i + 1 < segments.size()) within = within && segment.size() > TTS_SEGMENT_MAX_CHARS - 6; // Last full word
+        rejoined += segment + " ";
+        CHECK(segment.compare(0, 4, "word") == 0); // Never cut inside a word
+    }
+    CHECK(within);
+    CHECK_STR(rejoined.c_str(), words.c_str());
+
+    // The end of the text is allowed to run up to exactly the limit
+    std::string exact(TTS_SEGMENT_MAX_CHARS, 'x');
+    CHECK_EQ(speechSegmentEnd(exact.c_str(), 0, exact.size()), TTS_SEGMENT_MAX_CHARS);
+    std::string over = exact + "y";
+    CHECK_EQ(speechSegmentEnd(over.c_str(), 0, over.size()), TTS_SEGMENT_MAX_CHARS);
+
+    // A comma is preferred over a hard cut
+    std::string comma = std::string(100, 'a') + "," + std::string(250, 'b');
+    CHECK_EQ(speechSegmentEnd(comma.c_str(), 0, comma.size()), 101);
+
+    // No break at all: a hard cut that doesn't split a UTF-8 character
+    std::string accents;
+    while (accents.size() < 400) accents += "\xC3\xA9"; // "é"
+    size_t end = speechSegmentEnd(accents.c_str(), 0, accents.size());
+    CHECK(end <= TTS_SEGMENT_MAX_CHARS);
+    CHECK_EQ(end % 2, 0);
+    size_t odd = speechSegmentEnd(accents.c_str(), 1, accents.size()); // From a continuation byte
+    CHECK(odd > 1);
+    CHECK_EQ((unsigned char)accents[odd] & 0xC0, 0xC0);
+
+    // Counted from 'from', not from the start of the text
+    std::string tail = std::string(500, 'z') + " " + words;
+    CHECK(speechSegmentEnd(tail.c_str(), 501, tail.size()) - 501 <= TTS_SEGMENT_MAX_CHARS);
+}
+
+int main() {
+    checkSentences();
+    checkAbbreviations();
+    checkNoFinalPunctuation();
+    checkMaxLength();
+    return checkResult("test_speech_segmenter");
+}
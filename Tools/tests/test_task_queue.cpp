@@ -0,0 +1,207 @@
+// TaskQueue: the type and lane tables, the full queue, the text storage
+// and the executor's pick rule (plan order per lane, 'after' only holding
+// up its own task).
+#include "TaskQueue.h"
+#include "check.h"
+#include <string>
+
+static uint8_t add(TaskQueue& queue, TaskType type, uint8_t after = 0) {
+    Task task(type);
+    task.after = after;
+    return queue.push_back(task);
+}
+
+// What _continue_task() does with instant tasks turned off: start
+// everything that may start now. Returns how many were started.
+static int startAll(TaskQueue& queue) {
+    int started = 0;
+    int next;
+    while ((next = queue.nextStartable()) >= 0) {
+        queue[next].status = TaskStatus::RUNNING;
+        started++;
+    }
+    return started;
+}
+
+// --- Names ---
+// The tables are indexed by TaskType; a shifted entry shows up here.
+static void checkNames() {
+    CHECK_STR(taskTypeName(TaskType::PB_EMOTION), "PB_EMOTION");
+    CHECK_STR(taskTypeName(TaskType::CB_SOUND), "CB_SOUND");
+    CHECK_STR(taskTypeName(TaskType::CB_SOUND_EMOTION), "CB_SOUND_EMOTION");
+    CHECK_STR(taskTypeName(TaskType::CB_SPEAK), "CB_SPEAK");
+    CHECK_STR(taskTypeName(TaskType::CAMCANVAS_MOVE_HEAD), "CAMCANVAS_MOVE_HEAD");
+    CHECK_STR(taskTypeName(TaskType::CAMCANVAS_SET_LED), "CAMCANVAS_SET_LED");
+    CHECK_STR(taskTypeName(TaskType::CAM_ANALYZE), "CAM_ANALYZE");
+    CHECK_STR(taskTypeName(TaskType::CAM_NOD), "CAM_NOD");
+    CHECK_STR(taskTypeName(TaskType::CAM_TAKE_PICTURE), "CAM_TAKE_PICTURE");
+    CHECK_STR(taskTypeName(TaskType::CANVAS_IMAGE_SYNC), "CANVAS_IMAGE_SYNC");
+    CHECK_STR(taskTypeName(TaskType::CANVAS_IMAGE_ASYNC), "CANVAS_IMAGE_ASYNC");
+    CHECK_STR(taskTypeName(TaskType::INPUTPAD_SET_MODE), "INPUTPAD_SET_MODE");
+    CHECK_STR(taskTypeName(TaskType::EB_GET_LOCAL_DATA), "EB_GET_LOCAL_DATA");
+    CHECK_STR(taskTypeName(TaskType::COUNT), "UNKNOWN");
+    CHECK_STR(taskTypeName((TaskType)200), "UNKNOWN");
+
+    CHECK_STR(taskLaneName(TaskLane::AUDIO), "audio");
+    CHECK_STR(taskLaneName(TaskLane::CAMCANVAS), "camcanvas");
+    CHECK_STR(taskLaneName(TaskLane::INPUTPAD), "inputpad");
+    CHECK_STR(taskLaneName(TaskLane::LOCAL), "local");
+    CHECK_STR(taskLaneName(TaskLane::COUNT), "unknown");
+}
+
+// --- Lanes ---
+static void checkLanes() {
+    CHECK(taskLane(TaskType::PB_EMOTION) == TaskLane::LOCAL);
+    CHECK(taskLane(TaskType::CB_SOUND) == TaskLane::AUDIO);
+    CHECK(taskLane(TaskType::CB_SOUND_EMOTION) == TaskLane::AUDIO);
+    CHECK(taskLane(TaskType::CB_SPEAK) == TaskLane::AUDIO);
+    CHECK(taskLane(TaskType::CAMCANVAS_MOVE_HEAD) == TaskLane::CAMCANVAS);
+    CHECK(taskLane(TaskType::CAMCANVAS_SET_LED) == TaskLane::CAMCANVAS);
+    CHECK(taskLane(TaskType::CAM_ANALYZE) == TaskLane::CAMCANVAS);
+    CHECK(taskLane(TaskType::CAM_NOD) == TaskLane::CAMCANVAS);
+    CHECK(taskLane(TaskType::CAM_TAKE_PICTURE) == TaskLane::CAMCANVAS);
+    CHECK(taskLane(TaskType::CANVAS_IMAGE_SYNC) == TaskLane::CAMCANVAS);
+    CHECK(taskLane(TaskType::CANVAS_IMAGE_ASYNC) == TaskLane::CAMCANVAS);
+    CHECK(taskLane(TaskType::INPUTPAD_SET_MODE) == TaskLane::INPUTPAD);
+    CHECK(taskLane(TaskType::EB_GET_LOCAL_DATA) == TaskLane::LOCAL);
+    CHECK(taskLane(TaskType::COUNT) == TaskLane::LOCAL); // Out of range
+    CHECK(taskLane((TaskType)200) == TaskLane::LOCAL);
+}
+
+// --- Text storage ---
+static void checkText() {
+    TaskQueue queue;
+    JsonDocument doc;
+    CHECK(!deserializeJson(doc, "{\"text\":\"Hello\",\"number\":3,\"empty\":\"\"}"));
+
+    const char* hello = queue.storeText(doc["text"]);
+    CHECK_STR(hello, "Hello");
+    CHECK(hello != doc["text"].as<const char*>()); // A copy, not the document's string
+    CHECK(queue.storeText(doc["number"]) == nullptr);
+    CHECK(queue.storeText(doc["missing"]) == nullptr);
+    CHECK_STR(queue.storeText(doc["empty"]), "");
+    queue.clear();
+
+    // Fill the storage exactly: four strings of a quarter each (NUL included)
+    std::string quarter(TASK_TEXT_BYTES / 4 - 1, 'q');
+    JsonDocument big;
+    big["text"] = quarter.c_str();
+    const char* stored[4];
+    for (int i = 0; i < 4; i++) {
+        stored[i] = queue.storeText(big["text"]);
+        CHECK(stored[i] != nullptr);
+    }
+    CHECK(queue.storeText(doc["empty"]) == nullptr); // Not even the NUL fits
+    CHECK(queue.storeText(doc["text"]) == nullptr);
+    // Earlier strings are untouched by the refused ones
+    bool intact = true;
+    for (int i = 0; i < 4; i++) intact = intact && stored[i] != nullptr && quarter == stored[i];
+    CHECK(intact);
+
+    // One byte short: the last string doesn't fit and takes nothing
+    queue.clear();
+    std::string almost(TASK_TEXT_BYTES - 3, 'a'); // Leaves 2 bytes free
+    big["text"] = almost.c_str();
+    CHECK(queue.storeText(big["text"]) != nullptr);
+    CHECK(queue.storeText(doc["text"]) == nullptr);
+    big["text"] = "x";
+    CHECK_STR(queue.storeText(big["text"]), "x"); // The 2 bytes are still there
+    CHECK(queue.storeText(doc["empty"]) == nullptr);
+
+    // clear() rewinds the storage
+    queue.clear();
+    CHECK_STR(queue.storeText(doc["text"]), "Hello");
+}
+
+// --- Full queue ---
+static void checkFull() {
+    TaskQueue queue;
+    for (uint8_t i = 1; i <= TASK_QUEUE_SLOTS; i++) CHECK_EQ(add(queue, TaskType::PB_EMOTION), i);
+    CHECK_EQ(add(queue, TaskType::CB_SPEAK), 0);
+    CHECK_EQ(queue.size(), TASK_QUEUE_SLOTS);
+    CHECK(queue[TASK_QUEUE_SLOTS - 1].type == TaskType::PB_EMOTION); // Not overwritten
+
+    queue.clear();
+    CHECK(queue.empty());
+    CHECK_EQ(add(queue, TaskType::CB_SPEAK), 1);
+}
+
+// --- Same-lane ordering ---
+static void checkLaneOrder() {
+    TaskQueue queue;
+    add(queue, TaskType::CB_SPEAK);             // 0 audio
+    add(queue, TaskType::CAMCANVAS_MOVE_HEAD);  // 1 camcanvas
+    add(queue, TaskType::CB_SOUND);             // 2 audio
+    add(queue, TaskType::CAM_ANALYZE);          // 3 camcanvas
+    add(queue, TaskType::INPUTPAD_SET_MODE);    // 4 inputpad
+
+    // One task per lane, the first of each in plan order
+    CHECK_EQ(startAll(queue), 3);
+    CHECK(queue[0].status == TaskStatus::RUNNING);
+    CHECK(queue[1].status == TaskStatus::RUNNING);
+    CHECK(queue[2].status == TaskStatus::PENDING);
+    CHECK(queue[3].status == TaskStatus::PENDING);
+    CHECK(queue[4].status == TaskStatus::RUNNING);
+    CHECK_EQ(queue.running(TaskLane::AUDIO), 0);
+    CHECK_EQ(queue.running(TaskLane::LOCAL), -1);
+
+    // Another lane finishing doesn't move this one
+    queue[1].status = TaskStatus::DONE;
+    CHECK_EQ(queue.nextStartable(), 3);
+    queue[3].status = TaskStatus::RUNNING;
+    CHECK_EQ(queue.nextStartable(), -1);
+
+    queue[0].status = TaskStatus::DONE;
+    CHECK_EQ(queue.nextStartable(), 2);
+    queue[2].status = TaskStatus::DONE;
+    queue[3].status = TaskStatus::DONE;
+    CHECK(!queue.allDone());
+    queue[4].status = TaskStatus::DONE;
+    CHECK(queue.allDone());
+    CHECK(!queue.anyRunning());
+    CHECK_EQ(queue.nextStartable(), -1);
+}
+
+// --- Task::after ---
+static void checkAfter() {
+    TaskQueue queue;
+    uint8_t image = add(queue, TaskType::CANVAS_IMAGE_SYNC);   // 0 camcanvas
+    add(queue, TaskType::CB_SOUND, image);                      // 1 audio, after the image
+    add(queue, TaskType::CB_SPEAK);                             // 2 audio
+    add(queue, TaskType::CB_SOUND);                             // 3 audio
+
+    // The sound waits, the rest of the audio lane doesn't
+    CHECK_EQ(startAll(queue), 2);
+    CHECK(queue[0].status == TaskStatus::RUNNING);
+    CHECK(queue[1].status == TaskStatus::PENDING);
+    CHECK(queue[2].status == TaskStatus::RUNNING);
+
+    // Its 'after' is done but its lane is busy: it still waits
+    queue[0].status = TaskStatus::DONE;
+    CHECK_EQ(queue.nextStartable(), -1);
+
+    // Once the lane is free it goes before the later task 3
+    queue[2].status = TaskStatus::DONE;
+    CHECK_EQ(queue.nextStartable(), 1);
+    queue[1].status = TaskStatus::DONE;
+    CHECK_EQ(queue.nextStartable(), 3);
+
+    // An 'after' that can never be met (nothing running, nothing startable)
+    TaskQueue stuck;
+    add(stuck, TaskType::CB_SPEAK, 2);
+    add(stuck, TaskType::CB_SOUND, 1);
+    add(stuck, TaskType::PB_EMOTION, 9); // Past the end
+    CHECK_EQ(stuck.nextStartable(), -1);
+    CHECK(!stuck.anyRunning());
+    CHECK(!stuck.allDone());
+}
+
+int main() {
+    checkNames();
+    checkLanes();
+    checkFull();
+    checkText();
+    checkLaneOrder();
+    checkAfter();
+    return checkResult("test_task_queue");
+}
@@ -0,0 +1,250 @@
+// WavReader over the sounds shipped in SD_Card_Template and over generated
+// files for the chunk walk and format conversion edge cases.
+#include "WavReader.h"
+#include "check.h"
+#include <filesystem>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+static void put16(std::vector<uint8_t>& v, uint16_t x) { v.push_back(x & 0xFF); v.push_back(x >> 8); }
+static void put32(std::vector<uint8_t>& v, uint32_t x) { put16(v, x & 0xFFFF); put16(v, x >> 16); }
+
+// --- Building test files ---
+struct Chunk {
+    std::string id;
+    std::vector<uint8_t> body;
+    bool size_override = false;
+    uint32_t size = 0;              // Written instead of body.size() if size_override
+};
+
+static Chunk fmtChunk(uint16_t tag, uint16_t channels, uint32_t rate, uint16_t bits, uint16_t sub_tag = 0) {
+    Chunk c{"fmt ", {}};
+    uint16_t block_align = channels * ((bits + 7) / 8);
+    put16(c.body, tag);
+    put16(c.body, channels);
+    put32(c.body, rate);
+    put32(c.body, rate * block_align);
+    put16(c.body, block_align);
+    put16(c.body, bits);
+    if (tag == 0xFFFE) {
+        put16(c.body, 22);          // cbSize
+        put16(c.body, bits);        // wValidBitsPerSample
+        put32(c.body, 0);           // dwChannelMask
+        put16(c.body, sub_tag);     // SubFormat GUID, first two bytes
+        for (int i = 0; i < 14; i++) c.body.push_back(0);
+    }
+    return c;
+}
+
+static Chunk rawChunk(const char* id, std::vector<uint8_t> body) { return Chunk{id, std::move(body)}; }
+
+static Chunk sizedChunk(const char* id, std::vector<uint8_t> body, uint32_t size) {
+    Chunk c{id, std::move(body), true, size};
+    return c;
+}
+
+static std::vector<uint8_t> samples16(std::initializer_list<int16_t> samples) {
+    std::vector<uint8_t> v;
+    for (int16_t s : samples) put16(v, (uint16_t)s);
+    return v;
+}
+
+static fs::path work_dir;
+
+static std::string writeWav(const char* name, const std::vector<Chunk>& chunks) {
+    std::vector<uint8_t> body;
+    for (const Chunk& c : chunks) {
+        body.insert(body.end(), c.id.begin(), c.id.end());
+        put32(body, c.size_override ? c.size : (uint32_t)c.body.size());
+        body.insert(body.end(), c.body.begin(), c.body.end());
+        if (c.body.size() & 1) body.push_back(0); // Pad byte
+    }
+    std::vector<uint8_t> file = {'R', 'I', 'F', 'F'};
+    put32(file, (uint32_t)body.size() + 4);
+    file.insert(file.end(), {'W', 'A', 'V', 'E'});
+    file.insert(file.end(), body.begin(), body.end());
+
+    std::string path = (work_dir / name).string();
+    FILE* f = fopen(path.c_str(), "wb");
+    fwrite(file.data(), 1, file.size(), f);
+    fclose(f);
+    return path;
+}
+
+static std::vector<int16_t> readAll(WavReader& reader, size_t step) {
+    std::vector<int16_t> out;
+    std::vector<int16_t> buf(step);
+    size_t n;
+    while ((n = reader.read(buf.data(), step)) > 0) out.insert(out.end(), buf.begin(), buf.begin() + n);
+    return out;
+}
+
+// Opens 'path' and checks the mono 16-bit samples it yields.
+static void checkSamples(const std::string& path, const std::vector<int16_t>& expected, size_t step = 256) {
+    WavReader reader;
+    CHECK(reader.open(path.c_str()));
+    CHECK_EQ(reader.frameCount(), expected.size());
+    std::vector<int16_t> got = readAll(reader, step);
+    CHECK_EQ(got.size(), expected.size());
+    if (got.size() == expected.size()) {
+        for (size_t i = 0; i < got.size(); i++) {
+            if (got[i] != expected[i]) {
+                printf("  %s: sample %zu is %d, expected %d\n", path.c_str(), i, got[i], expected[i]);
+                CHECK_EQ(got[i], expected[i]);
+                break;
+            }
+        }
+    }
+    reader.close();
+}
+
+static void checkRejected(const std::string& path) {
+    WavReader reader;
+    CHECK(!reader.open(path.c_str()));
+}
+
+// --- Shipped sounds ---
+// Reference: the 'data' chunk found by a walk independent of WavReader.
+static void checkShippedSounds() {
+    int count = 0;
+    for (const auto& entry : fs::recursive_directory_iterator(SOUNDS_DIR)) {
+        if (entry.path().extension() != ".wav") continue;
+        count++;
+        std::string path = entry.path().string();
+
+        FILE* f = fopen(path.c_str(), "rb");
+        std::vector<uint8_t> bytes(fs::file_size(entry.path()));
+        CHECK_EQ(fread(bytes.data(), 1, bytes.size(), f), bytes.size());
+        fclose(f);
+        std::vector<int16_t> expected;
+        for (size_t pos = 12; pos + 8 <= bytes.size();) {
+            uint32_t size = bytes[pos + 4] | (bytes[pos + 5] << 8) | (bytes[pos + 6] << 16) | ((uint32_t)bytes[pos + 7] << 24);
+            if (memcmp(&bytes[pos], "data", 4) == 0) {
+                for (size_t i = 0; i + 1 < size; i += 2) {
+                    expected.push_back((int16_t)(bytes[pos + 8 + i] | (bytes[pos + 9 + i] << 8)));
+                }
+                break;
+            }
+            pos += 8 + size + (size & 1);
+        }
+
+        WavReader reader;
+        CHECK(reader.open(path.c_str()));
+        CHECK_EQ(reader.format().channels, 1);
+        CHECK_EQ(reader.format().bitsPerSample, 16);
+        CHECK(reader.format().sampleRate == 22050 || reader.format().sampleRate == 24000);
+        reader.close();
+        checkSamples(path, expected, 1000); // Trailing LIST/id3 chunks must not be played
+    }
+    CHECK(count >= 20);
+}
+
+// --- Chunk walk ---
+static void checkChunkWalk() {
+    std::vector<int16_t> pcm = {1, -2, 300, -32768, 32767};
+    Chunk fmt = fmtChunk(1, 1, 16000, 16);
+
+    // Chunks before 'fmt ', and an odd-sized one with its pad byte before 'data'
+    checkSamples(writeWav("list_first.wav", {rawChunk("LIST", {1, 2, 3, 4}), fmt,
+                                             rawChunk("fact", {9, 9, 9}), rawChunk("data", samples16({1, -2, 300, -32768, 32767}))}),
+                 pcm);
+    // Trailing chunks after 'data'
+    checkSamples(writeWav("trailing.wav", {fmt, rawChunk("data", samples16({1, -2, 300, -32768, 32767})),
+                                           rawChunk("id3 ", {1, 2, 3})}),
+                 pcm);
+    // 'data' before 'fmt '
+    checkRejected(writeWav("data_first.wav", {rawChunk("data", samples16({1, 2})), fmt}));
+    // No 'data' at all, and an empty one
+    checkRejected(writeWav("no_data.wav", {fmt, rawChunk("LIST", {1, 2})}));
+    checkRejected(writeWav("empty_data.wav", {fmt, rawChunk("data", {})}));
+
+    // Corrupt sizes on skipped chunks: must be rejected, not loop or wrap.
+    // 0xFFFFFFF8 at offset 12 wraps the walk back to offset 12.
+    checkRejected(writeWav("list_wraps.wav", {sizedChunk("LIST", {0, 0}, 0xFFFFFFF8u), fmt,
+                                              rawChunk("data", samples16({1, 2}))}));
+    checkRejected(writeWav("list_huge.wav", {sizedChunk("LIST", {0, 0}, 0xFFFFFFFFu), fmt,
+                                             rawChunk("data", samples16({1, 2}))}));
+    checkRejected(writeWav("list_past_end.wav", {fmt, sizedChunk("LIST", {0, 0}, 1000),
+                                                 rawChunk("data", samples16({1, 2}))}));
+    Chunk huge_fmt = fmt;
+    huge_fmt.size_override = true;
+    huge_fmt.size = 0xFFFFFFF0u;
+    checkRejected(writeWav("fmt_huge.wav", {huge_fmt, rawChunk("data", samples16({1, 2}))}));
+
+    // Streamed files: 'data' size 0 or 0xFFFFFFFF plays to the end of the file
+    checkSamples(writeWav("data_zero.wav", {fmt, sizedChunk("data", samples16({1, -2, 300, -32768, 32767}), 0)}), pcm);
+    checkSamples(writeWav("data_open.wav", {fmt, sizedChunk("data", samples16({1, -2, 300, -32768, 32767}), 0xFFFFFFFFu)}), pcm);
+    // Truncated: 'data' claims more than the file holds
+    checkSamples(writeWav("truncated.wav", {fmt, sizedChunk("data", samples16({1, -2, 300, -32768, 32767}), 1000)}), pcm);
+    // Odd byte count: the half sample is dropped
+    checkSamples(writeWav("odd_data.wav", {fmt, rawChunk("data", {0x10, 0x00, 0x20})}), {16});
+    // Cut off inside the header
+    checkRejected(writeWav("header_only.wav", {}));
+    checkRejected(writeWav("fmt_short.wav", {rawChunk("fmt ", {1, 0, 1, 0})}));
+}
+
+// --- Sample formats ---
+static void checkFormats() {
+    // Stereo 16-bit: channels averaged; long enough to cross the 768-byte read buffer
+    std::vector<uint8_t> stereo;
+    std::vector<int16_t> stereo_expected;
+    for (int i = 0; i < 500; i++) {
+        int16_t left = (int16_t)(i * 61 - 15000), right = (int16_t)(i * -37 + 9000);
+        put16(stereo, (uint16_t)left);
+        put16(stereo, (uint16_t)right);
+        stereo_expected.push_back((int16_t)(((int32_t)left + right) / 2));
+    }
+    std::string stereo_path = writeWav("stereo.wav", {fmtChunk(1, 2, 44100, 16), rawChunk("data", stereo)});
+    checkSamples(stereo_path, stereo_expected, 7);
+    checkSamples(stereo_path, stereo_expected, 4096);
+    checkSamples(writeWav("stereo_extremes.wav", {fmtChunk(1, 2, 44100, 16),
+                                                  rawChunk("data", samples16({-32768, -32768, 32767, 32767, -32768, 32767}))}),
+                 {-32768, 32767, 0});
+
+    // 8-bit is unsigned
+    checkSamples(writeWav("u8.wav", {fmtChunk(1, 1, 8000, 8), rawChunk("data", {128, 255, 0, 129})}),
+                 {0, 32512, -32768, 256});
+    // 24-bit keeps the top 16 bits
+    checkSamples(writeWav("s24.wav", {fmtChunk(1, 1, 48000, 24), rawChunk("data", {0x00, 0x34, 0x12, 0xFF, 0xFF, 0xFF, 0xAB, 0x00, 0x80})}),
+                 {0x1234, -1, -32768});
+    // 32-bit integer
+    checkSamples(writeWav("s32.wav", {fmtChunk(1, 1, 48000, 32), rawChunk("data", {0xFF, 0xFF, 0x34, 0x12, 0, 0, 0, 0x80})}),
+                 {0x1234, -32768});
+
+    // 32-bit float, clipped to [-1, 1]
+    std::vector<uint8_t> floats;
+    for (float f : {0.5f, -1.0f, 2.0f, -3.0f, 0.0f}) {
+        uint32_t bits;
+        memcpy(&bits, &f, 4);
+        put32(floats, bits);
+    }
+    std::vector<int16_t> float_expected = {16383, -32767, 32767, -32767, 0};
+    checkSamples(writeWav("f32.wav", {fmtChunk(3, 1, 24000, 32), rawChunk("data", floats)}), float_expected);
+    checkRejected(writeWav("f16.wav", {fmtChunk(3, 1, 24000, 16), rawChunk("data", samples16({1, 2}))}));
+
+    // WAVE_FORMAT_EXTENSIBLE: the SubFormat decides
+    checkSamples(writeWav("ext_pcm.wav", {fmtChunk(0xFFFE, 1, 24000, 16, 1), rawChunk("data", samples16({5, -5}))}), {5, -5});
+    checkSamples(writeWav("ext_float.wav", {fmtChunk(0xFFFE, 1, 24000, 32, 3), rawChunk("data", floats)}), float_expected);
+
+    // Compressed formats are refused
+    checkRejected(writeWav("adpcm.wav", {fmtChunk(2, 1, 24000, 4), rawChunk("data", {1, 2, 3, 4})}));
+    checkRejected(writeWav("ext_mp3.wav", {fmtChunk(0xFFFE, 1, 24000, 16, 0x55), rawChunk("data", samples16({1, 2}))}));
+    // Nonsense format fields
+    checkRejected(writeWav("no_channels.wav", {fmtChunk(1, 0, 24000, 16), rawChunk("data", samples16({1, 2}))}));
+    checkRejected(writeWav("no_rate.wav", {fmtChunk(1, 1, 0, 16), rawChunk("data", samples16({1, 2}))}));
+}
+
+int main() {
+    work_dir = fs::temp_directory_path() / ("emily_wav_test_" + std::to_string(getpid()));
+    fs::create_directories(work_dir);
+
+    checkShippedSounds();
+    checkChunkWalk();
+    checkFormats();
+
+    fs::remove_all(work_dir);
+    return checkResult("test_wav_reader");
+}